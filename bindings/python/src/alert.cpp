@@ -175,6 +175,7 @@ namespace boost
 	POLY(block_downloading_alert)
 	POLY(storage_moved_alert)
 	POLY(storage_moved_failed_alert)
+	POLY(storage_move_progress_alert)
 	POLY(torrent_deleted_alert)
 	POLY(torrent_paused_alert)
 	POLY(torrent_checked_alert)
@@ -490,6 +491,12 @@ void bind_alert()
 #endif
         ;
 
+    class_<storage_move_progress_alert, bases<torrent_alert>, noncopyable>(
+        "storage_move_progress_alert", no_init)
+        .def_readonly("bytes_copied", &storage_move_progress_alert::bytes_copied)
+        .def_readonly("total_bytes", &storage_move_progress_alert::total_bytes)
+        ;
+
     class_<torrent_deleted_alert, bases<torrent_alert>, noncopyable>(
         "torrent_deleted_alert", no_init)
         .def_readonly("info_hash", &torrent_deleted_alert::info_hash)
@@ -132,6 +132,79 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
     }
 }
 
+/*
+r = a[0] * A[0] + a[1] * A[1] + ... + a[n-1] * A[n-1]
+where a[j] is the 32 byte scalar at a + 32 * j, encoded like the scalars
+of ge_double_scalarmult_vartime(). All the points share one chain of
+doublings (Straus' method).
+aslide is scratch space for 256 * n entries and Ai for 8 * n entries.
+*/
+
+void ge_multi_scalarmult_vartime(ge_p3 *r, const unsigned char *a, const ge_p3 *A, size_t n, signed char *aslide, ge_cached *Ai) {
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 A2;
+    ge_p2 p;
+    size_t j;
+    int i;
+    int k;
+
+    for (j = 0; j < n; ++j) {
+        ge_cached *c = Ai + 8 * j; /* A,3A,5A,7A,9A,11A,13A,15A */
+        slide(aslide + 256 * j, a + 32 * j);
+        ge_p3_to_cached(&c[0], &A[j]);
+        ge_p3_dbl(&t, &A[j]);
+        ge_p1p1_to_p3(&A2, &t);
+
+        for (k = 1; k < 8; ++k) {
+            ge_add(&t, &A2, &c[k - 1]);
+            ge_p1p1_to_p3(&u, &t);
+            ge_p3_to_cached(&c[k], &u);
+        }
+    }
+
+    for (i = 255; i >= 0; --i) {
+        for (j = 0; j < n; ++j) {
+            if (aslide[256 * j + i]) {
+                break;
+            }
+        }
+
+        if (j < n) {
+            break;
+        }
+    }
+
+    if (i < 0) {
+        ge_p3_0(r);
+        return;
+    }
+
+    ge_p2_0(&p);
+
+    for (; i >= 0; --i) {
+        ge_p2_dbl(&t, &p);
+
+        for (j = 0; j < n; ++j) {
+            const signed char s = aslide[256 * j + i];
+
+            if (s > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &Ai[8 * j + s / 2]);
+            } else if (s < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &Ai[8 * j + (-s) / 2]);
+            }
+        }
+
+        if (i > 0) {
+            ge_p1p1_to_p2(&p, &t);
+        } else {
+            ge_p1p1_to_p3(r, &t);
+        }
+    }
+}
+
 
 static const fe d = {
     -10913610, 13857413, -15372611, 6949391, 114729, -8787816, -6275908, -3247719, -18696448, -12055116
@@ -3,9 +3,13 @@
 
 #include "libtorrent/ed25519.hpp"
 #include "libtorrent/hasher512.hpp"
+#include "libtorrent/random.hpp"
 #include "ge.h"
 #include "sc.h"
 
+#include <cstring>
+#include <vector>
+
 namespace libtorrent
 {
 
@@ -81,4 +85,182 @@ int ed25519_verify(const unsigned char *signature, const unsigned char *message,
     return 1;
 }
 
+/*
+ * returns true if the 32 bytes at s are the canonical encoding of the
+ * point they decode to. ed25519_verify() compares the encoding of the
+ * point it computes with R, so a signature with a non-canonical R never
+ * verifies on its own, and it must not verify in a batch either.
+ */
+static bool canonical_point(const unsigned char *s) {
+    int i;
+    const bool sign = (s[31] & 0x80) != 0;
+    const unsigned char top = s[31] & 0x7f;
+
+    /* y >= p = 2^255 - 19 */
+    if (top == 0x7f) {
+        for (i = 30; i > 0; --i) {
+            if (s[i] != 0xff) break;
+        }
+        if (i == 0 && s[0] >= 0xed) return false;
+    }
+
+    /* x = 0 (i.e. y = 1 or y = p - 1) can't have the sign bit set */
+    if (sign) {
+        if (top == 0 && s[0] == 1) {
+            for (i = 1; i < 31; ++i) {
+                if (s[i] != 0) break;
+            }
+            if (i == 31) return false;
+        }
+        if (top == 0x7f && s[0] == 0xec) {
+            for (i = 1; i < 31; ++i) {
+                if (s[i] != 0xff) break;
+            }
+            if (i == 31) return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * the order of the prime order subgroup, L = 2^252 + 27742317777372353535851937790883648493
+ */
+static const unsigned char group_order[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+    0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+/*
+ * returns true if [L]P is the neutral element, i.e. P has no small order
+ * component. The batch equation multiplies every point by a random z_i, and
+ * small order components of different signatures may cancel out in the sum
+ * even though each of them makes its own signature fail ed25519_verify().
+ * For instance, two signatures under keys A + T, where T is the point of
+ * order 2, and with odd z_i * h_i.
+ */
+static bool in_prime_order_subgroup(const ge_p3 *p) {
+    static const unsigned char zero[32] = {0};
+    unsigned char check[32];
+    ge_p2 r;
+
+    ge_double_scalarmult_vartime(&r, group_order, p, zero);
+    ge_tobytes(check, &r);
+
+    /* the encoding of the neutral element, (0, 1) */
+    if (check[0] != 1) return false;
+    for (int i = 1; i < 32; ++i) {
+        if (check[i] != 0) return false;
+    }
+    return true;
+}
+
+/*
+ * verifies num signatures at once with the randomized batch equation
+ *
+ *   (sum z_i * s_i) * B = sum z_i * R_i + sum (z_i * h_i) * A_i
+ *
+ * where z_i are random 128 bit scalars. Signatures that are malformed, or
+ * whose R_i or A_i have a small order component, are left out of the batch
+ * and verified on their own. If the equation doesn't hold, at least one
+ * signature in the batch is invalid and all of them are verified one at a
+ * time
+ */
+static void verify_batch_impl(const unsigned char **signature, const unsigned char **message, const size_t *message_len, const unsigned char **public_key, size_t num, int *valid) {
+    /* the points are -R_i and -A_i, with scalars z_i and z_i * h_i */
+    std::vector<ge_p3> points(2 * num);
+    std::vector<unsigned char> scalars(2 * 32 * num);
+    std::vector<signed char> slides(2 * 256 * num);
+    std::vector<ge_cached> cached(2 * 8 * num);
+    /* the indices of the signatures in the batch */
+    std::vector<size_t> batch;
+    unsigned char zero[32] = {0};
+    unsigned char sum_s[32] = {0};
+    unsigned char z[32] = {0};
+    unsigned char checker[32];
+    ge_p3 sum;
+    ge_p3 sB;
+    ge_cached sB_cached;
+    ge_p1p1 t;
+    ge_p2 res;
+    size_t i;
+
+    batch.reserve(num);
+    for (i = 0; i < num; ++i) {
+        const unsigned char *sig = signature[i];
+        const size_t k = batch.size();
+
+        if ((sig[63] & 224)
+            || !canonical_point(sig)
+            || ge_frombytes_negate_vartime(&points[2 * k], sig) != 0
+            || ge_frombytes_negate_vartime(&points[2 * k + 1], public_key[i]) != 0
+            || !in_prime_order_subgroup(&points[2 * k])
+            || !in_prime_order_subgroup(&points[2 * k + 1])) {
+            valid[i] = ed25519_verify(sig, message[i], message_len[i], public_key[i]);
+            continue;
+        }
+
+        hasher512 hash;
+        hash.update({reinterpret_cast<char const*>(sig), 32});
+        hash.update({reinterpret_cast<char const*>(public_key[i]), 32});
+        hash.update({reinterpret_cast<char const*>(message[i]), message_len[i]});
+        sha512_hash h = hash.final();
+        sc_reduce(reinterpret_cast<unsigned char*>(h.data()));
+
+        /* z_i is never 0 */
+        aux::random_bytes({reinterpret_cast<char*>(z), 16});
+        z[0] |= 1;
+
+        std::memcpy(&scalars[2 * 32 * k], z, 32);
+        sc_muladd(&scalars[2 * 32 * k + 32], z
+            , reinterpret_cast<unsigned char*>(h.data()), zero);
+        sc_muladd(sum_s, z, sig + 32, sum_s);
+        batch.push_back(i);
+    }
+
+    if (batch.empty()) return;
+
+    ge_multi_scalarmult_vartime(&sum, scalars.data(), points.data(), 2 * batch.size()
+        , slides.data(), cached.data());
+    ge_scalarmult_base(&sB, sum_s);
+    ge_p3_to_cached(&sB_cached, &sB);
+    ge_add(&t, &sum, &sB_cached);
+    ge_p1p1_to_p2(&res, &t);
+    ge_tobytes(checker, &res);
+
+    /* the encoding of the neutral element, (0, 1) */
+    zero[0] = 1;
+    const bool batch_valid = consttime_equal(checker, zero) != 0;
+
+    for (size_t const b : batch) {
+        valid[b] = batch_valid ? 1
+            : ed25519_verify(signature[b], message[b], message_len[b], public_key[b]);
+    }
+}
+
+int ed25519_verify_batch(const unsigned char **signature, const unsigned char **message, const size_t *message_len, const unsigned char **public_key, size_t num, int *valid) {
+    /* bound the scratch space, and how much a single bad signature costs */
+    const size_t max_batch = 64;
+    size_t i;
+    int ret = 1;
+
+    for (i = 0; i < num; i += max_batch) {
+        const size_t n = num - i < max_batch ? num - i : max_batch;
+
+        if (n == 1) {
+            valid[i] = ed25519_verify(signature[i], message[i], message_len[i], public_key[i]);
+        } else {
+            verify_batch_impl(signature + i, message + i, message_len + i
+                , public_key + i, n, valid + i);
+        }
+
+        for (size_t k = i; k < i + n; ++k) {
+            if (!valid[k]) ret = 0;
+        }
+    }
+
+    return ret;
+}
+
 }
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/create_torrent.hpp"
 #include "libtorrent/aux_/max_path.hpp" // for TORRENT_MAX_PATH
 
+#include <chrono>
 #include <functional>
 #include <cstdio>
 #include <sstream>
@@ -151,6 +152,8 @@ OPTIONS:
               this means aligning large files and pad them in order
               for piece hashes to uniquely indentify a file without
               overlap
+-T threads    the number of threads to hash pieces on. Defaults
+              to one per CPU core
 )";
 }
 
@@ -171,6 +174,7 @@ int main(int argc_, char const* argv_[]) try
 	std::vector<lt::sha1_hash> similar;
 	int pad_file_limit = -1;
 	int piece_size = 0;
+	int num_threads = 0;
 	lt::create_flags_t flags = {};
 	std::string root_cert;
 
@@ -214,6 +218,7 @@ int main(int argc_, char const* argv_[]) try
 			case 'w': web_seeds.push_back(args[1]); break;
 			case 't': trackers.push_back(args[1]); break;
 			case 's': piece_size = atoi(args[1]); break;
+			case 'T': num_threads = atoi(args[1]); break;
 			case 'o': outfile = args[1]; break;
 			case 'C': creator_str = args[1]; break;
 			case 'c': comment_str = args[1]; break;
@@ -297,11 +302,20 @@ int main(int argc_, char const* argv_[]) try
 		t.add_similar_torrent(s);
 
 	auto const num = t.num_pieces();
+	auto const start = std::chrono::steady_clock::now();
 	lt::set_piece_hashes(t, branch_path(full_path)
 		, [num] (lt::piece_index_t const p) {
 			std::cerr << "\r" << p << "/" << num;
-		});
-
+		}, num_threads);
+
+	double const seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	std::cerr << "\nhashed " << t.files().total_size() << " bytes in "
+		<< seconds << " s";
+	// small torrents may hash faster than the clock resolution
+	if (seconds > 0.)
+		std::cerr << " (" << (double(t.files().total_size()) / seconds / 1000000.)
+			<< " MB/s)";
 	std::cerr << "\n";
 	t.set_creator(creator_str.c_str());
 	if (!comment_str.empty()) {
@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 from __future__ import print_function
 
+import argparse
 import sys
 import os
 import resource
@@ -65,6 +66,16 @@ default_cache = cache_sizes[-1]
 # into RAM
 test_duration = 200  # 700
 
+parser = argparse.ArgumentParser(description='libtorrent disk I/O benchmarks')
+parser.add_argument('--compare-disk-backends', action='store_true',
+                    help='first compare the preadv/pwritev disk threads against '
+                    'io_uring submission (settings_pack::disk_io_backend)')
+parser.add_argument('--compare-io-modes', action='store_true',
+                    help='first compare page cache pressure and throughput of '
+                    'buffered, no-cache and O_DIRECT disk I/O '
+                    '(settings_pack::io_buffer_mode_t)')
+args = parser.parse_args()
+
 
 # make sure the environment is properly set up
 try:
@@ -189,9 +200,11 @@ def build_commandline(config, port):
     if config['disable-disk']:
         disable_disk = '-0'
     return ('./stage_%s/client_test -k -N -H -M -B %d -l %d -S %d -T %d -c %d -C %d -s "%s" -p %d -E %d %s '
+            '--disk_io_backend=%d --disk_io_write_mode=%d --disk_io_read_mode=%d '
             '-f session_stats/alerts_log.txt %s') % (
                 config['build'], test_duration, num_peers, num_peers, num_peers, num_peers, config['cache-size'],
-                config['save-path'], port, config['hash-threads'], disable_disk, torrent_path)
+                config['save-path'], port, config['hash-threads'], disable_disk, config['disk-backend'],
+                config['io-mode'], config['io-mode'], torrent_path)
 
 
 def delete_files(files):
@@ -213,10 +226,11 @@ def delete_files(files):
 
 def build_test_config(fs=default_fs, num_peers=default_peers, cache_size=default_cache,
                       test='upload', build='aio', profile='', hash_threads=1, torrent='test.torrent',
-                      disable_disk=False):
+                      disable_disk=False, disk_backend=0, io_mode=0):
     config = {'test': test, 'save-path': os.path.join('./', fs), 'num-peers': num_peers,
               'cache-size': cache_size, 'build': build, 'profile': profile,
-              'hash-threads': hash_threads, 'torrent': torrent, 'disable-disk': disable_disk}
+              'hash-threads': hash_threads, 'torrent': torrent, 'disable-disk': disable_disk,
+              'disk-backend': disk_backend, 'io-mode': io_mode}
     return config
 
 
@@ -266,7 +280,13 @@ def build_target_folder(config):
     if config['disable-disk']:
         no_disk = '_no-disk'
 
-    return 'results_%s_%s_%d_%d_%s_%s_h%d%s' % (config['build'],
+    # settings_pack::disk_io_backend
+    backend = ['', '_io_uring'][config['disk-backend']]
+
+    # settings_pack::io_buffer_mode_t
+    io_mode = ['', '', '_no-os-cache', '_direct-io'][config['io-mode']]
+
+    return 'results_%s_%s_%d_%d_%s_%s_h%d%s%s%s' % (config['build'],
                                                 test,
                                                 config['num-peers'],
                                                 config['cache-size'],
@@ -274,7 +294,19 @@ def build_target_folder(config):
         config['save-path'])[1],
         io_scheduler,
         config['hash-threads'],
-        no_disk)
+        no_disk,
+        backend,
+        io_mode)
+
+
+def page_cache_size():
+    # returns the size of the OS page cache, in kiB
+    if 'linux' not in sys.platform:
+        return 0
+    for line in open('/proc/meminfo'):
+        if line.startswith('Cached:'):
+            return int(line.split()[1])
+    return 0
 
 
 def find_library(name):
@@ -356,6 +388,9 @@ def run_test(config):
     print('clearing disk cache')
     clear_caches()
     print('OK')
+    # track how much of the page cache the test pushes out other data with
+    cache_start = page_cache_size()
+    cache_peak = cache_start
     client_output = open('session_stats/client.output', 'w+')
     client_error = open('session_stats/client.error', 'w+')
     print('launching: %s' % cmdline)
@@ -393,6 +428,7 @@ def run_test(config):
             break
         print('\r%d / %d' % (i, test_duration), end=' ')
         sys.stdout.flush()
+        cache_peak = max(cache_peak, page_cache_size())
         i += 1
         if config['test'] != 'upload' and config['test'] != 'dual' and i >= test_duration:
             break
@@ -410,6 +446,11 @@ def run_test(config):
     tester.wait()
     tester_output.close()
     client_output.close()
+
+    f = open('session_stats/page_cache.txt', 'w+')
+    print('start: %d kiB\npeak: %d kiB\nend: %d kiB\npeak growth: %d kiB' % (
+        cache_start, cache_peak, page_cache_size(), cache_peak - cache_start), file=f)
+    f.close()
     terminate = False
     if tester.returncode != 0:
         print('tester returned %d' % tester.returncode)
@@ -489,6 +530,22 @@ def run_test(config):
         sys.exit(1)
 
 
+# compare page cache pressure and throughput of buffered, no-cache and
+# O_DIRECT disk I/O (settings_pack::io_buffer_mode_t). See page_cache.txt in
+# the results folders
+if args.compare_io_modes:
+    for io_mode in [0, 2, 3]:
+        for test in ['upload', 'download']:
+            config = build_test_config(build='aio', test=test, io_mode=io_mode)
+            run_test(config)
+
+# compare the preadv/pwritev disk threads against io_uring submission
+if args.compare_disk_backends:
+    for backend in [0, 1]:
+        for test in ['upload', 'download']:
+            config = build_test_config(build='aio', test=test, disk_backend=backend)
+            run_test(config)
+
 for h in range(0, 7):
     config = build_test_config(
         num_peers=30,
@@ -81,7 +81,7 @@ namespace libtorrent {
 	constexpr int user_alert_id = 10000;
 
 	// this constant represents "max_alert_index" + 1
-	constexpr int num_alert_types = 96;
+	constexpr int num_alert_types = 97;
 
 	enum alert_priority
 	{
@@ -2868,6 +2868,27 @@ TORRENT_VERSION_NAMESPACE_2
 		std::bitset<num_alert_types> dropped_alerts;
 	};
 
+	// this alert is posted about once a second while
+	// ``torrent_handle::move_storage`` copies files, because the new location
+	// is on a different filesystem than the old one. Moves where all files can
+	// be renamed don't post it.
+	struct TORRENT_EXPORT storage_move_progress_alert final : torrent_alert
+	{
+		// internal
+		storage_move_progress_alert(aux::stack_allocator& alloc
+			, torrent_handle const& h, std::int64_t copied, std::int64_t total);
+
+		TORRENT_DEFINE_ALERT(storage_move_progress_alert, 96)
+
+		static constexpr alert_category_t static_category = alert::storage_notification;
+		std::string message() const override;
+
+		// the number of bytes copied so far, and the total number of bytes of
+		// the files being copied
+		std::int64_t const bytes_copied;
+		std::int64_t const total_bytes;
+	};
+
 TORRENT_VERSION_NAMESPACE_2_END
 
 #undef TORRENT_DEFINE_ALERT_IMPL
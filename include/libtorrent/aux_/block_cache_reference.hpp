@@ -48,6 +48,10 @@ namespace libtorrent { namespace aux {
 		// cache (and the buffer is mutable)
 		constexpr static std::int32_t none = 0x7fffffff;
 
+		// cookies referring to blocks in the cache are non-negative. Negative
+		// cookies refer to views handed out by the storage itself (see
+		// storage_interface::read_view())
+
 		storage_index_t storage{0};
 		std::int32_t cookie = none;
 	};
@@ -40,8 +40,16 @@ namespace libtorrent { namespace aux {
 	// initialized by static initializers (in cpuid.cpp)
 	TORRENT_EXTRA_EXPORT extern bool const sse42_support;
 	TORRENT_EXTRA_EXPORT extern bool const mmx_support;
+	TORRENT_EXTRA_EXPORT extern bool const sse2_support;
+	TORRENT_EXTRA_EXPORT extern bool const avx2_support;
+	// AVX-512 foundation instructions
+	TORRENT_EXTRA_EXPORT extern bool const avx512_support;
+	// Intel SHA extensions, along with the SSSE3 and SSE4.1 instructions
+	// needed to use them
+	TORRENT_EXTRA_EXPORT extern bool const sha_ni_support;
 	TORRENT_EXTRA_EXPORT extern bool const arm_neon_support;
 	TORRENT_EXTRA_EXPORT extern bool const arm_crc32c_support;
+	TORRENT_EXTRA_EXPORT extern bool const arm_sha1_support;
 } }
 
 #endif // TORRENT_CPUID_HPP_INCLUDED
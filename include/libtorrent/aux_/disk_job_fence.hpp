@@ -35,9 +35,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/tailqueue.hpp"
+#include "libtorrent/units.hpp"
 
 #include <atomic>
 #include <mutex>
+#include <vector>
+#include <unordered_map>
 
 namespace libtorrent {
 
@@ -52,7 +55,9 @@ namespace aux {
 	// the fence, blocking all new jobs, until there are no longer
 	// any outstanding jobs on the torrent, then the fence is lowered
 	// and it can be performed, along with the backlog of jobs that
-	// accrued while the fence was up
+	// accrued while the fence was up.
+	// A fence may also be scoped to a range of pieces (a piece fence), in
+	// which case only jobs on those pieces are held back by it
 	struct TORRENT_EXPORT disk_job_fence
 	{
 		disk_job_fence() = default;
@@ -62,6 +67,7 @@ namespace aux {
 		{
 			TORRENT_ASSERT(int(m_outstanding_jobs) == 0);
 			TORRENT_ASSERT(m_blocked_jobs.size() == 0);
+			TORRENT_ASSERT(m_piece_fences.empty());
 		}
 #endif
 
@@ -75,6 +81,19 @@ namespace aux {
 		enum { fence_post_fence = 0, fence_post_flush = 1, fence_post_none = 2 };
 		int raise_fence(disk_io_job* fence_job, disk_io_job* flush_job
 			, counters& cnt);
+
+		// like raise_fence(), but the fence only covers the pieces in the range
+		// [first, last). The fence job waits for the outstanding jobs on those
+		// pieces, and only new jobs on those pieces are held back until it
+		// completes. Jobs on other pieces keep being issued. The flush job is
+		// only expected to flush the pieces in the range. If a storage-wide
+		// fence, or a piece fence overlapping this one, is up, the fence is
+		// queued behind it.
+		int raise_piece_fence(disk_io_job* fence_job, disk_io_job* flush_job
+			, counters& cnt, piece_index_t first, piece_index_t last);
+
+		// returns true if there's a storage-wide fence up. Piece fences don't
+		// count
 		bool has_fence() const;
 
 		// called whenever a job completes and is posted back to the
@@ -92,6 +111,54 @@ namespace aux {
 		int num_blocked() const;
 
 	private:
+
+		struct piece_fence
+		{
+			piece_fence(disk_io_job* fence, disk_io_job* flush
+				, piece_index_t const f, piece_index_t const l)
+				: fence_job(fence), flush_job(flush), first(f), last(l)
+			{}
+
+			disk_io_job* fence_job;
+			disk_io_job* flush_job;
+
+			// the range of pieces covered by this fence, [first, last)
+			piece_index_t first;
+			piece_index_t last;
+
+			enum state_t : std::uint8_t
+			{
+				// the fence is blocked behind another fence
+				queued,
+				// the fence is up, waiting for the outstanding jobs on its
+				// pieces to complete
+				active,
+				// the fence job has been issued
+				running
+			};
+			state_t state = queued;
+
+			// set while the flush job is issued but not complete
+			bool flush_outstanding = false;
+
+			// the number of jobs issued before the fence was raised that the
+			// fence job is still waiting for
+			int outstanding = 0;
+
+			// jobs on the covered pieces that were issued while the fence
+			// was up. Anything in here is accounted for in m_outstanding_jobs
+			tailqueue<disk_io_job> blocked;
+		};
+
+		// these are all called with m_mutex held
+		piece_fence* overlapping_fence(piece_index_t first, piece_index_t last);
+		piece_fence* queued_fence(disk_io_job const* j);
+		void start_job(disk_io_job* j);
+		void release_job(disk_io_job* j, tailqueue<disk_io_job>& jobs);
+		void activate_fence(piece_fence& f, tailqueue<disk_io_job>& jobs);
+		void post_fence(piece_fence& f, tailqueue<disk_io_job>& jobs);
+		void outstanding_job_complete(piece_fence& f, tailqueue<disk_io_job>& jobs);
+
 		// when > 0, this storage is blocked for new async
 		// operations until all outstanding jobs have completed.
 		// at that point, the m_blocked_jobs are issued
@@ -108,8 +175,15 @@ namespace aux {
 		// when the fence can be lowered
 		std::atomic<int> m_outstanding_jobs{0};
 
-		// must be held when accessing m_has_fence and
-		// m_blocked_jobs
+		// the piece fences on this storage, in the order they were raised
+		std::vector<piece_fence> m_piece_fences;
+
+		// the number of outstanding jobs operating on each piece, used to
+		// know how many jobs a new piece fence has to wait for
+		std::unordered_map<piece_index_t, int> m_piece_jobs;
+
+		// must be held when accessing m_has_fence, m_blocked_jobs,
+		// m_piece_fences and m_piece_jobs
 		mutable std::mutex m_mutex;
 	};
 
@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+#define TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "libtorrent/tailqueue.hpp"
+#include "libtorrent/time.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace libtorrent { namespace aux {
+
+	// the priority classes of disk jobs, most urgent first
+	enum class disk_job_class : std::uint8_t
+	{
+		// reads with the disk_interface::time_critical flag, e.g. for
+		// torrent_handle::read_piece()
+		time_critical,
+
+		// reads on behalf of peers
+		read,
+
+		// writes and flushes of the write cache
+		write,
+
+		// hashing pieces and checking files
+		hash,
+
+		// everything else, e.g. moving, renaming and releasing files
+		maintenance,
+
+		// reads warming the cache (disk_interface::prefetch). These are only
+		// picked when no other job is queued
+		idle,
+
+		num_classes
+	};
+
+	TORRENT_EXTRA_EXPORT disk_job_class job_class(disk_io_job const* j);
+
+	// the jobs waiting for a disk thread. Every job is given a deadline when
+	// it's queued, which is the current time plus a budget depending on its
+	// class, and the job with the earliest deadline is picked first.
+	// Time-critical reads have no budget, so they go ahead of everything that's
+	// not late yet. Jobs of other classes can't be starved, a write that has
+	// waited longer than its budget goes ahead of a read queued just now.
+	// Within a class, jobs are picked in the order they were queued. Idle jobs
+	// have no deadline, they wait until every other class is empty.
+	struct TORRENT_EXTRA_EXPORT disk_job_queue
+	{
+		void push_back(disk_io_job* j);
+
+		// the job is picked before the other queued jobs of its class
+		void push_front(disk_io_job* j);
+
+		void append(tailqueue<disk_io_job>& jobs);
+
+		disk_io_job* pop_front();
+
+		bool empty() const { return m_size == 0; }
+		int size() const { return m_size; }
+
+		template <typename Fun>
+		void for_each(Fun f)
+		{
+			for (auto& q : m_queues)
+				for (auto i = q.iterate(); i.get(); i.next())
+					f(i.get());
+		}
+
+	private:
+
+		std::array<tailqueue<disk_io_job>
+			, static_cast<std::size_t>(disk_job_class::num_classes)> m_queues;
+		int m_size = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,169 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_DISK_TRACE_HPP_INCLUDED
+#define TORRENT_DISK_TRACE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/time.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libtorrent {
+
+	struct disk_io_job;
+
+namespace aux {
+
+	// one entry in a disk trace. Every job is recorded when it's issued to the
+	// disk thread. The first time a storage appears in the trace, it's
+	// described by a record whose action is ``storage_record``.
+	struct disk_trace_record
+	{
+		// the value of ``action`` for a record describing a storage. For
+		// these records, ``piece`` is the piece length, ``offset`` the number
+		// of pieces and ``size`` the size of the last piece
+		static constexpr std::uint8_t storage_record = 0xff;
+
+		// set in ``flags`` for reads (and hash jobs) that were served from the
+		// cache without having to be queued for a disk thread
+		static constexpr std::uint8_t cache_hit = 1;
+
+		// set in ``flags`` for reads issued to warm the cache
+		static constexpr std::uint8_t prefetch = 2;
+
+		// microseconds since the trace was started
+		std::uint64_t time;
+		std::uint32_t storage;
+		std::int32_t piece;
+		std::int32_t offset;
+		std::uint32_t size;
+
+		// the job_action_t of the job, or storage_record
+		std::uint8_t action;
+		std::uint8_t flags;
+	};
+
+	// records are stored big-endian, after a header identifying the file
+	constexpr int disk_trace_record_size = 26;
+	constexpr int disk_trace_header_size = 8;
+
+	// writes a disk trace to a file. Records are added by the network thread,
+	// which is where disk jobs are issued. They are buffered, and written to
+	// the file by a thread of its own, so tracing never blocks the network
+	// thread on disk I/O
+	struct TORRENT_EXTRA_EXPORT disk_trace_writer
+	{
+		// truncates the file at ``path``. If it can't be opened, is_open()
+		// returns false and records are dropped
+		explicit disk_trace_writer(std::string const& path);
+
+		// writes the records still buffered before returning
+		~disk_trace_writer();
+		disk_trace_writer(disk_trace_writer const&) = delete;
+		disk_trace_writer& operator=(disk_trace_writer const&) = delete;
+
+		// false if the file couldn't be opened, or writing to it failed
+		bool is_open() const { return !m_failed; }
+		std::string const& path() const { return m_path; }
+
+		// records the job ``j``. Describes its storage first, if it hasn't
+		// been described yet
+		void record(disk_io_job const* j, bool cache_hit);
+		void record(disk_trace_record const& r);
+
+		// the storage index ``st`` was given to a new torrent. Its next job
+		// describes it again
+		void new_storage(std::uint32_t st);
+
+	private:
+
+		// hands the buffered records to the writer thread
+		void submit();
+		void write_thread_fun();
+
+		std::string m_path;
+		time_point m_start;
+
+		// the storages that have been described in the trace
+		std::vector<bool> m_described;
+
+		// the records not yet handed to the writer thread
+		std::vector<char> m_buffer;
+
+		// only used by the writer thread, once it's been started
+		std::FILE* m_file;
+
+		// set when the file can't be written to. Records are dropped from
+		// then on
+		std::atomic<bool> m_failed{false};
+
+		// buffers of records waiting to be written, in order
+		std::vector<std::vector<char>> m_queue;
+		bool m_abort = false;
+
+		// protects m_queue and m_abort
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::thread m_thread;
+	};
+
+	// reads back a trace written by disk_trace_writer
+	struct TORRENT_EXTRA_EXPORT disk_trace_reader
+	{
+		// is_open() returns false if the file can't be opened or isn't a disk
+		// trace
+		explicit disk_trace_reader(std::string const& path);
+		~disk_trace_reader();
+		disk_trace_reader(disk_trace_reader const&) = delete;
+		disk_trace_reader& operator=(disk_trace_reader const&) = delete;
+
+		bool is_open() const { return m_file != nullptr; }
+
+		// returns false at the end of the trace
+		bool next(disk_trace_record& r);
+
+	private:
+		std::FILE* m_file;
+	};
+}}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_FILE_MAPPING_HPP_INCLUDED
+#define TORRENT_FILE_MAPPING_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#if TORRENT_HAVE_MMAP
+
+#include "libtorrent/file.hpp" // for handle_type
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+
+#include <cstdint>
+
+namespace libtorrent { namespace aux {
+
+	// a shared, read-only memory mapping of (the first ``size`` bytes of) a
+	// file. The mapping stays valid for as long as this object is alive,
+	// regardless of whether the file it was created from is still open.
+	//
+	// Mappings are never written through. A store into a page that can't be
+	// allocated (disk full) or read back (I/O error) raises SIGBUS rather than
+	// failing a write call, so writes go through pwritev() instead.
+	//
+	// Accessing a mapping whose underlying file has been truncated by someone
+	// else raises SIGBUS. This is the main caveat of mapped storage.
+	struct TORRENT_EXTRA_EXPORT file_mapping
+	{
+		file_mapping(handle_type fd, std::int64_t size, error_code& ec);
+		~file_mapping();
+		file_mapping(file_mapping const&) = delete;
+		file_mapping& operator=(file_mapping const&) = delete;
+
+		char* data() const { return m_mapping; }
+		std::int64_t size() const { return m_size; }
+
+		// copy from the mapping, starting at ``offset``. Like pread(), reading
+		// past the end of the mapping results in a short read. Returns the
+		// number of bytes copied
+		int readv(std::int64_t offset, span<iovec_t const> bufs) const;
+
+		// touch every page in the range, to take any page faults on the calling
+		// thread rather than on whoever ends up reading the memory
+		void prefault(std::int64_t offset, int size) const;
+
+	private:
+
+		char* m_mapping = nullptr;
+		std::int64_t m_size;
+	};
+}}
+
+#endif // TORRENT_HAVE_MMAP
+
+#endif // TORRENT_FILE_MAPPING_HPP_INCLUDED
@@ -0,0 +1,134 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_IO_URING_HPP_INCLUDED
+#define TORRENT_IO_URING_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#if TORRENT_USE_IO_URING
+
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/export.hpp"
+
+#include <cstdint>
+#include <cstddef>
+
+struct iovec;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace libtorrent { namespace aux {
+
+	// a minimal io_uring instance, driven directly through the
+	// io_uring_setup(2) and io_uring_enter(2) system calls, to avoid a
+	// dependency on liburing. Operations are queued with the add_*()
+	// functions and handed to the kernel in a single io_uring_enter() call by
+	// submit(), which also waits for all of them to complete. This lets a
+	// disk thread issue every chunk of a vectored read or write (and the
+	// fdatasync() following it) with one system call and have the kernel run
+	// them concurrently. An io_uring_batch is not thread safe, every disk
+	// thread uses its own (see thread_io_uring()).
+	struct TORRENT_EXTRA_EXPORT io_uring_batch
+	{
+		explicit io_uring_batch(std::uint32_t entries);
+		~io_uring_batch();
+		io_uring_batch(io_uring_batch const&) = delete;
+		io_uring_batch& operator=(io_uring_batch const&) = delete;
+
+		// returns false if the ring could not be set up, typically because the
+		// running kernel does not support io_uring
+		bool valid() const { return m_ring_fd >= 0; }
+
+		// the number of operations that can be queued before submit() has to
+		// be called
+		int free_slots() const { return int(m_sq_entries - m_queued); }
+		int queued() const { return int(m_queued); }
+
+		// queue a vectored read or write of ``num_bufs`` buffers at ``offset``.
+		// When submit() returns, ``*result`` is set to the number of bytes
+		// transferred, or the negated errno on failure. The iovec array and the
+		// buffers it refers to must stay valid until submit() returns.
+		void add_readv(int fd, std::int64_t offset, ::iovec const* bufs
+			, int num_bufs, std::int64_t* result);
+		void add_writev(int fd, std::int64_t offset, ::iovec const* bufs
+			, int num_bufs, std::int64_t* result);
+
+		// queue an fdatasync() of ``fd``. It is not started until every
+		// operation queued before it has completed.
+		void add_fdatasync(int fd, std::int64_t* result);
+
+		// submits all queued operations and blocks until they have completed.
+		// Returns false and sets ``ec`` if the kernel rejected the submission,
+		// in which case none of the results are valid.
+		bool submit(error_code& ec);
+
+	private:
+
+		io_uring_sqe* next_sqe();
+
+		int m_ring_fd = -1;
+
+		// the submission and completion ring mappings. The submission queue
+		// entries themselves live in a separate mapping
+		void* m_sq_ring = nullptr;
+		std::size_t m_sq_ring_size = 0;
+		void* m_cq_ring = nullptr;
+		std::size_t m_cq_ring_size = 0;
+		io_uring_sqe* m_sqes = nullptr;
+		std::size_t m_sqes_size = 0;
+
+		// pointers into the ring mappings
+		std::uint32_t* m_sq_head = nullptr;
+		std::uint32_t* m_sq_tail = nullptr;
+		std::uint32_t* m_sq_array = nullptr;
+		std::uint32_t m_sq_mask = 0;
+		std::uint32_t m_sq_entries = 0;
+		std::uint32_t* m_cq_head = nullptr;
+		std::uint32_t* m_cq_tail = nullptr;
+		io_uring_cqe* m_cqes = nullptr;
+		std::uint32_t m_cq_mask = 0;
+
+		// the number of entries added since the last call to submit()
+		std::uint32_t m_queued = 0;
+	};
+
+	// returns the io_uring_batch owned by the calling thread, setting it up
+	// the first time it's requested. Returns nullptr if io_uring is not
+	// available, in which case the caller is expected to fall back to
+	// preadv()/pwritev()
+	TORRENT_EXTRA_EXPORT io_uring_batch* thread_io_uring();
+}}
+
+#endif // TORRENT_USE_IO_URING
+
+#endif // TORRENT_IO_URING_HPP_INCLUDED
@@ -92,6 +92,13 @@ namespace libtorrent {
 		std::uint64_t atime = 0;
 		std::uint64_t mtime = 0;
 		std::uint64_t ctime = 0;
+		// the sub-second part of mtime and ctime, in nanoseconds. Zero where
+		// the platform doesn't report it
+		std::uint32_t mtime_nsec = 0;
+		std::uint32_t ctime_nsec = 0;
+		// the inode number (or file index on windows), identifying the file
+		// on its filesystem
+		std::uint64_t inode = 0;
 		enum {
 #if defined TORRENT_WINDOWS
 			fifo = 0x1000, // named pipe (fifo)
@@ -133,6 +140,14 @@ namespace libtorrent {
 		, std::string const& new_path, error_code& ec);
 	TORRENT_EXTRA_EXPORT void copy_file(std::string const& f
 		, std::string const& newf, error_code& ec);
+
+	// like copy_file() above, but calls ``progress`` with the number of bytes
+	// copied since the previous call, as the copy makes progress. Where the
+	// filesystem supports it, the copy is made by cloning the file's extents
+	// or by copying in the kernel, rather than through user space
+	TORRENT_EXTRA_EXPORT void copy_file(std::string const& f
+		, std::string const& newf, error_code& ec
+		, std::function<void(std::int64_t)> const& progress);
 	TORRENT_EXTRA_EXPORT void move_file(std::string const& f
 		, std::string const& newf, error_code& ec);
 
@@ -0,0 +1,89 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_READ_STREAM_DETECTOR_HPP_INCLUDED
+#define TORRENT_READ_STREAM_DETECTOR_HPP_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+
+namespace libtorrent { namespace aux {
+
+	// keeps track of the most recent read requests against a storage to tell
+	// sequential streams (e.g. a peer downloading the torrent in order, or a
+	// client streaming it) apart from random access. Each stream is the
+	// position the next request is expected at. Reads that continue a stream
+	// get a read-ahead window that grows as the stream keeps going, reads
+	// that don't are not read ahead at all.
+	//
+	// The disk thread doesn't know which peer a request comes from, but peers
+	// reading the same storage sequentially at different positions end up as
+	// separate streams.
+	struct TORRENT_EXTRA_EXPORT read_stream_detector
+	{
+		// the maximum number of streams tracked per storage. When a request
+		// doesn't match any of them, it replaces the least recently used one
+		static constexpr int max_streams = 8;
+
+		// records a read request of ``size`` bytes at the absolute offset
+		// ``offset`` in the storage. Returns the number of blocks to read
+		// (starting at the requested one) if the request misses the cache,
+		// at most ``max_read_ahead``. ``sequential`` is set to whether the
+		// request continued a stream.
+		int on_read(std::int64_t offset, int size, int max_read_ahead
+			, bool& sequential);
+
+	private:
+
+		struct stream
+		{
+			// the offset the next request in this stream is expected at
+			std::int64_t next = -1;
+
+			// the value of m_clock when this stream was last used
+			std::uint32_t last_use = 0;
+
+			// the number of blocks to read ahead for this stream
+			std::uint16_t window = 0;
+		};
+
+		std::mutex m_mutex;
+		std::array<stream, max_streams> m_streams;
+		std::uint32_t m_clock = 0;
+	};
+}}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SHA1_MB_HPP_INCLUDED
+#define TORRENT_SHA1_MB_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/span.hpp"
+
+namespace libtorrent { namespace aux {
+
+	// a message to be hashed by sha1_mb(). It's the concatenation of
+	// ``bufs``, which lets pieces read as separate blocks be hashed without
+	// copying them
+	struct sha1_mb_message
+	{
+		span<span<char const> const> bufs;
+	};
+
+	// the number of messages the widest multi-buffer SHA-1 kernel supported
+	// by this CPU hashes in parallel. 1 means there is no SIMD kernel and
+	// messages are hashed one at a time with hasher
+	TORRENT_EXTRA_EXPORT int sha1_mb_lanes();
+
+	// hashes every message in ``msgs`` independently, and stores its digest
+	// at the same index in ``hashes``. The messages are interleaved across the
+	// lanes of a SIMD kernel, a lane picks up the next message as soon as it's
+	// done with the previous one. ``max_lanes`` limits the kernel width, 0
+	// means the widest one this CPU supports. Narrower kernels are used when
+	// there are fewer messages than lanes.
+	TORRENT_EXTRA_EXPORT void sha1_mb(span<sha1_mb_message const> msgs
+		, span<sha1_hash> hashes, int max_lanes = 0);
+}}
+
+#endif // TORRENT_SHA1_MB_HPP_INCLUDED
@@ -0,0 +1,170 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SLAB_ALLOCATOR_HPP_INCLUDED
+#define TORRENT_SLAB_ALLOCATOR_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/span.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace libtorrent { namespace aux {
+
+	// hands out fixed size, page aligned blocks carved out of large slabs,
+	// each of which is mapped separately. Compared to allocating every block
+	// with malloc, the heap doesn't fragment under the churn of the disk
+	// cache, and a slab's memory is returned to the operating system as soon
+	// as it has no blocks in use. Blocks are allocated from the slab at the
+	// lowest address that has room, which packs the blocks in use into as
+	// few slabs as possible and lets the others drain. The free blocks of the
+	// slabs that can't be unmapped can be given back with trim(). The free
+	// lists are kept outside of the blocks, so that free blocks are never
+	// touched.
+	//
+	// This is not thread safe. disk_buffer_pool calls it with its mutex held.
+	struct TORRENT_EXTRA_EXPORT slab_allocator
+	{
+		slab_allocator(int block_size, int blocks_per_slab);
+		~slab_allocator();
+		slab_allocator(slab_allocator const&) = delete;
+		slab_allocator& operator=(slab_allocator const&) = delete;
+
+		// returns nullptr if a new slab was needed but couldn't be mapped
+		char* allocate();
+		void free(char* buf);
+
+		// returns true if buf was returned by allocate() and hasn't been
+		// freed since
+		bool in_use(char const* buf) const;
+
+		// when enabled, slabs mapped from now on are backed by huge pages,
+		// where supported
+		void set_huge_pages(bool h) { m_huge_pages = h; }
+
+		// unmaps all slabs that have no blocks in use. By default, one empty
+		// slab is kept around to avoid mapping and unmapping a slab
+		// repeatedly when the number of blocks in use hovers around a slab
+		// boundary
+		void release_empty_slabs();
+
+		// a range of adjacent free blocks whose memory is being given back
+		struct trim_range
+		{
+			char* ptr;
+			std::size_t size;
+		};
+
+		// gives the memory of all free blocks back to the operating system.
+		// Slabs with blocks in use can't be unmapped, but the pages of their
+		// free blocks can be dropped until they're allocated again.
+		//
+		// This is done in three steps, so that the system calls don't need to
+		// be made with the lock protecting the allocator held. begin_trim()
+		// takes the free blocks that haven't been trimmed yet out of
+		// circulation and returns them, merged into ranges of adjacent blocks.
+		// drop_pages() gives their memory back, and end_trim() makes them
+		// available again. The slabs of blocks between begin_trim() and
+		// end_trim() are not unmapped. trim() does all three in one go.
+		std::vector<trim_range> begin_trim();
+		static void drop_pages(span<trim_range const> ranges);
+		void end_trim(span<trim_range const> ranges);
+		void trim();
+
+		// the number of blocks the mapped slabs have room for, whether in use
+		// or not
+		int num_reserved() const
+		{ return int(m_slabs.size()) * m_blocks_per_slab; }
+
+		// the number of free blocks whose memory hasn't been given back by
+		// trim()
+		int num_untrimmed() const { return m_num_untrimmed; }
+
+	private:
+
+		struct slab
+		{
+			// the indices of the free blocks. Blocks are allocated from the
+			// back, and freed blocks are pushed there too
+			std::vector<int> free_blocks;
+
+			// the number of blocks at the front of free_blocks whose memory
+			// has been given back by trim()
+			int num_trimmed = 0;
+
+			// the blocks from this index and up have never been handed out.
+			// These are not in free_blocks, since their memory hasn't been
+			// touched yet
+			int untouched = 0;
+
+			int num_in_use = 0;
+
+			// the number of free blocks taken out by begin_trim(), that
+			// haven't been handed back to end_trim() yet
+			int num_trimming = 0;
+
+			// one bit per block, set for blocks that are in use
+			std::vector<bool> used;
+		};
+
+		char* map_slab();
+		void unmap_slab(char* base);
+		void slab_emptied(std::map<char*, slab>::iterator i);
+		std::map<char*, slab>::iterator slab_of(char const* buf);
+
+		int const m_block_size;
+		int const m_blocks_per_slab;
+
+		// all slabs, indexed by their base address
+		std::map<char*, slab> m_slabs;
+
+		// the base addresses of the slabs that have blocks that can be
+		// allocated
+		std::set<char*> m_available;
+
+		// the number of slabs with no blocks in use
+		int m_num_empty = 0;
+
+		// the number of free blocks (across all slabs) that haven't been
+		// trimmed
+		int m_num_untrimmed = 0;
+
+		bool m_huge_pages = false;
+	};
+}}
+
+#endif
@@ -33,6 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_STORAGE_PIECE_SET_HPP_INCLUDE
 #define TORRENT_STORAGE_PIECE_SET_HPP_INCLUDE
 
+#include <mutex>
+#include <atomic>
+
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/intrusive/list.hpp>
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
@@ -50,6 +53,11 @@ namespace aux {
 	// a specific storage, are in the cache right now. It's
 	// used for quickly being able to evict all pieces for a
 	// specific torrent
+	//
+	// The pieces of a storage may live in different cache shards, each
+	// guarded by its own mutex, so adding and removing pieces is
+	// synchronized by piece_mutex(). Anyone iterating over
+	// cached_pieces() must hold it too.
 	struct TORRENT_EXPORT storage_piece_set
 	{
 		using list_t = boost::intrusive::list<cached_piece_entry, boost::intrusive::constant_time_size<false>>;
@@ -58,10 +66,19 @@ namespace aux {
 		int num_pieces() const { return m_num_pieces; }
 		list_t const& cached_pieces() const
 		{ return m_cached_pieces; }
+		std::mutex& piece_mutex() const { return m_piece_mutex; }
+
+		// the number of read cache (i.e. clean) blocks of this storage,
+		// across all cache shards. Dirty blocks can't be evicted and aren't
+		// counted against the storage's share of the cache
+		int num_cached_blocks() const { return m_num_cached_blocks; }
+		void add_cached_blocks(int const n) { m_num_cached_blocks += n; }
 	private:
 		// these are cached pieces belonging to this storage
 		list_t m_cached_pieces;
 		int m_num_pieces = 0;
+		std::atomic<int> m_num_cached_blocks{0};
+		mutable std::mutex m_piece_mutex;
 	};
 }}
 
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <cstdint>
 #include <string>
+#include <functional>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/fwd.hpp"
@@ -71,15 +72,23 @@ namespace aux {
 		, span<iovec_t const> bufs, piece_index_t piece, int offset
 		, storage_error& ec, fileop op);
 
+	// called with the number of bytes copied so far and the total number of
+	// bytes to copy
+	using move_progress_fun = std::function<void(std::int64_t, std::int64_t)>;
+
 	// moves the files in file_storage f from ``save_path`` to
 	// ``destination_save_path`` according to the rules defined by ``flags``.
+	// Files that can't be renamed, because the destination is on a different
+	// filesystem, are copied, up to ``copy_threads`` at a time. ``progress``
+	// (if set) is called as the copies make progress.
 	// returns the status code and the new save_path.
 	TORRENT_EXTRA_EXPORT std::pair<status_t, std::string>
 	move_storage(file_storage const& f
 		, std::string const& save_path
 		, std::string const& destination_save_path
 		, part_file* pf
-		, move_flags_t flags, storage_error& ec);
+		, move_flags_t flags, storage_error& ec
+		, int copy_threads, move_progress_fun const& progress);
 
 	// deletes the files on fs from save_path according to options. Options may
 	// opt to only delete the partfile
@@ -80,6 +80,14 @@ struct suggest_piece
 		return ret;
 	}
 
+	// the (at most) n highest priority pieces, highest priority first
+	void top_pieces(std::vector<piece_index_t>& p, int const n) const
+	{
+		int const num = std::min(n, int(m_priority_pieces.size()));
+		for (int i = int(m_priority_pieces.size()) - 1; i >= int(m_priority_pieces.size()) - num; --i)
+			p.push_back(m_priority_pieces[i]);
+	}
+
 	void add_piece(piece_index_t const index, int const availability
 		, int const max_queue_size)
 	{
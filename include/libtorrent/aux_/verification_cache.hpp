@@ -0,0 +1,140 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_VERIFICATION_CACHE_HPP_INCLUDED
+#define TORRENT_VERIFICATION_CACHE_HPP_INCLUDED
+
+#include <mutex>
+#include <string>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/units.hpp"
+
+namespace libtorrent {
+
+	class file_storage;
+
+namespace aux {
+
+	// the hashes of the pieces of a storage as they are on disk. When
+	// checking the files, pieces whose hash is known don't have to be read.
+	// The hashes are saved to a file next to the storage's files, along with
+	// the size, mtime, ctime and inode of every file. When loaded, the hashes
+	// of pieces overlapping a file whose identity has changed since are
+	// dropped.
+	//
+	// The hashes are of whatever the pieces contained, whether they passed
+	// the hash check or not, and they are trusted as long as the file
+	// identity matches. A change to a file that leaves all of it intact goes
+	// unnoticed, and then a stale hash can make a corrupt piece pass the
+	// check. That takes a filesystem with coarse timestamps and a write
+	// within the same tick as the save, or (on Windows, where ctime is the
+	// creation time) a tool restoring the mtime after modifying the file.
+	struct TORRENT_EXTRA_EXPORT verification_cache
+	{
+		// ``name`` is the filename of the cache file and ``part_file`` the one
+		// of the storage's part file, both in ``save_path``
+		verification_cache(std::string save_path, std::string name
+			, std::string part_file);
+
+		// loads the cache file, if there is one, and starts recording hashes
+		void enable(file_storage const& fs);
+
+		// stops recording hashes, forgets the ones recorded and removes the
+		// cache file
+		void disable();
+
+		bool enabled() const;
+
+		// returns true and sets ``h`` if the hash of ``piece``, as it is on
+		// disk, is known
+		bool get(piece_index_t piece, sha1_hash& h) const;
+
+		// records the hash of ``piece``. ``on_disk`` is true if the hash was
+		// computed from data read from disk. Hashes computed from blocks in
+		// the disk cache are not saved until save_all(), since the blocks may
+		// not have been written yet
+		void set(piece_index_t piece, sha1_hash const& h, bool on_disk);
+
+		// forgets the hash of ``piece``, e.g. because writing to it failed
+		void clear(piece_index_t piece);
+
+		// saves the hashes computed from data read from disk, if there are
+		// new ones and the last save was a while ago
+		void maybe_save(file_storage const& fs);
+
+		// to be called once all blocks of the storage have been written to
+		// disk. Saves all the recorded hashes
+		void save_all(file_storage const& fs, error_code& ec);
+
+		// the files were moved to ``save_path``. The cache file at the old
+		// location is removed, the next save goes to the new one
+		void set_save_path(std::string save_path);
+
+		int num_hashes() const;
+
+	private:
+
+		void save_impl(file_storage const& fs, error_code& ec);
+		void load(file_storage const& fs);
+
+		std::string m_save_path;
+		std::string const m_name;
+		std::string const m_part_file;
+
+		// one entry per piece, valid where m_have is set
+		aux::vector<sha1_hash, piece_index_t> m_hashes;
+		typed_bitfield<piece_index_t> m_have;
+
+		// the subset of m_have computed from data read from disk. These are
+		// the ones that are safe to save at any time
+		typed_bitfield<piece_index_t> m_on_disk;
+
+		time_point m_last_save = min_time();
+
+		bool m_enabled = false;
+
+		// set when m_on_disk has changed since the last save
+		bool m_dirty = false;
+
+		mutable std::mutex m_mutex;
+	};
+}}
+
+#endif
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <unordered_set>
 #include <array>
+#include <memory>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/intrusive/list.hpp>
@@ -126,12 +127,13 @@ namespace aux {
 			, dirty(0)
 			, pending(0)
 			, cache_hit(0)
+			, out_of_order(0)
 		{
 		}
 
 		char* buf = nullptr;
 
-		static constexpr int max_refcount = (1 << 29) - 1;
+		static constexpr int max_refcount = (1 << 28) - 1;
 
 		// the number of references to this buffer. These references
 		// might be in outstanding asynchronous requests or in peer
@@ -139,7 +141,7 @@ namespace aux {
 		// all references are gone and refcount reaches 0. The buf
 		// pointer in this struct doesn't count as a reference and
 		// is always the last to be cleared
-		std::uint32_t refcount:29;
+		std::uint32_t refcount:28;
 
 		// if this is true, this block needs to be written to
 		// disk before it's freed. Typically all blocks in a piece
@@ -160,6 +162,11 @@ namespace aux {
 		// not just recently used.
 		std::uint32_t cache_hit:1;
 
+		// this is set for blocks that were written ahead of the piece's hash
+		// cursor, i.e. arrived out of order. It's cleared once the block has
+		// been hashed
+		std::uint32_t out_of_order:1;
+
 #if TORRENT_USE_ASSERTS
 		// this many of the references are held by hashing operations
 		int hashing_count = 0;
@@ -340,10 +347,21 @@ namespace aux {
 #endif
 	};
 
-	struct TORRENT_EXTRA_EXPORT block_cache : disk_buffer_pool
+	struct TORRENT_EXTRA_EXPORT block_cache
 	{
+		// constructs a cache allocating blocks from its own buffer pool
 		block_cache(io_service& ios, std::function<void()> const& trigger_trim);
 
+		// constructs a cache allocating blocks from ``pool``, which is shared
+		// with other caches (i.e. this cache is one shard of a larger cache).
+		// ``num_shards`` is the number of caches sharing the pool, used to
+		// divide the ARC ghost lists and the volatile block limit among them.
+		// The pool's settings are expected to be set by its owner.
+		block_cache(disk_buffer_pool& pool, int num_shards);
+
+		block_cache(block_cache const&) = delete;
+		block_cache& operator=(block_cache const&) = delete;
+
 	private:
 
 		struct hash_value
@@ -481,6 +499,29 @@ namespace aux {
 
 		int pinned_blocks() const { return m_pinned_blocks; }
 		int read_cache_size() const { return m_read_cache_size; }
+		int write_cache_size() const { return m_write_cache_size; }
+		int num_lru_pieces(int const lru) const { return m_lru[lru].size(); }
+
+		// the buffer pool blocks are allocated from
+		disk_buffer_pool& buffer_pool() { return m_pool; }
+
+		char* allocate_buffer(char const* category)
+		{ return m_pool.allocate_buffer(category); }
+		char* allocate_buffer(bool& exceeded, std::shared_ptr<disk_observer> o
+			, char const* category)
+		{ return m_pool.allocate_buffer(exceeded, std::move(o), category); }
+		void free_buffer(char* buf) { m_pool.free_buffer(buf); }
+		void free_multiple_buffers(span<char*> bufvec)
+		{ m_pool.free_multiple_buffers(bufvec); }
+		int allocate_iovec(span<iovec_t> iov) { return m_pool.allocate_iovec(iov); }
+		void free_iovec(span<iovec_t const> iov) { m_pool.free_iovec(iov); }
+		int in_use() const { return m_pool.in_use(); }
+		int num_to_evict(int const num_needed = 0)
+		{ return m_pool.num_to_evict(num_needed); }
+#if TORRENT_USE_ASSERTS
+		bool is_disk_buffer(char* buffer) const
+		{ return m_pool.is_disk_buffer(buffer); }
+#endif
 
 	private:
 
@@ -492,6 +533,16 @@ namespace aux {
 
 		int drain_piece_bufs(cached_piece_entry& p, std::vector<char*>& buf);
 
+		// set when this cache owns its buffer pool, i.e. when it's not
+		// sharing it with other shards
+		std::unique_ptr<disk_buffer_pool> m_own_pool;
+
+		// the pool blocks are allocated from
+		disk_buffer_pool& m_pool;
+
+		// the number of caches sharing m_pool
+		int m_num_shards;
+
 		// block container
 		cache_t m_pieces;
 
@@ -526,6 +577,19 @@ namespace aux {
 		// evicted.
 		int m_max_volatile_blocks;
 
+		// the number of blocks past the hash cursor of a piece being
+		// downloaded that are kept in the cache once they've been written
+		// to disk, to be hashed without reading them back (see
+		// settings_pack::hash_reorder_window). At most a quarter of the
+		// cache is kept this way
+		int m_hash_reorder_window;
+
+		// the max share of the cache, in percent, the read cache blocks of a
+		// single storage may take up before they are evicted ahead of other
+		// storages' blocks. 0 means no limit (see
+		// settings_pack::max_torrent_cache_share)
+		int m_max_storage_share;
+
 		// the number of blocks (buffers) allocated by volatile pieces.
 		std::int32_t m_volatile_size;
 
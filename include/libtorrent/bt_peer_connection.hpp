@@ -236,6 +236,8 @@ namespace libtorrent {
 		void write_have(piece_index_t index) override;
 		void write_dont_have(piece_index_t index) override;
 		void write_piece(peer_request const& r, disk_buffer_holder buffer) override;
+		void write_piece_file(peer_request const& r, file_range range) override;
+		bool can_send_file() const override;
 		void write_keepalive() override;
 		void write_handshake();
 		void write_upload_only(bool enabled) override;
@@ -263,6 +265,11 @@ namespace libtorrent {
 
 	private:
 
+		// the parts of a piece message around its payload, shared by
+		// write_piece() and write_piece_file()
+		void write_piece_header(peer_request const& r);
+		void piece_written(peer_request const& r);
+
 		template <typename... Args>
 		void send_message(message_type const type
 			, counters::stats_counter_t const counter
@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <deque>
 #include <vector>
+#include <memory>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/buffer.hpp>
@@ -56,6 +57,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+	struct file;
+
 	// TODO: 2 this type should probably be renamed to send_buffer
 	struct TORRENT_EXTRA_EXPORT chained_buffer : private single_threaded
 	{
@@ -84,6 +87,7 @@ namespace libtorrent {
 				buf = rhs.buf;
 				size = rhs.size;
 				used_size = rhs.used_size;
+				file_offset = rhs.file_offset;
 				move_holder(&holder, &rhs.holder);
 			}
 			buffer_t& operator=(buffer_t&& rhs) & noexcept
@@ -94,6 +98,7 @@ namespace libtorrent {
 				buf = rhs.buf;
 				size = rhs.size;
 				used_size = rhs.used_size;
+				file_offset = rhs.file_offset;
 				move_holder(&holder, &rhs.holder);
 				return *this;
 			}
@@ -116,6 +121,10 @@ namespace libtorrent {
 			char* buf = nullptr; // the first byte of the buffer
 			int size = 0; // the total size of the buffer
 			int used_size = 0; // this is the number of bytes to send/receive
+
+			// for entries added by append_file(), buf is nullptr and this is
+			// the offset into the file of the next byte to send
+			std::int64_t file_offset = 0;
 		};
 
 	public:
@@ -146,6 +155,17 @@ namespace libtorrent {
 			init_buffer_entry<Holder>(b, std::move(buffer), used_size);
 		}
 
+		// appends ``size`` bytes of the file ``f``, starting at ``offset``.
+		// These bytes are not part of the iovecs built by build_iovec(), they
+		// are sent straight out of the file once they reach the front (see
+		// front_file())
+		void append_file(std::shared_ptr<file> f, std::int64_t offset, int size);
+
+		// if the next bytes to send are in a file, returns the file and sets
+		// ``offset`` and ``size`` to the range of it left to send. Otherwise
+		// returns nullptr
+		file const* front_file(std::int64_t& offset, int& size) const;
+
 		// returns the number of bytes available at the
 		// end of the last chained buffer.
 		int space_in_last_buffer();
@@ -160,6 +180,8 @@ namespace libtorrent {
 		// enough room, returns 0
 		char* allocate_appendix(int s);
 
+		// the iovecs end at the first file entry, if any, so they may cover
+		// fewer than ``to_send`` bytes
 		std::vector<boost::asio::const_buffer> const& build_iovec(int to_send);
 
 		void clear();
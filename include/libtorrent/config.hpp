@@ -194,6 +194,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_IFCONF 1
 #define TORRENT_HAS_SALEN 0
 #define TORRENT_USE_FDATASYNC 1
+#define TORRENT_USE_SENDFILE 1
+
+// io_uring_setup() and IORING_OP_{READV,WRITEV,FSYNC} first appeared in 5.1
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,1,0) && !defined __ANDROID__
+# define TORRENT_USE_IO_URING 1
+#endif
 
 // ===== ANDROID ===== (almost linux, sort of)
 #if defined __ANDROID__
@@ -471,6 +477,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_PREADV 0
 #endif
 
+#ifndef TORRENT_USE_IO_URING
+#define TORRENT_USE_IO_URING 0
+#endif
+
+#ifndef TORRENT_USE_SENDFILE
+#define TORRENT_USE_SENDFILE 0
+#endif
+
 // if pread() exists, we assume pwrite() does as well
 #ifndef TORRENT_USE_PREAD
 #define TORRENT_USE_PREAD 1
@@ -609,6 +623,15 @@ constexpr std::size_t TORRENT_WRITE_HANDLER_MAX_SIZE = 342;
 #endif
 #endif // TORRENT_HAS_ARM_CRC32
 
+// the ARMv8 SHA1 instructions are only used on aarch64, when the compiler
+// is told the CPU may have them (e.g. -march=armv8-a+crypto)
+#if TORRENT_HAS_ARM && defined __aarch64__ \
+	&& (defined __ARM_FEATURE_CRYPTO || defined __ARM_FEATURE_SHA2)
+#	define TORRENT_HAS_ARM_SHA1 1
+#else
+#	define TORRENT_HAS_ARM_SHA1 0
+#endif // TORRENT_HAS_ARM_SHA1
+
 namespace libtorrent {}
 
 // create alias
@@ -395,8 +395,17 @@ namespace detail {
 	//
 	// The overloads that don't take an ``error_code&`` may throw an exception in case of a
 	// file error, the other overloads sets the error code to reflect the error, if any.
+	//
+	// The files are read and hashed on ``num_threads`` threads, 0 means one
+	// per CPU core. They don't go through a disk_io_thread, files are read in
+	// large chunks. ``f`` is called on the calling thread, in piece order. If
+	// ``f`` throws, the hashing threads are stopped before the exception
+	// propagates.
 	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec);
+	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
+		, std::function<void(piece_index_t)> const& f, int num_threads
+		, error_code& ec);
 	inline void set_piece_hashes(create_torrent& t, std::string const& p, error_code& ec)
 	{
 		set_piece_hashes(t, p, detail::nop, ec);
@@ -415,6 +424,13 @@ namespace detail {
 		set_piece_hashes(t, p, f, ec);
 		if (ec) throw system_error(ec);
 	}
+	inline void set_piece_hashes(create_torrent& t, std::string const& p
+		, std::function<void(piece_index_t)> const& f, int const num_threads)
+	{
+		error_code ec;
+		set_piece_hashes(t, p, f, num_threads, ec);
+		if (ec) throw system_error(ec);
+	}
 #endif
 
 	// all wstring APIs are deprecated since 0.16.11
@@ -35,9 +35,6 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/config.hpp"
 
-#if TORRENT_USE_INVARIANT_CHECKS
-#include <set>
-#endif
 #include <vector>
 #include <mutex>
 #include <functional>
@@ -46,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/io_service_fwd.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+#include "libtorrent/aux_/slab_allocator.hpp"
 
 namespace libtorrent {
 
@@ -81,6 +79,18 @@ namespace libtorrent {
 		}
 		int num_to_evict(int num_needed = 0);
 
+		// the max number of blocks the pool hands out before asking the cache
+		// to evict blocks
+		int max_size() const
+		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			return m_max_use;
+		}
+
+		// the number of blocks the pool has reserved memory for, including
+		// the ones in use
+		int num_reserved() const;
+
 		void set_settings(aux::session_settings const& sett);
 
 	protected:
@@ -119,15 +129,17 @@ namespace libtorrent {
 	private:
 
 		void check_buffer_level(std::unique_lock<std::mutex>& l);
-		void remove_buffer_in_use(char* buf);
 
 		mutable std::mutex m_pool_mutex;
 
-		// this is specifically exempt from release_asserts
-		// since it's a quite costly check. Only for debug
-		// builds.
-#if TORRENT_USE_INVARIANT_CHECKS
-		std::set<char*> m_buffers_in_use;
+#ifndef TORRENT_DEBUG_BUFFERS
+		// the buffers are carved out of slabs of this allocator. It also
+		// keeps track of which buffers are in use, for is_disk_buffer()
+		aux::slab_allocator m_slabs;
+
+		// set while a thread is giving back the memory of free blocks, with
+		// m_pool_mutex released
+		bool m_trimming = false;
 #endif
 #if TORRENT_USE_ASSERTS
 		int m_magic;
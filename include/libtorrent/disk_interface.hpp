@@ -53,6 +53,7 @@ namespace libtorrent {
 
 	struct disk_observer;
 	struct counters;
+	struct file;
 
 	struct storage_holder;
 
@@ -119,7 +120,20 @@ namespace libtorrent {
 	using pool_file_status = open_file_state;
 #endif
 
-	using disk_job_flags_t = flags::bitfield_flag<std::uint8_t, struct disk_job_flags_tag>;
+	// the bits not used by disk_interface are taken by disk_io_job's internal
+	// flags, so the prefetch flag needed a wider type than the original 8
+	// bits. This changed the ABI of disk_interface
+	using disk_job_flags_t = flags::bitfield_flag<std::uint16_t, struct disk_job_flags_tag>;
+
+	// a range of bytes in a file held open by the disk subsystem. This is
+	// what async_read_file() passes back instead of a buffer, when the block
+	// can be sent straight out of the file (with ``sendfile()``)
+	struct file_range
+	{
+		std::shared_ptr<file> handle;
+		std::int64_t offset = 0;
+		int size = 0;
+	};
 
 	struct TORRENT_EXTRA_EXPORT disk_interface
 	{
@@ -139,6 +153,17 @@ namespace libtorrent {
 		// not hit the disk, but found the data in the read cache.
 		static constexpr disk_job_flags_t cache_hit = 5_bit;
 
+		// the read is needed as soon as possible, e.g. by a streaming client.
+		// It's scheduled ahead of other disk jobs
+		static constexpr disk_job_flags_t time_critical = 7_bit;
+
+		// the read is only meant to pull the whole piece into the read cache,
+		// ahead of peers requesting it. It's only performed when the disk
+		// threads have nothing else to do, and it's skipped if the piece is
+		// already in the cache, or if it wouldn't fit without evicting other
+		// blocks
+		static constexpr disk_job_flags_t prefetch = 8_bit;
+
 		virtual storage_holder new_torrent(storage_constructor_type sc
 			, storage_params p, std::shared_ptr<void> const&) = 0;
 		virtual void remove_torrent(storage_index_t) = 0;
@@ -147,6 +172,17 @@ namespace libtorrent {
 		virtual void async_read(storage_index_t storage, peer_request const& r
 			, std::function<void(disk_buffer_holder block, disk_job_flags_t flags, storage_error const& se)> handler
 			, disk_job_flags_t flags = {}) = 0;
+
+		// like async_read(), except that a block not in the read cache is not
+		// read into a disk buffer, if it lies entirely within one regular file.
+		// Instead, ``range`` refers to where in that file the block is, for the
+		// caller to copy it to a socket without it passing through user space.
+		// When ``range.handle`` is nullptr, the block was read into ``block``,
+		// just like with async_read()
+		virtual void async_read_file(storage_index_t storage, peer_request const& r
+			, std::function<void(disk_buffer_holder block, file_range range
+				, disk_job_flags_t flags, storage_error const& se)> handler
+			, disk_job_flags_t flags = {}) = 0;
 		virtual bool async_write(storage_index_t storage, peer_request const& r
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
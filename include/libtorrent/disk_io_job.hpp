@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/units.hpp"
 #include "libtorrent/session_types.hpp"
 #include "libtorrent/flags.hpp"
+#include "libtorrent/time.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/variant/variant.hpp>
@@ -115,10 +116,17 @@ namespace libtorrent {
 		// is not dirty anymore
 		bool completed(cached_piece_entry const* pe);
 
+		// for read jobs, returns true if the block may be handed back as a
+		// file_range rather than being read into a buffer
+		bool wants_file_range() const;
+
 		// for read and write, this is the disk_buffer_holder
 		// for other jobs, it may point to other job-specific types
 		// for move_storage and rename_file this is a string
+		// for reads posted by async_read_file() that are served straight
+		// out of the file, this is the file_range
 		boost::variant<disk_buffer_holder
+			, file_range
 			, std::string
 			, add_torrent_params const*
 			, aux::vector<download_priority_t, file_index_t>
@@ -131,6 +139,7 @@ namespace libtorrent {
 		// this is called when operation completes
 
 		using read_handler = std::function<void(disk_buffer_holder block, disk_job_flags_t flags, storage_error const& se)>;
+		using read_file_handler = std::function<void(disk_buffer_holder block, file_range range, disk_job_flags_t flags, storage_error const& se)>;
 		using write_handler = std::function<void(storage_error const&)>;
 		using hash_handler = std::function<void(piece_index_t, sha1_hash const&, storage_error const&)>;
 		using move_handler = std::function<void(status_t, std::string, storage_error const&)>;
@@ -141,6 +150,7 @@ namespace libtorrent {
 		using set_file_prio_handler = std::function<void(storage_error const&, aux::vector<download_priority_t, file_index_t>)>;
 
 		boost::variant<read_handler
+			, read_file_handler
 			, write_handler
 			, hash_handler
 			, move_handler
@@ -167,6 +177,10 @@ namespace libtorrent {
 			// the hard link to.
 			aux::vector<std::string, file_index_t>* links;
 
+			// for flush_storage jobs, the number of pieces, starting at
+			// ``piece``, to flush. -1 means all pieces of the storage
+			int num_pieces;
+
 			struct io_args
 			{
 			// for read and write, the offset into the piece
@@ -179,6 +193,10 @@ namespace libtorrent {
 
 			// number of bytes 'buffer' points to. Used for read & write
 			std::uint16_t buffer_size;
+
+			// for reads, the number of blocks to read into the cache if
+			// this is a cache miss
+			std::uint16_t read_ahead;
 			} io;
 		} d;
 
@@ -195,6 +213,10 @@ namespace libtorrent {
 		// return value of operation
 		status_t ret = status_t::no_error;
 
+		// when the job was put on the job queue. Used to schedule it and to
+		// measure how long it waited
+		time_point queued_at;
+
 		// flags controlling this job
 		disk_job_flags_t flags{};
 
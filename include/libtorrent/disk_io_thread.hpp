@@ -39,20 +39,25 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/storage.hpp"
 #include "libtorrent/allocator.hpp"
 #include "libtorrent/io_service.hpp"
+#include "libtorrent/deadline_timer.hpp"
 #include "libtorrent/disk_io_thread_pool.hpp"
 #include "libtorrent/disk_io_job.hpp"
 #include "libtorrent/disk_job_pool.hpp"
+#include "libtorrent/aux_/disk_job_queue.hpp"
 #include "libtorrent/block_cache.hpp"
 #include "libtorrent/file_pool.hpp"
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/disk_trace.hpp"
 
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <thread>
 
 namespace libtorrent {
 
@@ -93,6 +98,17 @@ namespace aux {
 		bool need_readback;
 	};
 
+	// the disk cache occupancy of a torrent
+	struct cached_torrent_info
+	{
+		storage_interface* storage;
+
+		// the number of read cache blocks held by this torrent, i.e. blocks
+		// read from disk or already written to it. This is what's compared
+		// against settings_pack::max_torrent_cache_share.
+		int read_cache_blocks;
+	};
+
 	using jobqueue_t = tailqueue<disk_io_job>;
 
 	// this struct holds a number of statistics counters
@@ -102,6 +118,7 @@ namespace aux {
 		// initializes all counters to 0
 		cache_status()
 			: pieces()
+			, torrents()
 #if TORRENT_ABI_VERSION == 1
 			, blocks_written(0)
 			, writes(0)
@@ -147,6 +164,10 @@ namespace aux {
 
 		std::vector<cached_piece_info> pieces;
 
+		// the cache occupancy of the torrent the cache info was requested
+		// for, or of every torrent if it was requested for the whole session
+		std::vector<cached_torrent_info> torrents;
+
 #if TORRENT_ABI_VERSION == 1
 		// the total number of 16 KiB blocks written to disk
 		// since this session was started.
@@ -284,9 +305,7 @@ namespace aux {
 		, buffer_allocator_interface
 	{
 		disk_io_thread(io_service& ios, counters& cnt);
-#if TORRENT_USE_ASSERTS
 		~disk_io_thread();
-#endif
 
 		enum
 		{
@@ -294,6 +313,10 @@ namespace aux {
 			hasher_thread_divisor = 4
 		};
 
+		// the number of threads hashing pieces read when checking files, with
+		// the settings ``sett``
+		static int num_check_hashers(aux::session_settings const& sett);
+
 		void set_settings(settings_pack const* sett);
 
 		void abort(bool wait);
@@ -305,6 +328,10 @@ namespace aux {
 		void async_read(storage_index_t storage, peer_request const& r
 			, std::function<void(disk_buffer_holder block
 				, disk_job_flags_t flags, storage_error const& se)> handler, disk_job_flags_t flags = {}) override;
+		void async_read_file(storage_index_t storage, peer_request const& r
+			, std::function<void(disk_buffer_holder block, file_range range
+				, disk_job_flags_t flags, storage_error const& se)> handler
+			, disk_job_flags_t flags = {}) override;
 		bool async_write(storage_index_t storage, peer_request const& r
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
@@ -342,7 +369,7 @@ namespace aux {
 
 		// implements buffer_allocator_interface
 		void reclaim_blocks(span<aux::block_cache_reference> ref) override;
-		void free_disk_buffer(char* buf) override { m_disk_cache.free_buffer(buf); }
+		void free_disk_buffer(char* buf) override { m_buffer_pool.free_buffer(buf); }
 		void trigger_cache_trim();
 		void update_stats_counters(counters& c) const override;
 		void get_cache_info(cache_status* ret, storage_index_t storage
@@ -354,13 +381,16 @@ namespace aux {
 		// this submits all queued up jobs to the thread
 		void submit_jobs() override;
 
-		block_cache* cache() { return &m_disk_cache; }
-
 #if TORRENT_USE_ASSERTS
 		bool is_disk_buffer(char* buffer) const override
-		{ return m_disk_cache.is_disk_buffer(buffer); }
+		{ return m_buffer_pool.is_disk_buffer(buffer); }
 #endif
 
+		// fills in the read job and either completes it right away (on a cache
+		// hit) or queues it
+		void queue_read_job(disk_io_job* j, storage_index_t storage
+			, peer_request const& r, disk_job_flags_t flags);
+
 		int prep_read_job_impl(disk_io_job* j, bool check_fence = true);
 
 		void maybe_issue_queued_read_jobs(cached_piece_entry* pe,
@@ -374,6 +404,24 @@ namespace aux {
 		status_t do_hash(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_uncached_hash(disk_io_job* j);
 
+		// a piece read by a hash job for checking files, handed off to the
+		// check hasher threads to be hashed while the disk thread moves on to
+		// read the next piece
+		struct check_hash_job
+		{
+			disk_io_job* job;
+			cached_piece_entry* pe;
+			int first_block;
+			std::vector<iovec_t> iov;
+		};
+
+		// returns false if there are no check hasher threads to take the job,
+		// in which case the caller is expected to hash the piece itself
+		bool queue_check_hash(check_hash_job& cj);
+		void check_hasher_fun(int idx);
+		void hash_checked_pieces(span<check_hash_job> jobs);
+		void stop_check_hashers();
+
 		status_t do_move_storage(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_release_files(disk_io_job* j, jobqueue_t& completed_jobs);
 		status_t do_delete_files(disk_io_job* j, jobqueue_t& completed_jobs);
@@ -419,7 +467,7 @@ namespace aux {
 			std::condition_variable m_job_cond;
 
 			// jobs queued for servicing
-			jobqueue_t m_queued_jobs;
+			aux::disk_job_queue m_queued_jobs;
 		};
 
 		void thread_fun(job_queue& queue, disk_io_thread_pool& pool);
@@ -435,7 +483,38 @@ namespace aux {
 		void fail_jobs(storage_error const& e, jobqueue_t& jobs_);
 		void fail_jobs_impl(storage_error const& e, jobqueue_t& src, jobqueue_t& dst);
 
-		void check_cache_level(std::unique_lock<std::mutex>& l, jobqueue_t& completed_jobs);
+		// one slice of the disk cache. Every piece belongs to exactly one
+		// shard (see shard_for()), and each shard has its own ARC lists and
+		// mutex, so disk threads working on pieces in different shards don't
+		// contend for the same lock. All shards allocate their blocks from
+		// m_buffer_pool, which has its own lock.
+		struct cache_shard
+		{
+			cache_shard(disk_buffer_pool& pool, int num_shards)
+				: cache(pool, num_shards) {}
+
+			// protects cache and all cached_piece_entry objects in it
+			std::mutex mutex;
+			block_cache cache;
+		};
+
+		// returns the shard the specified piece belongs to. Pieces are
+		// assigned to shards in groups of contiguous pieces, to keep
+		// multi-piece flushes within a single shard
+		cache_shard& shard_for(storage_interface const* st, piece_index_t piece) const;
+		cache_shard& shard_for(cached_piece_entry const* pe) const
+		{ return shard_for(pe->storage.get(), pe->piece); }
+		cache_shard& shard_for(disk_io_job const* j) const
+		{ return shard_for(j->storage.get(), j->piece); }
+
+		// locks the mutexes of all shards, always in the same order.
+		// This is used by operations spanning the whole cache, like
+		// changing the settings or collecting statistics
+		std::vector<std::unique_lock<std::mutex>> lock_all_shards() const;
+
+		// evicts and flushes blocks in all shards, taking each shard's lock
+		// in turn
+		void check_cache_level(jobqueue_t& completed_jobs);
 
 		void perform_job(disk_io_job* j, jobqueue_t& completed_jobs);
 
@@ -443,12 +522,33 @@ namespace aux {
 		void add_job(disk_io_job* j, bool user_add = true);
 		void add_fence_job(disk_io_job* j, bool user_add = true);
 
-		// assumes l is locked (cache std::mutex).
+		// like add_fence_job(), but only jobs on the pieces [first, last) are
+		// held back by the fence
+		void add_piece_fence_job(disk_io_job* j, piece_index_t first
+			, piece_index_t last);
+		void post_fence_job(disk_io_job* j, disk_io_job* fj, int ret
+			, bool user_add);
+
+		// assumes l is locked (the mutex of p's cache shard).
 		// writes out the blocks [start, end) (releases the lock
 		// during the file operation)
 		int flush_range(cached_piece_entry* p, int start, int end
 			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 
+		// assumes l is locked (the mutex of p's cache shard).
+		// writes out the blocks [start, end of piece) of p together with
+		// adjacent pieces of the same storage that are dirty and hashed, as a
+		// single write. Returns -1 if there was no such piece.
+		int flush_coalesced(cached_piece_entry* p, int start
+			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
+		int max_coalesced_pieces(file_storage const& fs) const;
+		cached_piece_entry* coalesce_candidate(cached_piece_entry const* pe
+			, piece_index_t piece);
+		bool wait_for_next_piece(cached_piece_entry const* p);
+		void hold_piece(cached_piece_entry const* p);
+		void arm_held_timer();
+		void flush_held_pieces(error_code const& ec);
+
 		// low level flush operations, used by flush_range
 		int build_iovec(cached_piece_entry* pe, int start, int end
 			, span<iovec_t> iov, span<int> flushing, int block_base_index = 0);
@@ -460,7 +560,7 @@ namespace aux {
 			, storage_error const& error
 			, jobqueue_t& completed_jobs);
 
-		// assumes l is locked (the cache std::mutex).
+		// assumes l is locked (the mutex of pe's cache shard).
 		// assumes pe->hash to be set.
 		// If there are new blocks in piece 'pe' that have not been
 		// hashed by the partial_hash object attached to this piece,
@@ -481,15 +581,28 @@ namespace aux {
 			// used for asserts and only applies for fence jobs
 			flush_expect_clear = 8
 		};
-		void flush_cache(storage_interface* storage, std::uint32_t flags, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
-		void flush_expired_write_blocks(jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
-		void flush_piece(cached_piece_entry* pe, std::uint32_t flags, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
+		// these lock the shards they need themselves
+		void flush_cache(storage_interface* storage, std::uint32_t flags, jobqueue_t& completed_jobs);
+		void flush_expired_write_blocks(jobqueue_t& completed_jobs);
 
+		// these assume l is locked (the mutex of the shard the piece belongs to)
+		void flush_piece(cached_piece_entry* pe, std::uint32_t flags, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 		int try_flush_hashed(cached_piece_entry* p, int cont_blocks, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 
-		void try_flush_write_blocks(int num, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
+		// flushes write blocks in the specified shard. assumes l is locked
+		// (the shard's mutex)
+		int try_flush_write_blocks(cache_shard& shard, int num
+			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 
 		void maybe_flush_write_blocks();
+
+		// updates the queue time counters of the job's class, as it's taken
+		// off the job queue
+		void record_queue_time(disk_io_job const* j);
+
+		// records the job to the disk trace, if one is being recorded. Jobs
+		// are traced as they're issued, on the network thread
+		void trace_job(disk_io_job const* j, bool cache_hit = false);
 		void execute_job(disk_io_job* j);
 		void immediate_execute();
 		void abort_jobs();
@@ -521,6 +634,18 @@ namespace aux {
 		job_queue m_hash_io_jobs;
 		disk_io_thread_pool m_hash_threads;
 
+		// pieces read for checking, waiting to be hashed by one of the
+		// m_check_hashers. Hashers whose index is m_num_check_hashers or higher
+		// are idle. They're started by queue_check_hash(), the first time
+		// they're needed, and stopped as a group. All of these are protected
+		// by m_check_hash_mutex
+		std::deque<check_hash_job> m_check_hash_queue;
+		std::vector<std::thread> m_check_hashers;
+		int m_num_check_hashers = 0;
+		bool m_check_hash_abort = false;
+		std::mutex m_check_hash_mutex;
+		std::condition_variable m_check_hash_cond;
+
 		aux::session_settings m_settings;
 
 		// the last time we expired write blocks from the cache
@@ -533,9 +658,19 @@ namespace aux {
 		// LRU cache of open files
 		file_pool m_file_pool{40};
 
-		// disk cache
-		mutable std::mutex m_cache_mutex;
-		block_cache m_disk_cache;
+		// the pool all disk buffers are allocated from, whether they are
+		// part of the cache or not
+		disk_buffer_pool m_buffer_pool;
+
+		// the disk cache, split into shards
+		std::vector<std::unique_ptr<cache_shard>> m_cache_shards;
+
+		// the trace of disk jobs being recorded, if the disk_trace_file
+		// setting is set. Only used by the network thread
+		std::unique_ptr<aux::disk_trace_writer> m_trace;
+
+		// protects m_cache_check_state and m_last_cache_expiry
+		std::mutex m_cache_check_mutex;
 		enum
 		{
 			cache_check_idle,
@@ -568,6 +703,21 @@ namespace aux {
 		std::vector<std::pair<time_point, std::weak_ptr<storage_interface>>> m_need_tick;
 		std::mutex m_need_tick_mutex;
 
+		// complete pieces held back in the write cache by
+		// wait_for_next_piece(). m_held_timer flushes them once they've been
+		// held for too long. The timer is only used by the network thread.
+		// m_held_timer_armed is set while an expiry of it is scheduled
+		struct held_piece
+		{
+			time_point deadline;
+			std::weak_ptr<storage_interface> storage;
+			piece_index_t piece;
+		};
+		std::vector<held_piece> m_held_pieces;
+		bool m_held_timer_armed = false;
+		std::mutex m_held_pieces_mutex;
+		deadline_timer m_held_timer;
+
 		// this is protected by the completed_jobs_mutex. It's true whenever
 		// there's a call_job_handlers message in-flight to the network thread. We
 		// only ever keep one such message in flight at a time, and coalesce
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <string>
 #include <functional>
+#include <mutex>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/string_view.hpp"
@@ -177,6 +178,17 @@ namespace libtorrent {
 
 		// the mask of all attribute bits
 		constexpr open_mode_t attribute_mask = attribute_hidden | attribute_executable;
+
+		// this is only used for readv/writev flags. Submit the operation
+		// through the calling thread's io_uring instead of preadv()/pwritev().
+		// Ignored where io_uring is not supported
+		constexpr open_mode_t use_io_uring = 9_bit;
+
+		// open the file with O_DIRECT, bypassing the page cache entirely.
+		// Reads and writes that aren't aligned to the device block size are
+		// bounced through an aligned buffer. Where O_DIRECT is not supported
+		// (by the OS or by the filesystem) this behaves like no_cache
+		constexpr open_mode_t direct_io = 10_bit;
 	}
 
 	struct TORRENT_EXTRA_EXPORT file : boost::noncopyable
@@ -203,13 +215,32 @@ namespace libtorrent {
 		// belongs to a data-region
 		std::int64_t sparse_end(std::int64_t start) const;
 
+		// read ``size`` bytes at ``file_offset`` into the page cache, ahead of
+		// them being needed. Where supported, this blocks until they're there
+		void prefetch(std::int64_t file_offset, int size) const;
+
+#if TORRENT_USE_SENDFILE
+		// write up to ``size`` bytes at ``file_offset`` to the non-blocking
+		// socket ``s``, without copying them through user space. Returns the
+		// number of bytes written, 0 if the socket isn't writable, or -1 on
+		// error
+		int send_to(int s, std::int64_t file_offset, int size, error_code& ec) const;
+#endif
+
 		handle_type native_handle() const { return m_file_handle; }
 
 	private:
 
+		std::int64_t unaligned_direct_iov(bool write, std::int64_t file_offset
+			, span<iovec_t const> bufs, error_code& ec, open_mode_t flags);
+
 		handle_type m_file_handle;
 
 		open_mode_t m_open_mode{};
+
+		// serializes the read-modify-write of partial blocks in direct_io
+		// mode
+		std::mutex m_direct_io_mutex;
 	};
 }
 
@@ -33,9 +33,17 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_FILE_POOL_HPP
 #define TORRENT_FILE_POOL_HPP
 
-#include <map>
+#include <cstdint>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 #include <vector>
+#include <unordered_map>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/intrusive/list.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
 
 #include "libtorrent/file.hpp"
 #include "libtorrent/aux_/time.hpp"
@@ -90,25 +98,126 @@ namespace libtorrent {
 		// any file to stay open for too long, allowing the disk cache to accrue.
 		void close_oldest();
 
+		// files evicted from the pool (by open_file(), resize() and
+		// close_oldest()) are closed by a separate thread, since closing a file
+		// with a lot of dirty pages may block for a long time. This is the
+		// number of files allowed to wait for that thread. When the backlog is
+		// full, files are closed by the thread evicting them. 0 means files are
+		// always closed by the thread evicting them. release() doesn't return
+		// until all files waiting to be closed have been closed.
+		void set_close_backlog(int backlog);
+
+		// the number of files waiting to be closed
+		int num_pending_closes() const;
+
+		// the total time, in microseconds, spent closing evicted files
+		std::int64_t close_time() const { return m_close_time; }
+
 	private:
 
-		file_handle remove_oldest(std::unique_lock<std::mutex>&);
+		// the file held by this object is handed to close_file() when it's
+		// destructed. Declare it before locking m_mutex to close evicted
+		// files after the mutex has been released
+		struct deferred_close
+		{
+			explicit deferred_close(file_pool& p) : pool(p) {}
+			~deferred_close() { pool.close_file(std::move(file)); }
+			deferred_close(deferred_close const&) = delete;
+			deferred_close& operator=(deferred_close const&) = delete;
+			file_pool& pool;
+			file_handle file;
+		};
 
-		int m_size;
-		bool m_low_prio_io = false;
+		// closes f, either by handing it to the closer thread, or right away.
+		// Must not be called while holding m_mutex
+		void close_file(file_handle f);
+		void close_files(std::vector<file_handle>& files);
+		void close_thread_fun();
+		void drain_close_queue();
 
 		struct lru_file_entry
 		{
+			lru_file_entry(storage_index_t const st, file_index_t const f)
+				: storage(st), file_index(f) {}
+
 			file_handle file_ptr;
 			time_point const opened{aux::time_now()};
 			time_point last_use{opened};
 			open_mode_t mode{};
+
+			// the key this entry is stored under, to find it from the LRU
+			// lists
+			storage_index_t const storage;
+			file_index_t const file_index;
+
+			// links this entry into m_lru, ordered by last use
+			boost::intrusive::list_member_hook<> lru_hook;
+			// links this entry into m_open_order, ordered by when the file was
+			// opened
+			boost::intrusive::list_member_hook<> open_hook;
 		};
 
-		// maps storage pointer, file index pairs to the
-		// LRU entry for the file
-		std::map<std::pair<storage_index_t, file_index_t>, lru_file_entry> m_files;
+		using lru_list = boost::intrusive::list<lru_file_entry
+			, boost::intrusive::member_hook<lru_file_entry
+				, boost::intrusive::list_member_hook<>, &lru_file_entry::lru_hook>>;
+		using open_list = boost::intrusive::list<lru_file_entry
+			, boost::intrusive::member_hook<lru_file_entry
+				, boost::intrusive::list_member_hook<>, &lru_file_entry::open_hook>>;
+
+		// the open files of a single storage, by file index
+		using storage_files = std::unordered_map<file_index_t, lru_file_entry>;
+
+		file_handle remove_oldest(std::unique_lock<std::mutex>&);
+		file_handle remove_file(std::unique_lock<std::mutex>&
+			, lru_file_entry& e);
+
+		int m_size;
+		bool m_low_prio_io = false;
+
+		// maps storage index to the open files belonging to that storage.
+		// Files are never opened or closed while holding m_mutex, so it only
+		// protects constant time lookups and list updates
+		std::unordered_map<storage_index_t, storage_files> m_files;
+
+		// all entries in m_files. The front of m_lru is the most recently
+		// used file and the front of m_open_order is the file that was opened
+		// first
+		lru_list m_lru;
+		open_list m_open_order;
+
+		// incremented every time files are released. A file opened without
+		// holding the mutex is not added to the pool if files of its storage
+		// were released in the meantime, since it may have been opened before
+		// the release. m_release_counter counts releases of all files, and
+		// m_storage_release_counter releases of the files of one storage
+		std::uint32_t m_release_counter = 0;
+		std::unordered_map<storage_index_t, std::uint32_t> m_storage_release_counter;
+
+		// the number of releases that affected files of storage st. Must be
+		// called with m_mutex held
+		std::uint32_t release_count(storage_index_t st) const;
+
 		mutable std::mutex m_mutex;
+
+		// files waiting to be closed by m_close_thread
+		std::vector<file_handle> m_close_queue;
+
+		// the max size of m_close_queue
+		int m_close_backlog = 0;
+
+		// set while m_close_thread is closing files it took off the queue
+		bool m_closing = false;
+		bool m_close_abort = false;
+
+		std::atomic<std::int64_t> m_close_time{0};
+
+		// protects m_close_queue, m_close_backlog, m_closing and
+		// m_close_abort. Never held while closing a file
+		mutable std::mutex m_close_mutex;
+		std::condition_variable m_close_cond;
+
+		// started the first time a file is handed to it
+		std::thread m_close_thread;
 	};
 
 }
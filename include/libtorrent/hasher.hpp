@@ -121,6 +121,13 @@ namespace libtorrent {
 #endif
 	};
 
+	// hashes each buffer in ``pieces`` on its own, and stores its SHA-1 digest
+	// at the same index in ``hashes``, which must be at least as large as
+	// ``pieces``. On x86 CPUs, up to 16 buffers are hashed in parallel by a
+	// multi-buffer SSE2, AVX2 or AVX-512 kernel, picked at runtime. This is
+	// considerably faster than hashing the buffers one at a time with hasher.
+	TORRENT_EXPORT void hash_pieces(span<span<char const> const> pieces
+		, span<sha1_hash> hashes);
 }
 
 #endif // TORRENT_HASHER_HPP_INCLUDED
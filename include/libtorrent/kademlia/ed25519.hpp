@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <array>
 #include <tuple>
+#include <vector>
 
 namespace libtorrent { namespace dht {
 
@@ -69,6 +70,18 @@ namespace libtorrent { namespace dht {
 	TORRENT_EXPORT bool ed25519_verify(signature const& sig
 		, span<char const> msg, public_key const& pk);
 
+	// Verifies several signatures at once, the i:th signature against the
+	// i:th message and public key. The results are the same as those of
+	// ed25519_verify(). Every public key and R point is first checked for a
+	// small order component, which could cancel out across signatures in
+	// the batch. Signatures failing that check are verified on their own. If
+	// the batch fails, its signatures are verified one at a time to tell
+	// which are invalid. ``valid`` is set to the result of each signature,
+	// and true is returned if all of them are valid.
+	TORRENT_EXPORT bool ed25519_verify_batch(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks
+		, std::vector<bool>& valid);
+
 	// Adds a scalar to the given key pair where scalar is a 32 byte buffer
 	// (possibly generated with `ed25519_create_seed`), generating a new key pair.
 	//
@@ -65,7 +65,9 @@ namespace libtorrent {
 	struct rc4 {
 		int x;
 		int y;
-		aux::array<std::uint8_t, 256> buf;
+		// the permutation only holds byte values, but word sized entries
+		// make the keystream generation noticeably faster
+		aux::array<std::uint32_t, 256> buf;
 	};
 
 	// TODO: 3 dh_key_exchange should probably move into its own file
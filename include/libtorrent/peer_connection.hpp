@@ -632,6 +632,13 @@ namespace aux {
 			m_send_buffer.append_buffer(std::move(buffer), size);
 		}
 
+		// appends a block to be sent straight out of its file
+		void append_send_file(file_range range)
+		{
+			TORRENT_ASSERT(is_single_thread());
+			m_send_buffer.append_file(std::move(range.handle), range.offset, range.size);
+		}
+
 		int outstanding_bytes() const { return m_outstanding_bytes; }
 
 		int send_buffer_size() const
@@ -697,6 +704,9 @@ namespace aux {
 		virtual void write_dont_have(piece_index_t index) = 0;
 		virtual void write_keepalive() = 0;
 		virtual void write_piece(peer_request const& r, disk_buffer_holder buffer) = 0;
+		// sends a block straight out of the file it's stored in. Only called
+		// for connections where can_send_file() returns true
+		virtual void write_piece_file(peer_request const& r, file_range range);
 		virtual void write_suggest(piece_index_t piece) = 0;
 		virtual void write_bitfield() = 0;
 
@@ -704,6 +714,10 @@ namespace aux {
 		virtual void write_allow_fast(piece_index_t piece) = 0;
 		virtual void write_upload_only(bool enabled) = 0;
 
+		// returns true if blocks may be written to this connection's socket
+		// straight from their files (see zero_copy_upload)
+		virtual bool can_send_file() const { return false; }
+
 		virtual void on_connected() = 0;
 		virtual void on_tick() {}
 
@@ -746,6 +760,9 @@ namespace aux {
 		// callbacks for data being sent or received
 		void on_send_data(error_code const& error
 			, std::size_t bytes_transferred);
+#if TORRENT_USE_SENDFILE
+		void on_send_file(error_code const& error, int bytes);
+#endif
 		void on_receive_data(error_code const& error
 			, std::size_t bytes_transferred);
 
@@ -756,8 +773,9 @@ namespace aux {
 
 		void do_update_interest();
 		void fill_send_buffer();
-		void on_disk_read_complete(disk_buffer_holder disk_block, disk_job_flags_t flags
-			, storage_error const& error, peer_request const& r, time_point issue_time);
+		void on_disk_read_complete(disk_buffer_holder disk_block, file_range range
+			, disk_job_flags_t flags, storage_error const& error
+			, peer_request const& r, time_point issue_time);
 		void on_disk_write_complete(storage_error const& error
 			, peer_request const &r, std::shared_ptr<torrent> t);
 		void on_seed_mode_hashed(piece_index_t piece
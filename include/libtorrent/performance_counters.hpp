@@ -203,11 +203,74 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			num_coalesced_pieces,
+			num_read_stream_hits,
+			num_read_stream_misses,
+			num_read_ahead_blocks,
+			num_verification_cache_hits,
+			num_file_range_reads,
+			num_reordered_blocks_hashed,
+			num_prefetched_pieces,
 
 			disk_read_time,
 			disk_write_time,
 			disk_hash_time,
 			disk_job_time,
+			disk_file_close_time,
+
+			// these are in the order of aux::disk_job_class
+			disk_queue_time_critical,
+			disk_queue_time_read,
+			disk_queue_time_write,
+			disk_queue_time_hash,
+			disk_queue_time_maintenance,
+			disk_queue_time_idle,
+			num_disk_jobs_critical,
+			num_disk_jobs_read,
+			num_disk_jobs_write,
+			num_disk_jobs_hash,
+			num_disk_jobs_maintenance,
+			num_disk_jobs_idle,
+
+			// a histogram of the time jobs of each class spent queued, in the
+			// order of aux::disk_job_class. Each class has one counter per
+			// bucket, for less than 1, 10, 50 and 250 ms, 1 s, and the rest
+			disk_queue_critical_1ms,
+			disk_queue_critical_10ms,
+			disk_queue_critical_50ms,
+			disk_queue_critical_250ms,
+			disk_queue_critical_1s,
+			disk_queue_critical_slow,
+			disk_queue_read_1ms,
+			disk_queue_read_10ms,
+			disk_queue_read_50ms,
+			disk_queue_read_250ms,
+			disk_queue_read_1s,
+			disk_queue_read_slow,
+			disk_queue_write_1ms,
+			disk_queue_write_10ms,
+			disk_queue_write_50ms,
+			disk_queue_write_250ms,
+			disk_queue_write_1s,
+			disk_queue_write_slow,
+			disk_queue_hash_1ms,
+			disk_queue_hash_10ms,
+			disk_queue_hash_50ms,
+			disk_queue_hash_250ms,
+			disk_queue_hash_1s,
+			disk_queue_hash_slow,
+			disk_queue_maintenance_1ms,
+			disk_queue_maintenance_10ms,
+			disk_queue_maintenance_50ms,
+			disk_queue_maintenance_250ms,
+			disk_queue_maintenance_1s,
+			disk_queue_maintenance_slow,
+			disk_queue_idle_1ms,
+			disk_queue_idle_10ms,
+			disk_queue_idle_50ms,
+			disk_queue_idle_250ms,
+			disk_queue_idle_1s,
+			disk_queue_idle_slow,
 
 			waste_piece_timed_out,
 			waste_piece_cancelled,
@@ -403,6 +466,7 @@ namespace libtorrent {
 			request_latency,
 			pinned_blocks,
 			disk_blocks_in_use,
+			disk_blocks_reserved,
 			queued_disk_jobs,
 			num_running_disk_jobs,
 			num_read_jobs,
@@ -411,6 +475,7 @@ namespace libtorrent {
 			num_writing_threads,
 			num_running_threads,
 			blocked_disk_jobs,
+			queued_file_closes,
 			queued_write_bytes,
 			num_unchoke_slots,
 
@@ -238,6 +238,13 @@ namespace libtorrent {
 			// effect until the DHT is restarted.
 			dht_bootstrap_nodes,
 
+			// if set to a file path, every job issued to the disk thread is
+			// recorded to this file, in a compact binary format. The trace can be
+			// replayed against different cache settings with the
+			// ``disk_trace_replay`` tool. Set to an empty string to stop
+			// recording. Setting a new path truncates the file.
+			disk_trace_file,
+
 			max_string_setting_internal
 		};
 
@@ -729,6 +736,55 @@ namespace libtorrent {
 			// changes are taken in consideration.
 			enable_ip_notifier,
 
+			// when enabled, the read requests against each torrent are tracked
+			// to detect sequential streams, e.g. peers downloading the torrent
+			// in order. Cache misses in such a stream read ahead a window that
+			// grows with the length of the stream, up to
+			// ``read_cache_line_size`` blocks, while other cache misses only
+			// read the requested block. When disabled (the default), every
+			// cache miss reads ``read_cache_line_size`` blocks. Enabling this
+			// saves disk bandwidth when serving peers that request pieces in
+			// random order, at the cost of more, smaller reads for other
+			// access patterns.
+			adaptive_read_ahead,
+
+			// disk buffers are allocated from 2 MiB slabs. When this is
+			// enabled, slabs allocated from then on are backed by huge pages
+			// (on Linux, with transparent huge pages in ``madvise`` mode).
+			// This saves TLB misses when hashing and copying large amounts of
+			// cached data, at the cost of a slab taking up all of its 2 MiB as
+			// soon as its first block is used.
+			disk_cache_huge_pages,
+
+			// when enabled, the hashes of the pieces found on disk are saved
+			// in a hidden file next to the torrent's files, along with the
+			// size, modification and change time (with nanoseconds, where
+			// available) and inode of each file. When the files are checked,
+			// pieces whose files are unchanged since the hashes were saved are
+			// compared against the stored hashes instead of being read back
+			// and hashed. This saves a full recheck after an unclean shutdown,
+			// where the resume data is lost or out of date.
+			// The stored hashes are trusted as long as the file identity
+			// matches. A modification that keeps all of it intact isn't
+			// detected, and a piece that is corrupt on disk may then pass the
+			// check. On POSIX systems every write updates the change time, so
+			// this takes a filesystem with coarse (e.g. one or two second)
+			// timestamps. On Windows, the change time is the creation time,
+			// so a tool that restores the modification time after editing a
+			// file defeats it too. Don't enable this if files may be modified
+			// behind libtorrent's back in such ways.
+			use_verification_cache,
+
+			// when enabled, blocks uploaded to unencrypted BitTorrent peers
+			// over plain TCP that aren't in the read cache are not read into a
+			// disk buffer. Instead the disk thread pulls them into the page
+			// cache and they are written to the socket straight from the file,
+			// with ``sendfile()``. This saves copying every uploaded byte
+			// through user space, and the read cache is bypassed for these
+			// blocks. Only supported on Linux, and not for blocks spanning
+			// file boundaries or in files using a part file.
+			zero_copy_upload,
+
 			max_bool_setting_internal
 		};
 
@@ -1008,6 +1064,16 @@ namespace libtorrent {
 			//   potentially evict all other processes' cache by simply handling
 			//   high throughput and large files. If libtorrent's read cache is
 			//   disabled, enabling this may reduce performance.
+			// direct_io
+			//   This opens files with ``O_DIRECT`` (on systems and filesystems
+			//   that support it), bypassing the OS page cache entirely and
+			//   leaving libtorrent's block cache as the only cache. Reads and
+			//   writes that aren't aligned to 4 kiB (typically at file
+			//   boundaries and at the end of the last piece) are bounced
+			//   through an aligned buffer. Elsewhere this behaves like
+			//   ``disable_os_cache``. Since files are opened in read-write mode
+			//   once, setting either of the two modes to ``direct_io`` applies
+			//   to both.
 			//
 			// One reason to disable caching is that it may help the operating
 			// system from growing its file cache indefinitely.
@@ -1193,7 +1259,8 @@ namespace libtorrent {
 #endif
 
 			// ``read_cache_line_size`` is the number of blocks to read into the
-			// read cache when a read cache miss occurs. Setting this to 0 is
+			// read cache when a read cache miss occurs (see also
+			// ``adaptive_read_ahead``). Setting this to 0 is
 			// essentially the same thing as disabling read cache. The number of
 			// blocks read into the read cache is always capped by the piece
 			// boundary.
@@ -1665,6 +1732,90 @@ namespace libtorrent {
 			// as zero.
 			resolver_cache_timeout,
 
+			// determines how the disk threads issue file reads and writes. The
+			// options are:
+			//
+			// posix_disk_io
+			//   This is the default. Each read or write is issued with
+			//   ``preadv()``/``pwritev()`` (or the platform's equivalent), one
+			//   system call per ``IOV_MAX`` buffers.
+			// io_uring_disk_io
+			//   On Linux, vectored reads and writes (including hash reads) are
+			//   submitted through a per-thread io_uring. All chunks of an
+			//   operation, and the ``fdatasync()`` following writes in
+			//   ``disable_os_cache`` mode, are handed to the kernel in a single
+			//   submission. If the running kernel does not support io_uring,
+			//   this behaves like ``posix_disk_io``.
+			disk_io_backend,
+
+			// when the disk cache flushes a piece, dirty blocks of adjacent
+			// pieces (of the same torrent) that have already been hashed are
+			// written out along with it, as a single vectored write. This is
+			// the upper limit, in bytes, of such a write. It has no effect on
+			// torrents whose piece size is more than half of this. 0 (the
+			// default) flushes one piece at a time.
+			//
+			// To make merging possible, a complete and hashed piece is kept in
+			// the cache for up to half a second while the piece after it is
+			// still being downloaded. This adds that much latency to the
+			// piece's writes: their completion handlers aren't called, and the
+			// peers' queued disk bytes aren't released, until the piece is
+			// flushed. 1 MiB is a reasonable value when fewer, larger writes
+			// are worth that latency, e.g. on spinning disks.
+			max_coalesced_write_size,
+
+			// the number of threads computing the SHA-1 hashes of pieces read
+			// when checking files (e.g. force_recheck()). The disk threads only
+			// read the pieces and hand them off, so that reading the next piece
+			// overlaps with hashing the previous ones. 0 means one thread per
+			// CPU core. The threads are started the first time files are
+			// checked. How many pieces are in flight at a time, and so how many
+			// of these threads can be kept busy, is controlled by
+			// ``checking_mem_usage``.
+			checking_hash_threads,
+
+			// when move_storage() can't rename files, because the new location
+			// is on a different filesystem, the files are copied. This is the
+			// number of files copied at a time.
+			move_storage_copy_threads,
+
+			// blocks of a piece being downloaded that arrive ahead of the
+			// contiguous range that has been hashed so far can't be hashed
+			// until the gap in front of them is filled in. This is the number
+			// of blocks past that point that are kept in the cache after
+			// they've been flushed to disk, so that they can be hashed without
+			// being read back. Only pieces written to in the last 5 seconds
+			// keep these blocks, and at most a quarter of the cache is kept
+			// this way. Set to 0 to let the cache evict them like any other
+			// clean block.
+			hash_reorder_window,
+
+			// files evicted from the file pool are closed by a separate
+			// thread, since closing a file may block while the operating
+			// system flushes its dirty pages. This is the max number of
+			// evicted files waiting to be closed. Once reached, disk threads
+			// close files themselves. Set to 0 to always close files in the
+			// disk thread evicting them.
+			max_queued_file_closes,
+
+			// the max share of the disk cache, in percent, that the read cache
+			// blocks of a single torrent may take up. When blocks need to be
+			// evicted, the least recently used blocks of torrents above their
+			// share are evicted first, before the regular ARC eviction order is
+			// applied to all torrents. This keeps a single popular torrent from
+			// pushing all other torrents out of the cache. Set to 0 for no
+			// limit.
+			max_torrent_cache_share,
+
+			// when seeding with suggest_mode set to suggest_read_cache, this is
+			// the number of pieces of each torrent, among the ones suggested to
+			// peers, that are pulled into the disk cache ahead of peers
+			// requesting them. The pieces are read when the disk threads have
+			// nothing else to do, and only as long as they fit in the cache
+			// without evicting other blocks. This cuts the latency of the first
+			// requests for newly published content. Set to 0 to disable.
+			prefetch_suggested_pieces,
+
 			max_int_setting_internal
 		};
 
@@ -1699,7 +1850,14 @@ namespace libtorrent {
 #else
 			deprecated = 1,
 #endif
-			disable_os_cache = 2
+			disable_os_cache = 2,
+			direct_io = 3
+		};
+
+		enum disk_io_backend_t
+		{
+			posix_disk_io = 0,
+			io_uring_disk_io = 1
 		};
 
 		enum bandwidth_mixed_algo_t
@@ -29,6 +29,15 @@ namespace libtorrent {
 	TORRENT_EXTRA_EXPORT void SHA1_init(sha1_ctx* context);
 	TORRENT_EXTRA_EXPORT void SHA1_update(sha1_ctx* context
 		, std::uint8_t const* data, size_t len);
+
+	// SHA1_update() picks one of these at runtime. The _hw version uses the
+	// Intel SHA extensions or the ARMv8 SHA1 instructions. If neither the
+	// CPU nor the build supports them, it returns false without hashing
+	// anything
+	TORRENT_EXTRA_EXPORT void SHA1_update_sw(sha1_ctx* context
+		, std::uint8_t const* data, size_t len);
+	TORRENT_EXTRA_EXPORT bool SHA1_update_hw(sha1_ctx* context
+		, std::uint8_t const* data, size_t len);
 	TORRENT_EXTRA_EXPORT void SHA1_final(std::uint8_t* digest, sha1_ctx* context);
 }
 
@@ -42,6 +42,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/fwd.hpp"
 #include "libtorrent/aux_/disk_job_fence.hpp"
 #include "libtorrent/aux_/storage_piece_set.hpp"
+#include "libtorrent/aux_/read_stream_detector.hpp"
+#include "libtorrent/aux_/verification_cache.hpp"
 #include "libtorrent/storage_defs.hpp"
 #include "libtorrent/allocator.hpp"
 #include "libtorrent/part_file.hpp"
@@ -128,7 +130,7 @@ POSSIBILITY OF SUCH DAMAGE.
 //	}
 namespace libtorrent {
 
-	namespace aux { struct session_settings; }
+	namespace aux { struct session_settings; struct file_mapping; }
 
 	// The storage interface is a pure virtual class that can be implemented to
 	// customize how and where data for a torrent is stored. The default storage
@@ -313,6 +315,42 @@ namespace libtorrent {
 		// off again.
 		virtual bool tick() { return false; }
 
+		// storages that keep their files in memory (e.g. memory mapped) can
+		// serve read jobs without copying the data into a disk buffer.
+		// ``read_view()`` returns a pointer to ``size`` bytes at ``offset``
+		// into ``piece``, or nullptr if this range can't be served that way (in
+		// which case it's read with readv()). ``cookie`` is set to a negative
+		// number identifying the view. The memory must stay valid until
+		// ``release_view()`` is called with that cookie. ``has_read_views()``
+		// returns true if ``read_view()`` may succeed, in which case reads
+		// for this storage bypass the read cache.
+		virtual bool has_read_views() const { return false; }
+		virtual char* read_view(piece_index_t, int /* offset */, int /* size */
+			, std::int32_t& /* cookie */, storage_error&) { return nullptr; }
+		virtual void release_view(std::int32_t /* cookie */) {}
+
+		// storages keeping blocks in regular files may let them be sent straight
+		// out of the file, rather than having them read into a disk buffer first.
+		// ``file_for_block()`` returns the file holding ``size`` bytes at
+		// ``offset`` into ``piece`` and sets ``file_offset`` to where in the
+		// file they are, or nullptr if the range can't be served that way (in
+		// which case it's read with readv()). The range is expected to be in the
+		// page cache when this returns.
+		virtual file_handle file_for_block(piece_index_t, int /* offset */
+			, int /* size */, std::int64_t& /* file_offset */, storage_error&)
+		{ return file_handle(); }
+
+		// storages may remember the hashes of their pieces as they are on
+		// disk, to not have to read them again when checking the files.
+		// ``piece_hashed()`` is called every time the hash of a piece has been
+		// computed. ``on_disk`` is true if it was computed from data read from
+		// disk, rather than from blocks in the cache that may not have been
+		// written yet. If ``cached_piece_hash()`` returns true, ``h`` is the
+		// hash of the piece as it is on disk.
+		virtual void piece_hashed(piece_index_t, sha1_hash const&
+			, bool /* on_disk */) {}
+		virtual bool cached_piece_hash(piece_index_t, sha1_hash&) { return false; }
+
 		file_storage const& files() const { return m_files; }
 
 		bool set_need_tick()
@@ -348,6 +386,30 @@ namespace libtorrent {
 			return --m_references;
 		}
 		void inc_refcount() { ++m_references; }
+
+		// the read requests against this storage, used by the disk thread
+		// to size the read-ahead
+		aux::read_stream_detector& read_streams() { return m_read_streams; }
+
+		// the number of bytes copied, and the number of bytes to copy, by a
+		// move_storage() that copies files to another filesystem. The total
+		// is 0 when no files are being copied. This is read by the torrent
+		// while the move is in progress, to post storage_move_progress_alert
+		std::pair<std::int64_t, std::int64_t> move_progress() const
+		{
+			std::lock_guard<std::mutex> l(m_move_progress_mutex);
+			return { m_move_copied, m_move_total };
+		}
+
+	protected:
+
+		void set_move_progress(std::int64_t const copied, std::int64_t const total)
+		{
+			std::lock_guard<std::mutex> l(m_move_progress_mutex);
+			m_move_total = total;
+			m_move_copied = copied;
+		}
+
 	private:
 
 		bool m_need_tick = false;
@@ -365,6 +427,14 @@ namespace libtorrent {
 
 		// the number of block_cache_reference objects referencing this storage
 		std::atomic<int> m_references{1};
+
+		aux::read_stream_detector m_read_streams;
+
+		// the two are updated together, so a reader never sees the bytes
+		// copied of one move against the total of another
+		mutable std::mutex m_move_progress_mutex;
+		std::int64_t m_move_copied = 0;
+		std::int64_t m_move_total = 0;
 	};
 
 	// The default implementation of storage_interface. Behaves as a normal
@@ -386,6 +456,9 @@ namespace libtorrent {
 		// this is used to treat files with priority 0 slightly differently.
 		explicit default_storage(storage_params const& params, file_pool&);
 
+		// hidden
+		default_storage(storage_params const& params, file_pool&, bool memory_mapped);
+
 		// hidden
 		~default_storage() override;
 
@@ -409,6 +482,17 @@ namespace libtorrent {
 		int writev(span<iovec_t const> bufs
 			, piece_index_t piece, int offset, open_mode_t flags, storage_error& ec) override;
 
+		bool has_read_views() const override;
+		char* read_view(piece_index_t piece, int offset, int size
+			, std::int32_t& cookie, storage_error& ec) override;
+		void release_view(std::int32_t cookie) override;
+		file_handle file_for_block(piece_index_t piece, int offset, int size
+			, std::int64_t& file_offset, storage_error& ec) override;
+
+		void piece_hashed(piece_index_t piece, sha1_hash const& h
+			, bool on_disk) override;
+		bool cached_piece_hash(piece_index_t piece, sha1_hash& h) override;
+
 		// if the files in this storage are mapped, returns the mapped
 		// file_storage, otherwise returns the original file_storage object.
 		file_storage const& files() const
@@ -435,6 +519,17 @@ namespace libtorrent {
 		bool use_partfile(file_index_t index) const;
 		void use_partfile(file_index_t index, bool b);
 
+#if TORRENT_HAVE_MMAP
+		// returns a read-only mapping of the given file that covers it up to
+		// ``end`` (or as much of it as exists), creating it if necessary
+		std::shared_ptr<aux::file_mapping> open_mapping(file_index_t file
+			, std::int64_t end, storage_error& ec);
+#endif
+
+		// drop all file mappings. Any view handed out by read_view() keeps its
+		// mapping alive until it's released
+		void close_mappings();
+
 		aux::vector<download_priority_t, file_index_t> m_file_priority;
 		std::string m_save_path;
 		std::string m_part_file_name;
@@ -457,6 +552,10 @@ namespace libtorrent {
 		// used for skipped files
 		std::unique_ptr<part_file> m_part_file;
 
+		// the hashes of the pieces as they are on disk, saved next to the
+		// files. Only used if settings_pack::use_verification_cache is set
+		aux::verification_cache m_verification_cache;
+
 		// this is a bitfield with one bit per file. A bit being set means
 		// we've written to that file previously. If we do write to a file
 		// whose bit is 0, we set the file size, to make the file allocated
@@ -466,6 +565,20 @@ namespace libtorrent {
 		mutable typed_bitfield<file_index_t> m_file_created;
 
 		bool m_allocate_files;
+
+		// when set, files are read and written through memory mappings rather
+		// than through the file_pool handles. See mmap_storage_constructor()
+		bool const m_use_mmap;
+
+#if TORRENT_HAVE_MMAP
+		std::mutex m_mapping_mutex;
+		aux::vector<std::shared_ptr<aux::file_mapping>, file_index_t> m_mappings;
+
+		// mappings referenced by outstanding read views. The cookie of a view
+		// is -(slot + 1)
+		std::vector<std::shared_ptr<aux::file_mapping>> m_views;
+		std::vector<int> m_free_view_slots;
+#endif
 	};
 
 }
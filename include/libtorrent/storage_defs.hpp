@@ -135,6 +135,21 @@ namespace libtorrent {
 	TORRENT_EXPORT storage_interface* disabled_storage_constructor(storage_params const&, file_pool&);
 
 	TORRENT_EXPORT storage_interface* zero_storage_constructor(storage_params const&, file_pool&);
+
+	// the constructor function for a default_storage that reads its files
+	// through shared memory mappings rather than read calls. Reads are served
+	// straight out of the page cache, bypassing libtorrent's read cache and
+	// disk buffers, leaving it to the kernel to manage what stays in memory.
+	// This is primarily useful for seeding, with
+	// ``settings_pack::use_read_cache`` turned off. Writes still use regular
+	// write calls, so that a full disk is reported as an error. If a mapped
+	// file is truncated by another process while it's being read, the
+	// process receives SIGBUS.
+	//
+	// On platforms without mmap(), and on 32 bit systems (where whole-file
+	// mappings would exhaust the address space), this is the same as
+	// default_storage_constructor().
+	TORRENT_EXPORT storage_interface* mmap_storage_constructor(storage_params const&, file_pool&);
 }
 
 #endif
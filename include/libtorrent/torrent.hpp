@@ -437,6 +437,8 @@ namespace libtorrent {
 		void read_piece(piece_index_t piece);
 		void on_disk_read_complete(disk_buffer_holder block, disk_job_flags_t, storage_error const& se
 			, peer_request const& r, std::shared_ptr<read_piece_struct> rp);
+		void prefetch_suggested_pieces();
+		void on_piece_prefetched(disk_buffer_holder, disk_job_flags_t, storage_error const&);
 
 		storage_mode_t storage_mode() const;
 
@@ -1276,6 +1278,10 @@ namespace libtorrent {
 		// us.
 		aux::suggest_piece m_suggest_pieces;
 
+		// the number of prefetch reads issued for pieces in m_suggest_pieces
+		// that haven't completed yet
+		int m_outstanding_prefetches = 0;
+
 		aux::vector<announce_entry> m_trackers;
 
 		// this list is sorted by time_critical_piece::deadline
@@ -284,6 +284,9 @@ namespace aux {
 		//
 		// Note that if you read multiple pieces, the read operations are not
 		// guaranteed to finish in the same order as you initiated them.
+		//
+		// The reads are time-critical disk jobs, they are scheduled ahead of
+		// reads on behalf of peers, writes and checking.
 		void read_piece(piece_index_t piece) const;
 
 		// Returns true if this piece has been completely downloaded, and false
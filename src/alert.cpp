@@ -2579,7 +2579,7 @@ namespace {
 		"dht_pkt", "dht_get_peers_reply", "dht_direct_response",
 		"picker_log", "session_error", "dht_live_nodes",
 		"session_stats_header", "dht_sample_infohashes",
-		"block_uploaded", "alerts_dropped"
+		"block_uploaded", "alerts_dropped", "storage_move_progress"
 		}};
 
 		TORRENT_ASSERT(alert_type >= 0);
@@ -2602,6 +2602,21 @@ namespace {
 		return ret;
 	}
 
+	storage_move_progress_alert::storage_move_progress_alert(aux::stack_allocator& alloc
+		, torrent_handle const& h, std::int64_t const copied, std::int64_t const total)
+		: torrent_alert(alloc, h)
+		, bytes_copied(copied)
+		, total_bytes(total)
+	{}
+
+	std::string storage_move_progress_alert::message() const
+	{
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), " storage move: copied %" PRId64 " of %" PRId64 " bytes"
+			, bytes_copied, total_bytes);
+		return torrent_alert::message() + msg;
+	}
+
 	// this will no longer be necessary in C++17
 	constexpr alert_category_t torrent_removed_alert::static_category;
 	constexpr alert_category_t read_piece_alert::static_category;
@@ -2690,6 +2705,7 @@ namespace {
 	constexpr alert_category_t dht_sample_infohashes_alert::static_category;
 	constexpr alert_category_t block_uploaded_alert::static_category;
 	constexpr alert_category_t alerts_dropped_alert::static_category;
+	constexpr alert_category_t storage_move_progress_alert::static_category;
 #if TORRENT_ABI_VERSION == 1
 	constexpr alert_category_t anonymous_mode_alert::static_category;
 	constexpr alert_category_t mmap_cache_alert::static_category;
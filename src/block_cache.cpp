@@ -174,6 +174,13 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+namespace {
+
+	// the blocks in the hash reorder window of a piece that hasn't been
+	// written to for this long may be evicted
+	seconds const hash_reorder_timeout(5);
+}
+
 #if DEBUG_CACHE
 void log_refcounts(cached_piece_entry const* pe)
 {
@@ -341,10 +348,30 @@ cached_piece_entry::~cached_piece_entry()
 
 block_cache::block_cache(io_service& ios
 	, std::function<void()> const& trigger_trim)
-	: disk_buffer_pool(ios, trigger_trim)
+	: m_own_pool(new disk_buffer_pool(ios, trigger_trim))
+	, m_pool(*m_own_pool)
+	, m_num_shards(1)
+	, m_last_cache_op(cache_miss)
+	, m_ghost_size(8)
+	, m_max_volatile_blocks(100)
+	, m_hash_reorder_window(16)
+	, m_max_storage_share(0)
+	, m_volatile_size(0)
+	, m_read_cache_size(0)
+	, m_write_cache_size(0)
+	, m_send_buffer_blocks(0)
+	, m_pinned_blocks(0)
+{
+}
+
+block_cache::block_cache(disk_buffer_pool& pool, int const num_shards)
+	: m_pool(pool)
+	, m_num_shards(std::max(num_shards, 1))
 	, m_last_cache_op(cache_miss)
 	, m_ghost_size(8)
 	, m_max_volatile_blocks(100)
+	, m_hash_reorder_window(16)
+	, m_max_storage_share(0)
 	, m_volatile_size(0)
 	, m_read_cache_size(0)
 	, m_write_cache_size(0)
@@ -568,6 +595,7 @@ void block_cache::try_evict_one_volatile()
 			--pe->num_blocks;
 			TORRENT_PIECE_ASSERT(m_read_cache_size > 0, pe);
 			--m_read_cache_size;
+			pe->storage->add_cached_blocks(-1);
 			TORRENT_PIECE_ASSERT(m_volatile_size > 0, pe);
 			--m_volatile_size;
 		}
@@ -742,6 +770,11 @@ cached_piece_entry* block_cache::add_dirty_block(disk_io_job* j)
 	b.buf = boost::get<disk_buffer_holder>(j->argument).release();
 
 	b.dirty = true;
+	// a block is out of order if there's a gap between it and the hash
+	// cursor, i.e. it can't be hashed until more blocks arrive
+	int const hash_cursor = pe->hash ? pe->hash->offset / default_block_size : 0;
+	b.out_of_order = block > hash_cursor
+		&& (pe->blocks[block - 1].buf == nullptr || pe->blocks[block - 1].out_of_order);
 	++pe->num_blocks;
 	++pe->num_dirty;
 	++m_write_cache_size;
@@ -787,6 +820,7 @@ bool block_cache::blocks_flushed(cached_piece_entry* pe, int const* flushed, int
 
 	m_write_cache_size -= num_flushed;
 	m_read_cache_size += num_flushed;
+	pe->storage->add_cached_blocks(num_flushed);
 	pe->num_dirty -= num_flushed;
 
 	update_cache_state(pe);
@@ -822,6 +856,7 @@ void block_cache::free_block(cached_piece_entry* pe, int block)
 	{
 		TORRENT_PIECE_ASSERT(m_read_cache_size > 0, pe);
 		--m_read_cache_size;
+		pe->storage->add_cached_blocks(-1);
 		if (pe->cache_state == cached_piece_entry::volatile_read_lru)
 		{
 			--m_volatile_size;
@@ -858,6 +893,7 @@ bool block_cache::evict_piece(cached_piece_entry* pe, tailqueue<disk_io_job>& jo
 		{
 			TORRENT_PIECE_ASSERT(m_read_cache_size > 0, pe);
 			--m_read_cache_size;
+			pe->storage->add_cached_blocks(-1);
 		}
 		else
 		{
@@ -996,71 +1032,91 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 		lru_list[2] = &m_lru[cached_piece_entry::read_lru2];
 	}
 
-	// end refers to which end of the ARC cache we're evicting
-	// from. The LFU or the LRU end
-	for (int end = 0; num > 0 && end < 3; ++end)
+	// the number of read cache blocks a single storage may hold before its
+	// blocks are evicted ahead of everyone else's. The first pass only evicts
+	// blocks from storages above this limit, to keep one big torrent from
+	// pushing every other torrent out of the cache
+	int const storage_limit = m_max_storage_share > 0
+		? std::max(1, int(std::int64_t(m_pool.max_size()) * m_max_storage_share / 100))
+		: -1;
+
+	for (int pass = storage_limit < 0 ? 1 : 0; num > 0 && pass < 2; ++pass)
 	{
-		// iterate over all blocks in order of last being used (oldest first) and
-		// as long as we still have blocks to evict TODO: it's somewhat expensive
-		// to iterate over this linked list. Presumably because of the random
-		// access of memory. It would be nice if pieces with no evictable blocks
-		// weren't in this list
-		for (auto i = lru_list[end]->iterate(); i.get() && num > 0;)
+		// end refers to which end of the ARC cache we're evicting
+		// from. The LFU or the LRU end
+		for (int end = 0; num > 0 && end < 3; ++end)
 		{
-			cached_piece_entry* pe = i.get();
-			TORRENT_PIECE_ASSERT(pe->in_use, pe);
-			i.next();
+			// iterate over all blocks in order of last being used (oldest first) and
+			// as long as we still have blocks to evict TODO: it's somewhat expensive
+			// to iterate over this linked list. Presumably because of the random
+			// access of memory. It would be nice if pieces with no evictable blocks
+			// weren't in this list
+			for (auto i = lru_list[end]->iterate(); i.get() && num > 0;)
+			{
+				cached_piece_entry* pe = i.get();
+				TORRENT_PIECE_ASSERT(pe->in_use, pe);
+				i.next();
 
-			if (pe == ignore)
-				continue;
+				if (pe == ignore)
+					continue;
 
-			if (pe->ok_to_evict() && pe->num_blocks == 0)
-			{
+				// the most blocks to evict from this piece
+				int to_evict = num;
+				if (pass == 0)
+				{
+					to_evict = std::min(num, pe->storage->num_cached_blocks() - storage_limit);
+					if (to_evict <= 0) continue;
+				}
+
+				if (pe->ok_to_evict() && pe->num_blocks == 0)
+				{
 #if TORRENT_USE_INVARIANT_CHECKS
-				for (int j = 0; j < pe->blocks_in_piece; ++j)
-					TORRENT_PIECE_ASSERT(pe->blocks[j].buf == nullptr, pe);
+					for (int j = 0; j < pe->blocks_in_piece; ++j)
+						TORRENT_PIECE_ASSERT(pe->blocks[j].buf == nullptr, pe);
 #endif
-				TORRENT_PIECE_ASSERT(pe->refcount == 0, pe);
-				move_to_ghost(pe);
-				continue;
-			}
+					TORRENT_PIECE_ASSERT(pe->refcount == 0, pe);
+					move_to_ghost(pe);
+					continue;
+				}
 
-			TORRENT_PIECE_ASSERT(pe->num_dirty == 0, pe);
+				TORRENT_PIECE_ASSERT(pe->num_dirty == 0, pe);
 
-			// all blocks are pinned in this piece, skip it
-			if (pe->num_blocks <= pe->pinned) continue;
+				// all blocks are pinned in this piece, skip it
+				if (pe->num_blocks <= pe->pinned) continue;
 
-			// go through the blocks and evict the ones that are not dirty and not
-			// referenced
-			int removed = 0;
-			for (int j = 0; j < pe->blocks_in_piece && num > 0; ++j)
-			{
-				cached_block_entry& b = pe->blocks[j];
+				// go through the blocks and evict the ones that are not dirty and not
+				// referenced
+				int removed = 0;
+				for (int j = 0; j < pe->blocks_in_piece && removed < to_evict; ++j)
+				{
+					cached_block_entry& b = pe->blocks[j];
 
-				if (b.buf == nullptr || b.refcount > 0 || b.dirty || b.pending) continue;
+					if (b.buf == nullptr || b.refcount > 0 || b.dirty || b.pending) continue;
 
-				to_delete[num_to_delete++] = b.buf;
-				b.buf = nullptr;
-				TORRENT_PIECE_ASSERT(pe->num_blocks > 0, pe);
-				--pe->num_blocks;
-				++removed;
-				--num;
-			}
+					to_delete[num_to_delete++] = b.buf;
+					b.buf = nullptr;
+					TORRENT_PIECE_ASSERT(pe->num_blocks > 0, pe);
+					--pe->num_blocks;
+					++removed;
+					--num;
+				}
 
-			TORRENT_PIECE_ASSERT(m_read_cache_size >= removed, pe);
-			m_read_cache_size -= removed;
-			if (pe->cache_state == cached_piece_entry::volatile_read_lru)
-			{
-				m_volatile_size -= removed;
-			}
+				TORRENT_PIECE_ASSERT(m_read_cache_size >= removed, pe);
+				m_read_cache_size -= removed;
+				pe->storage->add_cached_blocks(-removed);
+				if (pe->cache_state == cached_piece_entry::volatile_read_lru)
+				{
+					m_volatile_size -= removed;
+				}
 
-			if (pe->ok_to_evict() && pe->num_blocks == 0)
-			{
+				if (pe->ok_to_evict() && pe->num_blocks == 0)
+				{
 #if TORRENT_USE_INVARIANT_CHECKS
-				for (int j = 0; j < pe->blocks_in_piece; ++j)
-					TORRENT_PIECE_ASSERT(pe->blocks[j].buf == nullptr, pe);
+					for (int j = 0; j < pe->blocks_in_piece; ++j)
+						TORRENT_PIECE_ASSERT(pe->blocks[j].buf == nullptr, pe);
 #endif
-				move_to_ghost(pe);
+					move_to_ghost(pe);
+				}
 			}
 		}
 	}
@@ -1075,8 +1131,14 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 	// TODO: this should probably only be done every n:th time
 	if (num > 0 && m_read_cache_size > m_pinned_blocks)
 	{
+		time_point const now = aux::time_now();
 		for (int pass = 0; pass < 2 && num > 0; ++pass)
 		{
+			// the number of blocks in hash reorder windows that may still be
+			// kept. Without a limit, many pieces downloaded in parallel could
+			// pin a large part of the cache
+			int reorder_budget = std::max(0, m_pool.max_size() / 4);
+
 			for (auto i = m_lru[cached_piece_entry::write_lru].iterate(); i.get() && num > 0;)
 			{
 				cached_piece_entry* pe = i.get();
@@ -1109,6 +1171,16 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 				if (pass == 0 && pe->hash)
 					end = pe->hash->offset / default_block_size;
 
+				// the blocks just past the hash cursor are kept, since they
+				// are hashed as soon as the gap in front of them is filled in,
+				// evicting them would make the hasher read them back from disk.
+				// Only pieces still being written to are protected, a piece
+				// whose gap isn't filled in soon may never be
+				int const window_start = pe->hash
+					? pe->hash->offset / default_block_size : end;
+				int const window_end = now - pe->expire < hash_reorder_timeout
+					? window_start + m_hash_reorder_window : window_start;
+
 				// go through the blocks and evict the ones
 				// that are not dirty and not referenced
 				int removed = 0;
@@ -1117,6 +1189,11 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 					cached_block_entry& b = pe->blocks[j];
 
 					if (b.buf == nullptr || b.refcount > 0 || b.dirty || b.pending) continue;
+					if (j >= window_start && j < window_end && reorder_budget > 0)
+					{
+						--reorder_budget;
+						continue;
+					}
 
 					to_delete[num_to_delete++] = b.buf;
 					b.buf = nullptr;
@@ -1128,6 +1205,7 @@ int block_cache::try_evict_blocks(int num, cached_piece_entry* ignore)
 
 				TORRENT_PIECE_ASSERT(m_read_cache_size >= removed, pe);
 				m_read_cache_size -= removed;
+				pe->storage->add_cached_blocks(-removed);
 				if (pe->cache_state == cached_piece_entry::volatile_read_lru)
 				{
 					m_volatile_size -= removed;
@@ -1295,11 +1373,13 @@ void block_cache::insert_blocks(cached_piece_entry* pe, int block, span<iovec_t
 		else
 		{
 			pe->blocks[block].buf = buf.data();
+			pe->blocks[block].out_of_order = false;
 
 			TORRENT_PIECE_ASSERT(buf.data() != nullptr, pe);
 			TORRENT_PIECE_ASSERT(pe->blocks[block].dirty == false, pe);
 			++pe->num_blocks;
 			++m_read_cache_size;
+			pe->storage->add_cached_blocks(1);
 			if (j->flags & disk_interface::volatile_read) ++m_volatile_size;
 
 			if (flags & blocks_inc_refcount)
@@ -1446,6 +1526,7 @@ int block_cache::drain_piece_bufs(cached_piece_entry& p, std::vector<char*>& buf
 
 	TORRENT_ASSERT(m_read_cache_size >= removed_clean);
 	m_read_cache_size -= removed_clean;
+	p.storage->add_cached_blocks(-removed_clean);
 	if (p.cache_state == cached_piece_entry::volatile_read_lru)
 	{
 		m_volatile_size -= removed_clean;
@@ -1493,11 +1574,21 @@ void block_cache::set_settings(aux::session_settings const& sett)
 	// assumption is that there are about 128 blocks per piece,
 	// and there are two ghost lists, so divide by 2.
 
+	// when the pool is shared with other shards, each shard gets its share
+	// of the ghost lists and volatile blocks.
+
 	m_ghost_size = std::max(8, sett.get_int(settings_pack::cache_size)
-		/ std::max(sett.get_int(settings_pack::read_cache_line_size), 4) / 2);
+		/ std::max(sett.get_int(settings_pack::read_cache_line_size), 4) / 2
+		/ m_num_shards);
+
+	m_hash_reorder_window = sett.get_int(settings_pack::hash_reorder_window);
+	m_max_storage_share = std::max(0, std::min(100
+		, sett.get_int(settings_pack::max_torrent_cache_share)));
 
 	m_max_volatile_blocks = sett.get_int(settings_pack::cache_size_volatile);
-	disk_buffer_pool::set_settings(sett);
+	if (m_max_volatile_blocks > 0)
+		m_max_volatile_blocks = std::max(1, m_max_volatile_blocks / m_num_shards);
+	if (m_own_pool) m_pool.set_settings(sett);
 }
 
 #if TORRENT_USE_INVARIANT_CHECKS
@@ -1551,6 +1642,7 @@ void block_cache::check_invariant() const
 
 	for (auto s : storages)
 	{
+		std::lock_guard<std::mutex> l(s->piece_mutex());
 		for (auto const& pe : s->cached_pieces())
 		{
 			TORRENT_PIECE_ASSERT(pe.storage.get() == s, &pe);
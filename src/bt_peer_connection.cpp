@@ -2248,6 +2248,44 @@ namespace {
 	{
 		INVARIANT_CHECK;
 
+		write_piece_header(r);
+
+		if (buffer.is_mutable())
+		{
+			append_send_buffer(std::move(buffer), r.length);
+		}
+		else
+		{
+			append_const_send_buffer(std::move(buffer), r.length);
+		}
+
+		piece_written(r);
+	}
+
+	void bt_peer_connection::write_piece_file(peer_request const& r, file_range range)
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASSERT(can_send_file());
+
+		write_piece_header(r);
+		append_send_file(std::move(range));
+		piece_written(r);
+	}
+
+	bool bt_peer_connection::can_send_file() const
+	{
+#if TORRENT_USE_SENDFILE
+#if !defined TORRENT_DISABLE_ENCRYPTION
+		if (!m_enc_handler.is_send_plaintext()) return false;
+#endif
+		return get_socket()->get<tcp::socket>() != nullptr;
+#else
+		return false;
+#endif
+	}
+
+	void bt_peer_connection::write_piece_header(peer_request const& r)
+	{
 		TORRENT_ASSERT(m_sent_handshake);
 		TORRENT_ASSERT(m_sent_bitfield);
 
@@ -2303,15 +2341,12 @@ namespace {
 		{
 			send_buffer({msg, 13});
 		}
+	}
 
-		if (buffer.is_mutable())
-		{
-			append_send_buffer(std::move(buffer), r.length);
-		}
-		else
-		{
-			append_const_send_buffer(std::move(buffer), r.length);
-		}
+	void bt_peer_connection::piece_written(peer_request const& r)
+	{
+		std::shared_ptr<torrent> t = associated_torrent().lock();
+		TORRENT_ASSERT(t);
 
 		m_payloads.emplace_back(send_buffer_size() - r.length, r.length);
 		setup_send();
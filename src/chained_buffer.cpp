@@ -47,7 +47,8 @@ namespace libtorrent {
 			buffer_t& b = m_vec.front();
 			if (b.used_size > bytes_to_pop)
 			{
-				b.buf += bytes_to_pop;
+				if (b.buf == nullptr) b.file_offset += bytes_to_pop;
+				else b.buf += bytes_to_pop;
 				b.used_size -= bytes_to_pop;
 				b.size -= bytes_to_pop;
 				m_capacity -= bytes_to_pop;
@@ -69,6 +70,46 @@ namespace libtorrent {
 		}
 	}
 
+	void chained_buffer::append_file(std::shared_ptr<file> f
+		, std::int64_t const offset, int const size)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(!m_destructed);
+		TORRENT_ASSERT(f);
+		TORRENT_ASSERT(size > 0);
+		using holder_t = std::shared_ptr<file>;
+		static_assert(sizeof(holder_t) <= sizeof(buffer_t::holder), "file holder too large");
+
+		m_vec.emplace_back();
+		buffer_t& b = m_vec.back();
+		b.buf = nullptr;
+		b.size = size;
+		b.used_size = size;
+		b.file_offset = offset;
+		b.destruct_holder = [](void* holder)
+		{ reinterpret_cast<holder_t*>(holder)->~holder_t(); };
+#if TORRENT_CPP98_DEQUE
+		b.move_holder = [](void* dst, void* src)
+		{ new (dst) holder_t(std::move(*reinterpret_cast<holder_t*>(src))); };
+#endif
+		new (&b.holder) holder_t(std::move(f));
+
+		m_bytes += size;
+		TORRENT_ASSERT(m_capacity < (std::numeric_limits<int>::max)() - size);
+		m_capacity += size;
+	}
+
+	file const* chained_buffer::front_file(std::int64_t& offset, int& size) const
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(!m_destructed);
+		if (m_vec.empty() || m_vec.front().buf != nullptr) return nullptr;
+		buffer_t const& b = m_vec.front();
+		offset = b.file_offset;
+		size = b.used_size;
+		return reinterpret_cast<std::shared_ptr<file> const*>(&b.holder)->get();
+	}
+
 	// returns the number of bytes available at the
 	// end of the last chained buffer.
 	int chained_buffer::space_in_last_buffer()
@@ -77,7 +118,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(!m_destructed);
 		if (m_vec.empty()) return 0;
 		buffer_t& b = m_vec.back();
-		TORRENT_ASSERT(b.buf != nullptr);
+		// nothing can be appended to a file entry
+		if (b.buf == nullptr) return 0;
 		return b.size - b.used_size;
 	}
 
@@ -103,7 +145,7 @@ namespace libtorrent {
 		TORRENT_ASSERT(!m_destructed);
 		if (m_vec.empty()) return nullptr;
 		buffer_t& b = m_vec.back();
-		TORRENT_ASSERT(b.buf != nullptr);
+		if (b.buf == nullptr) return nullptr;
 		char* const insert = b.buf + b.used_size;
 		if (insert + s > b.buf + b.size) return nullptr;
 		b.used_size += s;
@@ -133,7 +175,8 @@ namespace libtorrent {
 		TORRENT_ASSERT(!m_destructed);
 		for (auto i = m_vec.begin(), end(m_vec.end()); bytes > 0 && i != end; ++i)
 		{
-			TORRENT_ASSERT(i->buf != nullptr);
+			// the contents of files are not sent through iovecs
+			if (i->buf == nullptr) break;
 			if (i->used_size > bytes)
 			{
 				TORRENT_ASSERT(bytes > 0);
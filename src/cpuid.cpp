@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/cpuid.hpp"
 
 #include <cstdint>
+#include <cstring> // for std::memset
 
 #if defined _MSC_VER && TORRENT_HAS_SSE
 #include <intrin.h>
@@ -42,8 +43,6 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #if TORRENT_HAS_SSE && defined __GNUC__
 #include <cpuid.h>
-#else
-#include <cstring> // for std::memset
 #endif
 
 #if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 16))
@@ -90,6 +89,39 @@ namespace libtorrent { namespace aux {
 		TORRENT_UNUSED(type);
 		// for non-x86 and non-amd64, just return zeroes
 		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+#endif
+	}
+
+	// the structured extended feature flags (leaf 7, sub-leaf 0)
+	void cpuid_extended_features(std::uint32_t* info)
+	{
+		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+#if defined _MSC_VER
+		int max_leaf[4];
+		__cpuid(max_leaf, 0);
+		if (max_leaf[0] >= 7) __cpuidex((int*)info, 7, 0);
+#elif defined __GNUC__
+		if (__get_cpuid_max(0, nullptr) >= 7)
+			__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	// returns the register state the operating system saves on context
+	// switches (XCR0). Wider registers are only usable if they are saved
+	std::uint64_t os_saved_state()
+	{
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		// OSXSAVE
+		if ((cpui[2] & (1 << 27)) == 0) return 0;
+#if defined _MSC_VER
+		return _xgetbv(0);
+#elif defined __GNUC__
+		std::uint32_t eax, edx;
+		__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (std::uint64_t(edx) << 32) | eax;
+#else
+		return 0;
 #endif
 	}
 #endif
@@ -116,6 +148,59 @@ namespace libtorrent { namespace aux {
 #endif
 	}
 
+	bool supports_sse2()
+	{
+#if TORRENT_HAS_SSE
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		return (cpui[3] & (1 << 26)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_avx2()
+	{
+#if TORRENT_HAS_SSE
+		// XMM and YMM state
+		if ((os_saved_state() & 0x6) != 0x6) return false;
+		std::uint32_t cpui[4] = {0};
+		cpuid_extended_features(cpui);
+		return (cpui[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_avx512()
+	{
+#if TORRENT_HAS_SSE
+		// XMM, YMM, opmask and ZMM state
+		if ((os_saved_state() & 0xe6) != 0xe6) return false;
+		std::uint32_t cpui[4] = {0};
+		cpuid_extended_features(cpui);
+		// AVX512F
+		return (cpui[1] & (1 << 16)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_sha_ni()
+	{
+#if TORRENT_HAS_SSE
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		// SSSE3 and SSE4.1
+		if ((cpui[2] & ((1 << 9) | (1 << 19))) != ((1 << 9) | (1 << 19)))
+			return false;
+		cpuid_extended_features(cpui);
+		return (cpui[1] & (1 << 29)) != 0;
+#else
+		return false;
+#endif
+	}
+
 	bool supports_arm_neon()
 	{
 #if TORRENT_HAS_ARM_NEON && TORRENT_HAS_AUXV
@@ -150,10 +235,25 @@ namespace libtorrent { namespace aux {
 #endif
 	}
 
+	bool supports_arm_sha1()
+	{
+#if TORRENT_HAS_ARM_SHA1 && TORRENT_HAS_AUXV
+		//return (getauxval(AT_HWCAP) & HWCAP_SHA1);
+		return (helper_getauxval(16) & (1 << 5));
+#else
+		return false;
+#endif
+	}
+
 	} // anonymous namespace
 
 	bool const sse42_support = supports_sse42();
 	bool const mmx_support = supports_mmx();
+	bool const sse2_support = supports_sse2();
+	bool const avx2_support = supports_avx2();
+	bool const avx512_support = supports_avx512();
+	bool const sha_ni_support = supports_sha_ni();
 	bool const arm_neon_support = supports_arm_neon();
 	bool const arm_crc32c_support = supports_arm_crc32c();
+	bool const arm_sha1_support = supports_arm_sha1();
 } }
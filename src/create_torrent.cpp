@@ -33,19 +33,25 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/create_torrent.hpp"
 #include "libtorrent/utf8.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_to_wstring
-#include "libtorrent/disk_io_thread.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/bitfield.hpp"
 #include "libtorrent/aux_/merkle.hpp" // for merkle_*()
 #include "libtorrent/torrent_info.hpp"
 #include "libtorrent/announce_entry.hpp"
-#include "libtorrent/performance_counters.hpp" // for counters
-#include "libtorrent/alert_manager.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/sha1_mb.hpp"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 using namespace std::placeholders;
 
@@ -162,44 +168,6 @@ namespace {
 		}
 	}
 
-	struct hash_state
-	{
-		create_torrent& ct;
-		storage_holder storage;
-		disk_io_thread& iothread;
-		piece_index_t piece_counter;
-		piece_index_t completed_piece;
-		std::function<void(piece_index_t)> const& f;
-		error_code& ec;
-	};
-
-	void on_hash(piece_index_t const piece, sha1_hash const& piece_hash
-		, storage_error const& error, hash_state* st)
-	{
-		if (error)
-		{
-			// on error
-			st->ec = error.ec;
-			st->iothread.abort(true);
-			return;
-		}
-		st->ct.set_hash(piece, piece_hash);
-		st->f(st->completed_piece);
-		++st->completed_piece;
-		if (st->piece_counter < st->ct.files().end_piece())
-		{
-			st->iothread.async_hash(st->storage, st->piece_counter
-				, disk_interface::sequential_access
-				, std::bind(&on_hash, _1, _2, _3, st));
-			++st->piece_counter;
-		}
-		else
-		{
-			st->iothread.abort(true);
-		}
-		st->iothread.submit_jobs();
-	}
-
 } // anonymous namespace
 
 #if TORRENT_ABI_VERSION == 1
@@ -248,29 +216,195 @@ namespace {
 	}
 
 namespace {
-	struct disk_aborter
+
+	// state shared by the threads hashing the pieces of a torrent being
+	// created. Pieces are handed out in batches of consecutive pieces, the
+	// hashes are collected here and picked up, in order, by the thread that
+	// called set_piece_hashes()
+	struct hash_pipeline
+	{
+		hash_pipeline(file_storage const& f, std::string const& p
+			, int const batch_size)
+			: fs(f)
+			, path(p)
+			, pieces_per_batch(batch_size)
+		{
+			hashes.resize(f.num_pieces());
+			done.resize(f.num_pieces(), false);
+		}
+
+		file_storage const& fs;
+		std::string const& path;
+		int const pieces_per_batch;
+
+		std::atomic<int> next_batch{0};
+		std::atomic<bool> abort{false};
+
+		std::mutex mutex;
+		std::condition_variable cond;
+
+		// the hash of a piece is valid once its bit is set in done. Both are
+		// protected by mutex
+		aux::vector<sha1_hash, piece_index_t> hashes;
+		typed_bitfield<piece_index_t> done;
+		error_code error;
+
+		void fail(error_code const& ec)
+		{
+			std::lock_guard<std::mutex> l(mutex);
+			if (!error) error = ec;
+			abort = true;
+			cond.notify_all();
+		}
+	};
+
+	// the file a hash_worker is currently reading from. Batches are made of
+	// consecutive pieces, so holding on to the last file is enough to not
+	// re-open it for every batch
+	struct open_file
 	{
-		explicit disk_aborter(disk_io_thread& dio) : m_dio(dio) {}
-		~disk_aborter() { m_dio.abort(true); }
-		disk_aborter(disk_aborter const&) = delete;
-		disk_aborter& operator=(disk_aborter const&) = delete;
-	private:
-		disk_io_thread& m_dio;
+		file_index_t index{-1};
+		std::unique_ptr<file> handle;
+		std::int64_t size = 0;
 	};
+
+	bool open_for_hashing(hash_pipeline& st, open_file& of
+		, file_index_t const index, error_code& ec)
+	{
+		if (of.index == index) return true;
+
+		of = open_file();
+		std::string const file_path = st.fs.file_path(index, st.path);
+		of.handle.reset(new file(file_path
+			, open_mode::read_only | open_mode::no_atime, ec));
+		if (ec) return false;
+		of.size = of.handle->get_size(ec);
+		if (ec) return false;
+		if (of.size < st.fs.file_size(index))
+		{
+			ec = errors::file_too_short;
+			return false;
+		}
+		of.index = index;
+		return true;
+	}
+
+	// reads the range [first, last) of pieces into buf with one read per file.
+	// Files are deliberately not memory mapped. A file truncated while it's
+	// being hashed would raise SIGBUS on a mapping, a read just comes up short
+	void read_batch(hash_pipeline& st, open_file& of, piece_index_t const first
+		, int const size, std::vector<char>& buf, error_code& ec)
+	{
+		buf.resize(std::size_t(size));
+		char* dst = buf.data();
+		for (file_slice const& s : st.fs.map_block(first, 0, size))
+		{
+			if (s.size == 0) continue;
+			if (st.fs.pad_file_at(s.file_index))
+			{
+				std::memset(dst, 0, std::size_t(s.size));
+				dst += s.size;
+				continue;
+			}
+
+			if (!open_for_hashing(st, of, s.file_index, ec)) return;
+
+			std::int64_t offset = s.offset;
+			std::int64_t left = s.size;
+			while (left > 0)
+			{
+				iovec_t const b = { dst, std::size_t(left) };
+				std::int64_t const ret = of.handle->readv(offset, b, ec);
+				if (ec) return;
+				if (ret <= 0)
+				{
+					ec = errors::file_too_short;
+					return;
+				}
+				dst += ret;
+				offset += ret;
+				left -= ret;
+			}
+		}
+	}
+
+	void hash_worker(hash_pipeline& st)
+	{
+		file_storage const& fs = st.fs;
+		piece_index_t const end_piece = fs.end_piece();
+
+		open_file of;
+		std::vector<char> buf;
+		std::vector<span<char const>> bufs;
+		std::vector<int> piece_bufs;
+		std::vector<aux::sha1_mb_message> msgs;
+		std::vector<sha1_hash> hashes;
+
+		while (!st.abort)
+		{
+			int const batch = st.next_batch++;
+			if (batch >= (static_cast<int>(end_piece) + st.pieces_per_batch - 1)
+				/ st.pieces_per_batch)
+				break;
+
+			piece_index_t const first(batch * st.pieces_per_batch);
+			piece_index_t const last(std::min(static_cast<int>(first)
+				+ st.pieces_per_batch, static_cast<int>(end_piece)));
+
+			error_code ec;
+			bufs.clear();
+			piece_bufs.clear();
+			int const batch_size = int(std::min(std::int64_t(fs.piece_length())
+				* (static_cast<int>(last) - static_cast<int>(first))
+				, fs.total_size() - std::int64_t(static_cast<int>(first)) * fs.piece_length()));
+			read_batch(st, of, first, batch_size, buf, ec);
+			char const* ptr = buf.data();
+			for (piece_index_t i = first; i < last; ++i)
+			{
+				piece_bufs.push_back(int(bufs.size()));
+				bufs.emplace_back(ptr, std::size_t(fs.piece_size(i)));
+				ptr += fs.piece_size(i);
+			}
+
+			if (ec)
+			{
+				st.fail(ec);
+				return;
+			}
+
+			// bufs is complete, it's safe to refer into it now
+			piece_bufs.push_back(int(bufs.size()));
+			msgs.clear();
+			for (std::size_t i = 0; i + 1 < piece_bufs.size(); ++i)
+			{
+				msgs.push_back({span<span<char const> const>(bufs).subspan(
+					std::size_t(piece_bufs[i])
+					, std::size_t(piece_bufs[i + 1] - piece_bufs[i]))});
+			}
+			hashes.resize(msgs.size());
+			aux::sha1_mb(msgs, hashes);
+
+			std::lock_guard<std::mutex> l(st.mutex);
+			for (piece_index_t i = first; i < last; ++i)
+			{
+				st.hashes[i] = hashes[std::size_t(static_cast<int>(i) - static_cast<int>(first))];
+				st.done.set_bit(i);
+			}
+			st.cond.notify_all();
+		}
+	}
 }
 
 	void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec)
 	{
-		// optimized path
-#ifdef TORRENT_BUILD_SIMULATOR
-		sim::default_config conf;
-		sim::simulation sim{conf};
-		io_service ios{sim};
-#else
-		io_service ios;
-#endif
+		set_piece_hashes(t, p, f, 0, ec);
+	}
 
+	void set_piece_hashes(create_torrent& t, std::string const& p
+		, std::function<void(piece_index_t)> const& f, int num_threads
+		, error_code& ec)
+	{
 #if TORRENT_USE_UNC_PATHS
 		std::string const path = canonicalize_path(p);
 #else
@@ -289,50 +423,64 @@ namespace {
 			return;
 		}
 
-		counters cnt;
-		disk_io_thread disk_thread(ios, cnt);
-		disk_aborter da(disk_thread);
-
-		aux::vector<download_priority_t, file_index_t> priorities;
-		sha1_hash info_hash;
-		storage_params params{
-			t.files(),
-			nullptr,
-			path,
-			storage_mode_t::storage_mode_sparse,
-			priorities,
-			info_hash
-		};
-
-		storage_holder storage = disk_thread.new_torrent(default_storage_constructor
-			, params, std::shared_ptr<void>());
-
-		settings_pack sett;
-		sett.set_int(settings_pack::cache_size, 0);
-		int const num_threads = disk_io_thread::hasher_thread_divisor - 1;
-		int const jobs_per_thread = 4;
-		sett.set_int(settings_pack::aio_threads, num_threads);
-
-		disk_thread.set_settings(&sett);
-
-		int const piece_read_ahead = std::max(num_threads * jobs_per_thread
-			, default_block_size / t.piece_length());
-
-		hash_state st = { t, std::move(storage), disk_thread, piece_index_t(0), piece_index_t(0), f, ec };
-		for (piece_index_t i(0); i < piece_index_t(piece_read_ahead); ++i)
+		file_storage const& fs = t.files();
+		int const num_pieces = fs.num_pieces();
+
+		if (num_threads <= 0)
+			num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+		// every batch is read into a buffer, with one large read per file. A
+		// batch is at least as many pieces as the multi-buffer hasher hashes
+		// in parallel, and at least 4 MiB, but no more than 16 MiB. But make
+		// sure every thread gets something to do
+		int batch = std::max(aux::sha1_mb_lanes(), (4 << 20) / fs.piece_length());
+		batch = std::min(batch, (16 << 20) / fs.piece_length());
+		batch = std::max(1, std::min(batch, (num_pieces + num_threads - 1) / num_threads));
+		num_threads = std::min(num_threads, (num_pieces + batch - 1) / batch);
+
+		hash_pipeline st(fs, path, batch);
+
+		std::vector<std::thread> threads;
+		threads.reserve(std::size_t(num_threads));
+
+		// the workers must be stopped and joined however we leave this
+		// function, including when set_hash() or the progress callback throws
+		// (which it may, for instance when it's a python function). Destructing
+		// a joinable std::thread would terminate the process
+		struct join_workers
 		{
-			disk_thread.async_hash(st.storage, i, disk_interface::sequential_access
-				, std::bind(&on_hash, _1, _2, _3, &st));
-			++st.piece_counter;
-			if (st.piece_counter >= t.files().end_piece()) break;
-		}
-		disk_thread.submit_jobs();
+			hash_pipeline& st;
+			std::vector<std::thread>& threads;
+			~join_workers()
+			{
+				{
+					std::lock_guard<std::mutex> l(st.mutex);
+					st.abort = true;
+					st.cond.notify_all();
+				}
+				for (auto& th : threads) th.join();
+			}
+		} const guard{st, threads};
 
-#ifdef TORRENT_BUILD_SIMULATOR
-		sim.run();
-#else
-		ios.run(ec);
-#endif
+		for (int i = 0; i < num_threads; ++i)
+			threads.emplace_back(&hash_worker, std::ref(st));
+
+		// set the hashes and report progress in piece order, as the pieces
+		// complete, on this thread
+		{
+			std::unique_lock<std::mutex> l(st.mutex);
+			for (piece_index_t i(0); i < fs.end_piece(); ++i)
+			{
+				st.cond.wait(l, [&] { return st.error || st.done.get_bit(i); });
+				if (st.error) break;
+				sha1_hash const h = st.hashes[i];
+				l.unlock();
+				t.set_hash(i, h);
+				f(i);
+				l.lock();
+			}
+			if (st.error) ec = st.error;
+		}
 	}
 
 	create_torrent::~create_torrent() = default;
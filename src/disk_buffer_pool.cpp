@@ -66,6 +66,10 @@ namespace libtorrent {
 		}
 	}
 
+	// the size of the slabs disk buffers are allocated from, in blocks. 2 MiB
+	// is the size of a huge page on x86-64
+	constexpr int blocks_per_slab = 2 * 1024 * 1024 / default_block_size;
+
 	} // anonymous namespace
 
 	disk_buffer_pool::disk_buffer_pool(io_service& ios
@@ -76,6 +80,9 @@ namespace libtorrent {
 		, m_trigger_cache_trim(trigger_trim)
 		, m_exceeded_max_size(false)
 		, m_ios(ios)
+#ifndef TORRENT_DEBUG_BUFFERS
+		, m_slabs(default_block_size, blocks_per_slab)
+#endif
 	{
 #if TORRENT_USE_ASSERTS
 		m_magic = 0x1337;
@@ -92,6 +99,16 @@ namespace libtorrent {
 
 	}
 
+	int disk_buffer_pool::num_reserved() const
+	{
+		std::unique_lock<std::mutex> l(m_pool_mutex);
+#ifdef TORRENT_DEBUG_BUFFERS
+		return m_in_use;
+#else
+		return m_slabs.num_reserved();
+#endif
+	}
+
 	int disk_buffer_pool::num_to_evict(int const num_needed)
 	{
 		int ret = 0;
@@ -113,10 +130,31 @@ namespace libtorrent {
 	// checks to see if we're no longer exceeding the high watermark,
 	// and if we're in fact below the low watermark. If so, we need to
 	// post the notification messages to the peers that are waiting for
-	// more buffers to received data into
+	// more buffers to received data into. It also gives back the memory of
+	// free blocks, if there are many of them
 	void disk_buffer_pool::check_buffer_level(std::unique_lock<std::mutex>& l)
 	{
 		TORRENT_ASSERT(l.owns_lock());
+
+#ifndef TORRENT_DEBUG_BUFFERS
+		// if a good part of the cache size is free blocks, e.g. because the
+		// cache size was lowered, give their memory back to the system.
+		// Blocks scattered across slabs keep the slabs from being unmapped
+		if (!m_trimming
+			&& m_slabs.num_untrimmed() > std::max(m_max_use / 4, blocks_per_slab))
+		{
+			// don't hold up other threads allocating and freeing buffers while
+			// making the system calls
+			m_trimming = true;
+			std::vector<aux::slab_allocator::trim_range> const ranges = m_slabs.begin_trim();
+			l.unlock();
+			aux::slab_allocator::drop_pages(ranges);
+			l.lock();
+			m_slabs.end_trim(ranges);
+			m_trimming = false;
+		}
+#endif
+
 		if (!m_exceeded_max_size || m_in_use > m_low_watermark) return;
 
 		m_exceeded_max_size = false;
@@ -135,13 +173,10 @@ namespace libtorrent {
 		TORRENT_ASSERT(l.owns_lock());
 		TORRENT_UNUSED(l);
 
-#if TORRENT_USE_INVARIANT_CHECKS
-		return m_buffers_in_use.count(buffer) == 1;
-#elif defined TORRENT_DEBUG_BUFFERS
+#ifdef TORRENT_DEBUG_BUFFERS
 		return page_in_use(buffer);
 #else
-		TORRENT_UNUSED(buffer);
-		return true;
+		return m_slabs.in_use(buffer);
 #endif
 	}
 
@@ -197,7 +232,6 @@ namespace libtorrent {
 					char* buf = j.data();
 					TORRENT_ASSERT(is_disk_buffer(buf, l));
 					free_buffer_impl(buf, l);
-					remove_buffer_in_use(buf);
 				}
 				return -1;
 			}
@@ -214,7 +248,6 @@ namespace libtorrent {
 			char* buf = i.data();
 			TORRENT_ASSERT(is_disk_buffer(buf, l));
 			free_buffer_impl(buf, l);
-			remove_buffer_in_use(buf);
 		}
 		check_buffer_level(l);
 	}
@@ -227,7 +260,11 @@ namespace libtorrent {
 		TORRENT_ASSERT(l.owns_lock());
 		TORRENT_UNUSED(l);
 
+#ifdef TORRENT_DEBUG_BUFFERS
 		char* ret = page_malloc(default_block_size);
+#else
+		char* ret = m_slabs.allocate();
+#endif
 
 		if (ret == nullptr)
 		{
@@ -238,19 +275,6 @@ namespace libtorrent {
 
 		++m_in_use;
 
-#if TORRENT_USE_INVARIANT_CHECKS
-		try
-		{
-			TORRENT_ASSERT(m_buffers_in_use.count(ret) == 0);
-			m_buffers_in_use.insert(ret);
-		}
-		catch (...)
-		{
-			free_buffer_impl(ret, l);
-			return nullptr;
-		}
-#endif
-
 		if (m_in_use >= m_low_watermark + (m_max_use - m_low_watermark)
 			/ 2 && !m_exceeded_max_size)
 		{
@@ -272,7 +296,6 @@ namespace libtorrent {
 		{
 			TORRENT_ASSERT(is_disk_buffer(buf, l));
 			free_buffer_impl(buf, l);
-			remove_buffer_in_use(buf);
 		}
 
 		check_buffer_level(l);
@@ -283,7 +306,6 @@ namespace libtorrent {
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 		TORRENT_ASSERT(is_disk_buffer(buf, l));
 		free_buffer_impl(buf, l);
-		remove_buffer_in_use(buf);
 		check_buffer_level(l);
 	}
 
@@ -344,6 +366,13 @@ namespace libtorrent {
 		{
 			m_max_use = cache_size;
 		}
+#ifndef TORRENT_DEBUG_BUFFERS
+		m_slabs.set_huge_pages(sett.get_bool(settings_pack::disk_cache_huge_pages));
+		// slabs are unmapped as the blocks in them are freed, but one empty
+		// slab is kept as a spare. Settings changes are rare enough to drop
+		// that one too
+		m_slabs.release_empty_slabs();
+#endif
 		m_low_watermark = m_max_use - std::max(16, sett.get_int(settings_pack::max_queued_disk_bytes) / 0x4000);
 		if (m_low_watermark < 0) m_low_watermark = 0;
 		if (m_in_use >= m_max_use && !m_exceeded_max_size)
@@ -357,16 +386,6 @@ namespace libtorrent {
 #endif
 	}
 
-	void disk_buffer_pool::remove_buffer_in_use(char* buf)
-	{
-		TORRENT_UNUSED(buf);
-#if TORRENT_USE_INVARIANT_CHECKS
-		std::set<char*>::iterator i = m_buffers_in_use.find(buf);
-		TORRENT_ASSERT(i != m_buffers_in_use.end());
-		m_buffers_in_use.erase(i);
-#endif
-	}
-
 	void disk_buffer_pool::free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l)
 	{
 		TORRENT_ASSERT(buf);
@@ -375,7 +394,11 @@ namespace libtorrent {
 		TORRENT_ASSERT(l.owns_lock());
 		TORRENT_UNUSED(l);
 
+#ifdef TORRENT_DEBUG_BUFFERS
 		page_free(buf);
+#else
+		m_slabs.free(buf);
+#endif
 
 		--m_in_use;
 	}
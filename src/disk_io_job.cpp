@@ -53,6 +53,18 @@ namespace libtorrent {
 					, m_job.flags, m_job.error);
 			}
 
+			void operator()(disk_io_job::read_file_handler& h) const
+			{
+				if (!h) return;
+				if (file_range* r = boost::get<file_range>(&m_job.argument))
+				{
+					h(disk_buffer_holder(), std::move(*r), m_job.flags, m_job.error);
+					return;
+				}
+				h(std::move(boost::get<disk_buffer_holder>(m_job.argument))
+					, file_range(), m_job.flags, m_job.error);
+			}
+
 			void operator()(disk_io_job::write_handler& h) const
 			{
 				if (!h) return;
@@ -125,6 +137,12 @@ namespace libtorrent {
 		boost::apply_visitor(caller_visitor(*this), callback);
 	}
 
+	bool disk_io_job::wants_file_range() const
+	{
+		return action == job_action_t::read
+			&& boost::get<read_file_handler>(&callback) != nullptr;
+	}
+
 	bool disk_io_job::completed(cached_piece_entry const* pe)
 	{
 		if (action != job_action_t::write) return false;
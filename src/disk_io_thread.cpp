@@ -51,9 +51,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/debug.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/sha1_mb.hpp"
 #include "libtorrent/aux_/array.hpp"
 
 #include <functional>
+#include <algorithm> // for sort
+#include <array>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/variant/get.hpp>
@@ -120,10 +123,16 @@ namespace libtorrent {
 
 #endif // DEBUG_DISK_THREAD
 
+	open_mode_t backend_file_flags(aux::session_settings const& sett)
+	{
+		return sett.get_int(settings_pack::disk_io_backend) == settings_pack::io_uring_disk_io
+			? open_mode::use_io_uring : open_mode_t{};
+	}
+
 	open_mode_t file_flags_for_job(disk_io_job* j
-		, bool const coalesce_buffers)
+		, aux::session_settings const& sett, bool const coalesce_buffers)
 	{
-		open_mode_t ret = open_mode_t{};
+		open_mode_t ret = backend_file_flags(sett);
 		if (!(j->flags & disk_interface::sequential_access)) ret |= open_mode::random_access;
 		if (coalesce_buffers) ret |= open_mode::coalesce_buffers;
 		return ret;
@@ -137,6 +146,23 @@ namespace libtorrent {
 	// queue and try again later
 	constexpr status_t retry_job = static_cast<status_t>(201);
 
+	// the number of shards the disk cache is split into. Each shard has its
+	// own mutex, allowing this many disk threads to operate on the cache
+	// concurrently (as long as they work on pieces in different shards)
+	constexpr int num_cache_shards = 16;
+
+	// the number of contiguous pieces (of a single storage) assigned to the
+	// same shard. Multi-piece flushes, where the write cache line spans
+	// several pieces, and coalesced writes only happen within a group. This
+	// is large enough for a coalesced write of 16 kiB pieces to reach a
+	// max_coalesced_write_size of 1 MiB.
+	constexpr int cache_shard_piece_group = 64;
+
+	// the longest time a complete piece is held back in the write cache,
+	// waiting for the piece after it to be flushed together with it. Write
+	// handlers of the piece aren't called until it's flushed
+	constexpr time_duration max_write_hold = milliseconds(500);
+
 
 	struct piece_refcount_holder
 	{
@@ -159,6 +185,13 @@ namespace libtorrent {
 			TORRENT_PIECE_ASSERT(m_pe->piece_refcount > 0, m_pe);
 			--m_pe->piece_refcount;
 		}
+		// keep the reference, it's released by whoever the piece was handed
+		// off to
+		void disarm()
+		{
+			TORRENT_ASSERT(!m_executed);
+			m_executed = true;
+		}
 	private:
 		cached_piece_entry* m_pe;
 		bool m_executed = false;
@@ -193,6 +226,8 @@ constexpr disk_job_flags_t disk_interface::force_copy;
 constexpr disk_job_flags_t disk_interface::sequential_access;
 constexpr disk_job_flags_t disk_interface::volatile_read;
 constexpr disk_job_flags_t disk_interface::cache_hit;
+constexpr disk_job_flags_t disk_interface::time_critical;
+constexpr disk_job_flags_t disk_interface::prefetch;
 
 // ------- disk_io_thread ------
 
@@ -201,11 +236,36 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		, m_generic_threads(m_generic_io_jobs, ios)
 		, m_hash_io_jobs(*this)
 		, m_hash_threads(m_hash_io_jobs, ios)
-		, m_disk_cache(ios, std::bind(&disk_io_thread::trigger_cache_trim, this))
+		, m_buffer_pool(ios, std::bind(&disk_io_thread::trigger_cache_trim, this))
 		, m_stats_counters(cnt)
 		, m_ios(ios)
+		, m_held_timer(ios)
+	{
+		m_cache_shards.reserve(num_cache_shards);
+		for (int i = 0; i < num_cache_shards; ++i)
+		{
+			m_cache_shards.emplace_back(new cache_shard(m_buffer_pool, num_cache_shards));
+			m_cache_shards.back()->cache.set_settings(m_settings);
+		}
+		m_buffer_pool.set_settings(m_settings);
+	}
+
+	disk_io_thread::cache_shard& disk_io_thread::shard_for(storage_interface const* st
+		, piece_index_t const piece) const
+	{
+		std::uint32_t const group = std::uint32_t(static_cast<int>(piece) / cache_shard_piece_group);
+		std::uint32_t const idx = std::uint32_t(static_cast<int>(st->storage_index()));
+		std::uint32_t const h = (idx * 0x9e3779b1u) ^ group;
+		return *m_cache_shards[h % m_cache_shards.size()];
+	}
+
+	std::vector<std::unique_lock<std::mutex>> disk_io_thread::lock_all_shards() const
 	{
-		m_disk_cache.set_settings(m_settings);
+		std::vector<std::unique_lock<std::mutex>> ret;
+		ret.reserve(m_cache_shards.size());
+		for (auto const& s : m_cache_shards)
+			ret.emplace_back(s->mutex);
+		return ret;
 	}
 
 	storage_interface* disk_io_thread::get_torrent(storage_index_t const storage)
@@ -234,6 +294,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			storage_index_t const idx = m_torrents.end_index();
 			m_torrents.emplace_back(std::move(storage));
 			m_torrents.back()->set_storage_index(idx);
+			if (m_trace) m_trace->new_storage(std::uint32_t(static_cast<int>(idx)));
 			return storage_holder(idx, *this);
 		}
 		else
@@ -241,6 +302,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			storage_index_t const idx = m_free_slots.back();
 			m_free_slots.pop_back();
 			(m_torrents[idx] = std::move(storage))->set_storage_index(idx);
+			if (m_trace) m_trace->new_storage(std::uint32_t(static_cast<int>(idx)));
 			return storage_holder(idx, *this);
 		}
 	}
@@ -255,15 +317,18 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		}
 	}
 
-#if TORRENT_USE_ASSERTS
 	disk_io_thread::~disk_io_thread()
 	{
 		DLOG("destructing disk_io_thread\n");
 
+		// in case we were never aborted
+		stop_check_hashers();
+
+#if TORRENT_USE_ASSERTS
 		TORRENT_ASSERT(m_magic == 0x1337);
 		m_magic = 0xdead;
-	}
 #endif
+	}
 
 	void disk_io_thread::abort(bool const wait)
 	{
@@ -272,16 +337,24 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		std::unique_lock<std::mutex> l(m_job_mutex);
 		if (m_abort.exchange(true)) return;
 		bool const no_threads = m_num_running_threads == 0;
+
+		{
+			std::lock_guard<std::mutex> l2(m_held_pieces_mutex);
+			m_held_pieces.clear();
+		}
+		error_code ec;
+		m_held_timer.cancel(ec);
 		// abort outstanding jobs belonging to this torrent
 
-		for (auto i = m_hash_io_jobs.m_queued_jobs.iterate(); i.get(); i.next())
-			i.get()->flags |= disk_io_job::aborted;
+		m_hash_io_jobs.m_queued_jobs.for_each([](disk_io_job* j)
+			{ j->flags |= disk_io_job::aborted; });
 		l.unlock();
 
 		// if there are no disk threads, we can't wait for the jobs here, because
 		// we'd stall indefinitely
 		if (no_threads)
 		{
+			stop_check_hashers();
 			abort_jobs();
 		}
 
@@ -296,13 +369,25 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	{
 		TORRENT_ASSERT(m_magic == 0x1337);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
 		for (auto ref : refs)
 		{
 			auto& pos = m_torrents[ref.storage];
 			storage_interface* st = pos.get();
 			TORRENT_ASSERT(st != nullptr);
-			m_disk_cache.reclaim_block(st, ref);
+			// negative cookies refer to views handed out by the storage
+			// itself, rather than blocks in the cache
+			if (ref.cookie < 0)
+			{
+				st->release_view(ref.cookie);
+			}
+			else
+			{
+				int const blocks_per_piece = (st->files().piece_length()
+					+ default_block_size - 1) / default_block_size;
+				cache_shard& shard = shard_for(st, piece_index_t(ref.cookie / blocks_per_piece));
+				std::unique_lock<std::mutex> l(shard.mutex);
+				shard.cache.reclaim_block(st, ref);
+			}
 			if (st->dec_refcount() == 0)
 			{
 				pos.reset();
@@ -314,16 +399,40 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	void disk_io_thread::set_settings(settings_pack const* pack)
 	{
 		TORRENT_ASSERT(m_magic == 0x1337);
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		auto l = lock_all_shards();
 		apply_pack(pack, m_settings);
-		m_disk_cache.set_settings(m_settings);
+		for (auto const& s : m_cache_shards)
+			s->cache.set_settings(m_settings);
+		m_buffer_pool.set_settings(m_settings);
 		m_file_pool.resize(m_settings.get_int(settings_pack::file_pool_size));
+		m_file_pool.set_close_backlog(std::max(0
+			, m_settings.get_int(settings_pack::max_queued_file_closes)));
+
+		std::string const& trace = m_settings.get_str(settings_pack::disk_trace_file);
+		if (trace.empty()) m_trace.reset();
+		else if (!m_trace || m_trace->path() != trace)
+			m_trace.reset(new aux::disk_trace_writer(trace));
 
 		int const num_threads = m_settings.get_int(settings_pack::aio_threads);
 		// add one hasher thread for every three generic threads
 		int const num_hash_threads = num_threads / hasher_thread_divisor;
 		m_generic_threads.set_max_threads(num_threads - num_hash_threads);
 		m_hash_threads.set_max_threads(num_hash_threads);
+
+		// the hashers themselves are started by the first check job that
+		// needs them
+		int const num_check_hashers = disk_io_thread::num_check_hashers(m_settings);
+		std::unique_lock<std::mutex> l2(m_check_hash_mutex);
+		if (m_check_hash_abort) return;
+		m_num_check_hashers = num_check_hashers;
+		m_check_hash_cond.notify_all();
+	}
+
+	int disk_io_thread::num_check_hashers(aux::session_settings const& sett)
+	{
+		int const ret = sett.get_int(settings_pack::checking_hash_threads);
+		if (ret > 0) return ret;
+		return std::max(1, int(std::thread::hardware_concurrency()));
 	}
 
 	// flush all blocks that are below p->hash.offset, since we've
@@ -395,6 +504,18 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		if (cont_pieces <= 1 || m_settings.get_bool(settings_pack::allow_partial_disk_writes))
 		{
+			// a cont_block of 1 means we're flushing because of cache
+			// pressure, don't hold anything back then
+			if (cont_block > 1
+				&& end == int(p->blocks_in_piece)
+				&& p->num_dirty == p->blocks_in_piece
+				&& wait_for_next_piece(p))
+			{
+				DLOG("try_flush_hashed: (%d) waiting for next piece\n", int(p->piece));
+				hold_piece(p);
+				return 0;
+			}
+
 			DLOG("try_flush_hashed: (%d) blocks_in_piece: %d end: %d\n"
 				, int(p->piece), int(p->blocks_in_piece), end);
 
@@ -406,6 +527,18 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		piece_index_t const range_end(std::min(static_cast<int>(range_start)
 			+ cont_pieces, p->storage->files().num_pieces()));
 
+		// the pieces flushed together must all live in the same cache shard,
+		// i.e. the same piece group. If the range straddles two groups, fall
+		// back to flushing this piece on its own
+		if (static_cast<int>(range_start) / cache_shard_piece_group
+			!= (static_cast<int>(range_end) - 1) / cache_shard_piece_group)
+		{
+			DLOG("try_flush_hashed: (%d) range spans shards\n", int(p->piece));
+			return flush_range(p, 0, end, completed_jobs, l);
+		}
+
+		block_cache& cache = shard_for(p).cache;
+
 		// look through all the pieces in this range to see if
 		// they are ready to be flushed. If so, flush them all,
 		// otherwise, hold off
@@ -421,7 +554,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				DLOG("[%d self] ", static_cast<int>(i));
 				continue;
 			}
-			cached_piece_entry* pe = m_disk_cache.find_piece(p->storage.get(), i);
+			cached_piece_entry* pe = cache.find_piece(p->storage.get(), i);
 			if (pe == nullptr)
 			{
 				DLOG("[%d nullptr] ", static_cast<int>(i));
@@ -502,7 +635,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		{
 			cached_piece_entry* pe;
 			if (piece == p->piece) pe = p;
-			else pe = m_disk_cache.find_piece(p->storage.get(), piece);
+			else pe = cache.find_piece(p->storage.get(), piece);
 			if (pe == nullptr
 				|| pe->cache_state != cached_piece_entry::write_lru)
 			{
@@ -556,7 +689,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		{
 			cached_piece_entry* pe;
 			if (piece == p->piece) pe = p;
-			else pe = m_disk_cache.find_piece(p->storage.get(), piece);
+			else pe = cache.find_piece(p->storage.get(), piece);
 			if (pe == nullptr)
 			{
 				DLOG("iovec_flushed: piece %d gone!\n", static_cast<int>(piece));
@@ -568,7 +701,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			{
 				TORRENT_PIECE_ASSERT(pe->piece_refcount > 0, pe);
 				--pe->piece_refcount;
-				m_disk_cache.maybe_free_piece(pe);
+				cache.maybe_free_piece(pe);
 			}
 			const int block_diff = iovec_offset[i + 1] - iovec_offset[i];
 			iovec_flushed(pe, flushing.subspan(iovec_offset[i]).data(), block_diff
@@ -578,8 +711,8 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		// if the cache is under high pressure, we need to evict
 		// the blocks we just flushed to make room for more write pieces
-		int const evict = m_disk_cache.num_to_evict(0);
-		if (evict > 0) m_disk_cache.try_evict_blocks(evict);
+		int const evict = cache.num_to_evict(0);
+		if (evict > 0) cache.try_evict_blocks(evict);
 
 		return iov_len;
 	}
@@ -598,6 +731,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	int disk_io_thread::build_iovec(cached_piece_entry* pe, int const start, int end
 		, span<iovec_t> iov, span<int> flushing, int const block_base_index)
 	{
+		block_cache& cache = shard_for(pe).cache;
 		DLOG("build_iovec: piece=%d [%d, %d)\n"
 			, int(pe->piece), start, end);
 		TORRENT_PIECE_ASSERT(start >= 0, pe);
@@ -631,7 +765,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			}
 
 			// if we fail to lock the block, it' no longer in the cache
-			bool const locked = m_disk_cache.inc_block_refcount(pe, i, block_cache::ref_flushing);
+			bool const locked = cache.inc_block_refcount(pe, i, block_cache::ref_flushing);
 
 			// it should always succeed, since it's a dirty block, and
 			// should never have been marked as volatile
@@ -672,8 +806,9 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		DLOG("]\n");
 #endif
 
-		open_mode_t const file_flags = m_settings.get_bool(settings_pack::coalesce_writes)
-			? open_mode::coalesce_buffers : open_mode_t{};
+		open_mode_t const file_flags = backend_file_flags(m_settings)
+			| (m_settings.get_bool(settings_pack::coalesce_writes)
+			? open_mode::coalesce_buffers : open_mode_t{});
 
 		// issue the actual write operation
 		auto iov_start = iov;
@@ -733,6 +868,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		, storage_error const& error
 		, jobqueue_t& completed_jobs)
 	{
+		block_cache& cache = shard_for(pe).cache;
 		for (int i = 0; i < num_blocks; ++i)
 			flushing[i] -= block_offset;
 
@@ -743,7 +879,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			DLOG("%d ", flushing[i]);
 		DLOG("]\n");
 #endif
-		if (m_disk_cache.blocks_flushed(pe, flushing, num_blocks))
+		if (cache.blocks_flushed(pe, flushing, num_blocks))
 			return true;
 
 		if (error)
@@ -776,11 +912,257 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		return false;
 	}
 
+	// the number of pieces of this storage that may be flushed by a single
+	// coalesced write
+	int disk_io_thread::max_coalesced_pieces(file_storage const& fs) const
+	{
+		return std::min(m_settings.get_int(settings_pack::max_coalesced_write_size)
+			/ fs.piece_length(), cache_shard_piece_group);
+	}
+
+	// returns the cache entry for the given piece of pe's storage if it can
+	// be flushed together with pe. That's the case if it's in the write
+	// cache, in the same shard, and all of its blocks are dirty and hashed.
+	// Flushing such a piece early won't cause any read-back.
+	cached_piece_entry* disk_io_thread::coalesce_candidate(cached_piece_entry const* pe
+		, piece_index_t const piece)
+	{
+		storage_interface* const st = pe->storage.get();
+		file_storage const& fs = st->files();
+		if (piece < piece_index_t(0) || piece >= fs.end_piece()
+			|| static_cast<int>(piece) / cache_shard_piece_group
+				!= static_cast<int>(pe->piece) / cache_shard_piece_group)
+			return nullptr;
+
+		cached_piece_entry* e = shard_for(pe).cache.find_piece(st, piece);
+		if (e == nullptr
+			|| e->cache_state != cached_piece_entry::write_lru
+			|| e->hashing
+			|| e->num_dirty != e->blocks_in_piece)
+			return nullptr;
+
+		if (e->hashing_done
+			|| (e->hash && e->hash->offset >= fs.piece_size(piece))
+			|| m_settings.get_bool(settings_pack::disable_hash_checks))
+			return e;
+		return nullptr;
+	}
+
+	// returns true if flushing p, which is complete and hashed, should be
+	// put off until the piece after it is complete as well, to write them
+	// out together
+	bool disk_io_thread::wait_for_next_piece(cached_piece_entry const* p)
+	{
+		int const max_pieces = max_coalesced_pieces(p->storage->files());
+		if (max_pieces < 2) return false;
+
+		// don't hold on to the piece for longer than max_write_hold after its
+		// last block was added
+		if (aux::time_now() - p->expire >= max_write_hold) return false;
+
+		piece_index_t const n = next(p->piece);
+		if (n >= p->storage->files().end_piece()
+			|| static_cast<int>(n) / cache_shard_piece_group
+				!= static_cast<int>(p->piece) / cache_shard_piece_group)
+			return false;
+
+		// only wait if the next piece is being downloaded
+		cached_piece_entry const* e = shard_for(p).cache.find_piece(p->storage.get(), n);
+		if (e == nullptr
+			|| e->cache_state != cached_piece_entry::write_lru
+			|| e->num_dirty == 0)
+			return false;
+
+		// and the pieces already waiting, together with this one, don't make
+		// up a full write yet
+		int waiting = 1;
+		for (piece_index_t i = prev(p->piece); waiting < max_pieces
+			&& coalesce_candidate(p, i) != nullptr; --i)
+			++waiting;
+		return waiting < max_pieces;
+	}
+
+	// makes sure p is flushed once it's been held back for max_write_hold,
+	// even if its successor doesn't complete (or no other disk job comes in)
+	void disk_io_thread::hold_piece(cached_piece_entry const* p)
+	{
+		std::lock_guard<std::mutex> l(m_held_pieces_mutex);
+		for (auto const& h : m_held_pieces)
+		{
+			if (h.piece == p->piece && h.storage.lock() == p->storage)
+				return;
+		}
+		m_held_pieces.push_back({p->expire + max_write_hold, p->storage, p->piece});
+		if (m_held_timer_armed) return;
+		m_held_timer_armed = true;
+		m_ios.post([this] { arm_held_timer(); });
+	}
+
+	// called on the network thread
+	void disk_io_thread::arm_held_timer()
+	{
+		std::lock_guard<std::mutex> l(m_held_pieces_mutex);
+		if (m_held_pieces.empty() || m_abort)
+		{
+			m_held_timer_armed = false;
+			return;
+		}
+		time_point deadline = m_held_pieces.front().deadline;
+		for (auto const& h : m_held_pieces)
+			deadline = std::min(deadline, h.deadline);
+
+		m_held_timer.expires_at(deadline);
+		m_held_timer.async_wait([this](error_code const& ec)
+			{ flush_held_pieces(ec); });
+	}
+
+	// called on the network thread. Issues a flush_piece job for every piece
+	// whose hold has expired
+	void disk_io_thread::flush_held_pieces(error_code const& ec)
+	{
+		if (ec) return;
+
+		std::vector<held_piece> expired;
+		{
+			std::lock_guard<std::mutex> l(m_held_pieces_mutex);
+			time_point const now = aux::time_now();
+			auto const i = std::partition(m_held_pieces.begin(), m_held_pieces.end()
+				, [now](held_piece const& h) { return h.deadline > now; });
+			expired.assign(std::make_move_iterator(i)
+				, std::make_move_iterator(m_held_pieces.end()));
+			m_held_pieces.erase(i, m_held_pieces.end());
+		}
+
+		for (auto const& h : expired)
+		{
+			std::shared_ptr<storage_interface> st = h.storage.lock();
+			if (!st || m_abort) continue;
+			// if the piece is still held by the time this job runs (say, because
+			// it was read from in the meantime), it's simply held again
+			disk_io_job* j = allocate_job(job_action_t::flush_piece);
+			j->storage = std::move(st);
+			j->piece = h.piece;
+			add_job(j);
+		}
+		if (!expired.empty()) submit_jobs();
+
+		{
+			std::lock_guard<std::mutex> l(m_held_pieces_mutex);
+			if (m_held_pieces.empty())
+			{
+				m_held_timer_armed = false;
+				return;
+			}
+		}
+		arm_held_timer();
+	}
+
+	// flushes the tail of one piece together with the neighbouring pieces
+	// of the same storage, in a single write. When a torrent with small
+	// pieces is downloaded sequentially, this turns many piece sized writes
+	// into few large ones.
+	int disk_io_thread::flush_coalesced(cached_piece_entry* pe, int const start
+		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
+	{
+		TORRENT_ASSERT(l.owns_lock());
+		block_cache& cache = shard_for(pe).cache;
+		file_storage const& fs = pe->storage->files();
+
+		int const max_pieces = max_coalesced_pieces(fs);
+		if (max_pieces < 2) return -1;
+
+		// the number of blocks in every piece except possibly the last one.
+		// This is the stride of block indices in the flushing array
+		int const blocks_per_piece = (fs.piece_length() + default_block_size - 1)
+			/ default_block_size;
+
+		piece_index_t first = pe->piece;
+		piece_index_t last = pe->piece;
+		while (static_cast<int>(last) - static_cast<int>(first) + 1 < max_pieces
+			&& coalesce_candidate(pe, next(last)) != nullptr)
+			++last;
+
+		// the pieces before pe are only contiguous with the blocks we flush
+		// if we start at its first block
+		if (start == 0)
+		{
+			while (static_cast<int>(last) - static_cast<int>(first) + 1 < max_pieces
+				&& coalesce_candidate(pe, prev(first)) != nullptr)
+				--first;
+		}
+
+		if (first == last) return -1;
+
+		int const cont_pieces = static_cast<int>(last) - static_cast<int>(first) + 1;
+		int const blocks_to_flush = blocks_per_piece * cont_pieces;
+		TORRENT_ALLOCA(iov, iovec_t, blocks_to_flush);
+		TORRENT_ALLOCA(flushing, int, blocks_to_flush);
+		// this is the offset into iov and flushing for each piece
+		TORRENT_ALLOCA(iovec_offset, int, cont_pieces + 1);
+		TORRENT_ALLOCA(pieces, cached_piece_entry*, cont_pieces);
+
+		DLOG("flush_coalesced: piece: %d [%d, %d]\n", static_cast<int>(pe->piece)
+			, static_cast<int>(first), static_cast<int>(last));
+
+		int iov_len = 0;
+		piece_index_t piece = first;
+		for (int i = 0; i < cont_pieces; ++i, ++piece)
+		{
+			cached_piece_entry* e = piece == pe->piece ? pe
+				: cache.find_piece(pe->storage.get(), piece);
+			TORRENT_ASSERT(e != nullptr);
+			TORRENT_PIECE_ASSERT(e->cache_state == cached_piece_entry::write_lru, e);
+			pieces[i] = e;
+			iovec_offset[i] = iov_len;
+#if TORRENT_USE_ASSERTS
+			e->piece_log.push_back(piece_log_t(piece_log_t::flushing, -1));
+#endif
+			++e->piece_refcount;
+			if (e != pe || start < e->blocks_in_piece)
+			{
+				iov_len += build_iovec(e, e == pe ? start : 0, e->blocks_in_piece
+					, iov.subspan(iov_len), flushing.subspan(iov_len)
+					, i * blocks_per_piece);
+			}
+		}
+		iovec_offset[cont_pieces] = iov_len;
+
+		storage_error error;
+		if (iov_len > 0)
+		{
+			auto unlocker = scoped_unlock(l);
+			flush_iovec(pieces[0], iov, flushing, iov_len, error);
+		}
+
+		for (int i = 0; i < cont_pieces; ++i)
+		{
+			cached_piece_entry* e = pieces[i];
+			TORRENT_PIECE_ASSERT(e->piece_refcount > 0, e);
+			--e->piece_refcount;
+			int const block_diff = iovec_offset[i + 1] - iovec_offset[i];
+			if (block_diff == 0
+				|| !iovec_flushed(e, flushing.subspan(iovec_offset[i]).data(), block_diff
+				, i * blocks_per_piece, error, completed_jobs))
+				cache.maybe_free_piece(e);
+		}
+
+		if (iov_len > 0 && !error)
+			m_stats_counters.inc_stats_counter(counters::num_coalesced_pieces, cont_pieces - 1);
+
+		// if the cache is under high pressure, we need to evict
+		// the blocks we just flushed to make room for more write pieces
+		int const evict = cache.num_to_evict(0);
+		if (evict > 0) cache.try_evict_blocks(evict);
+
+		return iov_len;
+	}
+
 	// issues write operations for blocks in the given
 	// range on the given piece.
 	int disk_io_thread::flush_range(cached_piece_entry* pe, int const start, int const end
 		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
 	{
+		block_cache& cache = shard_for(pe).cache;
 		TORRENT_ASSERT(l.owns_lock());
 
 		DLOG("flush_range: piece=%d [%d, %d)\n"
@@ -788,6 +1170,16 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		TORRENT_PIECE_ASSERT(start >= 0, pe);
 		TORRENT_PIECE_ASSERT(start < end, pe);
 
+		// if we're flushing up to the end of the piece, the write may
+		// continue into the next one
+		if (end >= pe->blocks_in_piece
+			&& pe->num_dirty > 0
+			&& pe->cache_state == cached_piece_entry::write_lru)
+		{
+			int const ret = flush_coalesced(pe, start, completed_jobs, l);
+			if (ret >= 0) return ret;
+		}
+
 		TORRENT_ALLOCA(iov, iovec_t, pe->blocks_in_piece);
 		TORRENT_ALLOCA(flushing, int, pe->blocks_in_piece);
 		int const iov_len = build_iovec(pe, start, end, iov, flushing, 0);
@@ -807,12 +1199,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		}
 
 		if (!iovec_flushed(pe, flushing.data(), iov_len, 0, error, completed_jobs))
-			m_disk_cache.maybe_free_piece(pe);
+			cache.maybe_free_piece(pe);
 
 		// if the cache is under high pressure, we need to evict
 		// the blocks we just flushed to make room for more write pieces
-		int const evict = m_disk_cache.num_to_evict(0);
-		if (evict > 0) m_disk_cache.try_evict_blocks(evict);
+		int const evict = cache.num_to_evict(0);
+		if (evict > 0) cache.try_evict_blocks(evict);
 
 		return iov_len;
 	}
@@ -839,6 +1231,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	void disk_io_thread::flush_piece(cached_piece_entry* pe, std::uint32_t const flags
 		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
 	{
+		block_cache& cache = shard_for(pe).cache;
 		TORRENT_ASSERT(l.owns_lock());
 		if (flags & flush_delete_cache)
 		{
@@ -848,7 +1241,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				, pe->jobs, completed_jobs);
 			fail_jobs_impl(storage_error(boost::asio::error::operation_aborted)
 				, pe->read_jobs, completed_jobs);
-			m_disk_cache.abort_dirty(pe);
+			cache.abort_dirty(pe);
 		}
 		else if ((flags & flush_write_cache) && pe->num_dirty > 0)
 		{
@@ -867,34 +1260,49 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			fail_jobs_impl(storage_error(boost::asio::error::operation_aborted), pe->jobs, completed_jobs);
 			// we're removing the torrent, don't keep any entries around in the
 			// ghost list
-			m_disk_cache.mark_for_eviction(pe, block_cache::disallow_ghost);
+			cache.mark_for_eviction(pe, block_cache::disallow_ghost);
 		}
 	}
 
 	void disk_io_thread::flush_cache(storage_interface* storage, std::uint32_t const flags
-		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
+		, jobqueue_t& completed_jobs)
 	{
 		if (storage != nullptr)
 		{
-			auto const& pieces = storage->cached_pieces();
 			std::vector<piece_index_t> piece_index;
-			piece_index.reserve(pieces.size());
-			for (auto const& p : pieces)
 			{
-				TORRENT_ASSERT(p.get_storage() == storage);
-				if (p.get_storage() != storage) continue;
-				piece_index.push_back(p.piece);
+				std::lock_guard<std::mutex> pl(storage->piece_mutex());
+				auto const& pieces = storage->cached_pieces();
+				for (auto const& p : pieces)
+				{
+					TORRENT_ASSERT(p.get_storage() == storage);
+					if (p.get_storage() != storage) continue;
+					piece_index.push_back(p.piece);
+				}
 			}
 
+			// pieces in the same group are in the same shard, don't lock it
+			// once per piece
+			std::sort(piece_index.begin(), piece_index.end());
+
+			cache_shard* locked = nullptr;
+			std::unique_lock<std::mutex> l;
 			for (auto idx : piece_index)
 			{
-				cached_piece_entry* pe = m_disk_cache.find_piece(storage, idx);
+				cache_shard& shard = shard_for(storage, idx);
+				if (&shard != locked)
+				{
+					if (l.owns_lock()) l.unlock();
+					l = std::unique_lock<std::mutex>(shard.mutex);
+					locked = &shard;
+				}
+				cached_piece_entry* pe = shard.cache.find_piece(storage, idx);
 				if (pe == nullptr) continue;
 				TORRENT_PIECE_ASSERT(pe->storage.get() == storage, pe);
 				flush_piece(pe, flags, completed_jobs, l);
 			}
+			if (l.owns_lock()) l.unlock();
 #if TORRENT_USE_ASSERTS
-			TORRENT_ASSERT(l.owns_lock());
 			// if the user asked to delete the cache for this storage
 			// we really should not have any pieces left. This is only called
 			// from disk_io_thread::do_delete, which is a fence job and should
@@ -902,10 +1310,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			// keeping pieces or blocks alive
 			if ((flags & flush_delete_cache) && (flags & flush_expect_clear))
 			{
+				auto const shard_locks = lock_all_shards();
+				std::lock_guard<std::mutex> pl(storage->piece_mutex());
 				auto const& storage_pieces = storage->cached_pieces();
 				for (auto const& p : storage_pieces)
 				{
-					cached_piece_entry* pe = m_disk_cache.find_piece(storage, p.piece);
+					cached_piece_entry* pe = shard_for(storage, p.piece).cache.find_piece(storage, p.piece);
 					TORRENT_PIECE_ASSERT(pe->num_dirty == 0, pe);
 				}
 			}
@@ -913,25 +1323,27 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		}
 		else
 		{
-			auto range = m_disk_cache.all_pieces();
-			while (range.first != range.second)
+			for (auto const& shard : m_cache_shards)
 			{
-				// TODO: it would be nice to optimize this by having the cache
-				// pieces also ordered by
-				if ((flags & (flush_read_cache | flush_delete_cache)) == 0)
+				std::unique_lock<std::mutex> l(shard->mutex);
+				auto range = shard->cache.all_pieces();
+				while (range.first != range.second)
 				{
-					// if we're not flushing the read cache, and not deleting the
-					// cache, skip pieces with no dirty blocks, i.e. read cache
-					// pieces
-					while (range.first->num_dirty == 0)
+					// TODO: it would be nice to optimize this by having the cache
+					// pieces also ordered by
+					if ((flags & (flush_read_cache | flush_delete_cache)) == 0)
 					{
-						++range.first;
-						if (range.first == range.second) return;
+						// if we're not flushing the read cache, and not deleting the
+						// cache, skip pieces with no dirty blocks, i.e. read cache
+						// pieces
+						while (range.first != range.second && range.first->num_dirty == 0)
+							++range.first;
+						if (range.first == range.second) break;
 					}
+					cached_piece_entry* pe = const_cast<cached_piece_entry*>(&*range.first);
+					flush_piece(pe, flags, completed_jobs, l);
+					range = shard->cache.all_pieces();
 				}
-				cached_piece_entry* pe = const_cast<cached_piece_entry*>(&*range.first);
-				flush_piece(pe, flags, completed_jobs, l);
-				range = m_disk_cache.all_pieces();
 			}
 		}
 	}
@@ -940,14 +1352,15 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	// size limit. This means we should not restrict ourselves to contiguous
 	// blocks of write cache line size, but try to flush all old blocks
 	// this is why we pass in 1 as cont_block to the flushing functions
-	void disk_io_thread::try_flush_write_blocks(int num, jobqueue_t& completed_jobs
-		, std::unique_lock<std::mutex>& l)
+	int disk_io_thread::try_flush_write_blocks(cache_shard& shard, int num
+		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
 	{
 		DLOG("try_flush_write_blocks: %d\n", num);
 
-		auto const range = m_disk_cache.write_lru_pieces();
+		block_cache& cache = shard.cache;
+		auto const range = cache.write_lru_pieces();
 		aux::vector<std::pair<std::shared_ptr<storage_interface>, piece_index_t>> pieces;
-		pieces.reserve(m_disk_cache.num_write_lru_pieces());
+		pieces.reserve(cache.num_write_lru_pieces());
 
 		for (auto p = range; p.get() && num > 0; p.next())
 		{
@@ -960,7 +1373,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		{
 			// TODO: instead of doing a lookup each time through the loop, save
 			// cached_piece_entry pointers with piece_refcount incremented to pin them
-			cached_piece_entry* pe = m_disk_cache.find_piece(p.first.get(), p.second);
+			cached_piece_entry* pe = cache.find_piece(p.first.get(), p.second);
 			if (pe == nullptr) continue;
 
 			// another thread may flush this piece while we're looping and
@@ -975,7 +1388,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			num -= try_flush_hashed(pe, 1, completed_jobs, l);
 			--pe->piece_refcount;
 
-			m_disk_cache.maybe_free_piece(pe);
+			cache.maybe_free_piece(pe);
 		}
 
 		// when the write cache is under high pressure, it is likely
@@ -983,13 +1396,13 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// not have had its flush_hashed job run on it
 		// so only do it if no other thread is currently flushing
 
-		if (num == 0 || m_stats_counters[counters::num_writing_threads] > 0) return;
+		if (num == 0 || m_stats_counters[counters::num_writing_threads] > 0) return num;
 
 		// if we still need to flush blocks, start over and flush
 		// everything in LRU order (degrade to lru cache eviction)
 		for (auto const& p : pieces)
 		{
-			cached_piece_entry* pe = m_disk_cache.find_piece(p.first.get(), p.second);
+			cached_piece_entry* pe = cache.find_piece(p.first.get(), p.second);
 			if (pe == nullptr) continue;
 			if (pe->num_dirty == 0) continue;
 
@@ -1008,55 +1421,62 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			num -= flush_range(pe, 0, INT_MAX, completed_jobs, l);
 			--pe->piece_refcount;
 
-			m_disk_cache.maybe_free_piece(pe);
+			cache.maybe_free_piece(pe);
 		}
+		return num;
 	}
 
-	void disk_io_thread::flush_expired_write_blocks(jobqueue_t& completed_jobs
-		, std::unique_lock<std::mutex>& l)
+	void disk_io_thread::flush_expired_write_blocks(jobqueue_t& completed_jobs)
 	{
 		DLOG("flush_expired_write_blocks\n");
 
 		time_point const now = aux::time_now();
 		time_duration const expiration_limit = seconds(m_settings.get_int(settings_pack::cache_expiry));
 
+		TORRENT_ALLOCA(to_flush, cached_piece_entry*, 200);
+
+		for (auto const& shard : m_cache_shards)
+		{
+			std::unique_lock<std::mutex> l(shard->mutex);
+			block_cache& cache = shard->cache;
+
 #if TORRENT_USE_ASSERTS
-		time_point timeout = min_time();
+			time_point timeout = min_time();
 #endif
 
-		TORRENT_ALLOCA(to_flush, cached_piece_entry*, 200);
-		int num_flush = 0;
+			int num_flush = 0;
 
-		for (list_iterator<cached_piece_entry> p = m_disk_cache.write_lru_pieces(); p.get(); p.next())
-		{
-			cached_piece_entry* e = p.get();
+			for (list_iterator<cached_piece_entry> p = cache.write_lru_pieces(); p.get(); p.next())
+			{
+				cached_piece_entry* e = p.get();
 #if TORRENT_USE_ASSERTS
-			TORRENT_PIECE_ASSERT(e->expire >= timeout, e);
-			timeout = e->expire;
+				TORRENT_PIECE_ASSERT(e->expire >= timeout, e);
+				timeout = e->expire;
 #endif
 
-			// since we're iterating in order of last use, if this piece
-			// shouldn't be evicted, none of the following ones will either
-			if (now - e->expire < expiration_limit) break;
-			if (e->num_dirty == 0) continue;
+				// since we're iterating in order of last use, if this piece
+				// shouldn't be evicted, none of the following ones will either
+				if (now - e->expire < expiration_limit) break;
+				if (e->num_dirty == 0) continue;
 
-			TORRENT_PIECE_ASSERT(e->cache_state <= cached_piece_entry::read_lru1 || e->cache_state == cached_piece_entry::read_lru2, e);
+				TORRENT_PIECE_ASSERT(e->cache_state <= cached_piece_entry::read_lru1 || e->cache_state == cached_piece_entry::read_lru2, e);
 #if TORRENT_USE_ASSERTS
-			e->piece_log.push_back(piece_log_t(piece_log_t::flush_expired, -1));
+				e->piece_log.push_back(piece_log_t(piece_log_t::flush_expired, -1));
 #endif
-			++e->piece_refcount;
-			// We can rely on the piece entry not being removed by
-			// incrementing the piece_refcount
-			to_flush[num_flush++] = e;
-			if (num_flush == 200) break;
-		}
+				++e->piece_refcount;
+				// We can rely on the piece entry not being removed by
+				// incrementing the piece_refcount
+				to_flush[num_flush++] = e;
+				if (num_flush == 200) break;
+			}
 
-		for (int i = 0; i < num_flush; ++i)
-		{
-			flush_range(to_flush[i], 0, INT_MAX, completed_jobs, l);
-			TORRENT_ASSERT(to_flush[i]->piece_refcount > 0);
-			--to_flush[i]->piece_refcount;
-			m_disk_cache.maybe_free_piece(to_flush[i]);
+			for (int i = 0; i < num_flush; ++i)
+			{
+				flush_range(to_flush[i], 0, INT_MAX, completed_jobs, l);
+				TORRENT_ASSERT(to_flush[i]->piece_refcount > 0);
+				--to_flush[i]->piece_refcount;
+				cache.maybe_free_piece(to_flush[i]);
+			}
 		}
 	}
 
@@ -1094,28 +1514,48 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	// below the number of blocks we flushed by the time we're done flushing
 	// that's why we need to call this fairly often. Both before and after
 	// a disk job is executed
-	void disk_io_thread::check_cache_level(std::unique_lock<std::mutex>& l, jobqueue_t& completed_jobs)
+	void disk_io_thread::check_cache_level(jobqueue_t& completed_jobs)
 	{
 		// when the read cache is disabled, always try to evict all read cache
 		// blocks
 		if (!m_settings.get_bool(settings_pack::use_read_cache))
 		{
-			int const evict = m_disk_cache.read_cache_size();
-			m_disk_cache.try_evict_blocks(evict);
+			for (auto const& shard : m_cache_shards)
+			{
+				std::unique_lock<std::mutex> l(shard->mutex);
+				int const evict = shard->cache.read_cache_size();
+				shard->cache.try_evict_blocks(evict);
+			}
 		}
 
-		int evict = m_disk_cache.num_to_evict(0);
-		if (evict > 0)
+		int evict = m_buffer_pool.num_to_evict(0);
+		if (evict <= 0) return;
+
+		// first spread the eviction evenly across the shards, to approximate
+		// evicting in global LRU order. Whatever some shards couldn't evict is
+		// then taken from any shard that can
+		int const num_shards = int(m_cache_shards.size());
+		int const share = (evict + num_shards - 1) / num_shards;
+		for (int pass = 0; pass < 2 && evict > 0; ++pass)
 		{
-			evict = m_disk_cache.try_evict_blocks(evict);
-			// don't evict write jobs if at least one other thread
-			// is flushing right now. Doing so could result in
-			// unnecessary flushing of the wrong pieces
-			if (evict > 0 && m_stats_counters[counters::num_writing_threads] == 0)
+			for (auto const& shard : m_cache_shards)
 			{
-				try_flush_write_blocks(evict, completed_jobs, l);
+				if (evict <= 0) break;
+				std::unique_lock<std::mutex> l(shard->mutex);
+				int const target = pass == 0 ? std::min(share, evict) : evict;
+				evict -= target - shard->cache.try_evict_blocks(target);
 			}
 		}
+
+		// don't evict write jobs if at least one other thread
+		// is flushing right now. Doing so could result in
+		// unnecessary flushing of the wrong pieces
+		for (auto const& shard : m_cache_shards)
+		{
+			if (evict <= 0 || m_stats_counters[counters::num_writing_threads] > 0) break;
+			std::unique_lock<std::mutex> l(shard->mutex);
+			evict = try_flush_write_blocks(*shard, evict, completed_jobs, l);
+		}
 	}
 
 	void disk_io_thread::perform_job(disk_io_job* j, jobqueue_t& completed_jobs)
@@ -1124,16 +1564,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		TORRENT_ASSERT((j->flags & disk_io_job::in_progress) || !j->storage);
 
 #if DEBUG_DISK_THREAD
-		{
-			std::unique_lock<std::mutex> l(m_cache_mutex);
-
-			DLOG("perform_job job: %s ( %s%s) piece: %d offset: %d outstanding: %d\n"
-				, job_action_name[j->action]
-				, (j->flags & disk_io_job::fence) ? "fence ": ""
-				, (j->flags & disk_io_job::force_copy) ? "force_copy ": ""
-				, static_cast<int>(j->piece), j->d.io.offset
-				, j->storage ? j->storage->num_outstanding_jobs() : -1);
-		}
+		DLOG("perform_job job: %s ( %s%s) piece: %d offset: %d outstanding: %d\n"
+			, job_action_name[j->action]
+			, (j->flags & disk_io_job::fence) ? "fence ": ""
+			, (j->flags & disk_io_job::force_copy) ? "force_copy ": ""
+			, static_cast<int>(j->piece), j->d.io.offset
+			, j->storage ? j->storage->num_outstanding_jobs() : -1);
 #endif
 
 		std::shared_ptr<storage_interface> storage = j->storage;
@@ -1141,7 +1577,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		if (j->storage)
 		{
-			std::unique_lock<std::mutex> l(m_cache_mutex);
+			std::lock_guard<std::mutex> l(j->storage->piece_mutex());
 			auto const& pieces = j->storage->cached_pieces();
 			for (auto const& p : pieces)
 				TORRENT_ASSERT(p.storage == j->storage);
@@ -1191,14 +1627,15 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(m_cache_check_mutex);
 		if (m_cache_check_state == cache_check_idle)
 		{
 			m_cache_check_state = cache_check_active;
 			while (m_cache_check_state != cache_check_idle)
 			{
-				check_cache_level(l, completed_jobs);
-				TORRENT_ASSERT(l.owns_lock());
+				l.unlock();
+				check_cache_level(completed_jobs);
+				l.lock();
 				--m_cache_check_state;
 			}
 		}
@@ -1239,7 +1676,50 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 	status_t disk_io_thread::do_uncached_read(disk_io_job* j)
 	{
-		j->argument = disk_buffer_holder(*this, m_disk_cache.allocate_buffer("send buffer"), 0x4000);
+		if (j->wants_file_range())
+		{
+			std::int64_t file_offset = 0;
+			file_handle f = j->storage->file_for_block(j->piece, j->d.io.offset
+				, j->d.io.buffer_size, file_offset, j->error);
+			if (j->error) return status_t::fatal_disk_error;
+			if (f)
+			{
+				file_range r;
+				r.handle = std::move(f);
+				r.offset = file_offset;
+				r.size = j->d.io.buffer_size;
+				j->argument = std::move(r);
+				m_stats_counters.inc_stats_counter(counters::num_file_range_reads);
+				return status_t::no_error;
+			}
+		}
+
+		if (j->storage->has_read_views())
+		{
+			time_point const start_time = clock_type::now();
+			std::int32_t cookie = 0;
+			char* const view = j->storage->read_view(j->piece, j->d.io.offset
+				, j->d.io.buffer_size, cookie, j->error);
+			if (j->error) return status_t::fatal_disk_error;
+			if (view != nullptr)
+			{
+				// the view is released through reclaim_blocks(), just like a
+				// block in the cache, and it's not mutable
+				TORRENT_ASSERT(cookie < 0);
+				j->storage->inc_refcount();
+				j->argument = disk_buffer_holder(*this
+					, aux::block_cache_reference(j->storage->storage_index(), cookie)
+					, view, std::size_t(j->d.io.buffer_size));
+
+				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+				return status_t::no_error;
+			}
+		}
+
+		j->argument = disk_buffer_holder(*this, m_buffer_pool.allocate_buffer("send buffer"), 0x4000);
 		auto& buffer = boost::get<disk_buffer_holder>(j->argument);
 		if (buffer.get() == nullptr)
 		{
@@ -1250,7 +1730,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		time_point const start_time = clock_type::now();
 
-		open_mode_t const file_flags = file_flags_for_job(j
+		open_mode_t const file_flags = file_flags_for_job(j, m_settings
 			, m_settings.get_bool(settings_pack::coalesce_reads));
 		iovec_t b = {buffer.get(), std::size_t(j->d.io.buffer_size)};
 
@@ -1275,19 +1755,20 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 	status_t disk_io_thread::do_read(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
+		cache_shard& shard = shard_for(j);
 		int const piece_size = j->storage->files().piece_size(j->piece);
 		int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
-		int const iov_len = m_disk_cache.pad_job(j, blocks_in_piece
-			, m_settings.get_int(settings_pack::read_cache_line_size));
+		int const iov_len = shard.cache.pad_job(j, blocks_in_piece
+			, j->d.io.read_ahead);
 
 		TORRENT_ALLOCA(iov, iovec_t, iov_len);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		int const evict = m_disk_cache.num_to_evict(iov_len);
-		if (evict > 0) m_disk_cache.try_evict_blocks(evict);
+		int const evict = shard.cache.num_to_evict(iov_len);
+		if (evict > 0) shard.cache.try_evict_blocks(evict);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe == nullptr)
 		{
 			l.unlock();
@@ -1298,14 +1779,14 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		l.unlock();
 
 		// then we'll actually allocate the buffers
-		int ret = m_disk_cache.allocate_iovec(iov);
+		int ret = m_buffer_pool.allocate_iovec(iov);
 
 		if (ret < 0)
 		{
 			status_t const s = do_uncached_read(j);
 
-			std::unique_lock<std::mutex> l2(m_cache_mutex);
-			pe = m_disk_cache.find_piece(j);
+			std::unique_lock<std::mutex> l2(shard.mutex);
+			pe = shard.cache.find_piece(j);
 			if (pe != nullptr) maybe_issue_queued_read_jobs(pe, completed_jobs);
 			return s;
 		}
@@ -1325,7 +1806,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// can remove them. We can now release the cache std::mutex and dive into the
 		// disk operations.
 
-		open_mode_t const file_flags = file_flags_for_job(j
+		open_mode_t const file_flags = file_flags_for_job(j, m_settings
 			, m_settings.get_bool(settings_pack::coalesce_reads));
 		time_point const start_time = clock_type::now();
 
@@ -1338,7 +1819,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		{
 			std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
 
+			// the blocks beyond the ones the job asked for
+			int const requested = ((j->d.io.offset & (default_block_size - 1))
+				+ j->d.io.buffer_size + default_block_size - 1) / default_block_size;
 			m_stats_counters.inc_stats_counter(counters::num_blocks_read, iov_len);
+			m_stats_counters.inc_stats_counter(counters::num_read_ahead_blocks
+				, std::max(iov_len - requested, 0));
 			m_stats_counters.inc_stats_counter(counters::num_read_ops);
 			m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
 			m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
@@ -1349,9 +1835,9 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		if (ret < 0)
 		{
 			// read failed. free buffers and return error
-			m_disk_cache.free_iovec(iov);
+			m_buffer_pool.free_iovec(iov);
 
-			pe = m_disk_cache.find_piece(j);
+			pe = shard.cache.find_piece(j);
 			if (pe == nullptr)
 			{
 				// the piece is supposed to be allocated when the
@@ -1368,7 +1854,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #if TORRENT_USE_ASSERTS
 			pe->piece_log.emplace_back(piece_log_t::clear_outstanding_jobs);
 #endif
-			m_disk_cache.maybe_free_piece(pe);
+			shard.cache.maybe_free_piece(pe);
 			return status_t::fatal_disk_error;
 		}
 
@@ -1379,11 +1865,11 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// as soon we insert the blocks they may be evicted
 		// (if using purgeable memory). In order to prevent that
 		// until we can read from them, increment the refcounts
-		m_disk_cache.insert_blocks(pe, block, iov, j, block_cache::blocks_inc_refcount);
+		shard.cache.insert_blocks(pe, block, iov, j, block_cache::blocks_inc_refcount);
 
 		TORRENT_ASSERT(pe->blocks[block].buf);
 
-		int const tmp = m_disk_cache.try_read(j, *this, true);
+		int const tmp = shard.cache.try_read(j, *this, true);
 
 		// This should always succeed because we just checked to see there is a
 		// buffer for this block
@@ -1393,7 +1879,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		maybe_issue_queued_read_jobs(pe, completed_jobs);
 
 		for (int i = 0; i < iov_len; ++i, ++block)
-			m_disk_cache.dec_block_refcount(pe, block, block_cache::ref_reading);
+			shard.cache.dec_block_refcount(pe, block, block_cache::ref_reading);
 
 		return status_t::no_error;
 	}
@@ -1401,6 +1887,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	void disk_io_thread::maybe_issue_queued_read_jobs(cached_piece_entry* pe
 		, jobqueue_t& completed_jobs)
 	{
+		cache_shard& shard = shard_for(pe);
 		TORRENT_PIECE_ASSERT(pe->outstanding_read == 1, pe);
 
 		// if we're shutting down, just cancel the jobs
@@ -1413,7 +1900,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #if TORRENT_USE_ASSERTS
 			pe->piece_log.emplace_back(piece_log_t::clear_outstanding_jobs);
 #endif
-			m_disk_cache.maybe_free_piece(pe);
+			shard.cache.maybe_free_piece(pe);
 			return;
 		}
 
@@ -1433,7 +1920,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			disk_io_job* j = stalled_jobs.pop_front();
 			TORRENT_ASSERT(j->flags & disk_io_job::in_progress);
 
-			int ret = m_disk_cache.try_read(j, *this);
+			int ret = shard.cache.try_read(j, *this);
 			if (ret >= 0)
 			{
 				// cache-hit
@@ -1476,7 +1963,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #if TORRENT_USE_ASSERTS
 			pe->piece_log.emplace_back(piece_log_t::clear_outstanding_jobs);
 #endif
-			m_disk_cache.maybe_free_piece(pe);
+			shard.cache.maybe_free_piece(pe);
 		}
 	}
 
@@ -1486,7 +1973,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		auto buffer = std::move(boost::get<disk_buffer_holder>(j->argument));
 
 		iovec_t const b = { buffer.get(), std::size_t(j->d.io.buffer_size)};
-		open_mode_t const file_flags = file_flags_for_job(j
+		open_mode_t const file_flags = file_flags_for_job(j, m_settings
 			, m_settings.get_bool(settings_pack::coalesce_writes));
 
 		m_stats_counters.inc_stats_counter(counters::num_writing_threads, 1);
@@ -1521,11 +2008,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 	status_t disk_io_thread::do_write(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
+		cache_shard& shard = shard_for(j);
 		TORRENT_ASSERT(j->d.io.buffer_size <= default_block_size);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe != nullptr && pe->hashing_done)
 		{
 #if TORRENT_USE_ASSERTS
@@ -1539,7 +2027,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			return status_t::fatal_disk_error;
 		}
 
-		pe = m_disk_cache.add_dirty_block(j);
+		pe = shard.cache.add_dirty_block(j);
 
 		if (pe)
 		{
@@ -1552,7 +2040,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				&& !m_settings.get_bool(settings_pack::disable_hash_checks))
 			{
 				pe->hash.reset(new partial_hash);
-				m_disk_cache.update_cache_state(pe);
+				shard.cache.update_cache_state(pe);
 			}
 
 			TORRENT_PIECE_ASSERT(pe->cache_state <= cached_piece_entry::read_lru1 || pe->cache_state == cached_piece_entry::read_lru2, pe);
@@ -1570,7 +2058,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				settings_pack::write_cache_line_size), completed_jobs, l);
 
 			--pe->piece_refcount;
-			m_disk_cache.maybe_free_piece(pe);
+			shard.cache.maybe_free_piece(pe);
 
 			return defer_handler;
 		}
@@ -1583,27 +2071,98 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		, std::function<void(disk_buffer_holder block, disk_job_flags_t const flags
 		, storage_error const& se)> handler, disk_job_flags_t const flags)
 	{
-		TORRENT_ASSERT(r.length <= default_block_size);
-
 		DLOG("async_read piece: %d block: %d\n", static_cast<int>(r.piece)
 			, r.start / default_block_size);
 
 		disk_io_job* j = allocate_job(job_action_t::read);
+		j->callback = std::move(handler);
+		queue_read_job(j, storage, r, flags);
+	}
+
+	void disk_io_thread::async_read_file(storage_index_t storage, peer_request const& r
+		, std::function<void(disk_buffer_holder block, file_range range
+		, disk_job_flags_t flags, storage_error const& se)> handler
+		, disk_job_flags_t const flags)
+	{
+		DLOG("async_read_file piece: %d block: %d\n", static_cast<int>(r.piece)
+			, r.start / default_block_size);
+
+		disk_io_job* j = allocate_job(job_action_t::read);
+		j->callback = std::move(handler);
+		queue_read_job(j, storage, r, flags);
+	}
+
+	void disk_io_thread::queue_read_job(disk_io_job* j, storage_index_t const storage
+		, peer_request const& r, disk_job_flags_t const flags)
+	{
+		TORRENT_ASSERT(r.length <= default_block_size);
+
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->piece = r.piece;
 		j->d.io.offset = r.start;
 		j->d.io.buffer_size = std::uint16_t(r.length);
 		j->argument = disk_buffer_holder(*this, nullptr, 0);
 		j->flags = flags;
-		j->callback = std::move(handler);
 
-		TORRENT_ASSERT(static_cast<int>(r.piece) * static_cast<std::int64_t>(j->storage->files().piece_length())
-			+ r.start + r.length <= j->storage->files().total_size());
+		std::int64_t const offset = static_cast<int>(r.piece)
+			* static_cast<std::int64_t>(j->storage->files().piece_length()) + r.start;
+		TORRENT_ASSERT(offset + r.length <= j->storage->files().total_size());
+
+		int const read_ahead = m_settings.get_int(settings_pack::read_cache_line_size);
+		if (flags & disk_interface::prefetch)
+		{
+			int const piece_size = j->storage->files().piece_size(r.piece);
+			int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
+
+			// warming the cache is pointless if the piece doesn't end up in it,
+			// and it must not push out blocks someone asked for
+			if (!m_settings.get_bool(settings_pack::use_read_cache)
+				|| m_settings.get_int(settings_pack::cache_size) == 0
+				|| j->storage->has_read_views()
+				|| m_buffer_pool.in_use() + blocks_in_piece > m_buffer_pool.max_size())
+			{
+				j->ret = status_t::no_error;
+				j->call_callback();
+				free_job(j);
+				return;
+			}
+			j->d.io.read_ahead = std::uint16_t(std::min(blocks_in_piece, 0xffff));
+		}
+		else if (m_settings.get_bool(settings_pack::adaptive_read_ahead))
+		{
+			bool sequential = false;
+			j->d.io.read_ahead = std::uint16_t(j->storage->read_streams().on_read(
+				offset, r.length, read_ahead, sequential));
+			m_stats_counters.inc_stats_counter(sequential
+				? counters::num_read_stream_hits : counters::num_read_stream_misses);
+		}
+		else
+		{
+			j->d.io.read_ahead = std::uint16_t(std::min(read_ahead, 0xffff));
+		}
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cache_shard& shard = shard_for(j);
+		std::unique_lock<std::mutex> l(shard.mutex);
+		if (flags & disk_interface::prefetch)
+		{
+			// the piece is already cached, or being read. Don't count this as a
+			// cache hit, it would make the piece look more popular than it is
+			cached_piece_entry const* pe = shard.cache.find_piece(j);
+			if (pe != nullptr && (pe->num_blocks > 0 || pe->outstanding_read))
+			{
+				l.unlock();
+				j->ret = status_t::no_error;
+				j->call_callback();
+				free_job(j);
+				return;
+			}
+			m_stats_counters.inc_stats_counter(counters::num_prefetched_pieces);
+		}
 		int const ret = prep_read_job_impl(j);
 		l.unlock();
 
+		trace_job(j, ret == 0 && (j->flags & disk_interface::cache_hit));
+
 		switch (ret)
 		{
 			case 0:
@@ -1620,7 +2179,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	// and if it doesn't have a piece allocated, it allocates
 	// one and it sets outstanding_read flag and possibly queues
 	// up the job in the piece read job list
-	// the cache std::mutex must be held when calling this
+	// the mutex of the job's cache shard must be held when calling this
 	//
 	// returns 0 if the job succeeded immediately
 	// 1 if it needs to be added to the job queue
@@ -1628,9 +2187,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	//   add it to the queue)
 	int disk_io_thread::prep_read_job_impl(disk_io_job* j, bool const check_fence)
 	{
+		cache_shard& shard = shard_for(j);
 		TORRENT_ASSERT(j->action == job_action_t::read);
 
-		int const ret = m_disk_cache.try_read(j, *this);
+		int const ret = shard.cache.try_read(j, *this);
 		if (ret >= 0)
 		{
 			m_stats_counters.inc_stats_counter(counters::num_blocks_cache_hits);
@@ -1658,17 +2218,21 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		}
 
 		if (!m_settings.get_bool(settings_pack::use_read_cache)
-			|| m_settings.get_int(settings_pack::cache_size) == 0)
+			|| m_settings.get_int(settings_pack::cache_size) == 0
+			|| j->storage->has_read_views()
+			|| j->wants_file_range())
 		{
-			// if the read cache is disabled then we can skip going through the cache
+			// if the read cache is disabled (or the storage serves reads out of
+			// memory by itself, or the block may be sent straight out of the
+			// file) then we can skip going through the cache
 			// but only if there is no existing piece entry. Otherwise there may be a
 			// partial hit on one-or-more dirty buffers so we must use the cache
 			// to avoid reading bogus data from storage
-			if (m_disk_cache.find_piece(j) == nullptr)
+			if (shard.cache.find_piece(j) == nullptr)
 				return 1;
 		}
 
-		cached_piece_entry* pe = m_disk_cache.allocate_piece(j, cached_piece_entry::read_lru1);
+		cached_piece_entry* pe = shard.cache.allocate_piece(j, cached_piece_entry::read_lru1);
 
 		if (pe == nullptr)
 		{
@@ -1702,7 +2266,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		TORRENT_ASSERT(buf != nullptr);
 
 		bool exceeded = false;
-		disk_buffer_holder buffer(*this, m_disk_cache.allocate_buffer(exceeded, o, "receive buffer"), 0x4000);
+		disk_buffer_holder buffer(*this, m_buffer_pool.allocate_buffer(exceeded, o, "receive buffer"), 0x4000);
 		if (!buffer) aux::throw_ex<std::bad_alloc>();
 		std::memcpy(buffer.get(), buf, aux::numeric_cast<std::size_t>(r.length));
 
@@ -1715,9 +2279,11 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		j->callback = std::move(handler);
 		j->flags = flags;
 
+		cache_shard& shard = shard_for(j);
+
 #if TORRENT_USE_ASSERTS
-		std::unique_lock<std::mutex> l3_(m_cache_mutex);
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		std::unique_lock<std::mutex> l3_(shard.mutex);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe)
 		{
 			// we should never add a new dirty block to a piece
@@ -1731,21 +2297,25 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #endif
 
 #if TORRENT_USE_ASSERTS && defined TORRENT_EXPENSIVE_INVARIANT_CHECKS
-		std::unique_lock<std::mutex> l2_(m_cache_mutex);
-		auto range = m_disk_cache.all_pieces();
-		for (auto i = range.first; i != range.second; ++i)
+		for (auto const& s : m_cache_shards)
 		{
-			cached_piece_entry const& p = *i;
-			int const piece_size = p.storage->files().piece_size(p.piece);
-			int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
-			for (int k = 0; k < blocks_in_piece; ++k)
-				TORRENT_PIECE_ASSERT(p.blocks[k].buf != boost::get<disk_buffer_holder>(j->argument).get(), &p);
+			std::unique_lock<std::mutex> l2_(s->mutex);
+			auto range = s->cache.all_pieces();
+			for (auto i = range.first; i != range.second; ++i)
+			{
+				cached_piece_entry const& p = *i;
+				int const piece_size = p.storage->files().piece_size(p.piece);
+				int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
+				for (int k = 0; k < blocks_in_piece; ++k)
+					TORRENT_PIECE_ASSERT(p.blocks[k].buf != boost::get<disk_buffer_holder>(j->argument).get(), &p);
+			}
 		}
-		l2_.unlock();
 #endif
 
 		TORRENT_ASSERT((r.start % default_block_size) == 0);
 
+		trace_job(j);
+
 		if (j->storage->is_blocked(j))
 		{
 			// this means the job was queued up inside storage
@@ -1756,10 +2326,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			return exceeded;
 		}
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(shard.mutex);
 		// if we succeed in adding the block to the cache, the job will
 		// be added along with it. we may not free j if so
-		cached_piece_entry* dpe = m_disk_cache.add_dirty_block(j);
+		cached_piece_entry* dpe = shard.cache.add_dirty_block(j);
 
 		if (dpe != nullptr)
 		{
@@ -1800,8 +2370,9 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		int const piece_size = j->storage->files().piece_size(piece);
 
 		// first check to see if the hashing is already done
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cache_shard& shard = shard_for(j);
+		std::unique_lock<std::mutex> l(shard.mutex);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe != nullptr && !pe->hashing && pe->hash && pe->hash->offset == piece_size)
 		{
 			j->d.piece_hash = pe->hash->h.final();
@@ -1816,11 +2387,13 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #endif
 
 			l.unlock();
+			trace_job(j, true);
 			j->call_callback();
 			free_job(j);
 			return;
 		}
 		l.unlock();
+		trace_job(j);
 		add_job(j);
 	}
 
@@ -1846,12 +2419,13 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		{
-			std::unique_lock<std::mutex> l(m_cache_mutex);
+			std::lock_guard<std::mutex> l(j->storage->piece_mutex());
 			auto const& pieces = j->storage->cached_pieces();
 			for (auto const& p : pieces)
 				TORRENT_ASSERT(p.storage == j->storage);
 		}
 #endif
+		trace_job(j);
 		add_fence_job(j);
 	}
 
@@ -1863,12 +2437,11 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		std::shared_ptr<storage_interface> st
 			= m_torrents[storage]->shared_from_this();
 		// hash jobs
-		for (auto i = m_hash_io_jobs.m_queued_jobs.iterate(); i.get(); i.next())
+		m_hash_io_jobs.m_queued_jobs.for_each([&st](disk_io_job* j)
 		{
-			disk_io_job *j = i.get();
-			if (j->storage != st) continue;
+			if (j->storage != st) return;
 			j->flags |= disk_io_job::aborted;
-		}
+		});
 	}
 
 	void disk_io_thread::async_delete_files(storage_index_t const storage
@@ -1880,6 +2453,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->callback = std::move(handler);
 		j->argument = options;
+		trace_job(j);
 		add_fence_job(j);
 	}
 
@@ -1919,6 +2493,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		disk_io_job* j = allocate_job(job_action_t::stop_torrent);
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->callback = std::move(handler);
+		trace_job(j);
 		add_fence_job(j);
 	}
 
@@ -1939,6 +2514,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			return;
 		}
 
+		trace_job(j);
 		add_job(j);
 	}
 
@@ -1964,11 +2540,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		// regular jobs are not guaranteed to be executed in-order
 		// since clear piece must guarantee that all write jobs that
-		// have been issued finish before the clear piece job completes
-
-		// TODO: this is potentially very expensive. One way to solve
-		// it would be to have a fence for just this one piece.
-		add_fence_job(j);
+		// have been issued finish before the clear piece job completes.
+		// Only jobs on this piece need to be held back for that
+		trace_job(j);
+		add_piece_fence_job(j, index, next(index));
 	}
 
 	void disk_io_thread::clear_piece(storage_index_t const storage
@@ -1976,9 +2551,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	{
 
 		storage_interface* st = m_torrents[storage].get();
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cache_shard& shard = shard_for(st, index);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(st, index);
+		cached_piece_entry* pe = shard.cache.find_piece(st, index);
 		if (pe == nullptr) return;
 		TORRENT_PIECE_ASSERT(pe->hashing == false, pe);
 		pe->hashing_done = 0;
@@ -1991,7 +2567,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// in fact, no jobs should really be hung on this piece
 		// at this point
 		jobqueue_t jobs;
-		bool const ok = m_disk_cache.evict_piece(pe, jobs, block_cache::allow_ghost);
+		bool const ok = shard.cache.evict_piece(pe, jobs, block_cache::allow_ghost);
 		TORRENT_PIECE_ASSERT(ok, pe);
 		TORRENT_UNUSED(ok);
 		fail_jobs(storage_error(boost::asio::error::operation_aborted), jobs);
@@ -1999,6 +2575,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 	void disk_io_thread::kick_hasher(cached_piece_entry* pe, std::unique_lock<std::mutex>& l)
 	{
+		cache_shard& shard = shard_for(pe);
 		if (!pe->hash) return;
 		if (pe->hashing) return;
 
@@ -2018,7 +2595,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			if (bl.buf == nullptr) break;
 
 			// if we fail to lock the block, it' no longer in the cache
-			if (m_disk_cache.inc_block_refcount(pe, i, block_cache::ref_hashing) == false)
+			if (shard.cache.inc_block_refcount(pe, i, block_cache::ref_hashing) == false)
 				break;
 
 			++end;
@@ -2067,8 +2644,19 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		pe->hashing = 0;
 
 		// decrement the block refcounters
+		int reordered = 0;
 		for (int i = cursor; i < end; ++i)
-			m_disk_cache.dec_block_refcount(pe, i, block_cache::ref_hashing);
+		{
+			cached_block_entry& bl = pe->blocks[i];
+			if (bl.out_of_order)
+			{
+				++reordered;
+				bl.out_of_order = false;
+			}
+			shard.cache.dec_block_refcount(pe, i, block_cache::ref_hashing);
+		}
+		if (reordered > 0)
+			m_stats_counters.inc_stats_counter(counters::num_reordered_blocks_hashed, reordered);
 
 		// did we complete the hash?
 		if (pe->hash->offset != piece_size) return;
@@ -2097,6 +2685,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				hj->d.piece_hash = result;
 				hj->ret = status_t::no_error;
 			}
+			pe->storage->piece_hashed(pe->piece, result, false);
 
 			pe->hash.reset();
 			if (pe->cache_state != cached_piece_entry::volatile_read_lru)
@@ -2116,10 +2705,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		int const piece_size = j->storage->files().piece_size(j->piece);
 		int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
-		open_mode_t const file_flags = file_flags_for_job(j
+		open_mode_t const file_flags = file_flags_for_job(j, m_settings
 			, m_settings.get_bool(settings_pack::coalesce_reads));
 
-		iovec_t iov = { m_disk_cache.allocate_buffer("hashing")
+		iovec_t iov = { m_buffer_pool.allocate_buffer("hashing")
 			, static_cast<std::size_t>(default_block_size) };
 		hasher h;
 		int ret = 0;
@@ -2151,28 +2740,44 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			h.update(iov);
 		}
 
-		m_disk_cache.free_buffer(iov.data());
+		m_buffer_pool.free_buffer(iov.data());
 
 		j->d.piece_hash = h.final();
-		return ret >= 0 ? status_t::no_error : status_t::fatal_disk_error;
+		if (ret < 0) return status_t::fatal_disk_error;
+
+		j->storage->piece_hashed(j->piece, j->d.piece_hash, true);
+		return status_t::no_error;
 	}
 
 	status_t disk_io_thread::do_hash(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
 	{
+		cache_shard& shard = shard_for(j);
 		int const piece_size = j->storage->files().piece_size(j->piece);
-		open_mode_t const file_flags = file_flags_for_job(j
+		open_mode_t const file_flags = file_flags_for_job(j, m_settings
 			, m_settings.get_bool(settings_pack::coalesce_reads));
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(shard.mutex);
+
+		cached_piece_entry* pe = shard.cache.find_piece(j);
+
+		// when checking files, the storage may already know what the piece
+		// looks like on disk
+		if (pe == nullptr
+			&& (j->flags & disk_interface::volatile_read)
+			&& j->storage->cached_piece_hash(j->piece, j->d.piece_hash))
+		{
+			DLOG("do_hash: (%d) (verification cache)\n", int(j->piece));
+			m_stats_counters.inc_stats_counter(counters::num_verification_cache_hits);
+			return status_t::no_error;
+		}
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
 		if (pe != nullptr)
 		{
 			TORRENT_ASSERT(pe->in_use);
 #if TORRENT_USE_ASSERTS
 			pe->piece_log.push_back(piece_log_t(j->action));
 #endif
-			m_disk_cache.cache_hit(pe, j->d.io.offset / default_block_size
+			shard.cache.cache_hit(pe, j->d.io.offset / default_block_size
 				, bool(j->flags & disk_interface::volatile_read));
 
 			TORRENT_PIECE_ASSERT(pe->cache_state <= cached_piece_entry::read_lru1 || pe->cache_state == cached_piece_entry::read_lru2, pe);
@@ -2194,8 +2799,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #if TORRENT_USE_ASSERTS
 				++pe->hash_passes;
 #endif
-				m_disk_cache.update_cache_state(pe);
-				m_disk_cache.maybe_free_piece(pe);
+				shard.cache.update_cache_state(pe);
+				shard.cache.maybe_free_piece(pe);
+				l.unlock();
+				j->storage->piece_hashed(j->piece, j->d.piece_hash, false);
 				return status_t::no_error;
 			}
 		}
@@ -2209,7 +2816,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			std::uint16_t const cache_state = std::uint16_t((j->flags & disk_interface::volatile_read)
 				? cached_piece_entry::volatile_read_lru
 				: cached_piece_entry::read_lru1);
-			pe = m_disk_cache.allocate_piece(j, cache_state);
+			pe = shard.cache.allocate_piece(j, cache_state);
 		}
 		if (pe == nullptr)
 		{
@@ -2280,14 +2887,14 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			if (pe->blocks[first_block + i].buf == nullptr) continue;
 
 			// if we fail to lock the block, it's no longer in the cache
-			if (m_disk_cache.inc_block_refcount(pe, first_block + i, block_cache::ref_hashing) == false)
+			if (shard.cache.inc_block_refcount(pe, first_block + i, block_cache::ref_hashing) == false)
 				continue;
 
 			locked_blocks[num_locked_blocks++] = i;
 		}
 
 		// to keep the cache footprint low, try to evict a volatile piece
-		m_disk_cache.try_evict_one_volatile();
+		shard.cache.try_evict_one_volatile();
 
 		// save a local copy of offset to avoid concurrent access
 		int offset = ph->offset;
@@ -2304,7 +2911,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			// this is the fast path where we don't have any blocks in the cache.
 			// We'll need to read all (remaining blocks) from disk
 			TORRENT_ALLOCA(iov, iovec_t, blocks_left);
-			if (m_disk_cache.allocate_iovec(iov) >= 0)
+			if (m_buffer_pool.allocate_iovec(iov) >= 0)
 			{
 				// if this is the last piece, adjust the size of the
 				// last buffer to match up
@@ -2328,23 +2935,36 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
 					m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
 
+					slow_path = false;
+
+					// when checking files, leave the hashing to the check
+					// hashers and move on to read the next piece
+					if (j->flags & disk_interface::volatile_read)
+					{
+						check_hash_job cj{j, pe, first_block
+							, std::vector<iovec_t>(iov.begin(), iov.end())};
+						if (queue_check_hash(cj))
+						{
+							refcount_holder.disarm();
+							return defer_handler;
+						}
+					}
+
 					for (auto const& v : iov)
 					{
 						offset += int(v.size());
 						ph->h.update(v);
 					}
 
-					slow_path = false;
-
 					TORRENT_ASSERT(offset == piece_size);
 
 					l.lock();
-					m_disk_cache.insert_blocks(pe, first_block, iov, j);
+					shard.cache.insert_blocks(pe, first_block, iov, j);
 					l.unlock();
 				}
 				else
 				{
-					m_disk_cache.free_iovec(iov);
+					m_buffer_pool.free_iovec(iov);
 				}
 			}
 		}
@@ -2367,7 +2987,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 				}
 				else
 				{
-					iovec_t const iov = { m_disk_cache.allocate_buffer("hashing")
+					iovec_t const iov = { m_buffer_pool.allocate_buffer("hashing")
 						, aux::numeric_cast<std::size_t>(std::min(default_block_size, piece_size - offset))};
 
 					if (iov.data() == nullptr)
@@ -2375,12 +2995,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 						l.lock();
 						// decrement the refcounts of the blocks we just hashed
 						for (int k = 0; k < num_locked_blocks; ++k)
-							m_disk_cache.dec_block_refcount(pe, first_block + locked_blocks[k], block_cache::ref_hashing);
+							shard.cache.dec_block_refcount(pe, first_block + locked_blocks[k], block_cache::ref_hashing);
 
 						refcount_holder.release();
 						pe->hashing = false;
 						pe->hash.reset();
-						m_disk_cache.maybe_free_piece(pe);
+						shard.cache.maybe_free_piece(pe);
 
 						j->error.ec = errors::no_memory;
 						j->error.operation = operation_t::alloc_cache_piece;
@@ -2399,7 +3019,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					{
 						ret = status_t::fatal_disk_error;
 						TORRENT_ASSERT(j->error.ec && j->error.operation != operation_t::unknown);
-						m_disk_cache.free_buffer(iov.data());
+						m_buffer_pool.free_buffer(iov.data());
 						break;
 					}
 
@@ -2411,7 +3031,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 						ret = status_t::fatal_disk_error;
 						j->error.ec = boost::asio::error::eof;
 						j->error.operation = operation_t::file_read;
-						m_disk_cache.free_buffer(iov.data());
+						m_buffer_pool.free_buffer(iov.data());
 						break;
 					}
 
@@ -2431,7 +3051,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					ph->h.update(iov);
 
 					l.lock();
-					m_disk_cache.insert_blocks(pe, first_block + i, iov, j);
+					shard.cache.insert_blocks(pe, first_block + i, iov, j);
 					l.unlock();
 				}
 			}
@@ -2444,7 +3064,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		// decrement the refcounts of the blocks we just hashed
 		for (int i = 0; i < num_locked_blocks; ++i)
-			m_disk_cache.dec_block_refcount(pe, first_block + locked_blocks[i], block_cache::ref_hashing);
+			shard.cache.dec_block_refcount(pe, first_block + locked_blocks[i], block_cache::ref_hashing);
 
 		refcount_holder.release();
 
@@ -2460,16 +3080,179 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #if TORRENT_USE_ASSERTS
 			++pe->hash_passes;
 #endif
-			m_disk_cache.update_cache_state(pe);
+			shard.cache.update_cache_state(pe);
 		}
 
-		m_disk_cache.maybe_free_piece(pe);
+		shard.cache.maybe_free_piece(pe);
+		l.unlock();
 
 		TORRENT_ASSERT(ret == status_t::no_error || (j->error.ec && j->error.operation != operation_t::unknown));
 
+		// unless all of the piece was read from disk just now, some blocks
+		// may still be waiting to be written
+		if (ret == status_t::no_error)
+		{
+			j->storage->piece_hashed(j->piece, j->d.piece_hash
+				, num_locked_blocks == 0 && first_block == 0);
+		}
+
 		return ret;
 	}
 
+	bool disk_io_thread::queue_check_hash(check_hash_job& cj)
+	{
+		std::unique_lock<std::mutex> l(m_check_hash_mutex);
+		if (m_check_hash_abort || m_num_check_hashers == 0) return false;
+		while (int(m_check_hashers.size()) < m_num_check_hashers)
+		{
+			m_check_hashers.emplace_back(&disk_io_thread::check_hasher_fun
+				, this, int(m_check_hashers.size()));
+		}
+		m_check_hash_queue.push_back(std::move(cj));
+		// idle hashers (whose index is above m_num_check_hashers) ignore the
+		// job, make sure one of the active ones wakes up
+		m_check_hash_cond.notify_all();
+		return true;
+	}
+
+	void disk_io_thread::check_hasher_fun(int const idx)
+	{
+		int const max_batch = aux::sha1_mb_lanes();
+		std::vector<check_hash_job> batch;
+		batch.reserve(std::size_t(max_batch));
+
+		std::unique_lock<std::mutex> l(m_check_hash_mutex);
+		for (;;)
+		{
+			// once aborted, all hashers help draining the queue before exiting
+			m_check_hash_cond.wait(l, [&] {
+				return m_check_hash_queue.empty()
+					? m_check_hash_abort
+					: (m_check_hash_abort || idx < m_num_check_hashers); });
+			if (m_check_hash_queue.empty()) return;
+
+			// when the hashers can't keep up with reading, pieces queue up and
+			// are hashed in batches by the multi-buffer SHA-1 kernel. Take
+			// no more than our share of the queue though, to keep the other
+			// hashers busy too
+			int const num_hashers = std::max(m_num_check_hashers, 1);
+			int const share = (int(m_check_hash_queue.size()) + num_hashers - 1) / num_hashers;
+			int const batch_size = std::min(max_batch, share);
+			for (int i = 0; i < batch_size; ++i)
+			{
+				batch.push_back(std::move(m_check_hash_queue.front()));
+				m_check_hash_queue.pop_front();
+			}
+			l.unlock();
+			hash_checked_pieces(batch);
+			batch.clear();
+			l.lock();
+		}
+	}
+
+	// this is the second half of do_hash(), for pieces read in one go by a
+	// job with the volatile_read flag. The pieces are still marked as being
+	// hashed and we hold a piece refcount, so the partial hashes are ours
+	void disk_io_thread::hash_checked_pieces(span<check_hash_job> jobs)
+	{
+		time_point const start_time = clock_type::now();
+
+		// pieces read from the start are hashed together by the multi-buffer
+		// hasher. The ones whose first blocks were hashed from the cache
+		// already continue their partial hash
+		std::vector<span<char const>> bufs;
+		std::vector<aux::sha1_mb_message> msgs;
+		std::vector<sha1_hash> hashes(jobs.size());
+		std::size_t num_bufs = 0;
+		for (auto const& cj : jobs) num_bufs += cj.iov.size();
+		bufs.reserve(num_bufs);
+		msgs.reserve(jobs.size());
+
+		for (std::size_t i = 0; i < jobs.size(); ++i)
+		{
+			check_hash_job& cj = jobs[i];
+			partial_hash* ph = cj.pe->hash.get();
+			TORRENT_ASSERT(ph);
+			if (ph->offset == 0)
+			{
+				std::size_t const first = bufs.size();
+				bufs.insert(bufs.end(), cj.iov.begin(), cj.iov.end());
+				msgs.push_back({span<span<char const> const>(bufs).subspan(first, cj.iov.size())});
+			}
+			else
+			{
+				for (auto const& v : cj.iov) ph->h.update(v);
+				hashes[i] = ph->h.final();
+			}
+		}
+
+		std::vector<sha1_hash> mb_hashes(msgs.size());
+		aux::sha1_mb(msgs, mb_hashes);
+		for (std::size_t i = 0, k = 0; i < jobs.size(); ++i)
+		{
+			if (jobs[i].pe->hash->offset == 0) hashes[i] = mb_hashes[k++];
+		}
+
+		std::int64_t const hash_time = total_microseconds(clock_type::now() - start_time);
+		m_stats_counters.inc_stats_counter(counters::disk_hash_time, hash_time);
+		m_stats_counters.inc_stats_counter(counters::disk_job_time, hash_time);
+
+		jobqueue_t completed_jobs;
+		for (std::size_t i = 0; i < jobs.size(); ++i)
+		{
+			check_hash_job& cj = jobs[i];
+			disk_io_job* j = cj.job;
+			cached_piece_entry* pe = cj.pe;
+			partial_hash* ph = pe->hash.get();
+
+			int offset = ph->offset;
+			for (auto const& v : cj.iov) offset += int(v.size());
+
+			cache_shard& shard = shard_for(j);
+			std::unique_lock<std::mutex> l(shard.mutex);
+
+			TORRENT_PIECE_ASSERT(pe->hashing, pe);
+			TORRENT_PIECE_ASSERT(offset == j->storage->files().piece_size(j->piece), pe);
+			ph->offset = offset;
+
+			shard.cache.insert_blocks(pe, cj.first_block, cj.iov, j);
+
+			TORRENT_PIECE_ASSERT(pe->piece_refcount > 0, pe);
+			--pe->piece_refcount;
+			pe->hashing = 0;
+
+			j->d.piece_hash = hashes[i];
+			pe->hash.reset();
+			if (pe->cache_state != cached_piece_entry::volatile_read_lru)
+				pe->hashing_done = 1;
+#if TORRENT_USE_ASSERTS
+			++pe->hash_passes;
+#endif
+			shard.cache.update_cache_state(pe);
+			shard.cache.maybe_free_piece(pe);
+			l.unlock();
+
+			j->storage->piece_hashed(j->piece, j->d.piece_hash, cj.first_block == 0);
+
+			j->ret = status_t::no_error;
+			completed_jobs.push_back(j);
+		}
+		add_completed_jobs(completed_jobs);
+	}
+
+	void disk_io_thread::stop_check_hashers()
+	{
+		std::vector<std::thread> threads;
+		{
+			std::unique_lock<std::mutex> l(m_check_hash_mutex);
+			m_check_hash_abort = true;
+			threads.swap(m_check_hashers);
+		}
+		m_check_hash_cond.notify_all();
+		for (auto& t : threads) t.join();
+		TORRENT_ASSERT(m_check_hash_queue.empty());
+	}
+
 	status_t disk_io_thread::do_move_storage(disk_io_job* j, jobqueue_t& /* completed_jobs */ )
 	{
 		// if this assert fails, something's wrong with the fence logic
@@ -2485,9 +3268,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// if this assert fails, something's wrong with the fence logic
 		TORRENT_ASSERT(j->storage->num_outstanding_jobs() == 1);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-		flush_cache(j->storage.get(), flush_write_cache, completed_jobs, l);
-		l.unlock();
+		flush_cache(j->storage.get(), flush_write_cache, completed_jobs);
 
 		j->storage->release_files(j->error);
 		return j->error ? status_t::fatal_disk_error : status_t::no_error;
@@ -2500,12 +3281,9 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// if this assert fails, something's wrong with the fence logic
 		TORRENT_ASSERT(j->storage->num_outstanding_jobs() == 1);
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-
 		flush_cache(j->storage.get()
 			, flush_read_cache | flush_delete_cache | flush_expect_clear
-			, completed_jobs, l);
-		l.unlock();
+			, completed_jobs);
 
 		j->storage->delete_files(boost::get<remove_flags_t>(j->argument), j->error);
 		return j->error ? status_t::fatal_disk_error : status_t::no_error;
@@ -2588,10 +3366,8 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		// issue write commands for all dirty blocks
 		// and clear all read jobs
-		std::unique_lock<std::mutex> l(m_cache_mutex);
 		flush_cache(j->storage.get(), flush_read_cache | flush_write_cache
-			, completed_jobs, l);
-		l.unlock();
+			, completed_jobs);
 
 		j->storage->release_files(j->error);
 		return j->error ? status_t::fatal_disk_error : status_t::no_error;
@@ -2617,6 +3393,24 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			info.blocks[std::size_t(b)] = i->blocks[b].buf != nullptr;
 	}
 
+	// the cache gauges, summed across all cache shards
+	struct cache_totals
+	{
+		void add(block_cache const& c)
+		{
+			read_cache_size += c.read_cache_size();
+			write_cache_size += c.write_cache_size();
+			pinned_blocks += c.pinned_blocks();
+			for (int i = 0; i < cached_piece_entry::num_lrus; ++i)
+				lru_size[std::size_t(i)] += c.num_lru_pieces(i);
+		}
+
+		int read_cache_size = 0;
+		int write_cache_size = 0;
+		int pinned_blocks = 0;
+		std::array<int, cached_piece_entry::num_lrus> lru_size{};
+	};
+
 	} // anonymous namespace
 
 	void disk_io_thread::update_stats_counters(counters& c) const
@@ -2633,21 +3427,39 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		jl.unlock();
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-
 		// gauges
-		c.set_value(counters::disk_blocks_in_use, m_disk_cache.in_use());
+		c.set_value(counters::disk_blocks_in_use, m_buffer_pool.in_use());
+		c.set_value(counters::disk_blocks_reserved, m_buffer_pool.num_reserved());
+		c.set_value(counters::queued_file_closes, m_file_pool.num_pending_closes());
+		c.set_value(counters::disk_file_close_time, m_file_pool.close_time());
+
+		cache_totals t;
+		for (auto const& s : m_cache_shards)
+		{
+			std::unique_lock<std::mutex> l(s->mutex);
+			t.add(s->cache);
+		}
+
+		c.set_value(counters::write_cache_blocks, t.write_cache_size);
+		c.set_value(counters::read_cache_blocks, t.read_cache_size);
+		c.set_value(counters::pinned_blocks, t.pinned_blocks);
 
-		m_disk_cache.update_stats_counters(c);
+		c.set_value(counters::arc_mru_size, t.lru_size[cached_piece_entry::read_lru1]);
+		c.set_value(counters::arc_mru_ghost_size, t.lru_size[cached_piece_entry::read_lru1_ghost]);
+		c.set_value(counters::arc_mfu_size, t.lru_size[cached_piece_entry::read_lru2]);
+		c.set_value(counters::arc_mfu_ghost_size, t.lru_size[cached_piece_entry::read_lru2_ghost]);
+		c.set_value(counters::arc_write_size, t.lru_size[cached_piece_entry::write_lru]);
+		c.set_value(counters::arc_volatile_size, t.lru_size[cached_piece_entry::volatile_read_lru]);
 	}
 
 	void disk_io_thread::get_cache_info(cache_status* ret, storage_index_t const st
 		, bool const no_pieces, bool const session) const
 	{
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		// this needs a consistent view of the whole cache
+		auto l = lock_all_shards();
 
 #if TORRENT_ABI_VERSION == 1
-		ret->total_used_buffers = m_disk_cache.in_use();
+		ret->total_used_buffers = m_buffer_pool.in_use();
 
 		ret->blocks_read_hit = int(m_stats_counters[counters::num_blocks_cache_hits]);
 		ret->blocks_read = int(m_stats_counters[counters::num_blocks_read]);
@@ -2685,11 +3497,32 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		for (int i = 0; i < static_cast<int>(job_action_t::num_job_ids); ++i)
 			ret->num_fence_jobs[i] = int(m_stats_counters[counters::num_fenced_read + i]);
 
-		m_disk_cache.get_stats(ret);
+		cache_totals t;
+		for (auto const& s : m_cache_shards) t.add(s->cache);
+
+		ret->write_cache_size = t.write_cache_size;
+		ret->read_cache_size = t.read_cache_size;
+		ret->pinned_blocks = t.pinned_blocks;
+		ret->cache_size = t.read_cache_size + t.write_cache_size;
+
+		ret->arc_mru_size = t.lru_size[cached_piece_entry::read_lru1];
+		ret->arc_mru_ghost_size = t.lru_size[cached_piece_entry::read_lru1_ghost];
+		ret->arc_mfu_size = t.lru_size[cached_piece_entry::read_lru2];
+		ret->arc_mfu_ghost_size = t.lru_size[cached_piece_entry::read_lru2_ghost];
+		ret->arc_write_size = t.lru_size[cached_piece_entry::write_lru];
+		ret->arc_volatile_size = t.lru_size[cached_piece_entry::volatile_read_lru];
 
 #endif
 
 		ret->pieces.clear();
+		ret->torrents.clear();
+
+		for (auto const& storage : m_torrents)
+		{
+			if (!storage) continue;
+			if (!session && storage->storage_index() != st) continue;
+			ret->torrents.push_back({storage.get(), storage->num_cached_blocks()});
+		}
 
 		if (no_pieces == false)
 		{
@@ -2697,6 +3530,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			{
 				std::shared_ptr<storage_interface> storage = m_torrents[st];
 				TORRENT_ASSERT(storage);
+				std::lock_guard<std::mutex> pl(storage->piece_mutex());
 				ret->pieces.reserve(aux::numeric_cast<std::size_t>(storage->num_pieces()));
 
 				for (auto const& pe : storage->cached_pieces())
@@ -2712,21 +3546,26 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			}
 			else
 			{
-				ret->pieces.reserve(aux::numeric_cast<std::size_t>(m_disk_cache.num_pieces()));
+				int num_pieces = 0;
+				for (auto const& s : m_cache_shards) num_pieces += s->cache.num_pieces();
+				ret->pieces.reserve(aux::numeric_cast<std::size_t>(num_pieces));
 
-				auto range = m_disk_cache.all_pieces();
-				for (auto i = range.first; i != range.second; ++i)
+				for (auto const& s : m_cache_shards)
 				{
-					if (i->cache_state == cached_piece_entry::read_lru2_ghost
-						|| i->cache_state == cached_piece_entry::read_lru1_ghost)
-						continue;
-					ret->pieces.emplace_back();
-					get_cache_info_impl(ret->pieces.back(), &*i);
+					auto range = s->cache.all_pieces();
+					for (auto i = range.first; i != range.second; ++i)
+					{
+						if (i->cache_state == cached_piece_entry::read_lru2_ghost
+							|| i->cache_state == cached_piece_entry::read_lru1_ghost)
+							continue;
+						ret->pieces.emplace_back();
+						get_cache_info_impl(ret->pieces.back(), &*i);
+					}
 				}
 			}
 		}
 
-		l.unlock();
+		l.clear();
 
 #if TORRENT_ABI_VERSION == 1
 		std::unique_lock<std::mutex> jl(m_job_mutex);
@@ -2737,9 +3576,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 	status_t disk_io_thread::do_flush_piece(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cache_shard& shard = shard_for(j);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe == nullptr) return status_t::no_error;
 
 #if TORRENT_USE_ASSERTS
@@ -2756,9 +3596,10 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	// triggered by another mechanism.
 	status_t disk_io_thread::do_flush_hashed(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cache_shard& shard = shard_for(j);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 
 		if (pe == nullptr) return status_t::no_error;
 
@@ -2784,7 +3625,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			if (pe->hash == nullptr && !m_settings.get_bool(settings_pack::disable_hash_checks))
 			{
 				pe->hash.reset(new partial_hash);
-				m_disk_cache.update_cache_state(pe);
+				shard.cache.update_cache_state(pe);
 			}
 
 			// see if we can progress the hash cursor with this new block
@@ -2804,15 +3645,31 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		refcount_holder.release();
 
-		m_disk_cache.maybe_free_piece(pe);
+		shard.cache.maybe_free_piece(pe);
 
 		return status_t::no_error;
 	}
 
 	status_t disk_io_thread::do_flush_storage(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
-		std::unique_lock<std::mutex> l(m_cache_mutex);
-		flush_cache(j->storage.get(), flush_write_cache, completed_jobs, l);
+		if (j->d.num_pieces < 0)
+		{
+			flush_cache(j->storage.get(), flush_write_cache, completed_jobs);
+			return status_t::no_error;
+		}
+
+		// this flush job was issued by a piece fence, only the pieces it
+		// covers need to be flushed
+		storage_interface* st = j->storage.get();
+		piece_index_t const end(static_cast<int>(j->piece) + j->d.num_pieces);
+		for (piece_index_t p = j->piece; p < end; ++p)
+		{
+			cache_shard& shard = shard_for(st, p);
+			std::unique_lock<std::mutex> l(shard.mutex);
+			cached_piece_entry* pe = shard.cache.find_piece(st, p);
+			if (pe == nullptr) continue;
+			flush_piece(pe, flush_write_cache, completed_jobs, l);
+		}
 		return status_t::no_error;
 	}
 
@@ -2835,11 +3692,17 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 	// have been evicted
 	status_t disk_io_thread::do_clear_piece(disk_io_job* j, jobqueue_t& completed_jobs)
 	{
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		cache_shard& shard = shard_for(j);
+		std::unique_lock<std::mutex> l(shard.mutex);
 
-		cached_piece_entry* pe = m_disk_cache.find_piece(j);
+		cached_piece_entry* pe = shard.cache.find_piece(j);
 		if (pe == nullptr) return status_t::no_error;
-		TORRENT_PIECE_ASSERT(pe->hashing == false, pe);
+
+		// the fence only holds back jobs on this piece. Jobs on other pieces
+		// may still be hashing or flushing blocks of this one (when
+		// flushing to relieve cache pressure, or coalescing writes with an
+		// adjacent piece). Wait for them to finish
+		if (pe->hashing) return retry_job;
 		pe->hashing_done = 0;
 		pe->hash.reset();
 		pe->hashing_done = false;
@@ -2853,19 +3716,18 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// are still outstanding operations on it, in which case
 		// try again later
 		jobqueue_t jobs;
-		if (m_disk_cache.evict_piece(pe, jobs, block_cache::allow_ghost))
+		if (shard.cache.evict_piece(pe, jobs, block_cache::allow_ghost))
 		{
 			fail_jobs_impl(storage_error(boost::asio::error::operation_aborted)
 				, jobs, completed_jobs);
 			return status_t::no_error;
 		}
 
-		m_disk_cache.mark_for_eviction(pe, block_cache::allow_ghost);
+		shard.cache.mark_for_eviction(pe, block_cache::allow_ghost);
 		if (pe->num_blocks == 0) return status_t::no_error;
 
-		// we should always be able to evict the piece, since
-		// this is a fence job
-		TORRENT_PIECE_ASSERT_FAIL(pe);
+		// some blocks are still referenced by a flush or a hash issued on
+		// behalf of another piece, try again once they're released
 		return retry_job;
 	}
 
@@ -2884,8 +3746,37 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 		disk_io_job* fj = allocate_job(job_action_t::flush_storage);
 		fj->storage = j->storage;
+		fj->d.num_pieces = -1;
+
+		int const ret = j->storage->raise_fence(j, fj, m_stats_counters);
+		post_fence_job(j, fj, ret, user_add);
+	}
+
+	void disk_io_thread::add_piece_fence_job(disk_io_job* j
+		, piece_index_t const first, piece_index_t const last)
+	{
+		TORRENT_ASSERT(!m_abort);
+
+		DLOG("add_piece_fence:job: %s [%d, %d) (outstanding: %d)\n"
+			, job_action_name[j->action], static_cast<int>(first)
+			, static_cast<int>(last), j->storage->num_outstanding_jobs());
 
-		int ret = j->storage->raise_fence(j, fj, m_stats_counters);
+		m_stats_counters.inc_stats_counter(counters::num_fenced_read + static_cast<int>(j->action));
+
+		// the flush job only needs to flush the pieces covered by the fence
+		disk_io_job* fj = allocate_job(job_action_t::flush_storage);
+		fj->storage = j->storage;
+		fj->piece = first;
+		fj->d.num_pieces = static_cast<int>(last) - static_cast<int>(first);
+
+		int const ret = j->storage->raise_piece_fence(j, fj, m_stats_counters
+			, first, last);
+		post_fence_job(j, fj, ret, true);
+	}
+
+	void disk_io_thread::post_fence_job(disk_io_job* j, disk_io_job* fj
+		, int const ret, bool const user_add)
+	{
 		if (ret == aux::disk_job_fence::fence_post_fence)
 		{
 			std::unique_lock<std::mutex> l(m_job_mutex);
@@ -2995,6 +3886,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		while (!m_generic_io_jobs.m_queued_jobs.empty())
 		{
 			disk_io_job* j = m_generic_io_jobs.m_queued_jobs.pop_front();
+			record_queue_time(j);
 			maybe_flush_write_blocks();
 			execute_job(j);
 		}
@@ -3020,18 +3912,47 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		time_point const now = clock_type::now();
 		if (now <= m_last_cache_expiry + seconds(5)) return;
 
-		std::unique_lock<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(m_cache_check_mutex);
+		if (now <= m_last_cache_expiry + seconds(5)) return;
 		DLOG("blocked_jobs: %d queued_jobs: %d num_threads %d\n"
 			, int(m_stats_counters[counters::blocked_disk_jobs])
 			, m_generic_io_jobs.m_queued_jobs.size(), num_threads());
 		m_last_cache_expiry = now;
-		jobqueue_t completed_jobs;
-		flush_expired_write_blocks(completed_jobs, l);
 		l.unlock();
+		jobqueue_t completed_jobs;
+		flush_expired_write_blocks(completed_jobs);
 		if (!completed_jobs.empty())
 			add_completed_jobs(completed_jobs);
 	}
 
+	void disk_io_thread::record_queue_time(disk_io_job const* j)
+	{
+		// the upper bounds of the queue time histogram buckets, the last
+		// bucket has none
+		static std::array<std::int64_t, 5> const bucket_limit{{
+			1000, 10000, 50000, 250000, 1000000 }};
+		int const num_buckets = int(bucket_limit.size()) + 1;
+		static_assert(counters::disk_queue_idle_slow + 1 - counters::disk_queue_critical_1ms
+			== int(aux::disk_job_class::num_classes) * 6
+			, "there must be a histogram bucket counter per class and bucket");
+
+		int const c = static_cast<int>(aux::job_class(j));
+		std::int64_t const queue_time = total_microseconds(clock_type::now() - j->queued_at);
+		m_stats_counters.inc_stats_counter(counters::disk_queue_time_critical + c
+			, queue_time);
+		m_stats_counters.inc_stats_counter(counters::num_disk_jobs_critical + c);
+
+		int const bucket = int(std::upper_bound(bucket_limit.begin()
+			, bucket_limit.end(), queue_time) - bucket_limit.begin());
+		m_stats_counters.inc_stats_counter(counters::disk_queue_critical_1ms
+			+ c * num_buckets + bucket);
+	}
+
+	void disk_io_thread::trace_job(disk_io_job const* j, bool const cache_hit)
+	{
+		if (m_trace) m_trace->record(j, cache_hit);
+	}
+
 	void disk_io_thread::execute_job(disk_io_job* j)
 	{
 		jobqueue_t completed_jobs;
@@ -3114,6 +4035,8 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 			j = queue.m_queued_jobs.pop_front();
 			l.unlock();
 
+			record_queue_time(j);
+
 			TORRENT_ASSERT((j->flags & disk_io_job::in_progress) || !j->storage);
 
 			if (&pool == &m_generic_threads && thread_id == pool.first_thread_id())
@@ -3185,19 +4108,24 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		// This is not supposed to happen because the disk thread is now scheduled
 		// for shut down after all peers have shut down (see
 		// session_impl::abort_stage2()).
-		std::unique_lock<std::mutex> l2(m_cache_mutex);
-		TORRENT_ASSERT_VAL(m_disk_cache.pinned_blocks() == 0
-			, m_disk_cache.pinned_blocks());
-		while (m_disk_cache.pinned_blocks() > 0)
+		for (auto const& s : m_cache_shards)
 		{
-			l2.unlock();
-			std::this_thread::sleep_for(milliseconds(100));
-			l2.lock();
+			std::unique_lock<std::mutex> l2(s->mutex);
+			TORRENT_ASSERT_VAL(s->cache.pinned_blocks() == 0
+				, s->cache.pinned_blocks());
+			while (s->cache.pinned_blocks() > 0)
+			{
+				l2.unlock();
+				std::this_thread::sleep_for(milliseconds(100));
+				l2.lock();
+			}
 		}
-		l2.unlock();
 
 		DLOG("disk thread %s is the last one alive. cleaning up\n", thread_id_str.str().c_str());
 
+		// pieces still being hashed for checking hold references to the
+		// cache, let them complete first
+		stop_check_hashers();
 		abort_jobs();
 
 		TORRENT_ASSERT(m_magic == 0x1337);
@@ -3209,7 +4137,11 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 		TORRENT_ASSERT(!m_jobs_aborted.exchange(true));
 
 		jobqueue_t jobs;
-		m_disk_cache.clear(jobs);
+		for (auto const& s : m_cache_shards)
+		{
+			std::unique_lock<std::mutex> l(s->mutex);
+			s->cache.clear(jobs);
+		}
 		fail_jobs(storage_error(boost::asio::error::operation_aborted), jobs);
 
 		// close all files. This may take a long
@@ -3221,8 +4153,12 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 #if TORRENT_USE_ASSERTS
 		// by now, all pieces should have been evicted
-		auto pieces = m_disk_cache.all_pieces();
-		TORRENT_ASSERT(pieces.first == pieces.second);
+		for (auto const& s : m_cache_shards)
+		{
+			std::unique_lock<std::mutex> l(s->mutex);
+			auto pieces = s->cache.all_pieces();
+			TORRENT_ASSERT(pieces.first == pieces.second);
+		}
 #endif
 
 		TORRENT_ASSERT(m_magic == 0x1337);
@@ -3326,8 +4262,9 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 
 				if (j->action != job_action_t::write) continue;
 
-				std::unique_lock<std::mutex> l(m_cache_mutex);
-				cached_piece_entry* pe = m_disk_cache.find_piece(j);
+				cache_shard& shard = shard_for(j);
+				std::unique_lock<std::mutex> l(shard.mutex);
+				cached_piece_entry* pe = shard.cache.find_piece(j);
 				if (!pe) continue;
 
 				TORRENT_ASSERT(pe->blocks[j->d.io.offset / 16 / 1024].buf
@@ -3338,11 +4275,13 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 #endif
 			jobqueue_t other_jobs;
 			jobqueue_t flush_jobs;
-			std::unique_lock<std::mutex> l_(m_cache_mutex);
 			while (!new_jobs.empty())
 			{
 				disk_io_job* j = new_jobs.pop_front();
 
+				cache_shard& shard = shard_for(j);
+				std::unique_lock<std::mutex> l_(shard.mutex);
+
 				if (j->action == job_action_t::read)
 				{
 					int const state = prep_read_job_impl(j, false);
@@ -3365,7 +4304,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					continue;
 				}
 
-				cached_piece_entry* pe = m_disk_cache.add_dirty_block(j);
+				cached_piece_entry* pe = shard.cache.add_dirty_block(j);
 
 				if (pe == nullptr)
 				{
@@ -3384,7 +4323,7 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					&& !m_settings.get_bool(settings_pack::disable_hash_checks))
 				{
 					pe->hash.reset(new partial_hash);
-					m_disk_cache.update_cache_state(pe);
+					shard.cache.update_cache_state(pe);
 				}
 
 				TORRENT_PIECE_ASSERT(pe->cache_state <= cached_piece_entry::read_lru1 || pe->cache_state == cached_piece_entry::read_lru2, pe);
@@ -3401,7 +4340,6 @@ constexpr disk_job_flags_t disk_interface::cache_hit;
 					flush_jobs.push_back(fj);
 				}
 			}
-			l_.unlock();
 
 			{
 				std::lock_guard<std::mutex> l(m_job_mutex);
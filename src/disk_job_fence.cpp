@@ -35,6 +35,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_io_job.hpp"
 #include "libtorrent/performance_counters.hpp"
 
+#include <algorithm>
+
 #define DEBUG_STORAGE 0
 
 #if DEBUG_STORAGE
@@ -45,6 +47,28 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent { namespace aux {
 
+namespace {
+
+	// jobs that operate on a single piece. These are the jobs held back by
+	// piece fences. Any other job is either a fence itself, or a flush job
+	// issued by one
+	bool is_piece_job(disk_io_job const* j)
+	{
+		if (j->flags & disk_io_job::fence) return false;
+		switch (j->action)
+		{
+			case job_action_t::read:
+			case job_action_t::write:
+			case job_action_t::hash:
+			case job_action_t::flush_piece:
+			case job_action_t::flush_hashed:
+				return true;
+			default:
+				return false;
+		}
+	}
+}
+
 	int disk_job_fence::job_complete(disk_io_job* j, tailqueue<disk_io_job>& jobs)
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -54,7 +78,24 @@ namespace libtorrent { namespace aux {
 
 		TORRENT_ASSERT(m_outstanding_jobs > 0);
 		--m_outstanding_jobs;
-		if (j->flags & disk_io_job::fence)
+
+		int const num_jobs = jobs.size();
+
+		auto const pf = std::find_if(m_piece_fences.begin(), m_piece_fences.end()
+			, [j](piece_fence const& f) { return f.fence_job == j; });
+		if (pf != m_piece_fences.end())
+		{
+			// a piece fence job just completed. Issue the jobs that were held
+			// back by it, in order. Some of them may be held back again, by
+			// other piece fences
+			TORRENT_ASSERT(pf->state == piece_fence::running);
+			tailqueue<disk_io_job> blocked;
+			blocked.swap(pf->blocked);
+			m_piece_fences.erase(pf);
+			while (!blocked.empty())
+				release_job(blocked.pop_front(), jobs);
+		}
+		else if (j->flags & disk_io_job::fence)
 		{
 			// a fence job just completed. Make sure the fence logic
 			// works by asserting m_outstanding_jobs is in fact 0 now
@@ -66,23 +107,21 @@ namespace libtorrent { namespace aux {
 			// now we need to post all jobs that have been queued up
 			// while this fence was up. However, if there's another fence
 			// in the queue, stop there and raise the fence again
-			int ret = 0;
 			while (!m_blocked_jobs.empty())
 			{
 				disk_io_job *bj = m_blocked_jobs.pop_front();
-				if (bj->flags & disk_io_job::fence)
+				if ((bj->flags & disk_io_job::fence) && queued_fence(bj) == nullptr)
 				{
 					// we encountered another fence. We cannot post anymore
 					// jobs from the blocked jobs queue. We have to go back
 					// into a raised fence mode and wait for all current jobs
 					// to complete. The exception is that if there are no jobs
 					// executing currently, we should add the fence job.
-					if (m_outstanding_jobs == 0 && jobs.empty())
+					if (m_outstanding_jobs == 0 && jobs.size() == num_jobs)
 					{
 						TORRENT_ASSERT(!(bj->flags & disk_io_job::in_progress));
 						bj->flags |= disk_io_job::in_progress;
 						++m_outstanding_jobs;
-						++ret;
 #if TORRENT_USE_ASSERTS
 						TORRENT_ASSERT(bj->blocked);
 						bj->blocked = false;
@@ -94,26 +133,47 @@ namespace libtorrent { namespace aux {
 						// put the fence job back in the blocked queue
 						m_blocked_jobs.push_front(bj);
 					}
-					return ret;
+					return jobs.size() - num_jobs;
 				}
-				TORRENT_ASSERT(!(bj->flags & disk_io_job::in_progress));
-				bj->flags |= disk_io_job::in_progress;
 
+				// piece fences that were queued up behind this fence are raised
+				// now, and may hold back some of the jobs that follow them
 				++m_outstanding_jobs;
-				++ret;
-#if TORRENT_USE_ASSERTS
-				TORRENT_ASSERT(bj->blocked);
-				bj->blocked = false;
-#endif
-				jobs.push_back(bj);
+				release_job(bj, jobs);
+			}
+			return jobs.size() - num_jobs;
+		}
+		else
+		{
+			if (is_piece_job(j))
+			{
+				auto const i = m_piece_jobs.find(j->piece);
+				TORRENT_ASSERT(i != m_piece_jobs.end());
+				if (i != m_piece_jobs.end() && --i->second == 0)
+					m_piece_jobs.erase(i);
+			}
+
+			// this may be one of the jobs a piece fence is waiting for
+			for (auto& f : m_piece_fences)
+			{
+				if (f.flush_job == j)
+				{
+					TORRENT_ASSERT(f.flush_outstanding);
+					f.flush_outstanding = false;
+				}
+				else if (!is_piece_job(j) || j->piece < f.first || j->piece >= f.last)
+				{
+					continue;
+				}
+				if (f.state == piece_fence::active)
+					outstanding_job_complete(f, jobs);
 			}
-			return ret;
 		}
 
 		// there are still outstanding jobs, even if we have a
 		// fence, it's not time to lower it yet
 		// also, if we don't have a fence, we're done
-		if (m_outstanding_jobs > 0 || m_has_fence == 0) return 0;
+		if (m_outstanding_jobs > 0 || m_has_fence == 0) return jobs.size() - num_jobs;
 
 		// there's a fence raised, and no outstanding operations.
 		// it means we can execute the fence job right now.
@@ -133,7 +193,7 @@ namespace libtorrent { namespace aux {
 #endif
 		// prioritize fence jobs since they're blocking other jobs
 		jobs.push_front(bj);
-		return 1;
+		return jobs.size() - num_jobs;
 	}
 
 	bool disk_job_fence::is_blocked(disk_io_job* j)
@@ -148,9 +208,23 @@ namespace libtorrent { namespace aux {
 		if (m_has_fence == 0)
 		{
 			TORRENT_ASSERT(!(j->flags & disk_io_job::in_progress));
-			j->flags |= disk_io_job::in_progress;
 			++m_outstanding_jobs;
-			return false;
+
+			piece_fence* f = is_piece_job(j)
+				? overlapping_fence(j->piece, next(j->piece)) : nullptr;
+			if (f == nullptr)
+			{
+				start_job(j);
+				return false;
+			}
+
+			// there's a fence up on this piece
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(j->blocked == false);
+			j->blocked = true;
+#endif
+			f->blocked.push_back(j);
+			return true;
 		}
 
 		m_blocked_jobs.push_back(j);
@@ -172,7 +246,10 @@ namespace libtorrent { namespace aux {
 	int disk_job_fence::num_blocked() const
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
-		return m_blocked_jobs.size();
+		int ret = m_blocked_jobs.size();
+		for (auto const& f : m_piece_fences)
+			ret += f.blocked.size();
+		return ret;
 	}
 
 	// j is the fence job. It must have exclusive access to the storage
@@ -218,8 +295,8 @@ namespace libtorrent { namespace aux {
 		else
 		{
 			// in this case, fj is expected to be put on the job queue
-			fj->flags |= disk_io_job::in_progress;
 			++m_outstanding_jobs;
+			start_job(fj);
 		}
 #if TORRENT_USE_ASSERTS
 		TORRENT_ASSERT(j->blocked == false);
@@ -231,4 +308,189 @@ namespace libtorrent { namespace aux {
 		return m_has_fence > 1 ? fence_post_none : fence_post_flush;
 	}
 
+	int disk_job_fence::raise_piece_fence(disk_io_job* j, disk_io_job* fj
+		, counters& cnt, piece_index_t const first, piece_index_t const last)
+	{
+		TORRENT_ASSERT(!(j->flags & disk_io_job::fence));
+		TORRENT_ASSERT(first < last);
+		j->flags |= disk_io_job::fence;
+
+		std::lock_guard<std::mutex> l(m_mutex);
+
+		DLOG(stderr, "[%p] raise_piece_fence: [%d, %d) fence: %d num_outstanding: %d\n"
+			, static_cast<void*>(this), static_cast<int>(first), static_cast<int>(last)
+			, m_has_fence, int(m_outstanding_jobs));
+
+#if TORRENT_USE_ASSERTS
+		TORRENT_ASSERT(fj->blocked == false);
+		TORRENT_ASSERT(j->blocked == false);
+		j->blocked = true;
+#endif
+
+		if (m_has_fence > 0)
+		{
+			// there's a storage-wide fence up. This fence is raised once it's
+			// lowered. The flush job goes first, just like for a storage-wide
+			// fence
+			m_piece_fences.emplace_back(j, fj, first, last);
+#if TORRENT_USE_ASSERTS
+			fj->blocked = true;
+#endif
+			m_blocked_jobs.push_back(fj);
+			m_blocked_jobs.push_back(j);
+			cnt.inc_stats_counter(counters::blocked_disk_jobs, 2);
+			return fence_post_none;
+		}
+
+		piece_fence* o = overlapping_fence(first, last);
+		if (o != nullptr)
+		{
+			// another piece fence covers some of these pieces. This fence is
+			// raised once that one is lowered
+			m_outstanding_jobs += 2;
+#if TORRENT_USE_ASSERTS
+			fj->blocked = true;
+#endif
+			o->blocked.push_back(fj);
+			o->blocked.push_back(j);
+			m_piece_fences.emplace_back(j, fj, first, last);
+			cnt.inc_stats_counter(counters::blocked_disk_jobs, 2);
+			return fence_post_none;
+		}
+
+		m_piece_fences.emplace_back(j, nullptr, first, last);
+		piece_fence& f = m_piece_fences.back();
+		f.state = piece_fence::active;
+		++m_outstanding_jobs;
+		for (auto const& p : m_piece_jobs)
+		{
+			if (p.first >= first && p.first < last)
+				f.outstanding += p.second;
+		}
+
+		if (f.outstanding == 0)
+		{
+			// there are no outstanding jobs on these pieces. The fence job
+			// can be issued right away, and fj is expected to be discarded by
+			// the caller
+			f.state = piece_fence::running;
+			j->flags |= disk_io_job::in_progress;
+#if TORRENT_USE_ASSERTS
+			j->blocked = false;
+#endif
+			return fence_post_fence;
+		}
+
+		// fj is expected to be put on the job queue, to flush the pieces
+		// the outstanding jobs may be waiting on
+		++m_outstanding_jobs;
+		start_job(fj);
+		f.flush_job = fj;
+		f.flush_outstanding = true;
+		++f.outstanding;
+		cnt.inc_stats_counter(counters::blocked_disk_jobs);
+		return fence_post_flush;
+	}
+
+	disk_job_fence::piece_fence* disk_job_fence::overlapping_fence(
+		piece_index_t const first, piece_index_t const last)
+	{
+		for (auto& f : m_piece_fences)
+		{
+			if (f.state == piece_fence::queued) continue;
+			if (f.first < last && first < f.last) return &f;
+		}
+		return nullptr;
+	}
+
+	disk_job_fence::piece_fence* disk_job_fence::queued_fence(disk_io_job const* j)
+	{
+		for (auto& f : m_piece_fences)
+		{
+			if (f.fence_job == j && f.state == piece_fence::queued) return &f;
+		}
+		return nullptr;
+	}
+
+	// j is accounted for in m_outstanding_jobs already
+	void disk_job_fence::start_job(disk_io_job* j)
+	{
+		TORRENT_ASSERT(!(j->flags & disk_io_job::in_progress));
+		j->flags |= disk_io_job::in_progress;
+
+		if (is_piece_job(j)) ++m_piece_jobs[j->piece];
+
+		for (auto& f : m_piece_fences)
+		{
+			if (f.flush_job != j) continue;
+			TORRENT_ASSERT(f.state == piece_fence::queued);
+			f.flush_outstanding = true;
+		}
+	}
+
+	// j was held back by a fence that was just lowered. It's accounted for in
+	// m_outstanding_jobs already
+	void disk_job_fence::release_job(disk_io_job* j, tailqueue<disk_io_job>& jobs)
+	{
+		if (piece_fence* f = queued_fence(j))
+		{
+			piece_fence* o = overlapping_fence(f->first, f->last);
+			if (o != nullptr) o->blocked.push_back(j);
+			else activate_fence(*f, jobs);
+			return;
+		}
+
+		piece_fence* o = is_piece_job(j)
+			? overlapping_fence(j->piece, next(j->piece)) : nullptr;
+		if (o != nullptr)
+		{
+			o->blocked.push_back(j);
+			return;
+		}
+
+		start_job(j);
+#if TORRENT_USE_ASSERTS
+		TORRENT_ASSERT(j->blocked);
+		j->blocked = false;
+#endif
+		jobs.push_back(j);
+	}
+
+	void disk_job_fence::activate_fence(piece_fence& f, tailqueue<disk_io_job>& jobs)
+	{
+		TORRENT_ASSERT(f.state == piece_fence::queued);
+		f.state = piece_fence::active;
+		f.outstanding = f.flush_outstanding ? 1 : 0;
+		for (auto const& p : m_piece_jobs)
+		{
+			if (p.first >= f.first && p.first < f.last)
+				f.outstanding += p.second;
+		}
+		if (f.outstanding == 0) post_fence(f, jobs);
+	}
+
+	void disk_job_fence::post_fence(piece_fence& f, tailqueue<disk_io_job>& jobs)
+	{
+		TORRENT_ASSERT(f.state == piece_fence::active);
+		TORRENT_ASSERT(f.outstanding == 0);
+		f.state = piece_fence::running;
+
+		disk_io_job* j = f.fence_job;
+		TORRENT_ASSERT(!(j->flags & disk_io_job::in_progress));
+		j->flags |= disk_io_job::in_progress;
+#if TORRENT_USE_ASSERTS
+		TORRENT_ASSERT(j->blocked);
+		j->blocked = false;
+#endif
+		// prioritize fence jobs since they're blocking other jobs
+		jobs.push_front(j);
+	}
+
+	void disk_job_fence::outstanding_job_complete(piece_fence& f
+		, tailqueue<disk_io_job>& jobs)
+	{
+		TORRENT_ASSERT(f.outstanding > 0);
+		if (--f.outstanding == 0) post_fence(f, jobs);
+	}
+
 }}
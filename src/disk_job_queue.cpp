@@ -0,0 +1,135 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// the time a job of each class may wait for others before it goes ahead
+	// of newer jobs of more urgent classes
+	std::array<milliseconds, static_cast<std::size_t>(disk_job_class::num_classes)> const budget{{
+		milliseconds(0), // time_critical
+		milliseconds(50), // read
+		milliseconds(250), // write
+		milliseconds(500), // hash
+		milliseconds(1000), // maintenance
+		milliseconds(0), // idle, never goes ahead of anything
+	}};
+
+	std::size_t class_index(disk_io_job const* j)
+	{
+		return static_cast<std::size_t>(job_class(j));
+	}
+}
+
+	disk_job_class job_class(disk_io_job const* j)
+	{
+		switch (j->action)
+		{
+			case job_action_t::read:
+				return (j->flags & disk_interface::time_critical)
+					? disk_job_class::time_critical
+					: (j->flags & disk_interface::prefetch)
+					? disk_job_class::idle
+					: disk_job_class::read;
+			case job_action_t::write:
+			case job_action_t::flush_piece:
+			case job_action_t::flush_hashed:
+			case job_action_t::flush_storage:
+				return disk_job_class::write;
+			case job_action_t::hash:
+			case job_action_t::check_fastresume:
+				return disk_job_class::hash;
+			case job_action_t::move_storage:
+			case job_action_t::release_files:
+			case job_action_t::delete_files:
+			case job_action_t::rename_file:
+			case job_action_t::stop_torrent:
+			case job_action_t::trim_cache:
+			case job_action_t::file_priority:
+			case job_action_t::clear_piece:
+			case job_action_t::num_job_ids:
+				break;
+		}
+		return disk_job_class::maintenance;
+	}
+
+	void disk_job_queue::push_back(disk_io_job* j)
+	{
+		j->queued_at = clock_type::now();
+		m_queues[class_index(j)].push_back(j);
+		++m_size;
+	}
+
+	void disk_job_queue::push_front(disk_io_job* j)
+	{
+		// the job keeps its class, but goes ahead of the jobs queued in it.
+		// Its deadline can't be later than theirs, or it would hold them up
+		auto& q = m_queues[class_index(j)];
+		time_point const now = clock_type::now();
+		j->queued_at = q.empty() ? now : std::min(now, q.first()->queued_at);
+		q.push_front(j);
+		++m_size;
+	}
+
+	void disk_job_queue::append(tailqueue<disk_io_job>& jobs)
+	{
+		while (!jobs.empty()) push_back(jobs.pop_front());
+	}
+
+	disk_io_job* disk_job_queue::pop_front()
+	{
+		TORRENT_ASSERT(m_size > 0);
+		tailqueue<disk_io_job>* pick = nullptr;
+		time_point earliest = max_time();
+		std::size_t const idle = static_cast<std::size_t>(disk_job_class::idle);
+		for (std::size_t c = 0; c < m_queues.size(); ++c)
+		{
+			auto& q = m_queues[c];
+			if (q.empty()) continue;
+			if (c == idle && pick != nullptr) continue;
+			time_point const deadline = q.first()->queued_at + budget[c];
+			if (pick != nullptr && deadline >= earliest) continue;
+			pick = &q;
+			earliest = deadline;
+		}
+		TORRENT_ASSERT(pick != nullptr);
+		--m_size;
+		return pick->pop_front();
+	}
+}}
@@ -0,0 +1,232 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/disk_trace.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/io.hpp"
+
+namespace libtorrent { namespace aux {
+
+	constexpr std::uint8_t disk_trace_record::storage_record;
+	constexpr std::uint8_t disk_trace_record::cache_hit;
+	constexpr std::uint8_t disk_trace_record::prefetch;
+
+namespace {
+
+	char const disk_trace_magic[4] = { 'L', 'T', 'D', 'T' };
+	std::uint32_t const disk_trace_version = 1;
+
+	// the size the record buffer grows to before it's handed to the writer
+	// thread
+	std::size_t const write_buffer_size = disk_trace_record_size * 2048;
+
+} // anonymous namespace
+
+	disk_trace_writer::disk_trace_writer(std::string const& path)
+		: m_path(path)
+		, m_start(clock_type::now())
+		, m_file(std::fopen(path.c_str(), "wb"))
+	{
+		if (m_file == nullptr)
+		{
+			m_failed = true;
+			return;
+		}
+
+		m_buffer.reserve(write_buffer_size);
+		m_buffer.resize(disk_trace_header_size);
+		char* ptr = m_buffer.data();
+		for (char const c : disk_trace_magic) detail::write_uint8(c, ptr);
+		detail::write_uint32(disk_trace_version, ptr);
+
+		m_thread = std::thread([this] { write_thread_fun(); });
+	}
+
+	disk_trace_writer::~disk_trace_writer()
+	{
+		if (!m_thread.joinable()) return;
+
+		submit();
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_abort = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+		std::fclose(m_file);
+	}
+
+	void disk_trace_writer::submit()
+	{
+		if (m_buffer.empty()) return;
+		std::vector<char> buf;
+		buf.reserve(write_buffer_size);
+		buf.swap(m_buffer);
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_queue.push_back(std::move(buf));
+		}
+		m_cond.notify_all();
+	}
+
+	void disk_trace_writer::write_thread_fun()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (;;)
+		{
+			m_cond.wait(l, [this] { return !m_queue.empty() || m_abort; });
+			if (m_queue.empty()) break;
+
+			std::vector<std::vector<char>> bufs;
+			bufs.swap(m_queue);
+			l.unlock();
+			for (auto const& b : bufs)
+			{
+				// if the disk is full, stop tracing. Records are only ever
+				// written whole, so the trace ends with the last complete
+				// buffer
+				if (m_failed) break;
+				if (std::fwrite(b.data(), b.size(), 1, m_file) != 1)
+					m_failed = true;
+			}
+			l.lock();
+		}
+	}
+
+	void disk_trace_writer::new_storage(std::uint32_t const st)
+	{
+		if (st < m_described.size()) m_described[st] = false;
+	}
+
+	void disk_trace_writer::record(disk_io_job const* j, bool const cache_hit)
+	{
+		if (m_failed || !j->storage) return;
+
+		std::uint32_t const st = static_cast<std::uint32_t>(j->storage->storage_index());
+		std::uint64_t const now = std::uint64_t(total_microseconds(clock_type::now() - m_start));
+
+		if (st >= m_described.size()) m_described.resize(st + 1, false);
+		if (!m_described[st])
+		{
+			file_storage const& fs = j->storage->files();
+			disk_trace_record r;
+			r.time = now;
+			r.storage = st;
+			r.piece = fs.piece_length();
+			r.offset = fs.num_pieces();
+			r.size = fs.num_pieces() > 0
+				? std::uint32_t(fs.piece_size(fs.last_piece())) : 0;
+			r.action = disk_trace_record::storage_record;
+			r.flags = 0;
+			record(r);
+			m_described[st] = true;
+		}
+
+		disk_trace_record r;
+		r.time = now;
+		r.storage = st;
+		r.piece = static_cast<std::int32_t>(j->piece);
+		bool const io = j->action == job_action_t::read
+			|| j->action == job_action_t::write;
+		r.offset = io ? j->d.io.offset : 0;
+		r.size = io ? j->d.io.buffer_size : 0;
+		r.action = static_cast<std::uint8_t>(j->action);
+		r.flags = 0;
+		if (cache_hit) r.flags |= disk_trace_record::cache_hit;
+		if (j->flags & disk_interface::prefetch) r.flags |= disk_trace_record::prefetch;
+		record(r);
+	}
+
+	void disk_trace_writer::record(disk_trace_record const& r)
+	{
+		if (m_failed) return;
+
+		std::size_t const pos = m_buffer.size();
+		m_buffer.resize(pos + disk_trace_record_size);
+		char* ptr = m_buffer.data() + pos;
+		detail::write_uint64(r.time, ptr);
+		detail::write_uint32(r.storage, ptr);
+		detail::write_int32(r.piece, ptr);
+		detail::write_int32(r.offset, ptr);
+		detail::write_uint32(r.size, ptr);
+		detail::write_uint8(r.action, ptr);
+		detail::write_uint8(r.flags, ptr);
+		TORRENT_ASSERT(ptr == m_buffer.data() + m_buffer.size());
+
+		if (m_buffer.size() >= write_buffer_size) submit();
+	}
+
+	disk_trace_reader::disk_trace_reader(std::string const& path)
+		: m_file(std::fopen(path.c_str(), "rb"))
+	{
+		if (m_file == nullptr) return;
+
+		char header[disk_trace_header_size];
+		char const* ptr = header;
+		bool valid = std::fread(header, sizeof(header), 1, m_file) == 1;
+		for (char const c : disk_trace_magic)
+			if (valid && detail::read_uint8(ptr) != std::uint8_t(c)) valid = false;
+		if (valid && detail::read_uint32(ptr) != disk_trace_version) valid = false;
+
+		if (!valid)
+		{
+			std::fclose(m_file);
+			m_file = nullptr;
+		}
+	}
+
+	disk_trace_reader::~disk_trace_reader()
+	{
+		if (m_file != nullptr) std::fclose(m_file);
+	}
+
+	bool disk_trace_reader::next(disk_trace_record& r)
+	{
+		if (m_file == nullptr) return false;
+
+		char buf[disk_trace_record_size];
+		if (std::fread(buf, sizeof(buf), 1, m_file) != 1) return false;
+
+		char const* ptr = buf;
+		r.time = detail::read_uint64(ptr);
+		r.storage = detail::read_uint32(ptr);
+		r.piece = detail::read_int32(ptr);
+		r.offset = detail::read_int32(ptr);
+		r.size = detail::read_uint32(ptr);
+		r.action = detail::read_uint8(ptr);
+		r.flags = detail::read_uint8(ptr);
+		return true;
+	}
+}}
@@ -83,6 +83,8 @@ struct iovec
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
 #include "libtorrent/aux_/alloca.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
+#include "libtorrent/allocator.hpp" // for page_malloc
 #include "libtorrent/file.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/string_util.hpp"
@@ -132,6 +134,7 @@ struct iovec
 // linux specifics
 
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #ifdef TORRENT_ANDROID
 #include <sys/syscall.h>
 #define lseek lseek64
@@ -508,6 +511,15 @@ static_assert(!(open_mode::sparse & open_mode::attribute_mask), "internal flags
 		close();
 		native_path_string file_path = convert_to_native_path_string(path);
 
+#ifndef O_DIRECT
+		// without O_DIRECT, the closest we can get is to not cache the file
+		if (mode & open_mode::direct_io)
+		{
+			mode &= ~open_mode::direct_io;
+			mode |= open_mode::no_cache;
+		}
+#endif
+
 #ifdef TORRENT_WINDOWS
 
 		struct win_open_mode_t
@@ -603,6 +615,9 @@ static_assert(!(open_mode::sparse & open_mode::attribute_mask), "internal flags
 #endif
 #ifdef O_SYNC
 			| ((mode & open_mode::no_cache) ? O_SYNC : 0)
+#endif
+#ifdef O_DIRECT
+			| ((mode & open_mode::direct_io) ? O_DIRECT : 0)
 #endif
 			;
 
@@ -622,6 +637,22 @@ static_assert(!(open_mode::sparse & open_mode::attribute_mask), "internal flags
 				, mode_array[static_cast<std::uint32_t>(mode & open_mode::rw_mask)] | open_mode
 				, permissions);
 		}
+#endif
+#ifdef O_DIRECT
+		// not every filesystem supports O_DIRECT (tmpfs for instance). Fall
+		// back to no_cache mode for those
+		if (handle == -1 && (mode & open_mode::direct_io) && errno == EINVAL)
+		{
+			mode &= ~open_mode::direct_io;
+			mode |= open_mode::no_cache;
+			open_mode &= ~O_DIRECT;
+#ifdef O_SYNC
+			open_mode |= O_SYNC;
+#endif
+			handle = ::open(file_path.c_str()
+				, mode_array[static_cast<std::uint32_t>(mode & open_mode::rw_mask)] | open_mode
+				, permissions);
+		}
 #endif
 		if (handle == -1)
 		{
@@ -944,8 +975,202 @@ namespace {
 #endif // USE_PREADV
 	}
 
+#if TORRENT_USE_IO_URING
+	// like iov(), but rather than issuing one system call per IOV_MAX
+	// buffers, every chunk is queued on the calling thread's io_uring and
+	// submitted at once. If ``sync`` is set, an fdatasync() is queued behind
+	// the last write, saving another round-trip into the kernel
+	std::int64_t uring_iov(aux::io_uring_batch& ring, bool const write
+		, handle_type const fd, std::int64_t file_offset
+		, span<iovec_t const> bufs, bool const sync, error_code& ec)
+	{
+		TORRENT_ALLOCA(vec, ::iovec, bufs.size());
+		auto it = vec.begin();
+		for (auto const& b : bufs)
+		{
+			it->iov_base = b.data();
+			it->iov_len = b.size();
+			++it;
+		}
+
+#ifdef IOV_MAX
+		int const max_bufs = IOV_MAX;
+#else
+		int const max_bufs = int(vec.size());
+#endif
+		TORRENT_ALLOCA(results, std::int64_t, (int(vec.size()) + max_bufs - 1) / max_bufs);
+
+		std::int64_t ret = 0;
+		span<::iovec> remaining = vec;
+		int chunk = 0;
+		while (!remaining.empty())
+		{
+			// if there are more chunks than the ring has room for, they are
+			// submitted in rounds
+			span<::iovec> const round = remaining;
+			int const first_chunk = chunk;
+			while (!remaining.empty() && ring.free_slots() > (sync ? 1 : 0))
+			{
+				auto const nbufs = remaining.first(std::min(int(remaining.size()), max_bufs));
+				if (write)
+					ring.add_writev(fd, file_offset, nbufs.data(), int(nbufs.size()), &results[chunk]);
+				else
+					ring.add_readv(fd, file_offset, nbufs.data(), int(nbufs.size()), &results[chunk]);
+				file_offset += bufs_size(nbufs);
+				remaining = remaining.subspan(nbufs.size());
+				++chunk;
+			}
+
+			std::int64_t sync_ret = 0;
+			if (sync && remaining.empty()) ring.add_fdatasync(fd, &sync_ret);
+
+			if (!ring.submit(ec)) return -1;
+
+			auto submitted = round;
+			for (int i = first_chunk; i < chunk; ++i)
+			{
+				auto const nbufs = submitted.first(std::min(int(submitted.size()), max_bufs));
+				submitted = submitted.subspan(nbufs.size());
+				if (results[i] < 0)
+				{
+					ec.assign(int(-results[i]), system_category());
+					return -1;
+				}
+				ret += results[i];
+
+				// a short read/write. Just like iov(), punt it to the upper layer.
+				// Any chunk past this one is not accounted for
+				if (results[i] < bufs_size(nbufs)) return ret;
+			}
+
+			if (sync_ret < 0 && sync_ret != -EINVAL && sync_ret != -ENOSYS)
+				ec.assign(int(-sync_ret), system_category());
+		}
+		return ret;
+	}
+#endif // TORRENT_USE_IO_URING
+
+#ifdef O_DIRECT
+	// O_DIRECT requires the file offset, and the address and size of every
+	// buffer, to be aligned to the logical block size of the device. A 4 kiB
+	// page is a multiple of that on any device we'd reasonably run on
+	constexpr std::int64_t direct_io_alignment = 4096;
+
+	bool direct_io_aligned(std::int64_t const file_offset
+		, span<iovec_t const> bufs)
+	{
+		if (file_offset % direct_io_alignment != 0) return false;
+		for (auto const& b : bufs)
+		{
+			if (reinterpret_cast<std::uintptr_t>(b.data()) % direct_io_alignment != 0
+				|| b.size() % direct_io_alignment != 0)
+				return false;
+		}
+		return true;
+	}
+#endif
+
 	} // anonymous namespace
 
+	// bounces an unaligned operation on a direct_io file through a page
+	// aligned buffer covering all the blocks it touches. For writes, the
+	// partial blocks at either end are read back first, under a mutex, so
+	// concurrent writes to the two halves of a block don't clobber each other.
+	// Aligned writes never touch a partial block, so they don't need to take
+	// the mutex
+	std::int64_t file::unaligned_direct_iov(bool const write
+		, std::int64_t const file_offset, span<iovec_t const> bufs
+		, error_code& ec, open_mode_t const flags)
+	{
+#ifdef O_DIRECT
+		std::int64_t const size = bufs_size(bufs);
+		std::int64_t const start = file_offset & ~(direct_io_alignment - 1);
+		std::int64_t const end = (file_offset + size + direct_io_alignment - 1)
+			& ~(direct_io_alignment - 1);
+		std::int64_t const head = file_offset - start;
+
+		std::size_t const len = std::size_t(end - start);
+		std::unique_ptr<char, void(*)(char*)> buf(page_malloc(len), &page_free);
+		if (!buf)
+		{
+			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
+			return -1;
+		}
+		iovec_t const aligned = { buf.get(), len };
+
+		if (!write)
+		{
+			std::int64_t const ret = readv(start, aligned, ec, flags);
+			if (ret < 0) return ret;
+
+			// the read may have been cut short by the end of the file
+			std::int64_t left = std::min(ret - head, size);
+			if (left <= 0) return 0;
+			std::int64_t const copied = left;
+			char const* src = buf.get() + head;
+			for (auto const& b : bufs)
+			{
+				std::size_t const n = std::size_t(std::min(left, std::int64_t(b.size())));
+				std::memcpy(b.data(), src, n);
+				src += n;
+				left -= std::int64_t(n);
+				if (left == 0) break;
+			}
+			return copied;
+		}
+
+		TORRENT_ASSERT((m_open_mode & open_mode::rw_mask) == open_mode::read_write);
+
+		std::lock_guard<std::mutex> l(m_direct_io_mutex);
+
+		std::int64_t const file_size = get_size(ec);
+		if (ec) return -1;
+
+		auto read_block = [&](std::int64_t const block)
+		{
+			char* const dst = buf.get() + (block - start);
+			iovec_t const b = { dst, std::size_t(direct_io_alignment) };
+			std::int64_t const ret = readv(block, b, ec, flags);
+			if (ret < 0) return false;
+			// anything past the end of the file reads as zeros
+			std::memset(dst + ret, 0, std::size_t(direct_io_alignment - ret));
+			return true;
+		};
+
+		std::int64_t const last_block = end - direct_io_alignment;
+		if (head > 0 && !read_block(start)) return -1;
+		if (file_offset + size < end
+			&& (last_block != start || head == 0)
+			&& !read_block(last_block))
+			return -1;
+
+		gather_copy(bufs, buf.get() + head);
+
+		std::int64_t const ret = writev(start, aligned, ec, flags);
+		if (ret < 0) return ret;
+
+		// padding the write to a whole block must not grow the file. This is
+		// only safe because default_storage sizes files up-front in this mode,
+		// so no other write can extend the file concurrently
+		if (end > file_size && file_offset + size < end
+			&& ::ftruncate(native_handle(), std::max(file_size, file_offset + size)) < 0)
+		{
+			ec.assign(errno, system_category());
+			return -1;
+		}
+
+		return std::max(std::min(ret - head, size), std::int64_t(0));
+#else
+		TORRENT_UNUSED(write);
+		TORRENT_UNUSED(file_offset);
+		TORRENT_UNUSED(bufs);
+		TORRENT_UNUSED(flags);
+		TORRENT_ASSERT_FAIL();
+		ec = error_code(boost::system::errc::operation_not_supported, generic_category());
+		return -1;
+#endif
+	}
+
 	// this has to be thread safe and atomic. i.e. on posix systems it has to be
 	// turned into a series of pread() calls
 	std::int64_t file::readv(std::int64_t file_offset, span<iovec_t const> bufs
@@ -965,6 +1190,16 @@ namespace {
 		TORRENT_ASSERT(!bufs.empty());
 		TORRENT_ASSERT(is_open());
 
+#ifdef O_DIRECT
+		if (m_open_mode & open_mode::direct_io)
+		{
+			// a coalesced buffer wouldn't be aligned
+			flags &= ~open_mode::coalesce_buffers;
+			if (!direct_io_aligned(file_offset, bufs))
+				return unaligned_direct_iov(false, file_offset, bufs, ec, flags);
+		}
+#endif
+
 		// there's no point in coalescing single buffer writes
 		if (bufs.size() == 1)
 		{
@@ -980,7 +1215,13 @@ namespace {
 				flags &= ~open_mode::coalesce_buffers;
 		}
 
-#if TORRENT_USE_PREADV
+#if TORRENT_USE_IO_URING
+		aux::io_uring_batch* const ring = (flags & open_mode::use_io_uring)
+			? aux::thread_io_uring() : nullptr;
+		std::int64_t ret = ring
+			? uring_iov(*ring, false, native_handle(), file_offset, tmp_bufs, false, ec)
+			: iov(&::preadv, native_handle(), file_offset, tmp_bufs, ec);
+#elif TORRENT_USE_PREADV
 		std::int64_t ret = iov(&::preadv, native_handle(), file_offset, tmp_bufs, ec);
 #elif TORRENT_USE_PREAD
 		std::int64_t ret = iov(&::pread, native_handle(), file_offset, tmp_bufs, ec);
@@ -1017,6 +1258,16 @@ namespace {
 
 		ec.clear();
 
+#ifdef O_DIRECT
+		if (m_open_mode & open_mode::direct_io)
+		{
+			// a coalesced buffer wouldn't be aligned
+			flags &= ~open_mode::coalesce_buffers;
+			if (!direct_io_aligned(file_offset, bufs))
+				return unaligned_direct_iov(true, file_offset, bufs, ec, flags);
+		}
+#endif
+
 		// there's no point in coalescing single buffer writes
 		if (bufs.size() == 1)
 		{
@@ -1031,7 +1282,16 @@ namespace {
 				flags &= ~open_mode::coalesce_buffers;
 		}
 
-#if TORRENT_USE_PREADV
+#if TORRENT_USE_IO_URING
+		aux::io_uring_batch* const ring = (flags & open_mode::use_io_uring)
+			? aux::thread_io_uring() : nullptr;
+		// in no_cache mode, the fdatasync() is issued as part of the same
+		// submission as the writes
+		bool const synced = ring && (m_open_mode & open_mode::no_cache);
+		std::int64_t ret = ring
+			? uring_iov(*ring, true, native_handle(), file_offset, bufs, synced, ec)
+			: iov(&::pwritev, native_handle(), file_offset, bufs, ec);
+#elif TORRENT_USE_PREADV
 		std::int64_t ret = iov(&::pwritev, native_handle(), file_offset, bufs, ec);
 #elif TORRENT_USE_PREAD
 		std::int64_t ret = iov(&::pwrite, native_handle(), file_offset, bufs, ec);
@@ -1045,7 +1305,11 @@ namespace {
 #if TORRENT_USE_FDATASYNC \
 	&& !defined F_NOCACHE && \
 	!defined DIRECTIO_ON
-		if (m_open_mode & open_mode::no_cache)
+		if ((m_open_mode & open_mode::no_cache)
+#if TORRENT_USE_IO_URING
+			&& !synced
+#endif
+			)
 		{
 			if (::fdatasync(native_handle()) != 0
 				&& errno != EINVAL
@@ -1314,4 +1578,42 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		return start;
 #endif
 	}
+
+	void file::prefetch(std::int64_t const file_offset, int const size) const
+	{
+#ifdef TORRENT_LINUX
+		// this returns once the range has been read into the page cache
+		::readahead(native_handle(), file_offset, std::size_t(size));
+#elif defined F_RDADVISE
+		radvisory r;
+		r.ra_offset = file_offset;
+		r.ra_count = size;
+		::fcntl(native_handle(), F_RDADVISE, &r);
+#else
+		TORRENT_UNUSED(file_offset);
+		TORRENT_UNUSED(size);
+#endif
+	}
+
+#if TORRENT_USE_SENDFILE
+	int file::send_to(int const s, std::int64_t const file_offset
+		, int const size, error_code& ec) const
+	{
+		off_t offset = file_offset;
+		ssize_t const ret = ::sendfile(s, native_handle(), &offset, std::size_t(size));
+		if (ret < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+			ec.assign(errno, system_category());
+			return -1;
+		}
+		if (ret == 0)
+		{
+			// the file was truncated since the block was handed out
+			ec = errors::file_too_short;
+			return -1;
+		}
+		return int(ret);
+	}
+#endif
 }
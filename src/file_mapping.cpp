@@ -0,0 +1,98 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/file_mapping.hpp"
+
+#if TORRENT_HAVE_MMAP
+
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent { namespace aux {
+
+	file_mapping::file_mapping(handle_type const fd, std::int64_t const size
+		, error_code& ec)
+		: m_size(size)
+	{
+		// mmap() refuses to create empty mappings
+		if (size == 0) return;
+
+		void* const ret = ::mmap(nullptr, std::size_t(size)
+			, PROT_READ, MAP_SHARED, fd, 0);
+		if (ret == MAP_FAILED)
+		{
+			ec.assign(errno, system_category());
+			m_size = 0;
+			return;
+		}
+		m_mapping = static_cast<char*>(ret);
+	}
+
+	file_mapping::~file_mapping()
+	{
+		if (m_mapping) ::munmap(m_mapping, std::size_t(m_size));
+	}
+
+	int file_mapping::readv(std::int64_t offset, span<iovec_t const> bufs) const
+	{
+		int ret = 0;
+		for (auto const& b : bufs)
+		{
+			if (offset >= m_size) break;
+			std::size_t const len = std::size_t(std::min(std::int64_t(b.size())
+				, m_size - offset));
+			std::memcpy(b.data(), m_mapping + offset, len);
+			offset += std::int64_t(len);
+			ret += int(len);
+		}
+		return ret;
+	}
+
+	void file_mapping::prefault(std::int64_t const offset, int const size) const
+	{
+		TORRENT_ASSERT(offset + size <= m_size);
+		static std::int64_t const page_size = ::sysconf(_SC_PAGESIZE);
+		char sum = 0;
+		for (std::int64_t i = offset & ~(page_size - 1); i < offset + size; i += page_size)
+			sum = char(sum ^ *static_cast<char volatile*>(m_mapping + i));
+		TORRENT_UNUSED(sum);
+	}
+}}
+
+#endif // TORRENT_HAVE_MMAP
@@ -37,18 +37,29 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/units.hpp"
+#include "libtorrent/time.hpp"
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/aux_/path.hpp"
 #ifdef TORRENT_WINDOWS
 #include "libtorrent/aux_/win_util.hpp"
 #endif
 
-#include <limits>
+#include <algorithm>
+#include <tuple>
 
 namespace libtorrent {
 
 	file_pool::file_pool(int size) : m_size(size) {}
-	file_pool::~file_pool() = default;
+
+	file_pool::~file_pool()
+	{
+		{
+			std::lock_guard<std::mutex> l(m_close_mutex);
+			m_close_abort = true;
+		}
+		m_close_cond.notify_all();
+		if (m_close_thread.joinable()) m_close_thread.join();
+	}
 
 #ifdef TORRENT_WINDOWS
 	void set_low_priority(file_handle const& f)
@@ -99,79 +110,109 @@ namespace libtorrent {
 	}
 #endif // TORRENT_WINDOWS
 
+	namespace {
+
+	// returns true if a file opened with mode ``cached`` cannot be used for
+	// a request for mode ``m``, and has to be re-opened
+	bool needs_reopen(open_mode_t const cached, open_mode_t const m)
+	{
+		// if we asked for a file in write mode,
+		// and the cached file is is not opened in
+		// write mode, re-open it
+		return (((cached & open_mode::rw_mask) != open_mode::read_write)
+			&& ((m & open_mode::rw_mask) == open_mode::read_write))
+			|| (cached & open_mode::random_access) != (m & open_mode::random_access);
+	}
+
+	}
+
 	file_handle file_pool::open_file(storage_index_t st, std::string const& p
 		, file_index_t const file_index, file_storage const& fs
 		, open_mode_t const m, error_code& ec)
 	{
+		TORRENT_ASSERT(is_complete(p));
+		TORRENT_ASSERT((m & open_mode::rw_mask) == open_mode::read_only
+			|| (m & open_mode::rw_mask) == open_mode::read_write);
+
 		// potentially used to hold a reference to a file object that's
 		// about to be destructed. If we have such object we assign it to
-		// this member to be destructed after we release the std::mutex. On some
+		// this member to be closed after we release the std::mutex. On some
 		// operating systems (such as OSX) closing a file may take a long
 		// time. We don't want to hold the std::mutex for that.
-		file_handle defer_destruction;
+		deferred_close defer_destruction(*this);
 
 		std::unique_lock<std::mutex> l(m_mutex);
 
-		TORRENT_ASSERT(is_complete(p));
-		TORRENT_ASSERT((m & open_mode::rw_mask) == open_mode::read_only
-			|| (m & open_mode::rw_mask) == open_mode::read_write);
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i != m_files.end())
+		auto const s = m_files.find(st);
+		if (s != m_files.end())
 		{
-			lru_file_entry& e = i->second;
-			e.last_use = aux::time_now();
-
-			// if we asked for a file in write mode,
-			// and the cached file is is not opened in
-			// write mode, re-open it
-			if ((((e.mode & open_mode::rw_mask) != open_mode::read_write)
-				&& ((m & open_mode::rw_mask) == open_mode::read_write))
-				|| (e.mode & open_mode::random_access) != (m & open_mode::random_access))
+			auto const i = s->second.find(file_index);
+			if (i != s->second.end())
 			{
-				file_handle new_file = std::make_shared<file>();
+				lru_file_entry& e = i->second;
+				e.last_use = aux::time_now();
+				m_lru.erase(m_lru.iterator_to(e));
+				m_lru.push_front(e);
 
-				std::string full_path = fs.file_path(file_index, p);
-				if (!new_file->open(full_path, m, ec))
-					return file_handle();
-#ifdef TORRENT_WINDOWS
-				if (m_low_prio_io)
-					set_low_priority(new_file);
-#endif
-
-				TORRENT_ASSERT(new_file->is_open());
-				defer_destruction = std::move(e.file_ptr);
-				e.file_ptr = std::move(new_file);
-				e.mode = m;
+				if (!needs_reopen(e.mode, m)) return e.file_ptr;
 			}
-			return e.file_ptr;
 		}
 
-		lru_file_entry e;
-		e.file_ptr = std::make_shared<file>();
-		if (!e.file_ptr)
-		{
-			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
-			return file_handle();
-		}
-		std::string full_path = fs.file_path(file_index, p);
-		if (!e.file_ptr->open(full_path, m, ec))
+		std::uint32_t const release_counter = release_count(st);
+		l.unlock();
+
+		// opening a file may take a long time. Don't block other threads
+		// from looking up their files in the meantime
+		file_handle new_file = std::make_shared<file>();
+		std::string const full_path = fs.file_path(file_index, p);
+		if (!new_file->open(full_path, m, ec))
 			return file_handle();
 #ifdef TORRENT_WINDOWS
 		if (m_low_prio_io)
-			set_low_priority(e.file_ptr);
+			set_low_priority(new_file);
 #endif
+		TORRENT_ASSERT(new_file->is_open());
+
+		l.lock();
+
+		// files were released while we were opening this one. The release
+		// may have been meant for this file, so don't keep it open in the
+		// pool
+		if (release_counter != release_count(st)) return new_file;
+
+		storage_files& files = m_files[st];
+		auto const i = files.find(file_index);
+		if (i != files.end())
+		{
+			// another thread opened this file while we didn't hold the mutex,
+			// or we're re-opening it in a different mode
+			lru_file_entry& e = i->second;
+			if (!needs_reopen(e.mode, m))
+			{
+				defer_destruction.file = std::move(new_file);
+				return e.file_ptr;
+			}
+			defer_destruction.file = std::move(e.file_ptr);
+			e.file_ptr = new_file;
+			e.mode = m;
+			return new_file;
+		}
+
+		lru_file_entry& e = files.emplace(std::piecewise_construct
+			, std::forward_as_tuple(file_index)
+			, std::forward_as_tuple(st, file_index)).first->second;
+		e.file_ptr = new_file;
 		e.mode = m;
-		file_handle file_ptr = e.file_ptr;
-		m_files.insert(std::make_pair(std::make_pair(st, file_index), e));
-		TORRENT_ASSERT(file_ptr->is_open());
+		m_lru.push_front(e);
+		m_open_order.push_back(e);
 
-		if (int(m_files.size()) >= m_size)
+		if (int(m_lru.size()) >= m_size)
 		{
 			// the file cache is at its maximum size, close
 			// the least recently used (lru) file from it
-			defer_destruction = remove_oldest(l);
+			defer_destruction.file = remove_oldest(l);
 		}
-		return file_ptr;
+		return new_file;
 	}
 
 	namespace {
@@ -203,79 +244,114 @@ namespace libtorrent {
 		{
 			std::unique_lock<std::mutex> l(m_mutex);
 
-			auto const start = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-			auto const end = m_files.upper_bound(std::make_pair(st
-				, std::numeric_limits<file_index_t>::max()));
+			auto const s = m_files.find(st);
+			if (s == m_files.end()) return ret;
 
-			for (auto i = start; i != end; ++i)
+			for (auto const& f : s->second)
 			{
-				ret.push_back({i->first.second, to_file_open_mode(i->second.mode)
-					, i->second.last_use});
+				ret.push_back({f.first, to_file_open_mode(f.second.mode)
+					, f.second.last_use});
 			}
 		}
+		std::sort(ret.begin(), ret.end()
+			, [](open_file_state const& lhs, open_file_state const& rhs)
+			{ return lhs.file_index < rhs.file_index; });
 		return ret;
 	}
 
-	file_handle file_pool::remove_oldest(std::unique_lock<std::mutex>&)
+	file_handle file_pool::remove_oldest(std::unique_lock<std::mutex>& l)
 	{
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.last_use < rhs.second.last_use; });
-		if (i == m_files.end()) return file_handle();
-
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		if (m_lru.empty()) return file_handle();
 
 		// closing a file may be long running operation (mac os x)
 		// let the calling function destruct it after releasing the mutex
+		return remove_file(l, m_lru.back());
+	}
+
+	file_handle file_pool::remove_file(std::unique_lock<std::mutex>&
+		, lru_file_entry& e)
+	{
+		file_handle file_ptr = std::move(e.file_ptr);
+		m_lru.erase(m_lru.iterator_to(e));
+		m_open_order.erase(m_open_order.iterator_to(e));
+
+		// erasing the entry destructs e, so copy the key first
+		storage_index_t const st = e.storage;
+		file_index_t const file_index = e.file_index;
+		auto const s = m_files.find(st);
+		TORRENT_ASSERT(s != m_files.end());
+		s->second.erase(file_index);
+		if (s->second.empty()) m_files.erase(s);
 		return file_ptr;
 	}
 
+	std::uint32_t file_pool::release_count(storage_index_t const st) const
+	{
+		auto const i = m_storage_release_counter.find(st);
+		// both counters only ever grow, so their sum changes whenever either
+		// of them does
+		return m_release_counter
+			+ (i == m_storage_release_counter.end() ? 0 : i->second);
+	}
+
 	void file_pool::release(storage_index_t const st, file_index_t file_index)
 	{
 		std::unique_lock<std::mutex> l(m_mutex);
+		++m_storage_release_counter[st];
 
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i == m_files.end()) return;
+		auto const s = m_files.find(st);
+		if (s == m_files.end()) return;
+		auto const i = s->second.find(file_index);
+		if (i == s->second.end()) return;
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		file_handle file_ptr = remove_file(l, i->second);
 
 		// closing a file may take a long time (mac os x), so make sure
 		// we're not holding the mutex
 		l.unlock();
 		file_ptr.reset();
+		drain_close_queue();
 	}
 
 	// closes files belonging to the specified
 	// storage, or all if none is specified.
 	void file_pool::release()
 	{
+		decltype(m_files) to_close;
 		std::unique_lock<std::mutex> l(m_mutex);
-		m_files.clear();
+		++m_release_counter;
+		m_lru.clear();
+		m_open_order.clear();
+		to_close.swap(m_files);
 		l.unlock();
+		drain_close_queue();
+		// the files are closed here while the lock is not held
 	}
 
 	void file_pool::release(storage_index_t const st)
 	{
+		storage_files to_close;
 		std::unique_lock<std::mutex> l(m_mutex);
+		++m_storage_release_counter[st];
 
-		auto const begin = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-		auto const end = m_files.upper_bound(std::make_pair(st
-				, std::numeric_limits<file_index_t>::max()));
+		auto const s = m_files.find(st);
+		if (s == m_files.end()) return;
 
-		std::vector<file_handle> to_close;
-		for (auto it = begin; it != end; ++it)
-			to_close.push_back(std::move(it->second.file_ptr));
-		if (!to_close.empty()) m_files.erase(begin, end);
+		for (auto& f : s->second)
+		{
+			m_lru.erase(m_lru.iterator_to(f.second));
+			m_open_order.erase(m_open_order.iterator_to(f.second));
+		}
+		to_close.swap(s->second);
+		m_files.erase(s);
 		l.unlock();
+		drain_close_queue();
 		// the files are closed here while the lock is not held
 	}
 
 	void file_pool::resize(int size)
 	{
-		// these are destructed _after_ the mutex is released
+		// these are closed _after_ the mutex is released
 		std::vector<file_handle> defer_destruction;
 
 		std::unique_lock<std::mutex> l(m_mutex);
@@ -284,29 +360,101 @@ namespace libtorrent {
 
 		if (size == m_size) return;
 		m_size = size;
-		if (int(m_files.size()) <= m_size) return;
+		if (int(m_lru.size()) <= m_size) return;
 
 		// close the least recently used files
-		while (int(m_files.size()) > m_size)
+		while (int(m_lru.size()) > m_size)
 			defer_destruction.push_back(remove_oldest(l));
+		l.unlock();
+
+		for (auto& f : defer_destruction)
+			close_file(std::move(f));
 	}
 
 	void file_pool::close_oldest()
 	{
 		std::unique_lock<std::mutex> l(m_mutex);
 
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.opened < rhs.second.opened; });
-		if (i == m_files.end()) return;
-
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		if (m_open_order.empty()) return;
+		file_handle file_ptr = remove_file(l, m_open_order.front());
 
 		// closing a file may be long running operation (mac os x)
 		l.unlock();
-		file_ptr.reset();
-		l.lock();
+		close_file(std::move(file_ptr));
+	}
+
+	void file_pool::set_close_backlog(int const backlog)
+	{
+		TORRENT_ASSERT(backlog >= 0);
+		std::lock_guard<std::mutex> l(m_close_mutex);
+		m_close_backlog = backlog;
+	}
+
+	int file_pool::num_pending_closes() const
+	{
+		std::lock_guard<std::mutex> l(m_close_mutex);
+		return int(m_close_queue.size());
+	}
+
+	void file_pool::close_file(file_handle f)
+	{
+		if (!f) return;
+
+		std::unique_lock<std::mutex> l(m_close_mutex);
+		if (int(m_close_queue.size()) >= m_close_backlog || m_close_abort)
+		{
+			// the closer thread is falling behind (or disabled). Close the file
+			// here, which throttles the thread evicting files
+			l.unlock();
+			std::vector<file_handle> files;
+			files.push_back(std::move(f));
+			close_files(files);
+			return;
+		}
+
+		if (!m_close_thread.joinable())
+			m_close_thread = std::thread([this] { close_thread_fun(); });
+
+		m_close_queue.push_back(std::move(f));
+		l.unlock();
+		m_close_cond.notify_all();
+	}
+
+	void file_pool::close_files(std::vector<file_handle>& files)
+	{
+		time_point const start = clock_type::now();
+		files.clear();
+		m_close_time += total_microseconds(clock_type::now() - start);
+	}
+
+	void file_pool::close_thread_fun()
+	{
+		std::unique_lock<std::mutex> l(m_close_mutex);
+		for (;;)
+		{
+			m_close_cond.wait(l, [this] { return !m_close_queue.empty() || m_close_abort; });
+			if (m_close_queue.empty()) break;
+
+			std::vector<file_handle> files;
+			files.swap(m_close_queue);
+			m_closing = true;
+			l.unlock();
+			close_files(files);
+			l.lock();
+			m_closing = false;
+			m_close_cond.notify_all();
+		}
+	}
+
+	// close the files waiting for the closer thread, and wait for the ones
+	// it's closing right now
+	void file_pool::drain_close_queue()
+	{
+		std::unique_lock<std::mutex> l(m_close_mutex);
+		std::vector<file_handle> files;
+		files.swap(m_close_queue);
+		m_close_cond.wait(l, [this] { return !m_closing; });
+		l.unlock();
+		close_files(files);
 	}
 }
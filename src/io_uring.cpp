@@ -0,0 +1,250 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/io_uring.hpp"
+
+#if TORRENT_USE_IO_URING
+
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	int sys_io_uring_setup(std::uint32_t const entries, io_uring_params* p)
+	{
+#ifdef __NR_io_uring_setup
+		return int(::syscall(__NR_io_uring_setup, entries, p));
+#else
+		TORRENT_UNUSED(entries);
+		TORRENT_UNUSED(p);
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	int sys_io_uring_enter(int const fd, std::uint32_t const to_submit
+		, std::uint32_t const min_complete, std::uint32_t const flags)
+	{
+#ifdef __NR_io_uring_enter
+		return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete
+			, flags, nullptr, 0));
+#else
+		TORRENT_UNUSED(fd);
+		TORRENT_UNUSED(to_submit);
+		TORRENT_UNUSED(min_complete);
+		TORRENT_UNUSED(flags);
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	template <typename T>
+	T* ring_ptr(void* ring, std::uint32_t const offset)
+	{
+		return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+	}
+
+	void* map_ring(int const fd, std::size_t const size, off_t const offset)
+	{
+		void* ret = ::mmap(nullptr, size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, fd, offset);
+		return ret == MAP_FAILED ? nullptr : ret;
+	}
+}
+
+	io_uring_batch::io_uring_batch(std::uint32_t const entries)
+	{
+		io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		int const fd = sys_io_uring_setup(entries, &p);
+		if (fd < 0) return;
+
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+		m_sq_ring = map_ring(fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+		m_cq_ring = map_ring(fd, m_cq_ring_size, IORING_OFF_CQ_RING);
+		m_sqes = static_cast<io_uring_sqe*>(map_ring(fd, m_sqes_size, IORING_OFF_SQES));
+		if (m_sq_ring == nullptr || m_cq_ring == nullptr || m_sqes == nullptr)
+		{
+			if (m_sq_ring) ::munmap(m_sq_ring, m_sq_ring_size);
+			if (m_cq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+			if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+			m_sq_ring = nullptr;
+			m_cq_ring = nullptr;
+			m_sqes = nullptr;
+			::close(fd);
+			return;
+		}
+
+		m_sq_head = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.head);
+		m_sq_tail = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.tail);
+		m_sq_array = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.array);
+		m_sq_mask = *ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.ring_mask);
+		m_sq_entries = p.sq_entries;
+		m_cq_head = ring_ptr<std::uint32_t>(m_cq_ring, p.cq_off.head);
+		m_cq_tail = ring_ptr<std::uint32_t>(m_cq_ring, p.cq_off.tail);
+		m_cqes = ring_ptr<io_uring_cqe>(m_cq_ring, p.cq_off.cqes);
+		m_cq_mask = *ring_ptr<std::uint32_t>(m_cq_ring, p.cq_off.ring_mask);
+		m_ring_fd = fd;
+	}
+
+	io_uring_batch::~io_uring_batch()
+	{
+		if (m_ring_fd < 0) return;
+		::munmap(m_sqes, m_sqes_size);
+		::munmap(m_cq_ring, m_cq_ring_size);
+		::munmap(m_sq_ring, m_sq_ring_size);
+		::close(m_ring_fd);
+	}
+
+	io_uring_sqe* io_uring_batch::next_sqe()
+	{
+		TORRENT_ASSERT(valid());
+		TORRENT_ASSERT(m_queued < m_sq_entries);
+		// we're the only producer, and the kernel has consumed everything we
+		// submitted by the time submit() returns, so the tail is stable
+		std::uint32_t const idx = (*m_sq_tail + m_queued) & m_sq_mask;
+		m_sq_array[idx] = idx;
+		++m_queued;
+		io_uring_sqe* sqe = &m_sqes[idx];
+		std::memset(sqe, 0, sizeof(*sqe));
+		return sqe;
+	}
+
+	void io_uring_batch::add_readv(int const fd, std::int64_t const offset
+		, ::iovec const* bufs, int const num_bufs, std::int64_t* result)
+	{
+		io_uring_sqe* sqe = next_sqe();
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->off = std::uint64_t(offset);
+		sqe->addr = reinterpret_cast<std::uintptr_t>(bufs);
+		sqe->len = std::uint32_t(num_bufs);
+		sqe->user_data = reinterpret_cast<std::uintptr_t>(result);
+	}
+
+	void io_uring_batch::add_writev(int const fd, std::int64_t const offset
+		, ::iovec const* bufs, int const num_bufs, std::int64_t* result)
+	{
+		io_uring_sqe* sqe = next_sqe();
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->fd = fd;
+		sqe->off = std::uint64_t(offset);
+		sqe->addr = reinterpret_cast<std::uintptr_t>(bufs);
+		sqe->len = std::uint32_t(num_bufs);
+		sqe->user_data = reinterpret_cast<std::uintptr_t>(result);
+	}
+
+	void io_uring_batch::add_fdatasync(int const fd, std::int64_t* result)
+	{
+		io_uring_sqe* sqe = next_sqe();
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->flags = IOSQE_IO_DRAIN;
+		sqe->fd = fd;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+		sqe->user_data = reinterpret_cast<std::uintptr_t>(result);
+	}
+
+	bool io_uring_batch::submit(error_code& ec)
+	{
+		TORRENT_ASSERT(valid());
+		if (m_queued == 0) return true;
+
+		// publish the new entries to the kernel
+		__atomic_store_n(m_sq_tail, *m_sq_tail + m_queued, __ATOMIC_RELEASE);
+
+		std::uint32_t to_submit = m_queued;
+		std::uint32_t pending = m_queued;
+		m_queued = 0;
+		bool failed = false;
+
+		while (pending > 0)
+		{
+			int const ret = sys_io_uring_enter(m_ring_fd, to_submit, pending
+				, IORING_ENTER_GETEVENTS);
+			if (ret < 0)
+			{
+				if (errno == EINTR) continue;
+				ec.assign(errno, system_category());
+				// waiting for completions failed, there's nothing more we can do
+				if (to_submit == 0 || failed) return false;
+				failed = true;
+				// the kernel didn't accept the remaining entries, take them back
+				// so the ring is usable for the next batch. Whatever was already
+				// submitted still has to be waited for, since the caller is
+				// about to release the buffers
+				__atomic_store_n(m_sq_tail, *m_sq_tail - to_submit, __ATOMIC_RELEASE);
+				pending -= to_submit;
+				to_submit = 0;
+				continue;
+			}
+			to_submit -= std::uint32_t(ret);
+
+			std::uint32_t head = *m_cq_head;
+			std::uint32_t const tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head)
+			{
+				io_uring_cqe const& cqe = m_cqes[head & m_cq_mask];
+				*reinterpret_cast<std::int64_t*>(std::uintptr_t(cqe.user_data)) = cqe.res;
+				TORRENT_ASSERT(pending > 0);
+				--pending;
+			}
+			__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		}
+		return !failed;
+	}
+
+	io_uring_batch* thread_io_uring()
+	{
+		// one ring per disk thread. Reads and writes of a single piece rarely
+		// need more than a handful of entries, larger batches are submitted in
+		// rounds
+		thread_local std::unique_ptr<io_uring_batch> ring(new io_uring_batch(64));
+		return ring->valid() ? ring.get() : nullptr;
+	}
+}}
+
+#endif // TORRENT_USE_IO_URING
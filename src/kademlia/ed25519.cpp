@@ -83,6 +83,33 @@ namespace libtorrent { namespace dht {
 		return libtorrent::ed25519_verify(sig_ptr, msg_ptr, msg.size(), pk_ptr) == 1;
 	}
 
+	bool ed25519_verify_batch(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks
+		, std::vector<bool>& valid)
+	{
+		TORRENT_ASSERT(sigs.size() == msgs.size());
+		TORRENT_ASSERT(sigs.size() == pks.size());
+
+		std::size_t const num = sigs.size();
+		std::vector<unsigned char const*> sig_ptrs(num);
+		std::vector<unsigned char const*> msg_ptrs(num);
+		std::vector<std::size_t> msg_lens(num);
+		std::vector<unsigned char const*> pk_ptrs(num);
+		std::vector<int> ret(num);
+		for (std::size_t i = 0; i < num; ++i)
+		{
+			sig_ptrs[i] = reinterpret_cast<unsigned char const*>(sigs[i].bytes.data());
+			msg_ptrs[i] = reinterpret_cast<unsigned char const*>(msgs[i].data());
+			msg_lens[i] = msgs[i].size();
+			pk_ptrs[i] = reinterpret_cast<unsigned char const*>(pks[i].bytes.data());
+		}
+
+		bool const all_valid = libtorrent::ed25519_verify_batch(sig_ptrs.data()
+			, msg_ptrs.data(), msg_lens.data(), pk_ptrs.data(), num, ret.data()) == 1;
+		valid.assign(ret.begin(), ret.end());
+		return all_valid;
+	}
+
 	public_key ed25519_add_scalar(public_key const& pk
 		, std::array<char, 32> const& scalar)
 	{
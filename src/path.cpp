@@ -73,6 +73,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/string_util.hpp"
 #include "libtorrent/aux_/max_path.hpp" // for TORRENT_MAX_PATH
 #include <cstring>
+#include <vector>
 
 // for convert_to_wstring and convert_to_native
 #include "libtorrent/aux_/escape_string.hpp"
@@ -113,6 +114,12 @@ POSSIBILITY OF SUCH DAMAGE.
 // linux specifics
 
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+// cloning a file's extents (btrfs, xfs) first appeared in 4.5
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 #elif defined __APPLE__ && defined __MACH__ && MAC_OS_X_VERSION_MIN_REQUIRED >= 1050
 // mac specifics
@@ -163,6 +170,13 @@ namespace {
 		// convert to seconds
 		return time_t(ft / 10000000 - posix_time_offset);
 	}
+
+	std::uint32_t file_time_nsec(FILETIME f)
+	{
+		std::uint64_t ft = (std::uint64_t(f.dwHighDateTime) << 32)
+			| f.dwLowDateTime;
+		return std::uint32_t(ft % 10000000) * 100;
+	}
 #endif
 } // anonymous namespace
 
@@ -224,6 +238,9 @@ namespace {
 		s->ctime = file_time_to_posix(data.ftCreationTime);
 		s->atime = file_time_to_posix(data.ftLastAccessTime);
 		s->mtime = file_time_to_posix(data.ftLastWriteTime);
+		s->ctime_nsec = file_time_nsec(data.ftCreationTime);
+		s->mtime_nsec = file_time_nsec(data.ftLastWriteTime);
+		s->inode = (std::uint64_t(data.nFileIndexHigh) << 32) | data.nFileIndexLow;
 
 		s->mode = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
 			? file_status::directory
@@ -250,6 +267,14 @@ namespace {
 		s->atime = std::uint64_t(ret.st_atime);
 		s->mtime = std::uint64_t(ret.st_mtime);
 		s->ctime = std::uint64_t(ret.st_ctime);
+#if defined __APPLE__
+		s->mtime_nsec = std::uint32_t(ret.st_mtimespec.tv_nsec);
+		s->ctime_nsec = std::uint32_t(ret.st_ctimespec.tv_nsec);
+#elif defined TORRENT_LINUX
+		s->mtime_nsec = std::uint32_t(ret.st_mtim.tv_nsec);
+		s->ctime_nsec = std::uint32_t(ret.st_ctim.tv_nsec);
+#endif
+		s->inode = std::uint64_t(ret.st_ino);
 
 		s->mode = (S_ISREG(ret.st_mode) ? file_status::regular_file : 0)
 			| (S_ISDIR(ret.st_mode) ? file_status::directory : 0)
@@ -401,7 +426,112 @@ namespace {
 		}
 	}
 
+#if !defined TORRENT_WINDOWS \
+	&& !(defined __APPLE__ && defined __MACH__ && MAC_OS_X_VERSION_MIN_REQUIRED >= 1050)
+namespace {
+
+	// the number of bytes to copy between progress reports
+	constexpr std::int64_t copy_chunk_size = 16 * 1024 * 1024;
+
+#ifdef TORRENT_LINUX
+	std::int64_t sys_copy_file_range(int const infd, int const outfd
+		, std::size_t const len)
+	{
+#ifdef __NR_copy_file_range
+		return std::int64_t(::syscall(__NR_copy_file_range, infd, nullptr
+			, outfd, nullptr, len, 0u));
+#else
+		TORRENT_UNUSED(infd);
+		TORRENT_UNUSED(outfd);
+		TORRENT_UNUSED(len);
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	// returns true if the copy is done (or failed), false if the rest of the
+	// file needs to be copied through user space. This is the case if the
+	// kernel or the filesystems don't support copy_file_range(), or if the
+	// files are on different filesystems, on kernels older than 5.3
+	bool copy_in_kernel(int const infd, int const outfd, error_code& ec
+		, std::function<void(std::int64_t)> const& progress)
+	{
+		// if the filesystem supports it, make the new file share the extents
+		// of the old one. This is instant, regardless of the size of the file
+		if (::ioctl(outfd, FICLONE, infd) == 0)
+		{
+			struct ::stat st{};
+			if (::fstat(infd, &st) == 0 && progress) progress(st.st_size);
+			return true;
+		}
+
+		for (;;)
+		{
+			std::int64_t const ret = sys_copy_file_range(infd, outfd
+				, std::size_t(copy_chunk_size));
+			if (ret == 0) return true;
+			if (ret < 0)
+			{
+				if (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+					|| errno == EOPNOTSUPP)
+					return false;
+				ec.assign(errno, system_category());
+				return true;
+			}
+			if (progress) progress(ret);
+		}
+	}
+#endif
+
+	// copies the remainder of infd, from its current position, to outfd
+	void copy_user_space(int const infd, int const outfd, error_code& ec
+		, std::function<void(std::int64_t)> const& progress)
+	{
+		std::vector<char> buffer(1024 * 1024);
+		std::int64_t since_report = 0;
+		for (;;)
+		{
+			auto const num_read = ::read(infd, buffer.data(), buffer.size());
+			if (num_read == 0) break;
+			if (num_read < 0)
+			{
+				if (errno == EINTR) continue;
+				ec.assign(errno, system_category());
+				break;
+			}
+			char const* ptr = buffer.data();
+			auto left = num_read;
+			while (left > 0)
+			{
+				auto const num_written = ::write(outfd, ptr, std::size_t(left));
+				if (num_written < 0)
+				{
+					if (errno == EINTR) continue;
+					ec.assign(errno, system_category());
+					return;
+				}
+				ptr += num_written;
+				left -= num_written;
+			}
+			since_report += num_read;
+			if (since_report >= copy_chunk_size && progress)
+			{
+				progress(since_report);
+				since_report = 0;
+			}
+		}
+		if (since_report > 0 && progress) progress(since_report);
+	}
+}
+#endif
+
 	void copy_file(std::string const& inf, std::string const& newf, error_code& ec)
+	{
+		copy_file(inf, newf, ec, {});
+	}
+
+	void copy_file(std::string const& inf, std::string const& newf, error_code& ec
+		, std::function<void(std::int64_t)> const& progress)
 	{
 		ec.clear();
 		native_path_string f1 = convert_to_native_path_string(inf);
@@ -411,12 +541,16 @@ namespace {
 
 		if (CopyFileW(f1.c_str(), f2.c_str(), false) == 0)
 			ec.assign(GetLastError(), system_category());
+		else if (progress)
+			progress(file_size(newf));
 
 #elif defined __APPLE__ && defined __MACH__ && MAC_OS_X_VERSION_MIN_REQUIRED >= 1050
 		// this only works on 10.5
 		copyfile_state_t state = copyfile_state_alloc();
 		if (copyfile(f1.c_str(), f2.c_str(), state, COPYFILE_ALL) < 0)
 			ec.assign(errno, system_category());
+		else if (progress)
+			progress(file_size(newf));
 		copyfile_state_free(state);
 #else
 		int const infd = ::open(f1.c_str(), O_RDONLY);
@@ -432,31 +566,17 @@ namespace {
 			| S_IRGRP | S_IWGRP
 			| S_IROTH | S_IWOTH;
 
-		int const outfd = ::open(f2.c_str(), O_WRONLY | O_CREAT, permissions);
+		int const outfd = ::open(f2.c_str(), O_WRONLY | O_CREAT | O_TRUNC, permissions);
 		if (outfd < 0)
 		{
 			close(infd);
 			ec.assign(errno, system_category());
 			return;
 		}
-		char buffer[4096];
-		for (;;)
-		{
-			int const num_read = int(read(infd, buffer, sizeof(buffer)));
-			if (num_read == 0) break;
-			if (num_read < 0)
-			{
-				ec.assign(errno, system_category());
-				break;
-			}
-			int const num_written = int(write(outfd, buffer, std::size_t(num_read)));
-			if (num_written < num_read)
-			{
-				ec.assign(errno, system_category());
-				break;
-			}
-			if (num_read < int(sizeof(buffer))) break;
-		}
+#ifdef TORRENT_LINUX
+		if (!copy_in_kernel(infd, outfd, ec, progress))
+#endif
+			copy_user_space(infd, outfd, ec, progress);
 		close(infd);
 		close(outfd);
 #endif // TORRENT_WINDOWS
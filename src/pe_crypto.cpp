@@ -35,9 +35,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdint>
 #include <algorithm>
 #include <random>
+#include <cstring> // for memcpy
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
+#include <boost/detail/endian.hpp> // for BOOST_LITTLE_ENDIAN
 #include <boost/multiprecision/integer.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
 
@@ -327,7 +329,7 @@ namespace libtorrent {
 
 	std::tuple<int, int, int> rc4_handler::decrypt(span<span<char>> bufs)
 	{
-		if (!m_decrypt) std::make_tuple(0, 0, 0);
+		if (!m_decrypt) return std::make_tuple(0, 0, 0);
 
 		int bytes_processed = 0;
 		for (auto& buf : bufs)
@@ -350,65 +352,100 @@ namespace libtorrent {
 
 void rc4_init(const unsigned char* in, std::size_t len, rc4 *state)
 {
-	std::size_t const key_size = sizeof(state->buf);
+	std::size_t const key_size = 256;
 	aux::array<std::uint8_t, key_size> key;
-	std::uint8_t tmp, *s;
+	std::uint32_t* s;
 	int keylen, x, y, j;
 
 	TORRENT_ASSERT(state != nullptr);
 	TORRENT_ASSERT(len <= key_size);
 	if (len > key_size) len = key_size;
 
-	state->x = 0;
-	while (len--) {
-		state->buf[state->x++] = *in++;
-	}
-
 	/* extract the key */
-	s = state->buf.data();
-	std::memcpy(key.data(), s, key_size);
-	keylen = state->x;
+	std::memcpy(key.data(), in, len);
+	keylen = int(len);
 
 	/* make RC4 perm and shuffle */
+	s = state->buf.data();
 	for (x = 0; x < int(key_size); ++x) {
-		s[x] = x & 0xff;
+		s[x] = std::uint32_t(x);
 	}
 
 	for (j = x = y = 0; x < int(key_size); x++) {
-		y = (y + state->buf[x] + key[j++]) & 255;
+		y = (y + int(s[x]) + key[j++]) & 255;
 		if (j == keylen) {
 			j = 0;
 		}
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
+		std::swap(s[x], s[y]);
 	}
 	state->x = 0;
 	state->y = 0;
 }
 
+// the keystream is generated 8 bytes at a time and applied to the buffer as
+// a single 64 bit word. Generating the keystream is inherently serial (every
+// byte depends on the previous swap), so the gain comes from keeping x, y and
+// the keystream word in registers, using word sized entries in the
+// permutation and touching the payload once per 8 bytes.
+#define TORRENT_RC4_STEP(i) do { \
+	x = (x + 1) & 255; \
+	std::uint32_t const tx = s[x]; \
+	y = (y + tx) & 255; \
+	std::uint32_t const ty = s[y]; \
+	s[x] = ty; \
+	s[y] = tx; \
+	ks |= std::uint64_t(s[(tx + ty) & 255]) << (8 * (i)); \
+	} while (false)
+
 std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state)
 {
-	std::uint8_t x, y, *s, tmp;
-	std::size_t n;
-
 	TORRENT_ASSERT(out != nullptr);
 	TORRENT_ASSERT(state != nullptr);
 
-	n = outlen;
-	x = state->x & 0xff;
-	y = state->y & 0xff;
-	s = state->buf.data();
-	while (outlen--) {
-		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+	std::size_t const n = outlen;
+	std::uint32_t x = std::uint32_t(state->x) & 0xff;
+	std::uint32_t y = std::uint32_t(state->y) & 0xff;
+	std::uint32_t* const s = state->buf.data();
+
+	while (outlen >= 8)
+	{
+		// ks holds the next 8 keystream bytes, the first one in the lowest
+		// byte
+		std::uint64_t ks = 0;
+		TORRENT_RC4_STEP(0);
+		TORRENT_RC4_STEP(1);
+		TORRENT_RC4_STEP(2);
+		TORRENT_RC4_STEP(3);
+		TORRENT_RC4_STEP(4);
+		TORRENT_RC4_STEP(5);
+		TORRENT_RC4_STEP(6);
+		TORRENT_RC4_STEP(7);
+#if defined BOOST_LITTLE_ENDIAN
+		std::uint64_t word;
+		std::memcpy(&word, out, 8);
+		word ^= ks;
+		std::memcpy(out, &word, 8);
+#else
+		for (int i = 0; i < 8; ++i)
+			out[i] ^= std::uint8_t(ks >> (8 * i));
+#endif
+		out += 8;
+		outlen -= 8;
 	}
-	state->x = x;
-	state->y = y;
+
+	while (outlen--)
+	{
+		std::uint64_t ks = 0;
+		TORRENT_RC4_STEP(0);
+		*out++ ^= std::uint8_t(ks);
+	}
+	state->x = int(x);
+	state->y = int(y);
 	return n;
 }
 
+#undef TORRENT_RC4_STEP
+
 } // namespace libtorrent
 
 #endif // TORRENT_DISABLE_ENCRYPTION
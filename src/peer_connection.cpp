@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/entry.hpp"
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/alert_types.hpp"
+#include "libtorrent/file.hpp" // for file::send_to
 #include "libtorrent/invariant_check.hpp"
 #include "libtorrent/io.hpp"
 #include "libtorrent/extensions.hpp"
@@ -5216,9 +5217,21 @@ namespace libtorrent {
 				TORRENT_ASSERT(r.piece < t->torrent_file().end_piece());
 
 				auto conn = self();
-				m_disk_thread.async_read(t->storage(), r
-					, [conn, r](disk_buffer_holder buf, disk_job_flags_t f, storage_error const& ec)
-					{ conn->wrap(&peer_connection::on_disk_read_complete, std::move(buf), f, ec, r, clock_type::now()); });
+				if (m_settings.get_bool(settings_pack::zero_copy_upload) && can_send_file())
+				{
+					m_disk_thread.async_read_file(t->storage(), r
+						, [conn, r](disk_buffer_holder buf, file_range range
+							, disk_job_flags_t f, storage_error const& ec)
+						{ conn->wrap(&peer_connection::on_disk_read_complete, std::move(buf)
+							, std::move(range), f, ec, r, clock_type::now()); });
+				}
+				else
+				{
+					m_disk_thread.async_read(t->storage(), r
+						, [conn, r](disk_buffer_holder buf, disk_job_flags_t f, storage_error const& ec)
+						{ conn->wrap(&peer_connection::on_disk_read_complete, std::move(buf)
+							, file_range(), f, ec, r, clock_type::now()); });
+				}
 			}
 			m_last_sent_payload = clock_type::now();
 			m_requests.erase(m_requests.begin() + i);
@@ -5288,7 +5301,7 @@ namespace libtorrent {
 	}
 
 	void peer_connection::on_disk_read_complete(disk_buffer_holder buffer
-		, disk_job_flags_t const flags, storage_error const& error
+		, file_range range, disk_job_flags_t const flags, storage_error const& error
 		, peer_request const& r, time_point const issue_time)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -5372,7 +5385,21 @@ namespace libtorrent {
 		{
 			t->add_suggest_piece(r.piece);
 		}
-		write_piece(r, std::move(buffer));
+		if (range.handle)
+		{
+			TORRENT_ASSERT(range.size == r.length);
+			write_piece_file(r, std::move(range));
+		}
+		else
+		{
+			write_piece(r, std::move(buffer));
+		}
+	}
+
+	void peer_connection::write_piece_file(peer_request const&, file_range)
+	{
+		// only connections overriding can_send_file() are handed file ranges
+		TORRENT_ASSERT_FAIL();
 	}
 
 	void peer_connection::assign_bandwidth(int const channel, int const amount)
@@ -5631,6 +5658,37 @@ namespace libtorrent {
 		TORRENT_ASSERT(amount_to_send > 0);
 
 		TORRENT_ASSERT(!(m_channel_state[upload_channel] & peer_info::bw_network));
+
+#if TORRENT_USE_SENDFILE
+		std::int64_t file_offset = 0;
+		int file_bytes = 0;
+		if (m_send_buffer.front_file(file_offset, file_bytes) != nullptr)
+		{
+			// the next bytes to send are in a file. Wait for the socket to
+			// become writable, then write them to it straight from the file
+			TORRENT_ASSERT(m_socket->get<tcp::socket>() != nullptr);
+			int const file_amount = std::min(amount_to_send, file_bytes);
+#ifndef TORRENT_DISABLE_LOGGING
+			peer_log(peer_log_alert::outgoing, "ASYNC_SENDFILE", "bytes: %d", file_amount);
+#endif
+			ADD_OUTSTANDING_ASYNC("peer_connection::on_send_data");
+
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(!m_socket_is_writing);
+			m_socket_is_writing = true;
+#endif
+
+			auto conn = self();
+			m_socket->get<tcp::socket>()->async_write_some(boost::asio::null_buffers()
+				, make_handler(std::bind(&peer_connection::on_send_file, conn, _1, file_amount)
+				, m_write_handler_storage, *this));
+
+			m_channel_state[upload_channel] |= peer_info::bw_network;
+			m_last_sent = aux::time_now();
+			return;
+		}
+#endif
+
 #ifndef TORRENT_DISABLE_LOGGING
 		peer_log(peer_log_alert::outgoing, "ASYNC_WRITE", "bytes: %d", amount_to_send);
 #endif
@@ -6152,6 +6210,34 @@ namespace libtorrent {
 	// SEND DATA
 	// --------------------------
 
+#if TORRENT_USE_SENDFILE
+	void peer_connection::on_send_file(error_code const& error, int const bytes)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		// the socket is writable (or failed). Send what we can of the file
+		// range at the front of the send buffer and complete it like any
+		// other write
+		error_code ec = error;
+		int sent = 0;
+		std::int64_t file_offset = 0;
+		int file_bytes = 0;
+		file const* f = m_send_buffer.front_file(file_offset, file_bytes);
+		tcp::socket* const sock = m_socket->get<tcp::socket>();
+		if (!ec && f != nullptr && sock != nullptr)
+		{
+			if (!sock->native_non_blocking()) sock->native_non_blocking(true, ec);
+			if (!ec)
+			{
+				sent = f->send_to(sock->native_handle(), file_offset
+					, std::min(bytes, file_bytes), ec);
+				if (sent < 0) sent = 0;
+			}
+		}
+		on_send_data(ec, std::size_t(sent));
+	}
+#endif
+
 	void peer_connection::on_send_data(error_code const& error
 		, std::size_t const bytes_transferred)
 	{
@@ -0,0 +1,87 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/read_stream_detector.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	constexpr int read_stream_detector::max_streams;
+
+namespace {
+
+	// the read-ahead of a stream that has just been detected, in blocks. It
+	// doubles with every request that continues the stream
+	constexpr int initial_window = 4;
+
+	// requests are issued in order, but may arrive slightly out of order,
+	// since they're sent to the disk thread from different peers and disk
+	// threads. A request this far ahead of a stream (in bytes) still
+	// continues it
+	constexpr std::int64_t stream_slack = 4 * default_block_size;
+}
+
+	int read_stream_detector::on_read(std::int64_t const offset, int const size
+		, int const max_read_ahead, bool& sequential)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		++m_clock;
+
+		stream* s = std::find_if(m_streams.begin(), m_streams.end()
+			, [=](stream const& st)
+			{ return st.next >= 0 && offset >= st.next && offset <= st.next + stream_slack; });
+
+		if (s == m_streams.end())
+		{
+			// this is not part of a stream we know of. It may be the start of
+			// a new one, so replace the one we haven't seen for the longest
+			s = std::min_element(m_streams.begin(), m_streams.end()
+				, [](stream const& lhs, stream const& rhs)
+				{ return lhs.last_use < rhs.last_use; });
+			s->next = offset + size;
+			s->last_use = m_clock;
+			s->window = 1;
+			sequential = false;
+			return 1;
+		}
+
+		s->next = offset + size;
+		s->last_use = m_clock;
+		int const limit = std::max(std::min(max_read_ahead, 0xffff), 1);
+		s->window = std::uint16_t(std::min(limit
+			, s->window <= 1 ? initial_window : s->window * 2));
+		sequential = true;
+		return s->window;
+	}
+}}
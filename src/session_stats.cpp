@@ -343,6 +343,11 @@ namespace {
 		METRIC(disk, pinned_blocks)
 		METRIC(disk, disk_blocks_in_use)
 
+		// the number of disk blocks the disk buffer pool holds memory for,
+		// including the ones in use. The difference to ``disk_blocks_in_use``
+		// is memory that's free but not yet given back to the system
+		METRIC(disk, disk_blocks_reserved)
+
 		// ``queued_disk_jobs`` is the number of disk jobs currently queued,
 		// waiting to be executed by a disk thread. Deprecates
 		// ``cache_status::job_queue_length``.
@@ -353,6 +358,10 @@ namespace {
 		METRIC(disk, num_jobs)
 		METRIC(disk, blocked_disk_jobs)
 
+		// the number of files evicted from the file pool waiting to be closed
+		// by the file closer thread (see max_queued_file_closes)
+		METRIC(disk, queued_file_closes)
+
 		METRIC(disk, num_writing_threads)
 		METRIC(disk, num_running_threads)
 
@@ -394,6 +403,37 @@ namespace {
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of pieces that were written to disk as part of a write
+		// started by an adjacent piece, rather than with a write of their own
+		METRIC(disk, num_coalesced_pieces)
+
+		// the number of read requests that continued a sequential stream of
+		// requests against the same torrent, and the number of requests that
+		// didn't. Only requests in a stream are read ahead (see
+		// adaptive_read_ahead). ``num_read_ahead_blocks`` is the number of
+		// blocks read from disk beyond the ones that were requested
+		METRIC(disk, num_read_stream_hits)
+		METRIC(disk, num_read_stream_misses)
+		METRIC(disk, num_read_ahead_blocks)
+
+		// the number of pieces whose hash was taken from the verification cache
+		// when checking files, instead of being read back from disk and hashed
+		// (see use_verification_cache)
+		METRIC(disk, num_verification_cache_hits)
+
+		// the number of blocks uploaded straight out of their file, rather than
+		// being read into a disk buffer first (see zero_copy_upload)
+		METRIC(disk, num_file_range_reads)
+
+		// the number of blocks that were received out of order and still
+		// hashed straight out of the cache once the blocks in front of them
+		// arrived, rather than being read back (see hash_reorder_window)
+		METRIC(disk, num_reordered_blocks_hashed)
+
+		// the number of pieces read into the cache ahead of peers requesting
+		// them (see prefetch_suggested_pieces)
+		METRIC(disk, num_prefetched_pieces)
+
 		// cumulative time spent in various disk jobs, as well
 		// as total for all disk jobs. Measured in microseconds
 		METRIC(disk, disk_read_time)
@@ -401,6 +441,71 @@ namespace {
 		METRIC(disk, disk_hash_time)
 		METRIC(disk, disk_job_time)
 
+		// cumulative time, in microseconds, spent closing files evicted from
+		// the file pool, by the file closer thread or by disk threads
+		METRIC(disk, disk_file_close_time)
+
+		// the cumulative time, in microseconds, disk jobs of each priority
+		// class spent in the job queue before a disk thread picked them up,
+		// and the number of jobs picked up. Time-critical jobs are reads
+		// issued by torrent_handle::read_piece(), idle jobs are reads warming
+		// the cache
+		METRIC(disk, disk_queue_time_critical)
+		METRIC(disk, disk_queue_time_read)
+		METRIC(disk, disk_queue_time_write)
+		METRIC(disk, disk_queue_time_hash)
+		METRIC(disk, disk_queue_time_maintenance)
+		METRIC(disk, disk_queue_time_idle)
+		METRIC(disk, num_disk_jobs_critical)
+		METRIC(disk, num_disk_jobs_read)
+		METRIC(disk, num_disk_jobs_write)
+		METRIC(disk, num_disk_jobs_hash)
+		METRIC(disk, num_disk_jobs_maintenance)
+		METRIC(disk, num_disk_jobs_idle)
+
+		// a histogram of the time disk jobs of each priority class spent in
+		// the job queue. Each counter is the number of jobs picked up after
+		// waiting less than 1, 10, 50 or 250 milliseconds or 1 second (and
+		// more than the previous bucket). The ``slow`` bucket counts jobs that
+		// waited a second or longer. Percentiles of the queueing latency can
+		// be estimated from these
+		METRIC(disk, disk_queue_critical_1ms)
+		METRIC(disk, disk_queue_critical_10ms)
+		METRIC(disk, disk_queue_critical_50ms)
+		METRIC(disk, disk_queue_critical_250ms)
+		METRIC(disk, disk_queue_critical_1s)
+		METRIC(disk, disk_queue_critical_slow)
+		METRIC(disk, disk_queue_read_1ms)
+		METRIC(disk, disk_queue_read_10ms)
+		METRIC(disk, disk_queue_read_50ms)
+		METRIC(disk, disk_queue_read_250ms)
+		METRIC(disk, disk_queue_read_1s)
+		METRIC(disk, disk_queue_read_slow)
+		METRIC(disk, disk_queue_write_1ms)
+		METRIC(disk, disk_queue_write_10ms)
+		METRIC(disk, disk_queue_write_50ms)
+		METRIC(disk, disk_queue_write_250ms)
+		METRIC(disk, disk_queue_write_1s)
+		METRIC(disk, disk_queue_write_slow)
+		METRIC(disk, disk_queue_hash_1ms)
+		METRIC(disk, disk_queue_hash_10ms)
+		METRIC(disk, disk_queue_hash_50ms)
+		METRIC(disk, disk_queue_hash_250ms)
+		METRIC(disk, disk_queue_hash_1s)
+		METRIC(disk, disk_queue_hash_slow)
+		METRIC(disk, disk_queue_maintenance_1ms)
+		METRIC(disk, disk_queue_maintenance_10ms)
+		METRIC(disk, disk_queue_maintenance_50ms)
+		METRIC(disk, disk_queue_maintenance_250ms)
+		METRIC(disk, disk_queue_maintenance_1s)
+		METRIC(disk, disk_queue_maintenance_slow)
+		METRIC(disk, disk_queue_idle_1ms)
+		METRIC(disk, disk_queue_idle_10ms)
+		METRIC(disk, disk_queue_idle_50ms)
+		METRIC(disk, disk_queue_idle_250ms)
+		METRIC(disk, disk_queue_idle_1s)
+		METRIC(disk, disk_queue_idle_slow)
+
 		// for each kind of disk job, a counter of how many jobs of that kind
 		// are currently blocked by a disk fence
 		METRIC(disk, num_fenced_read)
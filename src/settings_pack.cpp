@@ -124,7 +124,8 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(proxy_password, "", &session_impl::update_proxy),
 		SET(i2p_hostname, "", &session_impl::update_i2p_bridge),
 		SET(peer_fingerprint, "-LT1200-", nullptr),
-		SET(dht_bootstrap_nodes, "dht.libtorrent.org:25401", &session_impl::update_dht_bootstrap_nodes)
+		SET(dht_bootstrap_nodes, "dht.libtorrent.org:25401", &session_impl::update_dht_bootstrap_nodes),
+		SET(disk_trace_file, "", nullptr)
 	}});
 
 	aux::array<bool_setting_entry_t, settings_pack::num_bool_settings> const bool_settings
@@ -207,6 +208,10 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(auto_sequential, true, &session_impl::update_auto_sequential),
 		SET(proxy_tracker_connections, true, nullptr),
 		SET(enable_ip_notifier, true, &session_impl::update_ip_notifier),
+		SET(adaptive_read_ahead, false, nullptr),
+		SET(disk_cache_huge_pages, false, nullptr),
+		SET(use_verification_cache, false, nullptr),
+		SET(zero_copy_upload, false, nullptr),
 	}});
 
 	aux::array<int_setting_entry_t, settings_pack::num_int_settings> const int_settings
@@ -343,6 +348,14 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(close_file_interval, CLOSE_FILE_INTERVAL, nullptr),
 		SET(max_web_seed_connections, 3, nullptr),
 		SET(resolver_cache_timeout, 1200, &session_impl::update_resolver_cache_timeout),
+		SET(disk_io_backend, settings_pack::posix_disk_io, nullptr),
+		SET(max_coalesced_write_size, 0, nullptr),
+		SET(checking_hash_threads, 0, nullptr),
+		SET(move_storage_copy_threads, 4, nullptr),
+		SET(hash_reorder_window, 16, nullptr),
+		SET(max_queued_file_closes, 32, nullptr),
+		SET(max_torrent_cache_share, 0, nullptr),
+		SET(prefetch_suggested_pieces, 0, nullptr),
 	}});
 
 #undef SET
@@ -14,9 +14,23 @@ changelog at the end of the file.
 #include <cstring>
 
 #include "libtorrent/sha1.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/detail/endian.hpp> // for BIG_ENDIAN and LITTLE_ENDIAN macros
+
+// the SHA extension intrinsics are available to functions with the target
+// attribute since GCC 5
+#if TORRENT_HAS_SSE && (defined _MSC_VER || defined __clang__ || __GNUC__ >= 5)
+#define TORRENT_HAS_SHA_NI 1
+#include <immintrin.h>
+#else
+#define TORRENT_HAS_SHA_NI 0
+#endif
+
+#if TORRENT_HAS_ARM_SHA1
+#include <arm_neon.h>
+#endif
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
 namespace libtorrent {
@@ -134,7 +148,192 @@ using u8 = std::uint8_t;
 #endif
 
 	template <class BlkFun>
-	void internal_update(sha1_ctx* context, u8 const* data, size_t len)
+	void SHA1transform_blocks(u32 state[5], u8 const* data, size_t blocks)
+	{
+		for (; blocks > 0; --blocks, data += 64)
+			SHA1transform<BlkFun>(state, data);
+	}
+
+#if TORRENT_HAS_SHA_NI
+
+#ifdef __GNUC__
+#define TORRENT_SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#else
+#define TORRENT_SHA_NI_TARGET
+#endif
+
+// four rounds, with the message schedule for the rounds 12 ahead. ex is the
+// E value for these rounds, m0 their message words and m1, m2 and m3 the
+// following ones. The rounds towards the end compute schedule words that
+// are never used, the compiler drops them
+#define SHA1_NI_ROUNDS(ex, ey, m0, m1, m2, m3, f) \
+	ex = _mm_sha1nexte_epu32(ex, m0); \
+	ey = abcd; \
+	m1 = _mm_sha1msg2_epu32(m1, m0); \
+	abcd = _mm_sha1rnds4_epu32(abcd, ex, f); \
+	m3 = _mm_sha1msg1_epu32(m3, m0); \
+	m2 = _mm_xor_si128(m2, m0)
+
+	// the Intel SHA extensions
+	TORRENT_SHA_NI_TARGET
+	void SHA1transform_sha_ni(u32 state[5], u8 const* data, size_t blocks)
+	{
+		__m128i const byte_order = _mm_set_epi64x(0x0001020304050607ll
+			, 0x08090a0b0c0d0e0fll);
+
+		__m128i abcd = _mm_shuffle_epi32(
+			_mm_loadu_si128(reinterpret_cast<__m128i const*>(state)), 0x1b);
+		__m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+		__m128i e1;
+
+		for (; blocks > 0; --blocks, data += 64)
+		{
+			__m128i const abcd_save = abcd;
+			__m128i const e0_save = e0;
+
+			__m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data)), byte_order);
+			e0 = _mm_add_epi32(e0, m0);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+			__m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 16)), byte_order);
+			e1 = _mm_sha1nexte_epu32(e1, m1);
+			e0 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+			m0 = _mm_sha1msg1_epu32(m0, m1);
+
+			__m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 32)), byte_order);
+			e0 = _mm_sha1nexte_epu32(e0, m2);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+			m1 = _mm_sha1msg1_epu32(m1, m2);
+			m0 = _mm_xor_si128(m0, m2);
+
+			__m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + 48)), byte_order);
+			SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 0);
+			SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 0);
+			SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+			SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 1);
+			SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 1);
+			SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 1);
+			SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+			SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+			SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 2);
+			SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 2);
+			SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 2);
+			SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+			SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 3);
+			SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 3);
+			SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 3);
+			SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 3);
+			SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 3);
+
+			e0 = _mm_sha1nexte_epu32(e0, e0_save);
+			abcd = _mm_add_epi32(abcd, abcd_save);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state)
+			, _mm_shuffle_epi32(abcd, 0x1b));
+		state[4] = u32(_mm_extract_epi32(e0, 3));
+	}
+
+#undef SHA1_NI_ROUNDS
+#undef TORRENT_SHA_NI_TARGET
+
+#endif // TORRENT_HAS_SHA_NI
+
+#if TORRENT_HAS_ARM_SHA1
+
+// four rounds with the round function op, with the message schedule for the
+// rounds 12 ahead. tx holds the message words plus round constant for these
+// rounds, and is loaded with the ones for 8 rounds ahead (m2 plus k).
+#define SHA1_ARM_ROUNDS(op, ex, ey, tx, m0, m1, m2, m3, k) \
+	ey = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = op(abcd, ex, tx); \
+	tx = vaddq_u32(m2, vdupq_n_u32(k)); \
+	m3 = vsha1su1q_u32(m3, m2); \
+	m0 = vsha1su0q_u32(m0, m1, m2)
+
+	// the ARMv8 cryptography extension
+	void SHA1transform_arm(u32 state[5], u8 const* data, size_t blocks)
+	{
+		u32 const k0 = 0x5a827999;
+		u32 const k1 = 0x6ed9eba1;
+		u32 const k2 = 0x8f1bbcdc;
+		u32 const k3 = 0xca62c1d6;
+
+		uint32x4_t abcd = vld1q_u32(state);
+		u32 e0 = state[4];
+		u32 e1;
+
+		for (; blocks > 0; --blocks, data += 64)
+		{
+			uint32x4_t const abcd_save = abcd;
+			u32 const e0_save = e0;
+
+			uint32x4_t m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+			uint32x4_t m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+			uint32x4_t m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+			uint32x4_t m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+			uint32x4_t t0 = vaddq_u32(m0, vdupq_n_u32(k0));
+			uint32x4_t t1 = vaddq_u32(m1, vdupq_n_u32(k0));
+
+			// rounds 0-3
+			e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1cq_u32(abcd, e0, t0);
+			t0 = vaddq_u32(m2, vdupq_n_u32(k0));
+			m0 = vsha1su0q_u32(m0, m1, m2);
+
+			// rounds 4-67
+			SHA1_ARM_ROUNDS(vsha1cq_u32, e1, e0, t1, m1, m2, m3, m0, k0);
+			SHA1_ARM_ROUNDS(vsha1cq_u32, e0, e1, t0, m2, m3, m0, m1, k0);
+			SHA1_ARM_ROUNDS(vsha1cq_u32, e1, e0, t1, m3, m0, m1, m2, k1);
+			SHA1_ARM_ROUNDS(vsha1cq_u32, e0, e1, t0, m0, m1, m2, m3, k1);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e1, e0, t1, m1, m2, m3, m0, k1);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e0, e1, t0, m2, m3, m0, m1, k1);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e1, e0, t1, m3, m0, m1, m2, k1);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e0, e1, t0, m0, m1, m2, m3, k2);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e1, e0, t1, m1, m2, m3, m0, k2);
+			SHA1_ARM_ROUNDS(vsha1mq_u32, e0, e1, t0, m2, m3, m0, m1, k2);
+			SHA1_ARM_ROUNDS(vsha1mq_u32, e1, e0, t1, m3, m0, m1, m2, k2);
+			SHA1_ARM_ROUNDS(vsha1mq_u32, e0, e1, t0, m0, m1, m2, m3, k2);
+			SHA1_ARM_ROUNDS(vsha1mq_u32, e1, e0, t1, m1, m2, m3, m0, k3);
+			SHA1_ARM_ROUNDS(vsha1mq_u32, e0, e1, t0, m2, m3, m0, m1, k3);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e1, e0, t1, m3, m0, m1, m2, k3);
+			SHA1_ARM_ROUNDS(vsha1pq_u32, e0, e1, t0, m0, m1, m2, m3, k3);
+
+			// rounds 68-79
+			e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1pq_u32(abcd, e1, t1);
+			t1 = vaddq_u32(m3, vdupq_n_u32(k3));
+
+			e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1pq_u32(abcd, e0, t0);
+
+			e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			abcd = vsha1pq_u32(abcd, e1, t1);
+
+			e0 += e0_save;
+			abcd = vaddq_u32(abcd, abcd_save);
+		}
+
+		vst1q_u32(state, abcd);
+		state[4] = e0;
+	}
+
+#undef SHA1_ARM_ROUNDS
+
+#endif // TORRENT_HAS_ARM_SHA1
+
+	using transform_fun = void (*)(u32 state[5], u8 const* data, size_t blocks);
+
+	void internal_update(sha1_ctx* context, u8 const* data, size_t len
+		, transform_fun const transform)
 	{
 		using namespace std;
 		size_t i, j;	// JHB
@@ -148,11 +347,10 @@ using u8 = std::uint8_t;
 		if ((j + len) > 63)
 		{
 			memcpy(&context->buffer[j], data, (i = 64-j));
-			SHA1transform<BlkFun>(context->state, context->buffer);
-			for ( ; i + 63 < len; i += 64)
-			{
-				SHA1transform<BlkFun>(context->state, &data[i]);
-			}
+			transform(context->state, context->buffer, 1);
+			size_t const blocks = (len - i) / 64;
+			transform(context->state, &data[i], blocks);
+			i += blocks * 64;
 			j = 0;
 		}
 		else
@@ -191,21 +389,51 @@ void SHA1_init(sha1_ctx* context)
 // Run your data through this.
 
 void SHA1_update(sha1_ctx* context, u8 const* data, size_t len)
+{
+	if (SHA1_update_hw(context, data, len)) return;
+	SHA1_update_sw(context, data, len);
+}
+
+void SHA1_update_sw(sha1_ctx* context, u8 const* data, size_t len)
 {
 	// GCC standard defines for endianness
 	// test with: cpp -dM /dev/null
 #if defined BOOST_BIG_ENDIAN
-	internal_update<big_endian_blk0>(context, data, len);
+	internal_update(context, data, len, &SHA1transform_blocks<big_endian_blk0>);
 #elif defined BOOST_LITTLE_ENDIAN
-	internal_update<little_endian_blk0>(context, data, len);
+	internal_update(context, data, len, &SHA1transform_blocks<little_endian_blk0>);
 #else
 	// select different functions depending on endianess
 	// and figure out the endianess runtime
 	if (is_big_endian())
-		internal_update<big_endian_blk0>(context, data, len);
+		internal_update(context, data, len, &SHA1transform_blocks<big_endian_blk0>);
 	else
-		internal_update<little_endian_blk0>(context, data, len);
+		internal_update(context, data, len, &SHA1transform_blocks<little_endian_blk0>);
+#endif
+}
+
+bool SHA1_update_hw(sha1_ctx* context, u8 const* data, size_t len)
+{
+#if TORRENT_HAS_SHA_NI
+	if (aux::sha_ni_support)
+	{
+		internal_update(context, data, len, &SHA1transform_sha_ni);
+		return true;
+	}
+#endif
+
+#if TORRENT_HAS_ARM_SHA1
+	if (aux::arm_sha1_support)
+	{
+		internal_update(context, data, len, &SHA1transform_arm);
+		return true;
+	}
 #endif
+
+	TORRENT_UNUSED(context);
+	TORRENT_UNUSED(data);
+	TORRENT_UNUSED(len);
+	return false;
 }
 
 
@@ -0,0 +1,458 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/sha1_mb.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// the multi-buffer kernels are written with the GCC vector extensions
+// (supported by clang too) and compiled for each instruction set with the
+// target attribute, so the library itself doesn't need to be built with
+// -mavx2 or -mavx512f
+#if TORRENT_HAS_SSE && defined __GNUC__
+#define TORRENT_HAS_SHA1_MB 1
+#define TORRENT_SHA1_MB_INLINE inline __attribute__((always_inline))
+// the rounds need to be unrolled for the message schedule to stay in
+// registers
+#if defined __clang__ || __GNUC__ >= 8
+#define TORRENT_SHA1_MB_UNROLL _Pragma("GCC unroll 20")
+#else
+#define TORRENT_SHA1_MB_UNROLL
+#endif
+#else
+#define TORRENT_HAS_SHA1_MB 0
+#endif
+
+namespace libtorrent {
+
+namespace aux {
+
+namespace {
+
+#if TORRENT_HAS_SHA1_MB
+
+	constexpr int max_sha1_lanes = 16;
+
+	using v4u32 = std::uint32_t __attribute__((vector_size(16)));
+	using v8u32 = std::uint32_t __attribute__((vector_size(32)));
+	using v16u32 = std::uint32_t __attribute__((vector_size(64)));
+
+	TORRENT_SHA1_MB_INLINE std::uint32_t load_be32(char const* p)
+	{
+		std::uint32_t ret;
+		std::memcpy(&ret, p, 4);
+		return __builtin_bswap32(ret);
+	}
+
+// these operate on the vectors a, b, c, d, e and w in sha1_mb_blocks(). They
+// are macros rather than functions since passing vectors by value to
+// functions not compiled for the wider instruction set changes the ABI
+#define TORRENT_SHA1_MB_ROUND(f, k, x) do { \
+	V const tmp_ = ((a << 5) | (a >> 27)) + (f) + e + std::uint32_t(k) + (x); \
+	e = d; d = c; c = (b << 30) | (b >> 2); b = a; a = tmp_; } while (false)
+
+#define TORRENT_SHA1_MB_SCHEDULE(i) do { \
+	V const tmp_ = w[((i) + 13) & 15] ^ w[((i) + 8) & 15] \
+		^ w[((i) + 2) & 15] ^ w[(i) & 15]; \
+	w[(i) & 15] = (tmp_ << 1) | (tmp_ >> 31); } while (false)
+
+	// runs the SHA-1 compression function over ``num_blocks`` consecutive
+	// 64 byte blocks of N messages at a time. ``state`` holds the five state
+	// words, each as N consecutive lanes. ``data`` points to the next block of
+	// every lane, and is advanced past the blocks consumed
+	template <typename V, int N>
+	TORRENT_SHA1_MB_INLINE void sha1_mb_blocks(std::uint32_t* state
+		, char const** data, int const num_blocks)
+	{
+		static_assert(sizeof(V) == N * sizeof(std::uint32_t), "lane count mismatch");
+
+		V h[5];
+		std::memcpy(h, state, sizeof(h));
+		for (int block = 0; block < num_blocks; ++block)
+		{
+			V w[16];
+			for (int i = 0; i < 16; ++i)
+			{
+				std::uint32_t words[N];
+				for (int l = 0; l < N; ++l) words[l] = load_be32(data[l] + i * 4);
+				std::memcpy(&w[i], words, sizeof(V));
+			}
+			for (int l = 0; l < N; ++l) data[l] += 64;
+
+			V a = h[0];
+			V b = h[1];
+			V c = h[2];
+			V d = h[3];
+			V e = h[4];
+
+			TORRENT_SHA1_MB_UNROLL
+			for (int i = 0; i < 16; ++i)
+				TORRENT_SHA1_MB_ROUND(d ^ (b & (c ^ d)), 0x5a827999, w[i]);
+			TORRENT_SHA1_MB_UNROLL
+			for (int i = 16; i < 20; ++i)
+			{
+				TORRENT_SHA1_MB_SCHEDULE(i);
+				TORRENT_SHA1_MB_ROUND(d ^ (b & (c ^ d)), 0x5a827999, w[i & 15]);
+			}
+			TORRENT_SHA1_MB_UNROLL
+			for (int i = 20; i < 40; ++i)
+			{
+				TORRENT_SHA1_MB_SCHEDULE(i);
+				TORRENT_SHA1_MB_ROUND(b ^ c ^ d, 0x6ed9eba1, w[i & 15]);
+			}
+			TORRENT_SHA1_MB_UNROLL
+			for (int i = 40; i < 60; ++i)
+			{
+				TORRENT_SHA1_MB_SCHEDULE(i);
+				TORRENT_SHA1_MB_ROUND((b & c) | (d & (b | c)), 0x8f1bbcdc, w[i & 15]);
+			}
+			TORRENT_SHA1_MB_UNROLL
+			for (int i = 60; i < 80; ++i)
+			{
+				TORRENT_SHA1_MB_SCHEDULE(i);
+				TORRENT_SHA1_MB_ROUND(b ^ c ^ d, 0xca62c1d6, w[i & 15]);
+			}
+
+			h[0] += a;
+			h[1] += b;
+			h[2] += c;
+			h[3] += d;
+			h[4] += e;
+		}
+		std::memcpy(state, h, sizeof(h));
+	}
+
+#undef TORRENT_SHA1_MB_ROUND
+#undef TORRENT_SHA1_MB_SCHEDULE
+
+	__attribute__((target("sse2")))
+	void sha1_mb_sse2(std::uint32_t* state, char const** data, int const num_blocks)
+	{
+		sha1_mb_blocks<v4u32, 4>(state, data, num_blocks);
+	}
+
+	__attribute__((target("avx2")))
+	void sha1_mb_avx2(std::uint32_t* state, char const** data, int const num_blocks)
+	{
+		sha1_mb_blocks<v8u32, 8>(state, data, num_blocks);
+	}
+
+	__attribute__((target("avx512f")))
+	void sha1_mb_avx512(std::uint32_t* state, char const** data, int const num_blocks)
+	{
+		sha1_mb_blocks<v16u32, 16>(state, data, num_blocks);
+	}
+
+	using sha1_mb_kernel = void (*)(std::uint32_t*, char const**, int);
+
+	// returns the widest kernel supported by the CPU that's not wider than
+	// max_lanes, or nullptr if there is none
+	sha1_mb_kernel pick_kernel(int const max_lanes, int& lanes)
+	{
+		if (max_lanes >= 16 && avx512_support)
+		{
+			lanes = 16;
+			return &sha1_mb_avx512;
+		}
+		if (max_lanes >= 8 && avx2_support)
+		{
+			lanes = 8;
+			return &sha1_mb_avx2;
+		}
+		// with the SHA extensions, a single message is hashed faster than
+		// four lanes of SSE2
+		if (max_lanes >= 4 && sse2_support && !sha_ni_support)
+		{
+			lanes = 4;
+			return &sha1_mb_sse2;
+		}
+		lanes = 1;
+		return nullptr;
+	}
+
+	std::uint32_t const sha1_iv[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+	// the position of one lane in the message it's hashing
+	struct sha1_lane
+	{
+		// index of the message, or -1 if there are no more messages for this
+		// lane
+		int msg = -1;
+
+		std::size_t buf = 0;
+		std::size_t offset = 0;
+
+		// bytes of the message not yet passed to the kernel
+		std::int64_t left = 0;
+		std::int64_t length = 0;
+
+		// a block straddling two buffers, or the last one or two blocks with
+		// the padding. When there are staged blocks, they are passed to the
+		// kernel in place of the message itself
+		char staged[128];
+		int staged_pos = 0;
+		int staged_blocks = 0;
+
+		// set when the staged blocks are the end of the message
+		bool last = false;
+	};
+
+	void start_message(sha1_lane& lane, int const msg
+		, span<sha1_mb_message const> msgs)
+	{
+		lane.msg = msg;
+		lane.buf = 0;
+		lane.offset = 0;
+		lane.length = 0;
+		for (auto const& b : msgs[msg].bufs) lane.length += std::int64_t(b.size());
+		lane.left = lane.length;
+		lane.staged_pos = 0;
+		lane.staged_blocks = 0;
+		lane.last = false;
+	}
+
+	// copies the next ``size`` bytes of the message to ``dst``, across
+	// buffer boundaries
+	void copy_message(sha1_lane& lane, span<sha1_mb_message const> msgs
+		, char* dst, int size)
+	{
+		auto const bufs = msgs[lane.msg].bufs;
+		while (size > 0)
+		{
+			TORRENT_ASSERT(lane.buf < bufs.size());
+			span<char const> const b = bufs[lane.buf];
+			std::size_t const n = std::min(std::size_t(size), b.size() - lane.offset);
+			std::memcpy(dst, b.data() + lane.offset, n);
+			dst += n;
+			size -= int(n);
+			lane.offset += n;
+			lane.left -= std::int64_t(n);
+			if (lane.offset == b.size())
+			{
+				++lane.buf;
+				lane.offset = 0;
+			}
+		}
+	}
+
+	// returns the lane's next block and sets ``blocks`` to the number of
+	// contiguous blocks available at it
+	char const* next_blocks(sha1_lane& lane, span<sha1_mb_message const> msgs
+		, int& blocks)
+	{
+		TORRENT_ASSERT(lane.msg >= 0);
+		if (lane.staged_blocks == 0)
+		{
+			auto const bufs = msgs[lane.msg].bufs;
+			while (lane.buf < bufs.size() && lane.offset == bufs[lane.buf].size())
+			{
+				++lane.buf;
+				lane.offset = 0;
+			}
+
+			if (lane.left < 64)
+			{
+				// the end of the message, append the padding and the length
+				// in bits
+				int const tail = int(lane.left);
+				copy_message(lane, msgs, lane.staged, tail);
+				lane.staged_blocks = tail + 9 > 64 ? 2 : 1;
+				std::memset(lane.staged + tail, 0, std::size_t(lane.staged_blocks * 64 - tail));
+				lane.staged[tail] = char(0x80);
+				std::uint64_t const bits = std::uint64_t(lane.length) * 8;
+				char* p = lane.staged + lane.staged_blocks * 64 - 8;
+				for (int i = 7; i >= 0; --i) *p++ = char((bits >> (i * 8)) & 0xff);
+				lane.staged_pos = 0;
+				lane.last = true;
+			}
+			else
+			{
+				span<char const> const b = bufs[lane.buf];
+				std::size_t const contiguous = b.size() - lane.offset;
+				if (contiguous >= 64)
+				{
+					std::int64_t const n = std::int64_t(contiguous / 64);
+					blocks = int(std::min(n, std::int64_t(std::numeric_limits<int>::max())));
+					return b.data() + lane.offset;
+				}
+				copy_message(lane, msgs, lane.staged, 64);
+				lane.staged_blocks = 1;
+				lane.staged_pos = 0;
+			}
+		}
+		blocks = lane.staged_blocks;
+		return lane.staged + lane.staged_pos * 64;
+	}
+
+	// returns true if the lane completed its message
+	bool advance(sha1_lane& lane, int const blocks)
+	{
+		if (lane.staged_blocks > 0)
+		{
+			lane.staged_blocks -= blocks;
+			lane.staged_pos += blocks;
+			return lane.staged_blocks == 0 && lane.last;
+		}
+		lane.offset += std::size_t(blocks) * 64;
+		lane.left -= std::int64_t(blocks) * 64;
+		return false;
+	}
+
+	void sha1_mb_impl(sha1_mb_kernel const kernel, int const lanes
+		, span<sha1_mb_message const> msgs, span<sha1_hash> hashes)
+	{
+		std::uint32_t state[5 * max_sha1_lanes];
+		sha1_lane lane[max_sha1_lanes];
+		char const* data[max_sha1_lanes];
+
+		int const num_msgs = int(msgs.size());
+		int next_msg = 0;
+		int active = 0;
+		for (int l = 0; l < lanes && next_msg < num_msgs; ++l)
+		{
+			start_message(lane[l], next_msg++, msgs);
+			for (int i = 0; i < 5; ++i) state[i * lanes + l] = sha1_iv[i];
+			++active;
+		}
+
+		while (active > 0)
+		{
+			int blocks = std::numeric_limits<int>::max();
+			int first_active = -1;
+			for (int l = 0; l < lanes; ++l)
+			{
+				if (lane[l].msg < 0) continue;
+				int n;
+				data[l] = next_blocks(lane[l], msgs, n);
+				blocks = std::min(blocks, n);
+				if (first_active < 0) first_active = l;
+			}
+
+			// idle lanes hash the same data as an active lane, and their
+			// result is ignored
+			for (int l = 0; l < lanes; ++l)
+				if (lane[l].msg < 0) data[l] = data[first_active];
+
+			kernel(state, data, blocks);
+
+			for (int l = 0; l < lanes; ++l)
+			{
+				if (lane[l].msg < 0 || !advance(lane[l], blocks)) continue;
+
+				char* digest = hashes[lane[l].msg].data();
+				for (int i = 0; i < 5; ++i)
+				{
+					std::uint32_t const v = state[i * lanes + l];
+					*digest++ = char((v >> 24) & 0xff);
+					*digest++ = char((v >> 16) & 0xff);
+					*digest++ = char((v >> 8) & 0xff);
+					*digest++ = char(v & 0xff);
+				}
+
+				if (next_msg < num_msgs)
+				{
+					start_message(lane[l], next_msg++, msgs);
+					for (int i = 0; i < 5; ++i) state[i * lanes + l] = sha1_iv[i];
+				}
+				else
+				{
+					lane[l].msg = -1;
+					--active;
+				}
+			}
+		}
+	}
+
+#endif // TORRENT_HAS_SHA1_MB
+
+} // anonymous namespace
+
+	int sha1_mb_lanes()
+	{
+#if TORRENT_HAS_SHA1_MB
+		int lanes;
+		pick_kernel(max_sha1_lanes, lanes);
+		return lanes;
+#else
+		return 1;
+#endif
+	}
+
+	void sha1_mb(span<sha1_mb_message const> msgs, span<sha1_hash> hashes
+		, int const max_lanes)
+	{
+		TORRENT_ASSERT(hashes.size() >= msgs.size());
+
+#if TORRENT_HAS_SHA1_MB
+		// a kernel at most twice as wide as the number of messages, most lanes
+		// would be idle otherwise
+		int lanes;
+		int const limit = max_lanes > 0 ? max_lanes : max_sha1_lanes;
+		sha1_mb_kernel const kernel = msgs.size() < 2 ? nullptr
+			: pick_kernel(int(std::min(std::size_t(limit), msgs.size() * 2)), lanes);
+		if (kernel != nullptr)
+		{
+			sha1_mb_impl(kernel, lanes, msgs, hashes);
+			return;
+		}
+#else
+		TORRENT_UNUSED(max_lanes);
+#endif
+
+		for (std::size_t i = 0; i < msgs.size(); ++i)
+		{
+			hasher h;
+			for (auto const& b : msgs[i].bufs)
+				if (!b.empty()) h.update(b);
+			hashes[i] = h.final();
+		}
+	}
+
+} // namespace aux
+
+	void hash_pieces(span<span<char const> const> pieces, span<sha1_hash> hashes)
+	{
+		std::vector<aux::sha1_mb_message> msgs;
+		msgs.reserve(pieces.size());
+		for (auto const& p : pieces) msgs.push_back({{&p, 1}});
+		aux::sha1_mb(msgs, hashes);
+	}
+
+}
@@ -0,0 +1,321 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/slab_allocator.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/allocator.hpp" // for page_malloc
+
+#include <algorithm>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#elif defined TORRENT_WINDOWS
+#include <windows.h>
+#endif
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent { namespace aux {
+
+	slab_allocator::slab_allocator(int const block_size, int const blocks_per_slab)
+		: m_block_size(block_size)
+		, m_blocks_per_slab(blocks_per_slab)
+	{
+		TORRENT_ASSERT(block_size >= int(sizeof(int)));
+		TORRENT_ASSERT(blocks_per_slab > 0);
+	}
+
+	slab_allocator::~slab_allocator()
+	{
+		for (auto& s : m_slabs)
+		{
+			TORRENT_ASSERT(s.second.num_in_use == 0);
+			TORRENT_ASSERT(s.second.num_trimming == 0);
+			unmap_slab(s.first);
+		}
+	}
+
+	char* slab_allocator::allocate()
+	{
+		if (m_available.empty())
+		{
+			char* const base = map_slab();
+			if (base == nullptr) return nullptr;
+			slab& s = m_slabs[base];
+			s.used.resize(std::size_t(m_blocks_per_slab), false);
+			s.free_blocks.reserve(std::size_t(m_blocks_per_slab));
+			m_available.insert(base);
+			++m_num_empty;
+		}
+
+		char* const base = *m_available.begin();
+		slab& s = m_slabs[base];
+		if (s.num_in_use == 0) --m_num_empty;
+
+		int idx;
+		if (!s.free_blocks.empty())
+		{
+			idx = s.free_blocks.back();
+			s.free_blocks.pop_back();
+			if (int(s.free_blocks.size()) < s.num_trimmed)
+				s.num_trimmed = int(s.free_blocks.size());
+			else
+				--m_num_untrimmed;
+		}
+		else
+		{
+			TORRENT_ASSERT(s.untouched < m_blocks_per_slab);
+			idx = s.untouched++;
+		}
+
+		++s.num_in_use;
+		if (s.free_blocks.empty() && s.untouched == m_blocks_per_slab)
+			m_available.erase(base);
+
+		TORRENT_ASSERT(!s.used[std::size_t(idx)]);
+		s.used[std::size_t(idx)] = true;
+		return base + std::ptrdiff_t(idx) * m_block_size;
+	}
+
+	void slab_allocator::free(char* const buf)
+	{
+		auto const i = slab_of(buf);
+		TORRENT_ASSERT(i != m_slabs.end());
+		char* const base = i->first;
+		slab& s = i->second;
+
+		std::ptrdiff_t const offset = buf - base;
+		TORRENT_ASSERT(offset % m_block_size == 0);
+		int const idx = int(offset / m_block_size);
+		TORRENT_ASSERT(s.used[std::size_t(idx)]);
+		s.used[std::size_t(idx)] = false;
+
+		s.free_blocks.push_back(idx);
+		++m_num_untrimmed;
+
+		m_available.insert(base);
+		--s.num_in_use;
+		if (s.num_in_use > 0) return;
+
+		++m_num_empty;
+		slab_emptied(i);
+	}
+
+	// called when the slab i has no blocks in use anymore, and is counted in
+	// m_num_empty. Unless it's the only empty one, or some of its blocks are
+	// being trimmed, give its memory back
+	void slab_allocator::slab_emptied(std::map<char*, slab>::iterator const i)
+	{
+		slab const& s = i->second;
+		TORRENT_ASSERT(s.num_in_use == 0);
+		if (m_num_empty == 1 || s.num_trimming > 0) return;
+
+		char* const base = i->first;
+		m_num_untrimmed -= int(s.free_blocks.size()) - s.num_trimmed;
+		m_available.erase(base);
+		m_slabs.erase(i);
+		unmap_slab(base);
+		--m_num_empty;
+	}
+
+	bool slab_allocator::in_use(char const* buf) const
+	{
+		auto i = m_slabs.upper_bound(const_cast<char*>(buf));
+		if (i == m_slabs.begin()) return false;
+		--i;
+		std::ptrdiff_t const offset = buf - i->first;
+		if (offset >= std::ptrdiff_t(m_blocks_per_slab) * m_block_size) return false;
+		if (offset % m_block_size != 0) return false;
+		return i->second.used[std::size_t(offset / m_block_size)];
+	}
+
+	void slab_allocator::release_empty_slabs()
+	{
+		for (auto i = m_slabs.begin(); i != m_slabs.end();)
+		{
+			slab const& s = i->second;
+			// slabs with blocks being trimmed are unmapped by end_trim()
+			if (s.num_in_use > 0 || s.num_trimming > 0)
+			{
+				++i;
+				continue;
+			}
+			char* const base = i->first;
+			m_num_untrimmed -= int(s.free_blocks.size()) - s.num_trimmed;
+			m_available.erase(base);
+			i = m_slabs.erase(i);
+			unmap_slab(base);
+			--m_num_empty;
+		}
+		TORRENT_ASSERT(m_num_empty >= 0);
+	}
+
+	std::vector<slab_allocator::trim_range> slab_allocator::begin_trim()
+	{
+		release_empty_slabs();
+
+		std::vector<trim_range> ret;
+		std::vector<int> blocks;
+		for (auto& i : m_slabs)
+		{
+			slab& s = i.second;
+			if (s.num_trimmed == int(s.free_blocks.size())) continue;
+
+			blocks.assign(s.free_blocks.begin() + s.num_trimmed, s.free_blocks.end());
+			s.free_blocks.resize(std::size_t(s.num_trimmed));
+			s.num_trimming += int(blocks.size());
+			if (s.free_blocks.empty() && s.untouched == m_blocks_per_slab)
+				m_available.erase(i.first);
+
+			// one range per run of adjacent blocks
+			std::sort(blocks.begin(), blocks.end());
+			for (std::size_t k = 0; k < blocks.size();)
+			{
+				std::size_t end = k + 1;
+				while (end < blocks.size() && blocks[end] == blocks[end - 1] + 1) ++end;
+				ret.push_back({i.first + std::ptrdiff_t(blocks[k]) * m_block_size
+					, (end - k) * std::size_t(m_block_size)});
+				k = end;
+			}
+		}
+		m_num_untrimmed = 0;
+		return ret;
+	}
+
+	// tells the operating system it may drop the pages of these ranges. They
+	// will read back as zeros, or with their old content, the next time
+	// they're touched
+	void slab_allocator::drop_pages(span<trim_range const> const ranges)
+	{
+		for (auto const& r : ranges)
+		{
+#if TORRENT_HAVE_MMAP
+#if defined MADV_FREE && !defined TORRENT_LINUX
+			// MADV_FREE is lazy on linux, the pages are still counted as
+			// resident until there's memory pressure
+			::madvise(r.ptr, r.size, MADV_FREE);
+#else
+			::madvise(r.ptr, r.size, MADV_DONTNEED);
+#endif
+#elif defined TORRENT_WINDOWS
+			::VirtualAlloc(r.ptr, r.size, MEM_RESET, PAGE_READWRITE);
+#else
+			TORRENT_UNUSED(r);
+#endif
+		}
+	}
+
+	void slab_allocator::end_trim(span<trim_range const> const ranges)
+	{
+		for (auto const& r : ranges)
+		{
+			auto const i = slab_of(r.ptr);
+			TORRENT_ASSERT(i != m_slabs.end());
+			slab& s = i->second;
+			int const first = int((r.ptr - i->first) / m_block_size);
+			int const num = int(r.size / std::size_t(m_block_size));
+			TORRENT_ASSERT(s.num_trimming >= num);
+
+			// trimmed blocks go at the front of the free list, to be allocated
+			// last
+			s.free_blocks.insert(s.free_blocks.begin(), std::size_t(num), 0);
+			for (int k = 0; k < num; ++k) s.free_blocks[std::size_t(k)] = first + k;
+			s.num_trimmed += num;
+			s.num_trimming -= num;
+			m_available.insert(i->first);
+
+			if (s.num_in_use == 0 && s.num_trimming == 0) slab_emptied(i);
+		}
+	}
+
+	void slab_allocator::trim()
+	{
+		std::vector<trim_range> const ranges = begin_trim();
+		drop_pages(ranges);
+		end_trim(ranges);
+	}
+
+	std::map<char*, slab_allocator::slab>::iterator slab_allocator::slab_of(char const* buf)
+	{
+		auto i = m_slabs.upper_bound(const_cast<char*>(buf));
+		if (i == m_slabs.begin()) return m_slabs.end();
+		--i;
+		if (buf - i->first >= std::ptrdiff_t(m_blocks_per_slab) * m_block_size)
+			return m_slabs.end();
+		return i;
+	}
+
+	char* slab_allocator::map_slab()
+	{
+		std::size_t const size = std::size_t(m_blocks_per_slab) * std::size_t(m_block_size);
+#if TORRENT_HAVE_MMAP
+		// huge pages can only back a range that's aligned to the huge page
+		// size. Map twice the size and trim it to get a slab aligned to its
+		// own size
+		std::size_t const map_size = m_huge_pages ? size * 2 : size;
+		void* const ret = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE
+			, MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (ret == MAP_FAILED) return nullptr;
+		char* base = static_cast<char*>(ret);
+		if (m_huge_pages)
+		{
+			std::uintptr_t const addr = reinterpret_cast<std::uintptr_t>(base);
+			std::size_t const head = (size - addr % size) % size;
+			if (head > 0) ::munmap(base, head);
+			if (size - head > 0) ::munmap(base + head + size, size - head);
+			base += head;
+#ifdef MADV_HUGEPAGE
+			::madvise(base, size, MADV_HUGEPAGE);
+#endif
+		}
+		return base;
+#elif defined TORRENT_WINDOWS
+		return static_cast<char*>(::VirtualAlloc(nullptr, size
+			, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+		return page_malloc(size);
+#endif
+	}
+
+	void slab_allocator::unmap_slab(char* const base)
+	{
+#if TORRENT_HAVE_MMAP
+		::munmap(base, std::size_t(m_blocks_per_slab) * std::size_t(m_block_size));
+#elif defined TORRENT_WINDOWS
+		::VirtualFree(base, 0, MEM_RELEASE);
+#else
+		page_free(base);
+#endif
+	}
+}}
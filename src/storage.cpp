@@ -72,6 +72,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_buffer_holder.hpp"
 #include "libtorrent/stat_cache.hpp"
 #include "libtorrent/hex.hpp" // to_hex
+#include "libtorrent/aux_/file_mapping.hpp"
 // for convert_to_wstring and convert_to_native
 #include "libtorrent/aux_/escape_string.hpp"
 
@@ -79,10 +80,20 @@ namespace libtorrent {
 
 	default_storage::default_storage(storage_params const& params
 		, file_pool& pool)
+		: default_storage(params, pool, false)
+	{}
+
+	default_storage::default_storage(storage_params const& params
+		, file_pool& pool, bool const memory_mapped)
 		: storage_interface(params.files)
 		, m_file_priority(params.priorities)
 		, m_pool(pool)
+		, m_verification_cache(complete(params.path)
+			, "." + aux::to_hex(params.info_hash) + ".hashes"
+			, "." + aux::to_hex(params.info_hash) + ".parts")
 		, m_allocate_files(params.mode == storage_mode_allocate)
+		// mapping whole files would quickly exhaust a 32 bit address space
+		, m_use_mmap(TORRENT_HAVE_MMAP && memory_mapped && sizeof(void*) >= 8)
 	{
 		if (params.mapped_files) m_mapped_files.reset(new file_storage(*params.mapped_files));
 
@@ -329,6 +340,11 @@ namespace libtorrent {
 
 		// close files that were opened in write mode
 		m_pool.release(storage_index());
+
+		if (m_settings && m_settings->get_bool(settings_pack::use_verification_cache))
+			m_verification_cache.enable(fs);
+		else
+			m_verification_cache.disable();
 	}
 
 	bool default_storage::has_any_file(storage_error& ec)
@@ -362,6 +378,7 @@ namespace libtorrent {
 	{
 		if (index < file_index_t(0) || index >= files().end_file()) return;
 		std::string old_name = files().file_path(index, m_save_path);
+		close_mappings();
 		m_pool.release(storage_index(), index);
 
 		// if the old file doesn't exist, just succeed and change the filename
@@ -437,8 +454,14 @@ namespace libtorrent {
 		}
 
 		// make sure we don't have the files open
+		close_mappings();
 		m_pool.release(storage_index());
 
+		// the disk cache has been flushed, all pieces we know the hash of are
+		// on disk now
+		error_code ignore;
+		m_verification_cache.save_all(files(), ignore);
+
 		// make sure we can pick up new files added to the download directory when
 		// we start the torrent again
 		m_stat_cache.clear();
@@ -447,6 +470,7 @@ namespace libtorrent {
 	void default_storage::delete_files(remove_flags_t const options, storage_error& ec)
 	{
 		// make sure we don't have the files open
+		close_mappings();
 		m_pool.release(storage_index());
 
 		// if there's a part file open, make sure to destruct it to have it
@@ -454,6 +478,8 @@ namespace libtorrent {
 		// delete it
 		if (m_part_file) m_part_file.reset();
 
+		m_verification_cache.disable();
+
 		aux::delete_files(files(), m_save_path, m_part_file_name, options, ec);
 	}
 
@@ -468,15 +494,24 @@ namespace libtorrent {
 	status_t default_storage::move_storage(std::string const& sp
 		, move_flags_t const flags, storage_error& ec)
 	{
+		close_mappings();
 		m_pool.release(storage_index());
 
+		int const copy_threads = m_settings
+			? m_settings->get_int(settings_pack::move_storage_copy_threads) : 1;
+
 		status_t ret;
 		std::tie(ret, m_save_path) = aux::move_storage(files(), m_save_path, sp
-			, m_part_file.get(), flags, ec);
+			, m_part_file.get(), flags, ec, copy_threads
+			, [this](std::int64_t const copied, std::int64_t const total)
+			{ set_move_progress(copied, total); });
+		set_move_progress(0, 0);
 
 		// clear the stat cache in case the new location has new files
 		m_stat_cache.clear();
 
+		m_verification_cache.set_save_path(m_save_path);
+
 		return ret;
 	}
 
@@ -521,6 +556,17 @@ namespace libtorrent {
 				return ret;
 			}
 
+#if TORRENT_HAVE_MMAP
+			if (m_use_mmap)
+			{
+				std::shared_ptr<aux::file_mapping> const m = open_mapping(file_index
+					, file_offset + bufs_size(vec), ec);
+				if (ec) return -1;
+				ec.operation = operation_t::file_read;
+				return m->readv(file_offset, vec);
+			}
+#endif
+
 			file_handle handle = open_file(file_index
 				, open_mode::read_only | flags, ec);
 			if (ec) return -1;
@@ -552,14 +598,16 @@ namespace libtorrent {
 		, piece_index_t const piece, int const offset
 		, open_mode_t const flags, storage_error& error)
 	{
-		return readwritev(files(), bufs, piece, offset, error
+		int const ret = readwritev(files(), bufs, piece, offset, error
 			, [this, flags](file_index_t const file_index
 				, std::int64_t const file_offset
 				, span<iovec_t const> vec, storage_error& ec)
 		{
 			if (files().pad_file_at(file_index))
 			{
-				// writing to a pad-file is a no-op
+				// writing to a pad-file is a no-op. Pad files are never stored on
+				// disk, reading them back always yields zeroes. Non-zero pad data
+				// from a peer makes the piece fail its hash check
 				return bufs_size(vec);
 			}
 
@@ -589,6 +637,10 @@ namespace libtorrent {
 			// we're writing to it
 			m_stat_cache.set_dirty(file_index);
 
+			// in mapped mode too, writes go through the file handle. A store
+			// into a mapping fails with SIGBUS, not with an error, if the disk
+			// is full. Mappings share the page cache, so they see these writes
+
 			file_handle handle = open_file(file_index
 				, open_mode::read_write, ec);
 			if (ec) return -1;
@@ -614,6 +666,17 @@ namespace libtorrent {
 
 			return ret;
 		});
+
+		// a failed write may have left any of the pieces it covers with
+		// different contents than the ones we have the hash of
+		if (error)
+		{
+			piece_index_t const last(static_cast<int>(piece)
+				+ (offset + std::max(bufs_size(bufs), 1) - 1) / files().piece_length());
+			for (piece_index_t p = piece; p <= last && p < files().end_piece(); ++p)
+				m_verification_cache.clear(p);
+		}
+		return ret;
 	}
 
 	file_handle default_storage::open_file(file_index_t const file
@@ -677,7 +740,12 @@ namespace libtorrent {
 					return h;
 				}
 
-				if (m_allocate_files || need_truncate)
+				// in direct_io mode, the unaligned tail of a write is padded to
+				// a whole block, which must not race with other writes
+				// extending the file. So the file is given its full size
+				// up-front (sparse, unless we're allocating)
+				if (m_allocate_files || need_truncate
+					|| (h->open_mode() & open_mode::direct_io))
 				{
 					h->set_size(size, e);
 					if (e)
@@ -716,11 +784,198 @@ namespace libtorrent {
 			mode |= open_mode::no_cache;
 		}
 
+		if (m_settings
+			&& (settings().get_int(settings_pack::disk_io_write_mode)
+				== settings_pack::direct_io
+			|| settings().get_int(settings_pack::disk_io_read_mode)
+				== settings_pack::direct_io))
+		{
+			mode |= open_mode::direct_io;
+		}
+
 		file_handle ret = m_pool.open_file(storage_index(), m_save_path, file
 			, files(), mode, ec);
 		return ret;
 	}
 
+	bool default_storage::has_read_views() const
+	{
+		return m_use_mmap;
+	}
+
+	char* default_storage::read_view(piece_index_t const piece, int const offset
+		, int const size, std::int32_t& cookie, storage_error& ec)
+	{
+#if TORRENT_HAVE_MMAP
+		if (!m_use_mmap) return nullptr;
+
+		// only ranges that fall entirely within a single regular file can be
+		// served as a view
+		file_storage const& fs = files();
+		std::vector<file_slice> const slices = fs.map_block(piece, offset, size);
+		if (slices.size() != 1) return nullptr;
+		file_index_t const file_index = slices.front().file_index;
+		if (fs.pad_file_at(file_index)) return nullptr;
+		if (file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index))
+			return nullptr;
+
+		std::int64_t const file_offset = slices.front().offset;
+		std::shared_ptr<aux::file_mapping> m = open_mapping(file_index
+			, file_offset + size, ec);
+		if (ec) return nullptr;
+		if (file_offset + size > m->size()) return nullptr;
+
+		// take the page faults here, on the disk thread
+		m->prefault(file_offset, size);
+		char* const ret = m->data() + file_offset;
+
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		int slot;
+		if (m_free_view_slots.empty())
+		{
+			slot = int(m_views.size());
+			m_views.emplace_back(std::move(m));
+		}
+		else
+		{
+			slot = m_free_view_slots.back();
+			m_free_view_slots.pop_back();
+			m_views[std::size_t(slot)] = std::move(m);
+		}
+		cookie = -(slot + 1);
+		return ret;
+#else
+		TORRENT_UNUSED(piece);
+		TORRENT_UNUSED(offset);
+		TORRENT_UNUSED(size);
+		TORRENT_UNUSED(cookie);
+		TORRENT_UNUSED(ec);
+		return nullptr;
+#endif
+	}
+
+	file_handle default_storage::file_for_block(piece_index_t const piece
+		, int const offset, int const size, std::int64_t& file_offset
+		, storage_error& ec)
+	{
+		// files opened for direct I/O don't go through the page cache
+		if (settings().get_int(settings_pack::disk_io_read_mode)
+			== settings_pack::direct_io)
+			return file_handle();
+
+		file_storage const& fs = files();
+		std::vector<file_slice> const slices = fs.map_block(piece, offset, size);
+		if (slices.size() != 1) return file_handle();
+		file_index_t const file_index = slices.front().file_index;
+		if (fs.pad_file_at(file_index)) return file_handle();
+		if (file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index))
+			return file_handle();
+
+		file_handle ret = open_file(file_index, open_mode::read_only, ec);
+		if (ec) return file_handle();
+
+		// a block past the end of the file would be sent short. Read it
+		// the regular way, to have that reported as an error
+		error_code e;
+		std::int64_t const file_size = ret->get_size(e);
+		if (e || slices.front().offset + size > file_size) return file_handle();
+
+		file_offset = slices.front().offset;
+
+		// pull the block into the page cache here, on the disk thread, to not
+		// stall the network thread once it's sent
+		ret->prefetch(file_offset, size);
+		return ret;
+	}
+
+	void default_storage::release_view(std::int32_t const cookie)
+	{
+#if TORRENT_HAVE_MMAP
+		TORRENT_ASSERT(cookie < 0);
+		int const slot = -cookie - 1;
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		TORRENT_ASSERT(slot < int(m_views.size()));
+		TORRENT_ASSERT(m_views[std::size_t(slot)]);
+		m_views[std::size_t(slot)].reset();
+		m_free_view_slots.push_back(slot);
+#else
+		TORRENT_UNUSED(cookie);
+#endif
+	}
+
+#if TORRENT_HAVE_MMAP
+	std::shared_ptr<aux::file_mapping> default_storage::open_mapping(
+		file_index_t const file, std::int64_t const end, storage_error& ec)
+	{
+		std::int64_t const file_size = files().file_size(file);
+		{
+			std::lock_guard<std::mutex> l(m_mapping_mutex);
+			if (file < m_mappings.end_index() && m_mappings[file])
+			{
+				auto const& m = m_mappings[file];
+				// files only grow while they're being downloaded, so a mapping
+				// of a file that was incomplete when it was mapped is still good
+				// for anything it covers
+				if (m->size() >= std::min(end, file_size))
+					return m;
+			}
+		}
+
+		file_handle h = open_file(file, open_mode::read_only, ec);
+		if (ec) return {};
+
+		error_code e;
+		std::int64_t const size = h->get_size(e);
+		if (e)
+		{
+			ec.ec = e;
+			ec.file(file);
+			ec.operation = operation_t::file_stat;
+			return {};
+		}
+
+		auto m = std::make_shared<aux::file_mapping>(h->native_handle()
+			, std::min(size, file_size), e);
+		if (e)
+		{
+			ec.ec = e;
+			ec.file(file);
+			ec.operation = operation_t::file;
+			return {};
+		}
+
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		if (m_mappings.end_index() <= file)
+			m_mappings.resize(static_cast<int>(file) + 1);
+		m_mappings[file] = m;
+		return m;
+	}
+#endif
+
+	void default_storage::close_mappings()
+	{
+#if TORRENT_HAVE_MMAP
+		std::lock_guard<std::mutex> l(m_mapping_mutex);
+		m_mappings.clear();
+#endif
+	}
+
+	void default_storage::piece_hashed(piece_index_t const piece
+		, sha1_hash const& h, bool const on_disk)
+	{
+		m_verification_cache.set(piece, h, on_disk);
+		if (on_disk) m_verification_cache.maybe_save(files());
+	}
+
+	bool default_storage::cached_piece_hash(piece_index_t const piece, sha1_hash& h)
+	{
+		return m_verification_cache.get(piece, h);
+	}
+
 	bool default_storage::tick()
 	{
 		error_code ec;
@@ -778,6 +1033,12 @@ namespace {
 		};
 	}
 
+	storage_interface* mmap_storage_constructor(storage_params const& params
+		, file_pool& pool)
+	{
+		return new default_storage(params, pool, true);
+	}
+
 	storage_interface* disabled_storage_constructor(storage_params const& params, file_pool&)
 	{
 		return new disabled_storage(params.files);
@@ -41,6 +41,7 @@ namespace libtorrent { namespace aux {
 	{
 		TORRENT_ASSERT(p->in_storage == false);
 		TORRENT_ASSERT(p->storage.get() == this);
+		std::lock_guard<std::mutex> l(m_piece_mutex);
 		m_cached_pieces.push_back(*p);
 		++m_num_pieces;
 #if TORRENT_USE_ASSERTS
@@ -51,6 +52,7 @@ namespace libtorrent { namespace aux {
 	void storage_piece_set::remove_piece(cached_piece_entry* p)
 	{
 		TORRENT_ASSERT(p->in_storage == true);
+		std::lock_guard<std::mutex> l(m_piece_mutex);
 		p->unlink();
 		--m_num_pieces;
 #if TORRENT_USE_ASSERTS
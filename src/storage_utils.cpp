@@ -41,6 +41,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/torrent_status.hpp"
 
 #include <set>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace libtorrent { namespace aux {
 
@@ -207,7 +211,8 @@ namespace libtorrent { namespace aux {
 		, std::string const& save_path
 		, std::string const& destination_save_path
 		, part_file* pf
-		, move_flags_t const flags, storage_error& ec)
+		, move_flags_t const flags, storage_error& ec
+		, int const copy_threads, move_progress_fun const& progress)
 	{
 		status_t ret = status_t::no_error;
 		std::string const new_save_path = complete(destination_save_path);
@@ -223,8 +228,9 @@ namespace libtorrent { namespace aux {
 				// the directory exists, check all the files
 				for (auto const i : f.file_range())
 				{
-					// files moved out to absolute paths are ignored
-					if (f.file_absolute_path(i)) continue;
+					// files moved out to absolute paths are ignored, pad files
+					// are never stored on disk
+					if (f.file_absolute_path(i) || f.pad_file_at(i)) continue;
 
 					stat_file(f.file_path(i, new_save_path), &s, err);
 					if (err != boost::system::errc::no_such_file_or_directory)
@@ -267,13 +273,21 @@ namespace libtorrent { namespace aux {
 		// later
 		aux::vector<bool, file_index_t> copied_files(std::size_t(f.num_files()), false);
 
+		// the files that couldn't be renamed and have to be copied. This is
+		// done once all renames have succeeded, several files at a time
+		std::vector<file_index_t> to_copy;
+
+		// the files that were renamed, and are moved back in case of an error
+		aux::vector<bool, file_index_t> renamed_files(std::size_t(f.num_files()), false);
+
 		// track how far we got in case of an error
 		file_index_t file_index{};
 		error_code e;
 		for (auto const i : f.file_range())
 		{
-			// files moved out to absolute paths are not moved
-			if (f.file_absolute_path(i)) continue;
+			// files moved out to absolute paths are not moved, pad files are
+			// never stored on disk
+			if (f.file_absolute_path(i) || f.pad_file_at(i)) continue;
 
 			std::string const old_path = combine_path(save_path, f.file_path(i));
 			std::string const new_path = combine_path(new_save_path, f.file_path(i));
@@ -291,7 +305,9 @@ namespace libtorrent { namespace aux {
 
 			// if the source file doesn't exist. That's not a problem
 			// we just ignore that file
-			if (e == boost::system::errc::no_such_file_or_directory)
+			if (!e)
+				renamed_files[i] = true;
+			else if (e == boost::system::errc::no_such_file_or_directory)
 				e.clear();
 			else if (e
 				&& e != boost::system::errc::invalid_argument
@@ -301,8 +317,8 @@ namespace libtorrent { namespace aux {
 				// on OSX, the error when trying to rename a file across different
 				// volumes is EXDEV, which will make it fall back to copying.
 				e.clear();
-				copy_file(old_path, new_path, e);
-				if (!e) copied_files[i] = true;
+				to_copy.push_back(i);
+				copied_files[i] = true;
 			}
 
 			if (e)
@@ -315,6 +331,74 @@ namespace libtorrent { namespace aux {
 			}
 		}
 
+		if (!e && !to_copy.empty())
+		{
+			std::int64_t total = 0;
+			for (auto const i : to_copy)
+			{
+				error_code ignore;
+				file_status s;
+				stat_file(combine_path(save_path, f.file_path(i)), &s, ignore);
+				if (!ignore) total += s.file_size;
+			}
+			if (progress) progress(0, total);
+
+			std::int64_t copied = 0;
+			std::atomic<std::size_t> next{0};
+			std::atomic<bool> failed{false};
+			std::mutex error_mutex;
+			std::mutex progress_mutex;
+
+			auto copy_files = [&]
+			{
+				for (;;)
+				{
+					std::size_t const idx = next++;
+					if (idx >= to_copy.size() || failed) return;
+					file_index_t const i = to_copy[idx];
+					error_code err;
+					copy_file(combine_path(save_path, f.file_path(i))
+						, combine_path(new_save_path, f.file_path(i)), err
+						, [&](std::int64_t const n)
+						{
+							if (!progress) return;
+							std::lock_guard<std::mutex> l(progress_mutex);
+							copied += n;
+							progress(copied, total);
+						});
+					if (!err) continue;
+
+					std::lock_guard<std::mutex> l(error_mutex);
+					if (failed) return;
+					failed = true;
+					e = err;
+					ec.ec = err;
+					ec.file(i);
+					ec.operation = operation_t::file_copy;
+				}
+			};
+
+			int const num_threads = std::max(1
+				, std::min(copy_threads, int(to_copy.size())));
+			std::vector<std::thread> threads;
+			for (int i = 1; i < num_threads; ++i)
+				threads.emplace_back(copy_files);
+			copy_files();
+			for (auto& t : threads) t.join();
+
+			if (e)
+			{
+				// the copies don't need to be rolled back, the originals are still
+				// in place. Just remove what we copied
+				for (auto const i : to_copy)
+				{
+					error_code ignore;
+					remove(combine_path(new_save_path, f.file_path(i)), ignore);
+				}
+				file_index = f.end_file();
+			}
+		}
+
 		if (!e && pf)
 		{
 			pf->move_partfile(new_save_path, e);
@@ -334,9 +418,9 @@ namespace libtorrent { namespace aux {
 				// files moved out to absolute paths are not moved
 				if (f.file_absolute_path(file_index)) continue;
 
-				// if we ended up copying the file, don't do anything during
-				// roll-back
-				if (copied_files[file_index]) continue;
+				// if we ended up copying the file, or didn't move it at all, don't
+				// do anything during roll-back
+				if (!renamed_files[file_index]) continue;
 
 				std::string const old_path = combine_path(save_path, f.file_path(file_index));
 				std::string const new_path = combine_path(new_save_path, f.file_path(file_index));
@@ -359,7 +443,7 @@ namespace libtorrent { namespace aux {
 		for (auto const i : f.file_range())
 		{
 			// files moved out to absolute paths are not moved
-			if (f.file_absolute_path(i)) continue;
+			if (f.file_absolute_path(i) || f.pad_file_at(i)) continue;
 
 			if (has_parent_path(f.file_path(i)))
 				subdirs.insert(parent_path(f.file_path(i)));
@@ -414,6 +498,9 @@ namespace libtorrent { namespace aux {
 			using iter_t = std::set<std::string>::iterator;
 			for (auto const i : fs.file_range())
 			{
+				// pad files are never stored on disk
+				if (fs.pad_file_at(i)) continue;
+
 				std::string const fp = fs.file_path(i);
 				bool const complete = fs.file_absolute_path(i);
 				std::string const p = complete ? fp : combine_path(save_path, fp);
@@ -517,10 +604,15 @@ namespace libtorrent { namespace aux {
 		{
 			if (rd.have_pieces.get_bit(i) == false) continue;
 
-			std::vector<file_slice> f = fs.map_block(i, 0, 1);
+			// pad files are never stored on disk. Check the first file of the
+			// piece that is
+			std::vector<file_slice> const f = fs.map_block(i, 0, fs.piece_size(i));
 			TORRENT_ASSERT(!f.empty());
+			auto const slice = std::find_if(f.begin(), f.end()
+				, [&fs](file_slice const& s) { return !fs.pad_file_at(s.file_index); });
+			if (slice == f.end()) continue;
 
-			file_index_t const file_index = f[0].file_index;
+			file_index_t const file_index = slice->file_index;
 
 			// files with priority zero may not have been saved to disk at their
 			// expected location, but is likely to be in a partfile. Just exempt it
@@ -530,7 +622,7 @@ namespace libtorrent { namespace aux {
 				continue;
 
 			error_code error;
-			std::int64_t const size = stat.get_filesize(f[0].file_index
+			std::int64_t const size = stat.get_filesize(file_index
 				, fs, save_path, error);
 
 			if (size < 0)
@@ -579,6 +671,9 @@ namespace libtorrent { namespace aux {
 	{
 		for (auto const i : fs.file_range())
 		{
+			// pad files are never stored on disk
+			if (fs.pad_file_at(i)) continue;
+
 			std::int64_t const sz = cache.get_filesize(
 				i, fs, save_path, ec.ec);
 
@@ -873,7 +873,8 @@ bool is_downloading_state(int const st)
 			r.length = std::min(piece_size - r.start, block_size());
 			m_ses.disk_thread().async_read(m_storage, r
 				, std::bind(&torrent::on_disk_read_complete
-				, shared_from_this(), _1, _2, _3, r, rp));
+				, shared_from_this(), _1, _2, _3, r, rp)
+				, disk_interface::time_critical);
 		}
 		m_ses.disk_thread().submit_jobs();
 	}
@@ -1249,6 +1250,14 @@ bool is_downloading_state(int const st)
 			, blocks_in_last_piece
 			, m_torrent_file->num_pieces()));
 
+		// a seed only has a piece picker in suggest mode, to track piece
+		// availability. It still has every piece
+		if (m_have_all)
+		{
+			for (piece_index_t i(0); i < m_torrent_file->end_piece(); ++i)
+				pp->we_have(i);
+		}
+
 		// initialize the file progress too
 		if (m_file_progress.empty())
 			m_file_progress.init(*pp, m_torrent_file->files());
@@ -2285,7 +2294,10 @@ bool is_downloading_state(int const st)
 			/ m_torrent_file->piece_length();
 		// if we only keep a single read operation in-flight at a time, we suffer
 		// significant performance degradation. Always keep at least 4 jobs
-		// outstanding per hasher thread
+		// outstanding per hasher thread. Beyond that, checking_mem_usage
+		// bounds how many check hashers can be kept busy. It's not raised to
+		// feed all of them, since that could take as much memory as one piece
+		// per CPU core
 		int const min_outstanding = 4
 			* std::max(1, settings().get_int(settings_pack::aio_threads)
 				/ disk_io_thread::hasher_thread_divisor);
@@ -3644,6 +3656,47 @@ bool is_downloading_state(int const st)
 	}
 	catch (...) { handle_exception(); }
 
+	// read the pieces we suggest to peers into the disk cache, before the
+	// peers get around to requesting them
+	void torrent::prefetch_suggested_pieces()
+	{
+		// wait for the previous round to complete
+		if (m_outstanding_prefetches > 0) return;
+		if (!has_storage() || !is_seed() || m_connections.empty()) return;
+		if (settings().get_int(settings_pack::suggest_mode)
+			!= settings_pack::suggest_read_cache)
+			return;
+
+		std::vector<piece_index_t> pieces;
+		m_suggest_pieces.top_pieces(pieces
+			, settings().get_int(settings_pack::prefetch_suggested_pieces));
+		if (pieces.empty()) return;
+
+		for (piece_index_t const p : pieces)
+		{
+			peer_request r;
+			r.piece = p;
+			r.start = 0;
+			r.length = std::min(m_torrent_file->piece_size(p), block_size());
+			// the handler may be called before async_read() returns
+			++m_outstanding_prefetches;
+			m_ses.disk_thread().async_read(m_storage, r
+				, std::bind(&torrent::on_piece_prefetched, shared_from_this(), _1, _2, _3)
+				, disk_interface::prefetch);
+		}
+		m_ses.disk_thread().submit_jobs();
+	}
+
+	// the block is just the first one of the piece, the piece itself is now in
+	// the cache. Errors are reported when peers request the piece
+	void torrent::on_piece_prefetched(disk_buffer_holder, disk_job_flags_t
+		, storage_error const&)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(m_outstanding_prefetches > 0);
+		--m_outstanding_prefetches;
+	}
+
 	void torrent::add_suggest_piece(piece_index_t const index)
 	{
 		TORRENT_ASSERT(settings().get_int(settings_pack::suggest_mode)
@@ -6933,6 +6986,9 @@ bool is_downloading_state(int const st)
 
 		if (num_peers() > 0) return true;
 
+		// to post storage_move_progress_alert
+		if (m_moving_storage) return true;
+
 		// we might want to connect web seeds
 		if (!is_finished() && !m_web_seeds.empty() && m_files_checked)
 			return true;
@@ -7567,6 +7623,7 @@ bool is_downloading_state(int const st)
 			m_ses.disk_thread().async_move_storage(m_storage, std::move(path), flags
 				, std::bind(&torrent::on_storage_moved, shared_from_this(), _1, _2, _3));
 			m_moving_storage = true;
+			update_want_tick();
 		}
 		else
 		{
@@ -7591,6 +7648,7 @@ bool is_downloading_state(int const st)
 		TORRENT_ASSERT(is_single_thread());
 
 		m_moving_storage = false;
+		update_want_tick();
 		if (status == status_t::no_error
 			|| status == status_t::need_full_check)
 		{
@@ -8883,6 +8941,20 @@ bool is_downloading_state(int const st)
 		if (m_abort) return;
 #endif
 
+		if (m_moving_storage
+			&& alerts().should_post<storage_move_progress_alert>())
+		{
+			storage_interface* st = get_storage_impl();
+			std::pair<std::int64_t, std::int64_t> const p = st
+				? st->move_progress() : std::make_pair(std::int64_t(0), std::int64_t(0));
+			// the progress is only known when files are being copied
+			if (p.second > 0)
+			{
+				alerts().emplace_alert<storage_move_progress_alert>(get_handle()
+					, p.first, p.second);
+			}
+		}
+
 		// if we're in upload only mode and we're auto-managed
 		// leave upload mode every 10 minutes hoping that the error
 		// condition has been fixed
@@ -8959,6 +9031,11 @@ bool is_downloading_state(int const st)
 			request_time_critical_pieces();
 		}
 
+		// ---- CACHE WARMING ----
+
+		if (settings().get_int(settings_pack::prefetch_suggested_pieces) > 0)
+			prefetch_suggested_pieces();
+
 		// ---- WEB SEEDS ----
 
 		maybe_connect_web_seeds();
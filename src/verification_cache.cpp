@@ -0,0 +1,353 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/verification_cache.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/time.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/bdecode.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	// the minimum time between saving the cache while pieces are being hashed
+	seconds const save_interval(60);
+
+	// what identifies a file as not having changed since the cache was saved.
+	// On POSIX systems any write to a file updates its ctime, and ctime can't
+	// be set back, so with nanosecond timestamps a modified file is caught
+	// even if its mtime is restored. On Windows ctime is the creation time
+	struct file_id
+	{
+		std::int64_t size = -1;
+		std::int64_t mtime = 0;
+		std::int64_t mtime_nsec = 0;
+		std::int64_t ctime = 0;
+		std::int64_t ctime_nsec = 0;
+		std::int64_t inode = 0;
+
+		bool operator==(file_id const& rhs) const
+		{
+			return size == rhs.size
+				&& mtime == rhs.mtime && mtime_nsec == rhs.mtime_nsec
+				&& ctime == rhs.ctime && ctime_nsec == rhs.ctime_nsec
+				&& inode == rhs.inode;
+		}
+	};
+
+	file_id stat_id(std::string const& path)
+	{
+		file_id ret;
+		file_status s;
+		error_code ec;
+		stat_file(path, &s, ec);
+		if (ec) return ret;
+		ret.size = s.file_size;
+		ret.mtime = std::int64_t(s.mtime);
+		ret.mtime_nsec = s.mtime_nsec;
+		ret.ctime = std::int64_t(s.ctime);
+		ret.ctime_nsec = s.ctime_nsec;
+		ret.inode = std::int64_t(s.inode);
+		return ret;
+	}
+
+	entry to_entry(file_id const& id)
+	{
+		entry::list_type ret;
+		ret.emplace_back(id.size);
+		ret.emplace_back(id.mtime);
+		ret.emplace_back(id.mtime_nsec);
+		ret.emplace_back(id.ctime);
+		ret.emplace_back(id.ctime_nsec);
+		ret.emplace_back(id.inode);
+		return ret;
+	}
+
+	file_id from_node(bdecode_node const& n)
+	{
+		file_id ret;
+		if (n.type() != bdecode_node::list_t || n.list_size() != 6) return ret;
+		ret.size = n.list_int_value_at(0, -1);
+		ret.mtime = n.list_int_value_at(1);
+		ret.mtime_nsec = n.list_int_value_at(2);
+		ret.ctime = n.list_int_value_at(3);
+		ret.ctime_nsec = n.list_int_value_at(4);
+		ret.inode = n.list_int_value_at(5);
+		return ret;
+	}
+
+	bool load_file(std::string const& path, std::vector<char>& buf)
+	{
+		error_code ec;
+		file f;
+		if (!f.open(path, open_mode::read_only, ec)) return false;
+		std::int64_t const size = f.get_size(ec);
+		if (ec || size <= 0) return false;
+		buf.resize(std::size_t(size));
+		return f.readv(0, {buf}, ec) == size && !ec;
+	}
+}
+
+	verification_cache::verification_cache(std::string save_path
+		, std::string name, std::string part_file)
+		: m_save_path(std::move(save_path))
+		, m_name(std::move(name))
+		, m_part_file(std::move(part_file))
+	{}
+
+	void verification_cache::enable(file_storage const& fs)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_enabled) return;
+		m_enabled = true;
+		m_hashes.resize(fs.num_pieces());
+		m_have.resize(fs.num_pieces(), false);
+		m_on_disk.resize(fs.num_pieces(), false);
+		load(fs);
+	}
+
+	void verification_cache::disable()
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled) return;
+		m_enabled = false;
+		m_hashes.clear();
+		m_hashes.shrink_to_fit();
+		m_have.clear();
+		m_on_disk.clear();
+		m_dirty = false;
+
+		error_code ignore;
+		remove(combine_path(m_save_path, m_name), ignore);
+	}
+
+	bool verification_cache::enabled() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_enabled;
+	}
+
+	bool verification_cache::get(piece_index_t const piece, sha1_hash& h) const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled || !m_have.get_bit(piece)) return false;
+		h = m_hashes[piece];
+		return true;
+	}
+
+	void verification_cache::set(piece_index_t const piece, sha1_hash const& h
+		, bool const on_disk)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled) return;
+		m_hashes[piece] = h;
+		m_have.set_bit(piece);
+		if (on_disk)
+		{
+			m_on_disk.set_bit(piece);
+			m_dirty = true;
+		}
+		else if (m_on_disk.get_bit(piece))
+		{
+			m_on_disk.clear_bit(piece);
+			m_dirty = true;
+		}
+	}
+
+	void verification_cache::clear(piece_index_t const piece)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled || !m_have.get_bit(piece)) return;
+		m_have.clear_bit(piece);
+		if (m_on_disk.get_bit(piece))
+		{
+			m_on_disk.clear_bit(piece);
+			m_dirty = true;
+		}
+	}
+
+	void verification_cache::maybe_save(file_storage const& fs)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled || !m_dirty) return;
+		if (m_last_save + save_interval > aux::time_now()) return;
+		error_code ignore;
+		save_impl(fs, ignore);
+	}
+
+	void verification_cache::save_all(file_storage const& fs, error_code& ec)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_enabled) return;
+		for (piece_index_t i(0); i < m_have.end_index(); ++i)
+		{
+			if (!m_have.get_bit(i) || m_on_disk.get_bit(i)) continue;
+			m_on_disk.set_bit(i);
+			m_dirty = true;
+		}
+		if (!m_dirty) return;
+		save_impl(fs, ec);
+	}
+
+	void verification_cache::set_save_path(std::string save_path)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (save_path == m_save_path) return;
+		error_code ignore;
+		remove(combine_path(m_save_path, m_name), ignore);
+		m_save_path = std::move(save_path);
+		m_dirty = m_enabled;
+	}
+
+	int verification_cache::num_hashes() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_have.count();
+	}
+
+	// the cache file is a bencoded dictionary. "files" has the size, mtime,
+	// ctime (both as seconds and nanoseconds) and inode of every file,
+	// "pieces" is a bitfield of the pieces whose hash is known and "hashes"
+	// their hashes, in piece order
+	void verification_cache::save_impl(file_storage const& fs, error_code& ec)
+	{
+		entry e;
+		e["version"] = 2;
+		e["piece-length"] = fs.piece_length();
+		e["num-pieces"] = fs.num_pieces();
+
+		entry::list_type& files = e["files"].list();
+		files.reserve(std::size_t(fs.num_files()));
+		for (auto const i : fs.file_range())
+			files.push_back(to_entry(stat_id(fs.file_path(i, m_save_path))));
+		e["part-file"] = to_entry(stat_id(combine_path(m_save_path, m_part_file)));
+
+		e["pieces"] = std::string(m_on_disk.data()
+			, std::size_t((m_on_disk.size() + 7) / 8));
+
+		std::string& hashes = e["hashes"].string();
+		hashes.reserve(std::size_t(m_on_disk.count()) * sha1_hash::size());
+		for (piece_index_t i(0); i < m_on_disk.end_index(); ++i)
+		{
+			if (!m_on_disk.get_bit(i)) continue;
+			hashes.append(m_hashes[i].data(), sha1_hash::size());
+		}
+
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), e);
+
+		// write to a temporary file first, to not leave a truncated cache file
+		// behind if we crash
+		std::string const path = combine_path(m_save_path, m_name);
+		std::string const tmp = path + ".tmp";
+		{
+			file f;
+			if (!f.open(tmp, open_mode::write_only | open_mode::attribute_hidden, ec))
+				return;
+			if (!f.set_size(std::int64_t(buf.size()), ec)) return;
+			f.writev(0, {buf}, ec);
+			if (ec) return;
+		}
+		rename(tmp, path, ec);
+		if (ec) return;
+
+		m_dirty = false;
+		m_last_save = aux::time_now();
+	}
+
+	void verification_cache::load(file_storage const& fs)
+	{
+		std::vector<char> buf;
+		if (!load_file(combine_path(m_save_path, m_name), buf)) return;
+
+		error_code ec;
+		bdecode_node const e = bdecode(buf, ec, nullptr, 100
+			, fs.num_files() * 5 + 100);
+		if (ec || e.type() != bdecode_node::dict_t) return;
+
+		if (e.dict_find_int_value("version") != 2
+			|| e.dict_find_int_value("piece-length") != fs.piece_length()
+			|| e.dict_find_int_value("num-pieces") != fs.num_pieces())
+			return;
+
+		bdecode_node const files = e.dict_find_list("files");
+		if (!files || files.list_size() != fs.num_files()) return;
+
+		// if the part file has changed, we can't tell which pieces it affects
+		if (!(from_node(e.dict_find("part-file"))
+			== stat_id(combine_path(m_save_path, m_part_file))))
+			return;
+
+		string_view const pieces = e.dict_find_string_value("pieces");
+		string_view const hashes = e.dict_find_string_value("hashes");
+		int const num_pieces = fs.num_pieces();
+		if (int(pieces.size()) != (num_pieces + 7) / 8) return;
+
+		typed_bitfield<piece_index_t> have;
+		have.assign(pieces.data(), num_pieces);
+		if (int(hashes.size()) != have.count() * int(sha1_hash::size())) return;
+
+		char const* h = hashes.data();
+		for (piece_index_t i(0); i < have.end_index(); ++i)
+		{
+			if (!have.get_bit(i)) continue;
+			std::memcpy(m_hashes[i].data(), h, sha1_hash::size());
+			h += sha1_hash::size();
+		}
+
+		// drop the pieces of files that have changed
+		for (auto const i : fs.file_range())
+		{
+			if (fs.pad_file_at(i) || fs.file_size(i) == 0) continue;
+			if (from_node(files.list_at(static_cast<int>(i)))
+				== stat_id(fs.file_path(i, m_save_path)))
+				continue;
+
+			piece_index_t const first = fs.map_file(i, 0, 1).piece;
+			piece_index_t const last = fs.map_file(i, fs.file_size(i) - 1, 1).piece;
+			for (piece_index_t p = first; p <= last; ++p)
+				have.clear_bit(p);
+		}
+
+		m_have = have;
+		m_on_disk = have;
+	}
+}}
@@ -178,10 +178,11 @@ TORRENT_TEST(alerts_types)
 	TEST_ALERT_TYPE(dht_sample_infohashes_alert, 93, 0, alert::dht_operation_notification);
 	TEST_ALERT_TYPE(block_uploaded_alert, 94, 0, PROGRESS_NOTIFICATION alert::upload_notification);
 	TEST_ALERT_TYPE(alerts_dropped_alert, 95, 3, alert::error_notification);
+	TEST_ALERT_TYPE(storage_move_progress_alert, 96, 0, alert::storage_notification);
 
 #undef TEST_ALERT_TYPE
 
-	TEST_EQUAL(num_alert_types, 96);
+	TEST_EQUAL(num_alert_types, 97);
 	TEST_EQUAL(num_alert_types, count_alert_types);
 }
 
@@ -489,6 +489,143 @@ TORRENT_TEST(block_cache)
 	// TODO: test unaligned reads
 }
 
+TORRENT_TEST(hash_reorder_window)
+{
+	TEST_SETUP;
+
+	// block 1 arrives before block 0. Once it's been flushed it's a clean
+	// block in a piece being hashed
+	WRITE_BLOCK(0, 1);
+	TEST_CHECK(pe->blocks[1].out_of_order);
+	pe->hash.reset(new partial_hash);
+
+	int flushing[1] = {1};
+	pe->blocks[1].pending = true;
+	bc.inc_block_refcount(pe, 1, block_cache::ref_flushing);
+	bc.blocks_flushed(pe, flushing, 1);
+	TEST_EQUAL(pe->num_dirty, 0);
+	pe->jobs.get_all();
+
+	// it's within the reorder window, so it's kept, to be hashed once block
+	// 0 arrives
+	TEST_EQUAL(bc.try_evict_blocks(1), 1);
+	TEST_CHECK(pe->blocks[1].buf != nullptr);
+
+	// without a reorder window it's evicted like any other clean block, and
+	// would have to be read back to complete the hash. That was the piece's
+	// only block, so the piece goes with it
+	sett.set_int(settings_pack::hash_reorder_window, 0);
+	bc.set_settings(sett);
+	TEST_EQUAL(bc.try_evict_blocks(1), 0);
+	TEST_CHECK(bc.find_piece(pm.get(), piece_index_t(0)) == nullptr);
+
+	// block 0 followed by block 1 is in order
+	WRITE_BLOCK(1, 0);
+	TEST_CHECK(!pe->blocks[0].out_of_order);
+	pe->jobs.get_all();
+	WRITE_BLOCK(1, 1);
+	TEST_CHECK(!pe->blocks[1].out_of_order);
+
+	tailqueue<disk_io_job> jobs;
+	bc.clear(jobs);
+}
+
+TORRENT_TEST(hash_reorder_window_limits)
+{
+	TEST_SETUP;
+	sett.set_int(settings_pack::cache_size, 8);
+	bc.set_settings(sett);
+
+	// the second block of three pieces arrives first, and is flushed
+	for (int p = 0; p < 3; ++p)
+	{
+		WRITE_BLOCK(p, 1);
+		pe->hash.reset(new partial_hash);
+		int flushing[1] = {1};
+		pe->blocks[1].pending = true;
+		bc.inc_block_refcount(pe, 1, block_cache::ref_flushing);
+		bc.blocks_flushed(pe, flushing, 1);
+		pe->jobs.get_all();
+	}
+
+	// at most a quarter of the cache (2 blocks) is kept for reordering, so
+	// one of the blocks is evicted even though it's in a reorder window
+	TEST_EQUAL(bc.try_evict_blocks(3), 2);
+	int kept = 0;
+	for (int p = 0; p < 3; ++p)
+	{
+		cached_piece_entry* e = bc.find_piece(pm.get(), piece_index_t(p));
+		if (e != nullptr && e->blocks[1].buf != nullptr) ++kept;
+	}
+	TEST_EQUAL(kept, 2);
+
+	// pieces that haven't been written to for a while aren't protected
+	for (int p = 0; p < 3; ++p)
+	{
+		cached_piece_entry* e = bc.find_piece(pm.get(), piece_index_t(p));
+		if (e != nullptr) e->expire -= seconds(10);
+	}
+	TEST_EQUAL(bc.try_evict_blocks(2), 0);
+	for (int p = 0; p < 3; ++p)
+		TEST_CHECK(bc.find_piece(pm.get(), piece_index_t(p)) == nullptr);
+}
+
+TORRENT_TEST(torrent_cache_share)
+{
+	io_service ios;
+	block_cache bc(ios, std::bind(&nop));
+	aux::session_settings sett;
+	sett.set_int(settings_pack::cache_size, 8);
+	sett.set_int(settings_pack::max_torrent_cache_share, 25);
+	bc.set_settings(sett);
+
+	file_storage fs;
+	fs.add_file("a/test0", 0x20000);
+	fs.set_piece_length(0x8000);
+	fs.set_num_pieces(4);
+	std::shared_ptr<storage_interface> small
+		= std::make_shared<test_storage_impl>(fs);
+	std::shared_ptr<storage_interface> big
+		= std::make_shared<test_storage_impl>(fs);
+	small->m_settings = &sett;
+	big->m_settings = &sett;
+
+	auto insert = [&](std::shared_ptr<storage_interface> const& st, int const piece)
+	{
+		disk_io_job j;
+		INITIALIZE_JOB(j)
+		j.storage = st;
+		j.piece = piece_index_t(piece);
+		cached_piece_entry* p = bc.allocate_piece(&j, cached_piece_entry::read_lru1);
+		iovec_t iov[2];
+		TEST_EQUAL(bc.allocate_iovec(iov), 0);
+		bc.insert_blocks(p, 0, iov, &j);
+	};
+
+	// the small torrent's piece is the least recently used one, it would be
+	// the first to go without the share limit
+	insert(small, 0);
+	for (int i = 0; i < 3; ++i) insert(big, i);
+	TEST_EQUAL(small->num_cached_blocks(), 2);
+	TEST_EQUAL(big->num_cached_blocks(), 6);
+
+	// the big torrent holds more than 25% of the 8 block cache, its blocks
+	// are evicted first
+	TEST_EQUAL(bc.try_evict_blocks(3), 0);
+	TEST_EQUAL(small->num_cached_blocks(), 2);
+	TEST_EQUAL(big->num_cached_blocks(), 3);
+
+	// once it's down to its share, only evicting more than it holds above
+	// its share touches other torrents
+	TEST_EQUAL(bc.try_evict_blocks(3), 0);
+	TEST_EQUAL(big->num_cached_blocks(), 2);
+	TEST_EQUAL(small->num_cached_blocks(), 0);
+
+	tailqueue<disk_io_job> jobs;
+	bc.clear(jobs);
+	TEST_EQUAL(big->num_cached_blocks(), 0);
+}
+
 TORRENT_TEST(delete_piece)
 {
 	TEST_SETUP;
@@ -513,3 +650,64 @@ TORRENT_TEST(delete_piece)
 
 	TEST_CHECK(bc.num_pieces() == 0);
 }
+
+TORRENT_TEST(shared_buffer_pool)
+{
+	io_service ios;
+	aux::session_settings sett;
+	disk_buffer_pool pool(ios, std::bind(&nop));
+	pool.set_settings(sett);
+
+	// two shards of the same cache, allocating from the same pool
+	block_cache bc1(pool, 2);
+	block_cache bc2(pool, 2);
+	bc1.set_settings(sett);
+	bc2.set_settings(sett);
+
+	file_storage fs;
+	fs.add_file("a/test0", 0x8000);
+	fs.add_file("a/test1", 0x8000);
+	fs.set_piece_length(0x8000);
+	fs.set_num_pieces(2);
+	std::shared_ptr<storage_interface> pm
+		= std::make_shared<test_storage_impl>(fs);
+	pm->m_settings = &sett;
+	allocator alloc(bc1, pm.get());
+
+	disk_io_job wj[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		INITIALIZE_JOB(wj[i])
+		wj[i].storage = pm;
+		wj[i].flags = disk_io_job::in_progress;
+		wj[i].action = job_action_t::write;
+		wj[i].piece = piece_index_t(i);
+		wj[i].d.io.offset = 0;
+		wj[i].d.io.buffer_size = 0x4000;
+	}
+
+	wj[0].argument = disk_buffer_holder(alloc, bc1.allocate_buffer("write-test"), 0x4000);
+	TEST_CHECK(bc1.add_dirty_block(&wj[0]) != nullptr);
+
+	wj[1].argument = disk_buffer_holder(alloc, bc2.allocate_buffer("write-test"), 0x4000);
+	TEST_CHECK(bc2.add_dirty_block(&wj[1]) != nullptr);
+
+	// each shard only has its own piece, but they account for the blocks
+	// in the same pool
+	TEST_EQUAL(bc1.num_pieces(), 1);
+	TEST_EQUAL(bc2.num_pieces(), 1);
+	TEST_CHECK(bc1.find_piece(pm.get(), piece_index_t(1)) == nullptr);
+	TEST_CHECK(bc2.find_piece(pm.get(), piece_index_t(0)) == nullptr);
+	TEST_EQUAL(bc1.write_cache_size(), 1);
+	TEST_EQUAL(bc2.write_cache_size(), 1);
+	TEST_EQUAL(pool.in_use(), 2);
+	TEST_EQUAL(bc1.in_use(), 2);
+
+	// the storage tracks the pieces of both shards
+	TEST_EQUAL(pm->num_pieces(), 2);
+
+	tailqueue<disk_io_job> jobs;
+	bc1.clear(jobs);
+	bc2.clear(jobs);
+	TEST_EQUAL(pool.in_use(), 0);
+}
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/buffer.hpp"
 #include "libtorrent/chained_buffer.hpp"
+#include "libtorrent/file.hpp"
 #include "libtorrent/socket.hpp"
 
 #include "test.hpp"
@@ -307,3 +308,55 @@ TORRENT_TEST(chained_buffer)
 	}
 	TEST_CHECK(buffer_list.empty());
 }
+
+TORRENT_TEST(chained_buffer_file)
+{
+	char data_test[] = "foobar";
+	{
+		chained_buffer b;
+		auto f = std::make_shared<file>();
+
+		char* b1 = allocate_buffer(512);
+		std::memcpy(b1, data_test, 6);
+		b.append_buffer(holder(b1, 512), 3);
+		b.append_file(f, 100, 50);
+		TEST_EQUAL(b.size(), 53);
+
+		// nothing can be appended to the file entry
+		TEST_EQUAL(b.space_in_last_buffer(), 0);
+		TEST_EQUAL(b.allocate_appendix(1), static_cast<char*>(nullptr));
+
+		char* b2 = allocate_buffer(512);
+		std::memcpy(b2, data_test + 3, 3);
+		b.append_buffer(holder(b2, 512), 3);
+		TEST_EQUAL(b.size(), 56);
+
+		// the iovecs stop at the file
+		std::vector<boost::asio::const_buffer> const& vec = b.build_iovec(56);
+		TEST_EQUAL(vec.size(), 1);
+		TEST_EQUAL(boost::asio::buffer_size(vec[0]), 3);
+
+		std::int64_t offset = 0;
+		int size = 0;
+		TEST_CHECK(b.front_file(offset, size) == nullptr);
+
+		b.pop_front(3);
+		TEST_CHECK(b.front_file(offset, size) == f.get());
+		TEST_EQUAL(offset, 100);
+		TEST_EQUAL(size, 50);
+		TEST_CHECK(b.build_iovec(53).empty());
+
+		b.pop_front(20);
+		TEST_CHECK(b.front_file(offset, size) == f.get());
+		TEST_EQUAL(offset, 120);
+		TEST_EQUAL(size, 30);
+		TEST_EQUAL(b.size(), 33);
+
+		b.pop_front(30);
+		TEST_CHECK(b.front_file(offset, size) == nullptr);
+		TEST_EQUAL(b.size(), 3);
+		TEST_CHECK(compare_chained_buffer(b, "bar", 3));
+		TEST_EQUAL(f.use_count(), 1);
+	}
+	TEST_CHECK(buffer_list.empty());
+}
@@ -38,8 +38,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/announce_entry.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_path_to_posix
 #include "libtorrent/announce_entry.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/path.hpp" // for combine_path, create_directories
 
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
 
 
 // make sure creating a torrent from an existing handle preserves the
@@ -119,3 +124,121 @@ TORRENT_TEST(create_torrent_round_trip)
 	TEST_CHECK(info1.info_hash() == info2.info_hash());
 }
 
+
+namespace {
+
+void write_test_file(std::string const& path, int const size, int const seed)
+{
+	std::vector<char> buf(static_cast<std::size_t>(size));
+	for (int i = 0; i < size; ++i) buf[std::size_t(i)] = char(i * 7 + seed);
+	std::ofstream f(path, std::ios_base::binary);
+	f.write(buf.data(), size);
+}
+
+// the torrent's payload, concatenating the files with pad files filled with
+// zeroes
+std::vector<char> torrent_payload(lt::file_storage const& fs)
+{
+	std::vector<char> ret;
+	for (auto const i : fs.file_range())
+	{
+		if (fs.pad_file_at(i))
+		{
+			ret.resize(ret.size() + std::size_t(fs.file_size(i)), '\0');
+			continue;
+		}
+		std::ifstream f(fs.file_path(i, "."), std::ios_base::binary);
+		std::vector<char> const buf((std::istreambuf_iterator<char>(f))
+			, std::istreambuf_iterator<char>());
+		TEST_EQUAL(std::int64_t(buf.size()), fs.file_size(i));
+		ret.insert(ret.end(), buf.begin(), buf.end());
+	}
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(set_piece_hashes_threads)
+{
+	std::string const dir = "test_piece_hashes";
+	lt::error_code ec;
+	lt::create_directories(dir, ec);
+
+	lt::file_storage fs;
+	int const sizes[] = {0x40000 + 100, 5, 0x12345, 0, 0x30000, 0x3fff};
+	for (int i = 0; i < int(sizeof(sizes) / sizeof(sizes[0])); ++i)
+	{
+		std::string const name = lt::combine_path(dir, "file" + std::to_string(i));
+		write_test_file(name, sizes[i], i);
+		fs.add_file(name, sizes[i]);
+	}
+
+	for (int const threads : {1, 2, 7})
+	{
+		// pad every file, to exercise pieces that span files and pad files
+		lt::create_torrent t(fs, 0x4000, 0, lt::create_torrent::optimize_alignment);
+		int calls = 0;
+		lt::set_piece_hashes(t, ".", [&](lt::piece_index_t const p) {
+				TEST_EQUAL(static_cast<int>(p), calls);
+				++calls;
+			}, threads, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(calls, t.num_pieces());
+
+		std::vector<char> buf;
+		lt::bencode(std::back_inserter(buf), t.generate());
+		lt::torrent_info const ti(buf, lt::from_span);
+
+		std::vector<char> const payload = torrent_payload(ti.files());
+		TEST_EQUAL(std::int64_t(payload.size()), ti.total_size());
+		for (auto const p : ti.piece_range())
+		{
+			lt::sha1_hash const h = lt::hasher(payload.data()
+				+ std::int64_t(static_cast<int>(p)) * ti.piece_length()
+				, ti.piece_size(p)).final();
+			TEST_CHECK(ti.hash_for_piece(p) == h);
+		}
+	}
+
+	// a file that's shorter than the torrent says fails
+	lt::file_storage fs2;
+	fs2.add_file(lt::combine_path(dir, "file1"), 100);
+	lt::create_torrent t(fs2, 0x4000);
+	lt::set_piece_hashes(t, ".", [](lt::piece_index_t) {}, 2, ec);
+	TEST_CHECK(ec == lt::errors::file_too_short);
+
+	// as does a file that doesn't exist
+	lt::file_storage fs3;
+	fs3.add_file(lt::combine_path(dir, "missing"), 100);
+	lt::create_torrent t3(fs3, 0x4000);
+	ec.clear();
+	lt::set_piece_hashes(t3, ".", [](lt::piece_index_t) {}, 2, ec);
+	TEST_CHECK(ec);
+}
+
+TORRENT_TEST(set_piece_hashes_callback_throws)
+{
+	std::string const dir = "test_piece_hashes_throw";
+	lt::error_code ec;
+	lt::create_directories(dir, ec);
+
+	lt::file_storage fs;
+	std::string const name = lt::combine_path(dir, "file");
+	write_test_file(name, 0x40000, 1);
+	fs.add_file(name, 0x40000);
+
+	// the exception propagates to the caller, with the hashing threads
+	// stopped and joined
+	lt::create_torrent t(fs, 0x4000);
+	int calls = 0;
+	try
+	{
+		lt::set_piece_hashes(t, ".", [&](lt::piece_index_t const p) {
+				++calls;
+				if (p == lt::piece_index_t(2)) throw std::runtime_error("abort");
+			}, 4, ec);
+		TEST_ERROR("set_piece_hashes() did not throw");
+	}
+	catch (std::runtime_error const&) {}
+	TEST_EQUAL(calls, 3);
+}
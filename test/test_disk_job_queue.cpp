@@ -0,0 +1,158 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "test.hpp"
+
+using namespace lt;
+using lt::aux::disk_job_queue;
+
+namespace {
+
+void set_job(disk_io_job& j, job_action_t const a, disk_job_flags_t const f = {})
+{
+	j.action = a;
+	j.flags = f;
+}
+
+}
+
+TORRENT_TEST(job_class)
+{
+	disk_io_job j;
+	set_job(j, job_action_t::read, disk_interface::time_critical);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::time_critical);
+	set_job(j, job_action_t::read);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::read);
+	set_job(j, job_action_t::flush_hashed);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::write);
+	set_job(j, job_action_t::check_fastresume);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::hash);
+	set_job(j, job_action_t::release_files);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::maintenance);
+	set_job(j, job_action_t::read, disk_interface::prefetch);
+	TEST_CHECK(aux::job_class(&j) == aux::disk_job_class::idle);
+}
+
+TORRENT_TEST(priority_order)
+{
+	disk_io_job jobs[6];
+	set_job(jobs[0], job_action_t::trim_cache);
+	set_job(jobs[1], job_action_t::hash);
+	set_job(jobs[2], job_action_t::write);
+	set_job(jobs[3], job_action_t::read);
+	set_job(jobs[4], job_action_t::read, disk_interface::time_critical);
+	set_job(jobs[5], job_action_t::read);
+
+	disk_job_queue q;
+	for (auto& j : jobs) q.push_back(&j);
+	TEST_EQUAL(q.size(), 6);
+
+	// jobs queued at the same time are picked by class. Within a class,
+	// in the order they were queued
+	TEST_CHECK(q.pop_front() == &jobs[4]);
+	TEST_CHECK(q.pop_front() == &jobs[3]);
+	TEST_CHECK(q.pop_front() == &jobs[5]);
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(no_starvation)
+{
+	disk_io_job jobs[3];
+	set_job(jobs[0], job_action_t::flush_piece);
+	set_job(jobs[1], job_action_t::read);
+	set_job(jobs[2], job_action_t::read, disk_interface::time_critical);
+
+	disk_job_queue q;
+	for (auto& j : jobs) q.push_back(&j);
+
+	// the write has waited longer than its budget. It goes ahead of the reads
+	// queued just now, even the time-critical one
+	jobs[0].queued_at -= seconds(1);
+
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(idle_jobs)
+{
+	disk_io_job jobs[3];
+	set_job(jobs[0], job_action_t::read, disk_interface::prefetch);
+	set_job(jobs[1], job_action_t::release_files);
+	set_job(jobs[2], job_action_t::read, disk_interface::prefetch);
+
+	disk_job_queue q;
+	for (auto& j : jobs) q.push_back(&j);
+
+	// no matter how long they've waited, idle jobs are only picked when
+	// nothing else is queued
+	jobs[0].queued_at -= seconds(10);
+
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	TEST_CHECK(q.empty());
+}
+
+TORRENT_TEST(push_front)
+{
+	disk_io_job jobs[4];
+	set_job(jobs[0], job_action_t::read, disk_interface::time_critical);
+	set_job(jobs[1], job_action_t::write);
+	set_job(jobs[2], job_action_t::read);
+	set_job(jobs[3], job_action_t::flush_storage);
+
+	disk_job_queue q;
+	q.push_back(&jobs[0]);
+	q.push_back(&jobs[1]);
+	q.push_back(&jobs[2]);
+	q.push_front(&jobs[3]);
+
+	int num_jobs = 0;
+	q.for_each([&](disk_io_job*) { ++num_jobs; });
+	TEST_EQUAL(num_jobs, 4);
+
+	// the flush keeps its class. It goes ahead of the write queued before
+	// it, but not of the reads
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	TEST_CHECK(q.pop_front() == &jobs[3]);
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	TEST_CHECK(q.empty());
+}
@@ -0,0 +1,155 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/disk_trace.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "test.hpp"
+
+#include <cstdio>
+
+using namespace lt;
+using lt::aux::disk_trace_record;
+
+namespace {
+
+disk_trace_record make_record(job_action_t const a, int const piece
+	, int const offset = 0, int const size = 0, std::uint8_t const flags = 0)
+{
+	disk_trace_record r;
+	r.time = 0;
+	r.storage = 0;
+	r.piece = piece;
+	r.offset = offset;
+	r.size = std::uint32_t(size);
+	r.action = static_cast<std::uint8_t>(a);
+	r.flags = flags;
+	return r;
+}
+
+// a storage with 4 pieces of 4 blocks each
+disk_trace_record storage_record()
+{
+	disk_trace_record r;
+	r.time = 0;
+	r.storage = 0;
+	r.piece = 0x10000;
+	r.offset = 4;
+	r.size = 0x10000;
+	r.action = disk_trace_record::storage_record;
+	r.flags = 0;
+	return r;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(round_trip)
+{
+	char const* path = "disk_trace_round_trip";
+	{
+		aux::disk_trace_writer w(path);
+		TEST_CHECK(w.is_open());
+		w.record(storage_record());
+		disk_trace_record r = make_record(job_action_t::read, 3, 0x4001, 0x3fff
+			, disk_trace_record::cache_hit);
+		r.storage = 0xfffffffe;
+		r.time = 0x123456789;
+		w.record(r);
+	}
+
+	aux::disk_trace_reader rd(path);
+	TEST_CHECK(rd.is_open());
+	disk_trace_record r;
+	TEST_CHECK(rd.next(r));
+	TEST_EQUAL(r.action, disk_trace_record::storage_record);
+	TEST_EQUAL(r.piece, 0x10000);
+	TEST_EQUAL(r.offset, 4);
+	TEST_EQUAL(r.size, 0x10000);
+
+	TEST_CHECK(rd.next(r));
+	TEST_EQUAL(r.time, 0x123456789);
+	TEST_EQUAL(r.storage, 0xfffffffe);
+	TEST_EQUAL(r.piece, 3);
+	TEST_EQUAL(r.offset, 0x4001);
+	TEST_EQUAL(r.size, 0x3fff);
+	TEST_EQUAL(r.action, static_cast<std::uint8_t>(job_action_t::read));
+	TEST_EQUAL(r.flags, disk_trace_record::cache_hit);
+
+	TEST_CHECK(!rd.next(r));
+	std::remove(path);
+}
+
+TORRENT_TEST(invalid_trace)
+{
+	char const* path = "disk_trace_invalid";
+	{
+		FILE* f = std::fopen(path, "wb");
+		std::fputs("not a disk trace", f);
+		std::fclose(f);
+	}
+	aux::disk_trace_reader rd(path);
+	TEST_CHECK(!rd.is_open());
+	disk_trace_record r;
+	TEST_CHECK(!rd.next(r));
+	std::remove(path);
+
+	aux::disk_trace_reader missing("disk_trace_does_not_exist");
+	TEST_CHECK(!missing.is_open());
+}
+
+TORRENT_TEST(many_records)
+{
+	// enough records for the writer to hand several buffers to its thread
+	int const num_records = 10000;
+	char const* path = "disk_trace_many_records";
+	{
+		aux::disk_trace_writer w(path);
+		TEST_CHECK(w.is_open());
+		w.record(storage_record());
+		for (int i = 0; i < num_records; ++i)
+			w.record(make_record(job_action_t::read, i, 0, 0x4000));
+	}
+
+	aux::disk_trace_reader rd(path);
+	TEST_CHECK(rd.is_open());
+	disk_trace_record r;
+	TEST_CHECK(rd.next(r));
+	TEST_EQUAL(r.action, disk_trace_record::storage_record);
+	int num_read = 0;
+	while (rd.next(r))
+	{
+		TEST_EQUAL(r.piece, num_read);
+		++num_read;
+	}
+	TEST_EQUAL(num_read, num_records);
+	std::remove(path);
+}
@@ -34,7 +34,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef TORRENT_DISABLE_DHT
 
+#include <cstring>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "libtorrent/kademlia/ed25519.hpp"
 #include "libtorrent/hex.hpp"
@@ -280,6 +283,135 @@ TORRENT_TEST(key_exchange)
 	TEST_EQUAL(aux::to_hex(secretA), aux::to_hex(secretB));
 }
 
+namespace
+{
+	struct signed_messages
+	{
+		explicit signed_messages(int const num)
+		{
+			for (int i = 0; i < num; ++i)
+			{
+				public_key pk;
+				secret_key sk;
+				std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+				std::string msg = "message number " + std::to_string(i);
+				msg.resize(std::size_t(50 + i % 300), 'x');
+				pks.push_back(pk);
+				sigs.push_back(ed25519_sign(msg, pk, sk));
+				msgs.push_back(std::move(msg));
+			}
+			for (auto const& m : msgs) spans.emplace_back(m);
+		}
+
+		std::vector<public_key> pks;
+		std::vector<signature> sigs;
+		std::vector<std::string> msgs;
+		std::vector<span<char const>> spans;
+	};
+}
+
+TORRENT_TEST(verify_batch)
+{
+	signed_messages m(100);
+	std::vector<bool> valid;
+
+	TEST_CHECK(ed25519_verify_batch({}, {}, {}, valid));
+	TEST_CHECK(valid.empty());
+
+	TEST_CHECK(ed25519_verify_batch(m.sigs, m.spans, m.pks, valid));
+	TEST_CHECK(valid == std::vector<bool>(m.sigs.size(), true));
+
+	// a single signature
+	TEST_CHECK(ed25519_verify_batch(span<signature const>(m.sigs).first(1)
+		, span<span<char const> const>(m.spans).first(1)
+		, span<public_key const>(m.pks).first(1), valid));
+	TEST_CHECK(valid == std::vector<bool>(1, true));
+
+	// invalidate a few items in different ways. The batch fails and every
+	// signature is checked on its own
+	m.msgs[3][0] ^= 1;
+	m.sigs[40].bytes[5] ^= 1;
+	m.sigs[41].bytes[40] ^= 1;
+	std::swap(m.pks[70], m.pks[71]);
+	TEST_CHECK(!ed25519_verify_batch(m.sigs, m.spans, m.pks, valid));
+	TEST_EQUAL(int(valid.size()), 100);
+	for (int i = 0; i < 100; ++i)
+	{
+		bool const expected = i != 3 && i != 40 && i != 41 && i != 70 && i != 71;
+		TEST_EQUAL(valid[std::size_t(i)], expected);
+		TEST_EQUAL(ed25519_verify(m.sigs[std::size_t(i)], m.spans[std::size_t(i)]
+			, m.pks[std::size_t(i)]), expected);
+	}
+}
+
+namespace
+{
+	// returns pk + T, where T = (0, -1) is the point of order 2. The sum of
+	// (x, y) and T is (-x, -y)
+	public_key add_order_2_point(public_key const& pk)
+	{
+		// p = 2^255 - 19, little endian
+		unsigned char p[32];
+		std::memset(p, 0xff, sizeof(p));
+		p[0] = 0xed;
+		p[31] = 0x7f;
+
+		public_key ret;
+		auto const* y = reinterpret_cast<unsigned char const*>(pk.bytes.data());
+		int borrow = 0;
+		for (int i = 0; i < 32; ++i)
+		{
+			int const yi = i == 31 ? (y[i] & 0x7f) : y[i];
+			int d = p[i] - yi - borrow;
+			borrow = d < 0;
+			if (borrow) d += 256;
+			ret.bytes[std::size_t(i)] = char(d);
+		}
+		// negate x
+		ret.bytes[31] = char(ret.bytes[31] ^ (y[31] & 0x80) ^ 0x80);
+		return ret;
+	}
+}
+
+TORRENT_TEST(verify_batch_small_order)
+{
+	// two signatures under keys with a component of order 2. Each of them
+	// fails on its own when h is odd, but in the batch equation the order 2
+	// components cancel out when z_i * h_i is odd for both
+	std::vector<public_key> pks;
+	std::vector<signature> sigs;
+	std::vector<std::string> msgs;
+	for (int i = 0; int(sigs.size()) < 2; ++i)
+	{
+		public_key pk;
+		secret_key sk;
+		std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+		public_key const bad_pk = add_order_2_point(pk);
+		std::string const msg = "small order " + std::to_string(i);
+		signature const sig = ed25519_sign(msg, bad_pk, sk);
+		// the signature verifies when h is even, try another message
+		if (ed25519_verify(sig, msg, bad_pk)) continue;
+		pks.push_back(bad_pk);
+		sigs.push_back(sig);
+		msgs.push_back(msg);
+	}
+	std::vector<span<char const>> spans(msgs.begin(), msgs.end());
+
+	std::vector<bool> valid;
+	TEST_CHECK(!ed25519_verify_batch(sigs, spans, pks, valid));
+	TEST_CHECK(valid == std::vector<bool>(2, false));
+
+	// along with valid signatures
+	signed_messages m(10);
+	m.pks.insert(m.pks.begin() + 3, pks.begin(), pks.end());
+	m.sigs.insert(m.sigs.begin() + 3, sigs.begin(), sigs.end());
+	m.spans.insert(m.spans.begin() + 3, spans.begin(), spans.end());
+	TEST_CHECK(!ed25519_verify_batch(m.sigs, m.spans, m.pks, valid));
+	TEST_EQUAL(int(valid.size()), 12);
+	for (int i = 0; i < 12; ++i)
+		TEST_EQUAL(valid[std::size_t(i)], i != 3 && i != 4);
+}
+
 #else
 TORRENT_TEST(empty)
 {
@@ -241,3 +241,283 @@ TORRENT_TEST(double_fence)
 	fence.job_complete(&test_job[9], jobs);
 }
 
+
+namespace {
+
+void piece_job(disk_io_job& j, int const piece
+	, job_action_t const action = job_action_t::read)
+{
+	j.action = action;
+	j.piece = piece_index_t(piece);
+}
+
+}
+
+TORRENT_TEST(piece_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+
+	// one outstanding job on piece 0 and one on piece 1
+	piece_job(test_job[0], 0);
+	piece_job(test_job[1], 1);
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+	TEST_CHECK(fence.is_blocked(&test_job[1]) == false);
+
+	// raise a fence on piece 1. It has to wait for the outstanding job on
+	// that piece, so the flush job needs to be posted
+	piece_job(test_job[2], 1, job_action_t::clear_piece);
+	test_job[3].action = job_action_t::flush_storage;
+	int const ret = fence.raise_piece_fence(&test_job[2], &test_job[3], cnt
+		, piece_index_t(1), piece_index_t(2));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_flush);
+
+	// a piece fence isn't a storage-wide fence
+	TEST_CHECK(!fence.has_fence());
+
+	// jobs on other pieces are not held back
+	piece_job(test_job[4], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[4]) == false);
+
+	// but jobs on piece 1 are
+	piece_job(test_job[5], 1, job_action_t::write);
+	TEST_CHECK(fence.is_blocked(&test_job[5]) == true);
+	TEST_EQUAL(fence.num_blocked(), 1);
+
+	tailqueue<disk_io_job> jobs;
+
+	fence.job_complete(&test_job[0], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[1], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+
+	// once the flush job completes, there are no outstanding jobs left on
+	// piece 1 and the fence job can run, even though piece 0 still has one
+	fence.job_complete(&test_job[3], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[2]);
+	jobs.pop_front();
+
+	// complete the fence job, the blocked job can be posted now
+	fence.job_complete(&test_job[2], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[5]);
+	TEST_EQUAL(fence.num_blocked(), 0);
+
+	fence.job_complete(&test_job[4], jobs);
+	fence.job_complete(&test_job[5], jobs);
+}
+
+TORRENT_TEST(empty_piece_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+
+	// an outstanding job on another piece doesn't hold back the fence
+	piece_job(test_job[0], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+
+	piece_job(test_job[1], 1, job_action_t::clear_piece);
+	int const ret = fence.raise_piece_fence(&test_job[1], &test_job[2], cnt
+		, piece_index_t(1), piece_index_t(2));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_fence);
+
+	piece_job(test_job[3], 1);
+	TEST_CHECK(fence.is_blocked(&test_job[3]) == true);
+
+	tailqueue<disk_io_job> jobs;
+	fence.job_complete(&test_job[1], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[3]);
+
+	fence.job_complete(&test_job[0], jobs);
+	fence.job_complete(&test_job[3], jobs);
+}
+
+TORRENT_TEST(storage_fence_behind_piece_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+
+	piece_job(test_job[0], 1);
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+
+	piece_job(test_job[1], 1, job_action_t::clear_piece);
+	test_job[2].action = job_action_t::flush_storage;
+	int ret = fence.raise_piece_fence(&test_job[1], &test_job[2], cnt
+		, piece_index_t(1), piece_index_t(2));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_flush);
+
+	piece_job(test_job[3], 1);
+	TEST_CHECK(fence.is_blocked(&test_job[3]) == true);
+
+	// the storage-wide fence has to wait for the piece fence, as well as
+	// the job it's holding back
+	test_job[4].action = job_action_t::release_files;
+	test_job[5].action = job_action_t::flush_storage;
+	ret = fence.raise_fence(&test_job[4], &test_job[5], cnt);
+	TEST_EQUAL(ret, disk_job_fence::fence_post_flush);
+	TEST_CHECK(fence.has_fence());
+
+	// now every job is held back, regardless of its piece
+	piece_job(test_job[6], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[6]) == true);
+	TEST_EQUAL(fence.num_blocked(), 3);
+
+	tailqueue<disk_io_job> jobs;
+
+	fence.job_complete(&test_job[0], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[2], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[1]);
+	jobs.pop_front();
+
+	// the piece fence completes, the job it held back was issued before the
+	// storage fence was raised, so it runs first
+	fence.job_complete(&test_job[1], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[3]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[3], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[5], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[4]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[4], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[6]);
+	TEST_CHECK(!fence.has_fence());
+
+	fence.job_complete(&test_job[6], jobs);
+}
+
+TORRENT_TEST(piece_fence_behind_storage_fence)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+
+	piece_job(test_job[0], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+
+	test_job[1].action = job_action_t::release_files;
+	test_job[2].action = job_action_t::flush_storage;
+	int ret = fence.raise_fence(&test_job[1], &test_job[2], cnt);
+	TEST_EQUAL(ret, disk_job_fence::fence_post_flush);
+
+	// the piece fence is queued up behind the storage fence
+	piece_job(test_job[3], 0, job_action_t::clear_piece);
+	test_job[4].action = job_action_t::flush_storage;
+	ret = fence.raise_piece_fence(&test_job[3], &test_job[4], cnt
+		, piece_index_t(0), piece_index_t(1));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_none);
+
+	piece_job(test_job[5], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[5]) == true);
+	piece_job(test_job[6], 2);
+	TEST_CHECK(fence.is_blocked(&test_job[6]) == true);
+
+	tailqueue<disk_io_job> jobs;
+
+	fence.job_complete(&test_job[0], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[2], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[1]);
+	jobs.pop_front();
+
+	// when the storage fence is lowered, the piece fence is raised. Its
+	// flush job is posted, and so is the job on piece 2. The job on piece 0
+	// is held back by the piece fence
+	fence.job_complete(&test_job[1], jobs);
+	TEST_EQUAL(jobs.size(), 2);
+	TEST_CHECK(jobs.first() == &test_job[4]);
+	jobs.pop_front();
+	TEST_CHECK(jobs.first() == &test_job[6]);
+	jobs.pop_front();
+	TEST_EQUAL(fence.num_blocked(), 1);
+
+	fence.job_complete(&test_job[6], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[4], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[3]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[3], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[5]);
+
+	fence.job_complete(&test_job[5], jobs);
+}
+
+TORRENT_TEST(overlapping_piece_fences)
+{
+	counters cnt;
+	disk_job_fence fence;
+
+	disk_io_job test_job[10];
+
+	piece_job(test_job[0], 0);
+	TEST_CHECK(fence.is_blocked(&test_job[0]) == false);
+
+	// a fence on pieces 0 and 1
+	piece_job(test_job[1], 0, job_action_t::clear_piece);
+	test_job[2].action = job_action_t::flush_storage;
+	int ret = fence.raise_piece_fence(&test_job[1], &test_job[2], cnt
+		, piece_index_t(0), piece_index_t(2));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_flush);
+
+	// a fence on piece 1, which has to wait for the first one
+	piece_job(test_job[3], 1, job_action_t::clear_piece);
+	test_job[4].action = job_action_t::flush_storage;
+	ret = fence.raise_piece_fence(&test_job[3], &test_job[4], cnt
+		, piece_index_t(1), piece_index_t(2));
+	TEST_EQUAL(ret, disk_job_fence::fence_post_none);
+
+	piece_job(test_job[5], 1);
+	TEST_CHECK(fence.is_blocked(&test_job[5]) == true);
+
+	// piece 2 isn't covered by either
+	piece_job(test_job[6], 2);
+	TEST_CHECK(fence.is_blocked(&test_job[6]) == false);
+
+	tailqueue<disk_io_job> jobs;
+
+	fence.job_complete(&test_job[0], jobs);
+	TEST_EQUAL(jobs.size(), 0);
+	fence.job_complete(&test_job[2], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[1]);
+	jobs.pop_front();
+
+	// lowering the first fence raises the second one. The job on piece 1 is
+	// still held back
+	fence.job_complete(&test_job[1], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[4]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[4], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[3]);
+	jobs.pop_front();
+
+	fence.job_complete(&test_job[3], jobs);
+	TEST_EQUAL(jobs.size(), 1);
+	TEST_CHECK(jobs.first() == &test_job[5]);
+
+	fence.job_complete(&test_job[5], jobs);
+	fence.job_complete(&test_job[6], jobs);
+}
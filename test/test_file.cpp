@@ -35,10 +35,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/numeric_cast.hpp"
 #include "libtorrent/string_util.hpp" // for split_string
 #include "libtorrent/string_view.hpp"
+#include "libtorrent/allocator.hpp" // for page_malloc
 #include "test.hpp"
 #include <vector>
 #include <set>
 #include <thread>
+#include <algorithm>
+#include <cstring>
 
 using namespace lt;
 
@@ -406,6 +409,45 @@ TORRENT_TEST(hard_link)
 		std::printf("remove failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
 }
 
+TORRENT_TEST(copy_file_progress)
+{
+	std::vector<char> content(3 * 1024 * 1024 + 17);
+	for (std::size_t i = 0; i < content.size(); ++i)
+		content[i] = char(i * 7);
+
+	error_code ec;
+	{
+		file f;
+		TEST_CHECK(f.open("copy_source", open_mode::read_write, ec));
+		TEST_EQUAL(f.writev(0, {content}, ec), int(content.size()));
+		TEST_EQUAL(ec, error_code());
+
+		// the destination is larger than the source. It's replaced, not just
+		// overwritten
+		TEST_CHECK(f.open("copy_target", open_mode::read_write, ec));
+		std::vector<char> junk(content.size() * 2, 'x');
+		TEST_EQUAL(f.writev(0, {junk}, ec), int(junk.size()));
+		TEST_EQUAL(ec, error_code());
+	}
+
+	std::int64_t copied = 0;
+	lt::copy_file("copy_source", "copy_target", ec
+		, [&](std::int64_t const n) { copied += n; });
+	TEST_EQUAL(ec, error_code());
+	TEST_EQUAL(copied, std::int64_t(content.size()));
+	TEST_EQUAL(file_size("copy_target"), std::int64_t(content.size()));
+
+	file f;
+	TEST_CHECK(f.open("copy_target", open_mode::read_only, ec));
+	std::vector<char> result(content.size());
+	TEST_EQUAL(f.readv(0, {result}, ec), int(result.size()));
+	TEST_CHECK(result == content);
+	f.close();
+
+	remove("copy_source", ec);
+	remove("copy_target", ec);
+}
+
 TORRENT_TEST(coalesce_buffer)
 {
 	error_code ec;
@@ -438,6 +480,89 @@ TORRENT_TEST(coalesce_buffer)
 	f.close();
 }
 
+// use_io_uring is ignored on platforms without io_uring, and falls back to
+// pwritev()/preadv() on kernels that don't support it. Either way the result
+// has to be the same. Use more buffers than fit in a single system call to
+// make sure the operation is split (and reassembled) correctly
+TORRENT_TEST(io_uring_buffers)
+{
+	error_code ec;
+	file f;
+	TEST_CHECK(f.open("test_file", open_mode::read_write | open_mode::no_cache, ec));
+	TEST_EQUAL(ec, error_code());
+	if (ec) std::printf("open failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+
+	int const num_bufs = 3000;
+	std::vector<char> buf(num_bufs * 4);
+	for (int i = 0; i < int(buf.size()); ++i) buf[std::size_t(i)] = char(i & 0xff);
+	std::vector<iovec_t> vec;
+	for (int i = 0; i < num_bufs; ++i) vec.emplace_back(&buf[std::size_t(i) * 4], 4);
+
+	TEST_EQUAL(f.writev(0, vec, ec, open_mode::use_io_uring), num_bufs * 4);
+	if (ec) std::printf("writev failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+	TEST_EQUAL(ec, error_code());
+
+	std::vector<char> read_buf(buf.size());
+	for (int i = 0; i < num_bufs; ++i) vec[std::size_t(i)] = { &read_buf[std::size_t(i) * 4], 4 };
+	TEST_EQUAL(f.readv(0, vec, ec, open_mode::use_io_uring), num_bufs * 4);
+	if (ec) std::printf("readv failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(read_buf == buf);
+
+	// a short read at the end of the file
+	iovec_t tail = { read_buf.data(), read_buf.size() };
+	TEST_EQUAL(f.readv(std::int64_t(buf.size()) - 10, tail, ec, open_mode::use_io_uring), 10);
+	TEST_EQUAL(ec, error_code());
+	f.close();
+}
+
+TORRENT_TEST(direct_io_unaligned)
+{
+	error_code ec;
+	remove("test_file", ec);
+	ec.clear();
+	file f;
+	TEST_CHECK(f.open("test_file", open_mode::read_write | open_mode::direct_io, ec));
+	TEST_EQUAL(ec, error_code());
+	if (ec) std::printf("open failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+
+	// an aligned block, as handed out by the disk buffer pool
+	char* block = page_malloc(0x4000);
+	std::memset(block, 'a', 0x4000);
+	iovec_t b = { block, 0x4000 };
+	TEST_EQUAL(f.writev(0, b, ec), 0x4000);
+	TEST_EQUAL(ec, error_code());
+
+	// an unaligned write straddling two blocks must not clobber the bytes
+	// around it
+	char data[100];
+	std::memset(data, 'b', sizeof(data));
+	b = { data, sizeof(data) };
+	TEST_EQUAL(f.writev(4050, b, ec), 100);
+	TEST_EQUAL(ec, error_code());
+
+	// an unaligned write at the end of the file must not pad it
+	TEST_EQUAL(f.writev(0x4000, b, ec), 100);
+	TEST_EQUAL(ec, error_code());
+	TEST_EQUAL(f.get_size(ec), 0x4000 + 100);
+
+	char read_buf[300];
+	b = { read_buf, sizeof(read_buf) };
+	TEST_EQUAL(f.readv(4000, b, ec), 300);
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(std::all_of(read_buf, read_buf + 50, [](char c) { return c == 'a'; }));
+	TEST_CHECK(std::all_of(read_buf + 50, read_buf + 150, [](char c) { return c == 'b'; }));
+	TEST_CHECK(std::all_of(read_buf + 150, read_buf + 300, [](char c) { return c == 'a'; }));
+
+	// a short read at the end of the file
+	TEST_EQUAL(f.readv(0x4000 - 10, b, ec), 110);
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(std::all_of(read_buf + 10, read_buf + 110, [](char c) { return c == 'b'; }));
+
+	page_free(block);
+	f.close();
+}
+
 TORRENT_TEST(stat_file)
 {
 	file_status st;
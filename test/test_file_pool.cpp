@@ -0,0 +1,208 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/file_pool.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/disk_interface.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "test.hpp"
+
+using namespace lt;
+
+namespace {
+
+file_storage make_files()
+{
+	file_storage fs;
+	for (int i = 0; i < 4; ++i)
+		fs.add_file("file_pool_test/" + std::to_string(i), 1024);
+	return fs;
+}
+
+std::string setup_dir()
+{
+	error_code ec;
+	remove_all("file_pool_test", ec);
+	create_directory("file_pool_test", ec);
+	TEST_CHECK(!ec);
+	return current_working_directory();
+}
+
+bool is_open(file_pool const& fp, storage_index_t const st, file_index_t const f)
+{
+	for (auto const& s : fp.get_status(st))
+		if (s.file_index == f) return true;
+	return false;
+}
+
+}
+
+TORRENT_TEST(lru_eviction)
+{
+	std::string const save_path = setup_dir();
+	file_storage const fs = make_files();
+	file_pool fp(4);
+	error_code ec;
+
+	storage_index_t const st{0};
+	for (file_index_t f{0}; f < file_index_t{3}; ++f)
+	{
+		TEST_CHECK(fp.open_file(st, save_path, f, fs, open_mode::read_write, ec));
+		TEST_CHECK(!ec);
+	}
+
+	// touch file 0, which makes file 1 the least recently used
+	TEST_CHECK(fp.open_file(st, save_path, file_index_t{0}, fs, open_mode::read_write, ec));
+
+	// the pool is full when it holds as many files as its size, opening a
+	// new file closes the least recently used one
+	TEST_CHECK(fp.open_file(st, save_path, file_index_t{3}, fs, open_mode::read_write, ec));
+	TEST_CHECK(is_open(fp, st, file_index_t{0}));
+	TEST_CHECK(!is_open(fp, st, file_index_t{1}));
+	TEST_CHECK(is_open(fp, st, file_index_t{2}));
+	TEST_CHECK(is_open(fp, st, file_index_t{3}));
+
+	fp.resize(2);
+	TEST_EQUAL(int(fp.get_status(st).size()), 2);
+	TEST_CHECK(is_open(fp, st, file_index_t{0}));
+	TEST_CHECK(is_open(fp, st, file_index_t{3}));
+}
+
+TORRENT_TEST(close_oldest)
+{
+	std::string const save_path = setup_dir();
+	file_storage const fs = make_files();
+	file_pool fp(10);
+	error_code ec;
+
+	storage_index_t const st{0};
+	for (file_index_t f{0}; f < file_index_t{3}; ++f)
+		TEST_CHECK(fp.open_file(st, save_path, f, fs, open_mode::read_write, ec));
+
+	// using a file doesn't change when it was opened
+	TEST_CHECK(fp.open_file(st, save_path, file_index_t{0}, fs, open_mode::read_write, ec));
+
+	fp.close_oldest();
+	TEST_CHECK(!is_open(fp, st, file_index_t{0}));
+	TEST_CHECK(is_open(fp, st, file_index_t{1}));
+	fp.close_oldest();
+	TEST_CHECK(!is_open(fp, st, file_index_t{1}));
+	TEST_CHECK(is_open(fp, st, file_index_t{2}));
+}
+
+TORRENT_TEST(release_storage)
+{
+	std::string const save_path = setup_dir();
+	file_storage const fs = make_files();
+	file_pool fp(10);
+	error_code ec;
+
+	storage_index_t const st0{0};
+	storage_index_t const st1{1};
+	for (file_index_t f{3}; f >= file_index_t{0}; --f)
+	{
+		TEST_CHECK(fp.open_file(st0, save_path, f, fs, open_mode::read_write, ec));
+		TEST_CHECK(fp.open_file(st1, save_path, f, fs, open_mode::read_only, ec));
+	}
+
+	// the status is ordered by file index
+	auto const status = fp.get_status(st0);
+	TEST_EQUAL(int(status.size()), 4);
+	for (int i = 0; i < int(status.size()); ++i)
+	{
+		TEST_EQUAL(status[std::size_t(i)].file_index, file_index_t{i});
+		TEST_CHECK((status[std::size_t(i)].open_mode & file_open_mode::rw_mask)
+			== file_open_mode::read_write);
+	}
+
+	fp.release(st0, file_index_t{2});
+	TEST_CHECK(!is_open(fp, st0, file_index_t{2}));
+	TEST_CHECK(is_open(fp, st1, file_index_t{2}));
+
+	fp.release(st0);
+	TEST_CHECK(fp.get_status(st0).empty());
+	TEST_EQUAL(int(fp.get_status(st1).size()), 4);
+
+	// a file opened read-only is re-opened when it's needed for writing
+	TEST_CHECK(fp.open_file(st1, save_path, file_index_t{1}, fs, open_mode::read_write, ec));
+	TEST_CHECK(!ec);
+	for (auto const& s : fp.get_status(st1))
+	{
+		TEST_CHECK((s.open_mode & file_open_mode::rw_mask)
+			== (s.file_index == file_index_t{1}
+				? file_open_mode::read_write : file_open_mode::read_only));
+	}
+
+	fp.release();
+	TEST_CHECK(fp.get_status(st1).empty());
+}
+
+TORRENT_TEST(background_close)
+{
+	std::string const save_path = setup_dir();
+	file_storage const fs = make_files();
+	file_pool fp(2);
+	fp.set_close_backlog(4);
+	error_code ec;
+
+	storage_index_t const st{0};
+	std::weak_ptr<file> evicted;
+	{
+		auto const f = fp.open_file(st, save_path, file_index_t{0}, fs, open_mode::read_write, ec);
+		TEST_CHECK(f);
+		evicted = f;
+	}
+
+	// evicting a file hands it to the closer thread, it's no longer in the
+	// pool, but it may not have been closed yet
+	TEST_CHECK(fp.open_file(st, save_path, file_index_t{1}, fs, open_mode::read_write, ec));
+	TEST_CHECK(!is_open(fp, st, file_index_t{0}));
+	TEST_CHECK(fp.num_pending_closes() <= 4);
+
+	// release() doesn't return until the evicted files have been closed too
+	fp.release();
+	TEST_CHECK(evicted.expired());
+	TEST_EQUAL(fp.num_pending_closes(), 0);
+	TEST_CHECK(fp.close_time() >= 0);
+
+	// with no backlog, files are closed by the thread evicting them
+	fp.set_close_backlog(0);
+	{
+		auto const f = fp.open_file(st, save_path, file_index_t{2}, fs, open_mode::read_write, ec);
+		TEST_CHECK(f);
+		evicted = f;
+	}
+	TEST_CHECK(fp.open_file(st, save_path, file_index_t{3}, fs, open_mode::read_write, ec));
+	TEST_CHECK(evicted.expired());
+	TEST_EQUAL(fp.num_pending_closes(), 0);
+}
@@ -32,9 +32,15 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/hex.hpp"
+#include "libtorrent/sha1.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/aux_/sha1_mb.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
 
 #include "test.hpp"
 
+#include <algorithm>
+
 using namespace lt;
 
 namespace
@@ -123,3 +129,153 @@ TORRENT_TEST(hasher_test_vec1)
 		, 16777216
 	);
 }
+
+namespace {
+
+std::vector<char> test_buffer(int const size, int const seed)
+{
+	std::vector<char> ret(static_cast<std::size_t>(size));
+	std::uint32_t x = std::uint32_t(seed) * 2654435761u + 1;
+	for (auto& c : ret)
+	{
+		x = x * 1103515245u + 12345u;
+		c = char(x >> 24);
+	}
+	return ret;
+}
+
+sha1_hash reference_hash(span<char const> buf)
+{
+	hasher h;
+	if (!buf.empty()) h.update(buf);
+	return h.final();
+}
+
+}
+
+TORRENT_TEST(hash_pieces)
+{
+	// cover the message lengths where the padding spills into a second block
+	std::vector<std::vector<char>> buffers;
+	for (int i = 0; i < 300; ++i)
+		buffers.push_back(test_buffer(i == 0 ? 0 : i * 37 % 1000 + i % 3, i));
+
+	std::vector<span<char const>> pieces;
+	for (auto const& b : buffers) pieces.push_back(b);
+	std::vector<sha1_hash> hashes(pieces.size());
+	hash_pieces(pieces, hashes);
+
+	for (std::size_t i = 0; i < pieces.size(); ++i)
+		TEST_CHECK(hashes[i] == reference_hash(pieces[i]));
+
+	// a single piece
+	hash_pieces(span<span<char const> const>(pieces).first(1), hashes);
+	TEST_CHECK(hashes[0] == reference_hash(pieces[0]));
+}
+
+TORRENT_TEST(sha1_mb_kernels)
+{
+	// every kernel width, each message split into buffers that don't line
+	// up with the 64 byte blocks
+	for (int const lanes : {1, 4, 8, 16})
+	{
+		for (int num_msgs = 1; num_msgs < 40; num_msgs += 3)
+		{
+			std::vector<std::vector<char>> buffers;
+			std::vector<std::vector<span<char const>>> bufs(static_cast<std::size_t>(num_msgs));
+			std::vector<aux::sha1_mb_message> msgs;
+			for (int i = 0; i < num_msgs; ++i)
+			{
+				buffers.push_back(test_buffer((i * 131 + lanes) % 1500, i + lanes));
+				span<char const> b = buffers.back();
+				std::size_t const split = std::size_t(i % 5) * 29;
+				while (b.size() > split && split > 0)
+				{
+					bufs[std::size_t(i)].push_back(b.first(split));
+					b = b.subspan(split);
+				}
+				bufs[std::size_t(i)].push_back(b);
+				// empty buffers are skipped
+				bufs[std::size_t(i)].push_back(b.first(0));
+			}
+			for (auto const& b : bufs) msgs.push_back({b});
+
+			std::vector<sha1_hash> hashes(msgs.size());
+			aux::sha1_mb(msgs, hashes, lanes);
+			for (std::size_t i = 0; i < msgs.size(); ++i)
+				TEST_CHECK(hashes[i] == reference_hash(buffers[i]));
+		}
+	}
+}
+
+// compares the throughput of hashing pieces one at a time with hasher
+// against the multi-buffer kernels, on a single core
+TORRENT_TEST(sha1_mb_benchmark)
+{
+	int const piece_size = 256 * 1024;
+	int const num_pieces = 64;
+	std::vector<std::vector<char>> buffers;
+	std::vector<span<char const>> pieces;
+	for (int i = 0; i < num_pieces; ++i)
+		buffers.push_back(test_buffer(piece_size, i));
+	for (auto const& b : buffers) pieces.push_back(b);
+	std::vector<sha1_hash> hashes(pieces.size());
+	std::vector<sha1_hash> reference(pieces.size());
+
+	double const total = double(piece_size) * num_pieces;
+	time_point start = clock_type::now();
+	for (std::size_t i = 0; i < pieces.size(); ++i)
+		reference[i] = hasher(pieces[i]).final();
+	double const scalar_time = double(total_microseconds(clock_type::now() - start));
+	std::printf("hasher: %.3f GB/s\n", total / scalar_time / 1000.);
+
+	std::vector<aux::sha1_mb_message> msgs;
+	for (auto const& p : pieces) msgs.push_back({{&p, 1}});
+	for (int const lanes : {4, 8, 16})
+	{
+		start = clock_type::now();
+		aux::sha1_mb(msgs, hashes, lanes);
+		double const t = double(total_microseconds(clock_type::now() - start));
+		std::printf("sha1_mb (%d lanes, %d supported): %.3f GB/s\n"
+			, lanes, aux::sha1_mb_lanes(), total / t / 1000.);
+		TEST_CHECK(hashes == reference);
+	}
+}
+
+#if !defined TORRENT_USE_LIBGCRYPT && !TORRENT_USE_COMMONCRYPTO \
+	&& !TORRENT_USE_CRYPTOAPI && !defined TORRENT_USE_LIBCRYPTO
+TORRENT_TEST(sha1_hw)
+{
+	std::printf("SHA extensions: %s ARMv8 SHA1: %s\n"
+		, aux::sha_ni_support ? "yes" : "no"
+		, aux::arm_sha1_support ? "yes" : "no");
+
+	// lengths around the block size, fed in chunks that don't line up with
+	// blocks
+	std::vector<char> const buf = test_buffer(5000, 0);
+	auto const* data = reinterpret_cast<std::uint8_t const*>(buf.data());
+	for (std::size_t len = 0; len < buf.size(); len += len < 300 ? 1 : 97)
+	{
+		for (std::size_t const chunk : {std::size_t(1), std::size_t(63), std::size_t(64), std::size_t(1000)})
+		{
+			sha1_ctx sw;
+			sha1_ctx hw;
+			SHA1_init(&sw);
+			SHA1_init(&hw);
+			for (std::size_t i = 0; i < len; i += chunk)
+			{
+				std::size_t const n = std::min(chunk, len - i);
+				SHA1_update_sw(&sw, data + i, n);
+				if (!SHA1_update_hw(&hw, data + i, n))
+					SHA1_update_sw(&hw, data + i, n);
+			}
+			sha1_hash sw_digest;
+			sha1_hash hw_digest;
+			SHA1_final(reinterpret_cast<std::uint8_t*>(sw_digest.data()), &sw);
+			SHA1_final(reinterpret_cast<std::uint8_t*>(hw_digest.data()), &hw);
+			TEST_CHECK(sw_digest == hw_digest);
+			TEST_CHECK(sw_digest == reference_hash({buf.data(), len}));
+		}
+	}
+}
+#endif
@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/read_stream_detector.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "test.hpp"
+
+using namespace lt;
+
+namespace {
+
+int const block = default_block_size;
+
+int read(aux::read_stream_detector& d, std::int64_t const offset, bool& seq)
+{
+	return d.on_read(offset, block, 32, seq);
+}
+
+}
+
+TORRENT_TEST(sequential_stream)
+{
+	aux::read_stream_detector d;
+	bool seq = true;
+
+	// the first request can't be known to be part of a stream
+	TEST_EQUAL(read(d, 0, seq), 1);
+	TEST_CHECK(!seq);
+
+	// the read-ahead grows as the stream continues, up to the limit
+	TEST_EQUAL(read(d, block, seq), 4);
+	TEST_CHECK(seq);
+	TEST_EQUAL(read(d, 2 * block, seq), 8);
+	TEST_EQUAL(read(d, 3 * block, seq), 16);
+	TEST_EQUAL(read(d, 4 * block, seq), 32);
+	TEST_EQUAL(read(d, 5 * block, seq), 32);
+	TEST_CHECK(seq);
+
+	// a request slightly ahead of the stream still continues it
+	TEST_EQUAL(read(d, 8 * block, seq), 32);
+	TEST_CHECK(seq);
+
+	// the limit may change
+	TEST_EQUAL(d.on_read(9 * block, block, 2, seq), 2);
+	TEST_CHECK(seq);
+}
+
+TORRENT_TEST(random_access)
+{
+	aux::read_stream_detector d;
+	bool seq = true;
+
+	std::int64_t const offsets[] = { 100, 3, 57, 12, 80, 31, 200, 150, 44, 70 };
+	for (std::int64_t const o : offsets)
+	{
+		TEST_EQUAL(read(d, o * block, seq), 1);
+		TEST_CHECK(!seq);
+	}
+}
+
+TORRENT_TEST(interleaved_streams)
+{
+	aux::read_stream_detector d;
+	bool seq = true;
+
+	// two peers downloading the same torrent in order, at different
+	// positions, are tracked as separate streams
+	TEST_EQUAL(read(d, 0, seq), 1);
+	TEST_EQUAL(read(d, 1000 * block, seq), 1);
+	for (int i = 1; i < 4; ++i)
+	{
+		TEST_CHECK(read(d, i * block, seq) > 1);
+		TEST_CHECK(seq);
+		TEST_CHECK(read(d, (1000 + i) * block, seq) > 1);
+		TEST_CHECK(seq);
+	}
+}
+
+TORRENT_TEST(stream_eviction)
+{
+	aux::read_stream_detector d;
+	bool seq = true;
+
+	read(d, 0, seq);
+	read(d, block, seq);
+	TEST_CHECK(seq);
+
+	// enough random requests push the stream out
+	for (int i = 0; i < aux::read_stream_detector::max_streams; ++i)
+		read(d, (1000 + i * 100) * block, seq);
+
+	TEST_EQUAL(read(d, 2 * block, seq), 1);
+	TEST_CHECK(!seq);
+}
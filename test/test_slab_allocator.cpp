@@ -0,0 +1,212 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/slab_allocator.hpp"
+#include "test.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace lt;
+
+namespace {
+
+int const block_size = 0x4000;
+int const blocks_per_slab = 8;
+
+}
+
+TORRENT_TEST(allocate_free)
+{
+	aux::slab_allocator a(block_size, blocks_per_slab);
+	TEST_EQUAL(a.num_reserved(), 0);
+
+	std::vector<char*> bufs;
+	for (int i = 0; i < blocks_per_slab * 3; ++i)
+	{
+		char* b = a.allocate();
+		TEST_CHECK(b != nullptr);
+		if (b == nullptr) return;
+		// blocks are page aligned
+		TEST_EQUAL(reinterpret_cast<std::uintptr_t>(b) % 4096, 0);
+		// and writable
+		std::memset(b, i, block_size);
+		TEST_CHECK(a.in_use(b));
+		bufs.push_back(b);
+	}
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab * 3);
+
+	// no block is handed out twice
+	std::vector<char*> sorted = bufs;
+	std::sort(sorted.begin(), sorted.end());
+	TEST_CHECK(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+	// the data of a block isn't disturbed by freeing others
+	a.free(bufs[1]);
+	TEST_CHECK(!a.in_use(bufs[1]));
+	TEST_EQUAL(bufs[2][0], 2);
+	TEST_EQUAL(bufs[0][block_size - 1], 0);
+
+	// a freed block is reused before mapping a new slab
+	char* b = a.allocate();
+	TEST_CHECK(b == bufs[1]);
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab * 3);
+
+	for (char* buf : bufs) a.free(buf);
+
+	// one empty slab is kept around
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab);
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), 0);
+}
+
+TORRENT_TEST(lowest_slab_first)
+{
+	aux::slab_allocator a(block_size, blocks_per_slab);
+
+	std::vector<char*> bufs;
+	for (int i = 0; i < blocks_per_slab * 2; ++i)
+		bufs.push_back(a.allocate());
+	std::sort(bufs.begin(), bufs.end());
+
+	// free one block in each slab. New blocks are taken from the slab at the
+	// lower address
+	a.free(bufs[3]);
+	a.free(bufs[blocks_per_slab + 3]);
+	char* b = a.allocate();
+	TEST_CHECK(b == bufs[3]);
+
+	for (char* buf : bufs)
+		if (buf != bufs[blocks_per_slab + 3]) a.free(buf);
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), 0);
+}
+
+TORRENT_TEST(huge_pages)
+{
+	aux::slab_allocator a(block_size, 128);
+	a.set_huge_pages(true);
+
+	char* b = a.allocate();
+	TEST_CHECK(b != nullptr);
+	if (b == nullptr) return;
+	std::memset(b, 0xff, block_size);
+	TEST_CHECK(a.in_use(b));
+	a.free(b);
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), 0);
+}
+
+TORRENT_TEST(trim)
+{
+	aux::slab_allocator a(block_size, blocks_per_slab);
+
+	std::vector<char*> bufs;
+	for (int i = 0; i < blocks_per_slab * 2; ++i)
+		bufs.push_back(a.allocate());
+
+	// free every other block, which leaves both slabs in use
+	for (std::size_t i = 0; i < bufs.size(); i += 2)
+		a.free(bufs[i]);
+	TEST_EQUAL(a.num_untrimmed(), blocks_per_slab);
+
+	a.trim();
+	TEST_EQUAL(a.num_untrimmed(), 0);
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab * 2);
+
+	// the blocks still in use are intact, and trimmed blocks can be used
+	// again
+	for (std::size_t i = 1; i < bufs.size(); i += 2)
+		TEST_CHECK(a.in_use(bufs[i]));
+	for (std::size_t i = 0; i < bufs.size(); i += 2)
+	{
+		bufs[i] = a.allocate();
+		TEST_CHECK(bufs[i] != nullptr);
+		if (bufs[i] == nullptr) return;
+		std::memset(bufs[i], 1, block_size);
+	}
+	TEST_EQUAL(a.num_untrimmed(), 0);
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab * 2);
+
+	for (char* buf : bufs) a.free(buf);
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), 0);
+	TEST_EQUAL(a.num_untrimmed(), 0);
+}
+
+TORRENT_TEST(trim_ranges)
+{
+	aux::slab_allocator a(block_size, blocks_per_slab);
+
+	std::vector<char*> bufs;
+	for (int i = 0; i < blocks_per_slab; ++i)
+		bufs.push_back(a.allocate());
+	std::sort(bufs.begin(), bufs.end());
+
+	a.free(bufs[5]);
+	a.free(bufs[1]);
+	a.free(bufs[0]);
+	a.free(bufs[2]);
+
+	// adjacent free blocks are merged into a single range
+	std::vector<aux::slab_allocator::trim_range> const ranges = a.begin_trim();
+	TEST_EQUAL(ranges.size(), 2);
+	if (ranges.size() != 2) return;
+	TEST_CHECK(ranges[0].ptr == bufs[0]);
+	TEST_EQUAL(ranges[0].size, 3 * block_size);
+	TEST_CHECK(ranges[1].ptr == bufs[5]);
+	TEST_EQUAL(ranges[1].size, block_size);
+	TEST_EQUAL(a.num_untrimmed(), 0);
+
+	// blocks being trimmed aren't handed out, so their pages can be dropped
+	// without holding up the allocator
+	char* b = a.allocate();
+	TEST_CHECK(std::find(bufs.begin(), bufs.end(), b) == bufs.end());
+	TEST_EQUAL(a.num_reserved(), 2 * blocks_per_slab);
+	a.free(b);
+
+	// nor is their slab unmapped when it runs empty
+	for (int i : {3, 4, 6, 7}) a.free(bufs[std::size_t(i)]);
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), blocks_per_slab);
+
+	aux::slab_allocator::drop_pages(ranges);
+	a.end_trim(ranges);
+	// the blocks freed while trimming haven't been trimmed
+	TEST_EQUAL(a.num_untrimmed(), 4);
+
+	a.release_empty_slabs();
+	TEST_EQUAL(a.num_reserved(), 0);
+	TEST_EQUAL(a.num_untrimmed(), 0);
+}
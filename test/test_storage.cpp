@@ -1530,3 +1530,364 @@ TORRENT_TEST(dont_move_intermingled_files)
 	TEST_CHECK(!exists(combine_path(test_path, combine_path("temp_storage"
 		, combine_path("_folder3", "alien_folder1")))));
 }
+
+TORRENT_TEST(pad_files_not_on_disk)
+{
+	std::string const save_path = combine_path(current_working_directory(), "save_path_pad");
+	delete_dirs(save_path);
+
+	// the pad file straddles the piece boundary, so piece 1 starts in it
+	file_storage fs;
+	fs.add_file(combine_path("temp_storage", "a"), 0x3000);
+	fs.add_file(combine_path("temp_storage", combine_path(".pad", "8192"))
+		, 0x2000, file_storage::flag_pad_file);
+	fs.add_file(combine_path("temp_storage", "b"), 0x3000);
+	fs.set_piece_length(0x4000);
+	fs.set_num_pieces(2);
+	std::string const pad_path = combine_path(save_path
+		, combine_path("temp_storage", ".pad"));
+
+	aux::session_settings set;
+	file_pool fp;
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	std::unique_ptr<storage_interface> s(new default_storage(p, fp));
+	s->m_settings = &set;
+
+	storage_error se;
+	s->initialize(se);
+	TEST_CHECK(!se);
+	TEST_CHECK(!s->has_any_file(se));
+	TEST_CHECK(!se);
+
+	std::vector<char> piece(0x4000, 0);
+	std::fill(piece.begin(), piece.begin() + 0x3000, 'a');
+	iovec_t b = {piece.data(), piece.size()};
+	TEST_EQUAL(s->writev(b, piece_index_t(0), 0, open_mode::read_write, se), 0x4000);
+	TEST_CHECK(!se);
+	std::fill(piece.begin(), piece.end(), 0);
+	std::fill(piece.begin() + 0x1000, piece.end(), 'b');
+	TEST_EQUAL(s->writev(b, piece_index_t(1), 0, open_mode::read_write, se), 0x4000);
+	TEST_CHECK(!se);
+	TEST_CHECK(!exists(pad_path));
+	TEST_CHECK(s->has_any_file(se));
+
+	// reading the pad file yields zeroes
+	std::vector<char> out(0x4000, 'x');
+	b = {out.data(), out.size()};
+	TEST_EQUAL(s->readv(b, piece_index_t(1), 0, open_mode::read_only, se), 0x4000);
+	TEST_CHECK(!se);
+	TEST_CHECK(out == piece);
+
+	// the first file of piece 1 that exists on disk is checked, not the pad
+	// file it starts in
+	add_torrent_params atp;
+	atp.have_pieces.resize(2, true);
+	aux::vector<std::string, file_index_t> links;
+	TEST_CHECK(s->verify_resume_data(atp, links, se));
+	TEST_CHECK(!se);
+
+	s->release_files(se);
+	std::string const new_path = combine_path(current_working_directory(), "save_path_pad2");
+	delete_dirs(new_path);
+	s->move_storage(new_path, move_flags_t::always_replace_files, se);
+	TEST_CHECK(!se);
+	TEST_CHECK(exists(combine_path(new_path, combine_path("temp_storage", "b"))));
+	TEST_CHECK(!exists(combine_path(new_path, combine_path("temp_storage", ".pad"))));
+
+	s->delete_files(session::delete_files, se);
+	TEST_CHECK(!se);
+	TEST_CHECK(!exists(combine_path(new_path, combine_path("temp_storage", "b"))));
+}
+
+TORRENT_TEST(mmap_storage)
+{
+	std::string const save_path = combine_path(current_working_directory(), "save_path_mmap");
+	delete_dirs(combine_path(save_path, "temp_storage"));
+
+	aux::session_settings set;
+	file_storage fs;
+	std::vector<char> buf;
+	std::shared_ptr<torrent_info> info = setup_torrent_info(fs, buf);
+
+	file_pool fp;
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	std::unique_ptr<storage_interface> s(mmap_storage_constructor(p, fp));
+	s->m_settings = &set;
+
+	storage_error se;
+	s->initialize(se);
+	TEST_CHECK(!se);
+
+	// this range spans test1.tmp and test2.tmp
+	std::vector<char> piece = new_piece(4);
+	iovec_t b = {piece.data(), 4};
+	int ret = s->writev(b, piece_index_t(1), 2, open_mode::read_write, se);
+	TEST_EQUAL(ret, 4);
+	TEST_CHECK(!se);
+
+	std::vector<char> piece2 = new_piece(4);
+	b = {piece2.data(), 4};
+	ret = s->writev(b, piece_index_t(3), 0, open_mode::read_write, se);
+	TEST_EQUAL(ret, 4);
+
+	char out[4];
+	b = {out, 4};
+	ret = s->readv(b, piece_index_t(1), 2, open_mode::read_only, se);
+	TEST_EQUAL(ret, 4);
+	TEST_CHECK(std::equal(out, out + 4, piece.data()));
+
+	if (!s->has_read_views()) return;
+
+	// piece 3 is entirely within test2.tmp, so it can be served as a view
+	std::int32_t cookie = 0;
+	char const* view = s->read_view(piece_index_t(3), 0, 4, cookie, se);
+	TEST_CHECK(!se);
+	TEST_CHECK(view != nullptr);
+	TEST_CHECK(cookie < 0);
+	if (view) TEST_CHECK(std::equal(view, view + 4, piece2.data()));
+	if (view) s->release_view(cookie);
+
+	// a range spanning two files can't
+	view = s->read_view(piece_index_t(1), 2, 4, cookie, se);
+	TEST_CHECK(view == nullptr);
+
+	s->release_files(se);
+}
+
+namespace {
+void on_block_written(storage_error const& error, int* outstanding)
+{
+	TEST_CHECK(!error);
+	--*outstanding;
+}
+}
+
+TORRENT_TEST(coalesced_write)
+{
+	std::string const save_path = combine_path(current_working_directory(), "save_path_coalesce");
+	delete_dirs(combine_path(save_path, "temp_storage"));
+
+	// pieces of a single block, written in order. Each piece is held back
+	// until the next one arrives, and the whole file ends up being flushed
+	// by a single write
+	int const num_pieces = 8;
+	file_storage fs;
+	fs.set_piece_length(default_block_size);
+	fs.add_file(combine_path("temp_storage", "test1.tmp"), num_pieces * default_block_size);
+	fs.set_num_pieces(num_pieces);
+
+	boost::asio::io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	sett.set_int(settings_pack::max_coalesced_write_size, 1024 * 1024);
+	io.set_settings(&sett);
+
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<char> const data = new_piece(std::size_t(num_pieces * default_block_size));
+	int outstanding = num_pieces;
+	for (piece_index_t i(0); i < fs.end_piece(); ++i)
+	{
+		peer_request r;
+		r.piece = i;
+		r.start = 0;
+		r.length = default_block_size;
+		io.async_write(st, r, data.data() + static_cast<int>(i) * default_block_size
+			, std::shared_ptr<disk_observer>()
+			, std::bind(&on_block_written, _1, &outstanding));
+	}
+	io.submit_jobs();
+
+	while (outstanding > 0)
+	{
+		ios.reset();
+		ios.run_one();
+	}
+
+	TEST_EQUAL(cnt[counters::num_coalesced_pieces], num_pieces - 1);
+	TEST_EQUAL(cnt[counters::num_blocks_written], num_pieces);
+
+	std::vector<char> out(data.size());
+	std::ifstream f(combine_path(save_path, combine_path("temp_storage", "test1.tmp")).c_str()
+		, std::ios::binary);
+	f.read(out.data(), std::streamsize(out.size()));
+	TEST_CHECK(out == data);
+
+	io.abort(true);
+}
+
+TORRENT_TEST(coalesced_write_hold_expires)
+{
+	std::string const save_path = combine_path(current_working_directory(), "save_path_coalesce_hold");
+	delete_dirs(combine_path(save_path, "temp_storage"));
+
+	// piece 0 is complete, but held back because piece 1 is being
+	// downloaded. Piece 1 never completes, yet piece 0 must not be held on
+	// to (with its write handlers) for longer than a moment
+	file_storage fs;
+	fs.set_piece_length(2 * default_block_size);
+	fs.add_file(combine_path("temp_storage", "test1.tmp"), 4 * default_block_size);
+	fs.set_num_pieces(2);
+
+	boost::asio::io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	sett.set_int(settings_pack::max_coalesced_write_size, 1024 * 1024);
+	io.set_settings(&sett);
+
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<char> const data = new_piece(std::size_t(3 * default_block_size));
+	int outstanding = 2;
+	int piece1_outstanding = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		peer_request r;
+		r.piece = piece_index_t(i / 2);
+		r.start = (i % 2) * default_block_size;
+		r.length = default_block_size;
+		io.async_write(st, r, data.data() + i * default_block_size
+			, std::shared_ptr<disk_observer>()
+			, std::bind(&on_block_written, _1, i < 2 ? &outstanding : &piece1_outstanding));
+	}
+	io.submit_jobs();
+
+	time_point const start = clock_type::now();
+	while (outstanding > 0 && clock_type::now() - start < seconds(10))
+	{
+		ios.reset();
+		if (ios.poll_one() == 0)
+			std::this_thread::sleep_for(lt::milliseconds(10));
+	}
+	TEST_EQUAL(outstanding, 0);
+	TEST_EQUAL(piece1_outstanding, 1);
+
+	io.abort(true);
+}
+
+namespace {
+
+void on_check_hashed(piece_index_t const piece, sha1_hash const& h
+	, storage_error const& error, std::vector<sha1_hash>* hashes, int* outstanding)
+{
+	if (error) std::printf("hash failed: %s\n", error.ec.message().c_str());
+	TEST_CHECK(!error);
+	(*hashes)[std::size_t(static_cast<int>(piece))] = h;
+	--*outstanding;
+}
+
+}
+
+TORRENT_TEST(check_hash_pipeline)
+{
+	std::string const save_path = combine_path(current_working_directory(), "save_path_check");
+	delete_dirs(combine_path(save_path, "temp_storage"));
+
+	// hash jobs issued for checking have their pieces hashed by the check
+	// hashers, possibly completing out of order
+	int const num_pieces = 32;
+	int const piece_size = 4 * default_block_size;
+	file_storage fs;
+	fs.set_piece_length(piece_size);
+	fs.add_file(combine_path("temp_storage", "test1.tmp"), num_pieces * piece_size);
+	fs.set_num_pieces(num_pieces);
+
+	std::vector<char> const data = new_piece(std::size_t(num_pieces * piece_size));
+	{
+		error_code ec;
+		create_directories(combine_path(save_path, "temp_storage"), ec);
+		std::ofstream f(combine_path(save_path, combine_path("temp_storage", "test1.tmp")).c_str()
+			, std::ios::binary);
+		f.write(data.data(), std::streamsize(data.size()));
+	}
+
+	boost::asio::io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 4);
+	sett.set_int(settings_pack::checking_hash_threads, 4);
+	io.set_settings(&sett);
+
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<sha1_hash> hashes(static_cast<std::size_t>(num_pieces));
+	int outstanding = num_pieces;
+	for (piece_index_t i(0); i < fs.end_piece(); ++i)
+	{
+		io.async_hash(st, i
+			, disk_interface::sequential_access | disk_interface::volatile_read
+			, std::bind(&on_check_hashed, _1, _2, _3, &hashes, &outstanding));
+	}
+	io.submit_jobs();
+
+	while (outstanding > 0)
+	{
+		ios.reset();
+		ios.run_one();
+	}
+
+	for (int i = 0; i < num_pieces; ++i)
+	{
+		TEST_CHECK(hashes[std::size_t(i)] == hasher(data.data() + i * piece_size
+			, piece_size).final());
+	}
+	TEST_EQUAL(cnt[counters::num_blocks_hashed], num_pieces * 4);
+
+	io.abort(true);
+}
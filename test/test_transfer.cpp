@@ -125,6 +125,7 @@ using transfer_flags_t = lt::flags::bitfield_flag<std::uint8_t, struct transfer_
 constexpr transfer_flags_t disk_full = 1_bit;
 constexpr transfer_flags_t delete_files = 2_bit;
 constexpr transfer_flags_t move_storage = 3_bit;
+constexpr transfer_flags_t expect_prefetch = 4_bit;
 
 void test_transfer(int proxy_type, settings_pack const& sett
 	, transfer_flags_t flags = {}
@@ -367,6 +368,15 @@ void test_transfer(int proxy_type, settings_pack const& sett
 		TEST_CHECK(tor2.status().is_seeding);
 	}
 
+	// the seed must have read suggested pieces into its cache ahead of the
+	// downloader's requests
+	if (flags & expect_prefetch)
+	{
+		std::int64_t const prefetched = get_counters(ses1)["disk.num_prefetched_pieces"];
+		std::printf("prefetched pieces: %d\n", int(prefetched));
+		TEST_CHECK(prefetched > 0);
+	}
+
 	// this allows shutting down the sessions in parallel
 	p1 = ses1.abort();
 	p2 = ses2.abort();
@@ -510,6 +520,34 @@ TORRENT_TEST(no_coalesce_writes)
 	cleanup();
 }
 
+TORRENT_TEST(zero_copy_upload)
+{
+	using namespace lt;
+	settings_pack p;
+	p.set_bool(settings_pack::zero_copy_upload, true);
+	// make the blocks be read from disk, rather than the cache
+	p.set_bool(settings_pack::use_read_cache, false);
+	test_transfer(0, p);
+
+	cleanup();
+}
+
+TORRENT_TEST(prefetch_suggested_pieces)
+{
+	using namespace lt;
+	settings_pack p;
+	p.set_int(settings_pack::suggest_mode, settings_pack::suggest_read_cache);
+	p.set_int(settings_pack::prefetch_suggested_pieces, 4);
+	// a cache smaller than the torrent, for the suggested pieces to be
+	// evicted and read back in
+	p.set_int(settings_pack::cache_size, 16);
+	// make the transfer take a few seconds, for the pieces to be prefetched
+	p.set_int(settings_pack::upload_rate_limit, 100000);
+	test_transfer(0, p, expect_prefetch);
+
+	cleanup();
+}
+
 TORRENT_TEST(allocate)
 {
 	using namespace lt;
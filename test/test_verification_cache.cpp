@@ -0,0 +1,172 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/aux_/verification_cache.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "test.hpp"
+
+using namespace lt;
+
+namespace {
+
+// two files of two pieces each
+file_storage make_files()
+{
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	fs.add_file("verification_cache_test/0", 0x8000);
+	fs.add_file("verification_cache_test/1", 0x8000);
+	fs.set_num_pieces(int((fs.total_size() + fs.piece_length() - 1)
+		/ fs.piece_length()));
+	return fs;
+}
+
+void write_file(std::string const& path, int const size)
+{
+	std::vector<char> buf(std::size_t(size), 'a');
+	error_code ec;
+	file f;
+	TEST_CHECK(f.open(path, open_mode::write_only, ec));
+	TEST_CHECK(!ec);
+	f.set_size(size, ec);
+	TEST_CHECK(!ec);
+	f.writev(0, {buf}, ec);
+	TEST_CHECK(!ec);
+}
+
+std::string setup_dir(file_storage const& fs)
+{
+	error_code ec;
+	remove_all("verification_cache_test", ec);
+	create_directory("verification_cache_test", ec);
+	TEST_CHECK(!ec);
+	std::string const save_path = current_working_directory();
+	for (auto const i : fs.file_range())
+		write_file(fs.file_path(i, save_path), int(fs.file_size(i)));
+	return save_path;
+}
+
+sha1_hash piece_hash(piece_index_t const p)
+{
+	return hasher(std::to_string(static_cast<int>(p))).final();
+}
+
+}
+
+TORRENT_TEST(save_load)
+{
+	file_storage const fs = make_files();
+	std::string const save_path = setup_dir(fs);
+
+	{
+		aux::verification_cache c(save_path, ".hashes", ".parts");
+		c.enable(fs);
+		TEST_EQUAL(c.num_hashes(), 0);
+		for (piece_index_t p : fs.piece_range())
+			c.set(p, piece_hash(p), true);
+		c.clear(piece_index_t{1});
+		error_code ec;
+		c.save_all(fs, ec);
+		TEST_CHECK(!ec);
+	}
+
+	aux::verification_cache c(save_path, ".hashes", ".parts");
+	sha1_hash h;
+	TEST_CHECK(!c.get(piece_index_t{0}, h));
+	c.enable(fs);
+	TEST_EQUAL(c.num_hashes(), 3);
+	for (piece_index_t p : fs.piece_range())
+	{
+		TEST_EQUAL(c.get(p, h), p != piece_index_t{1});
+		if (p != piece_index_t{1}) TEST_EQUAL(h, piece_hash(p));
+	}
+
+	// disabling the cache removes the file
+	c.disable();
+	TEST_CHECK(!c.get(piece_index_t{0}, h));
+	TEST_CHECK(!exists(combine_path(save_path, ".hashes")));
+}
+
+TORRENT_TEST(changed_file)
+{
+	file_storage const fs = make_files();
+	std::string const save_path = setup_dir(fs);
+
+	{
+		aux::verification_cache c(save_path, ".hashes", ".parts");
+		c.enable(fs);
+		for (piece_index_t p : fs.piece_range())
+			c.set(p, piece_hash(p), true);
+		error_code ec;
+		c.save_all(fs, ec);
+		TEST_CHECK(!ec);
+	}
+
+	// the second file is truncated. Its pieces can't be trusted anymore
+	write_file(fs.file_path(file_index_t{1}, save_path), 0x2000);
+
+	aux::verification_cache c(save_path, ".hashes", ".parts");
+	c.enable(fs);
+	TEST_EQUAL(c.num_hashes(), 2);
+	sha1_hash h;
+	TEST_CHECK(c.get(piece_index_t{0}, h));
+	TEST_CHECK(c.get(piece_index_t{1}, h));
+	TEST_CHECK(!c.get(piece_index_t{2}, h));
+	TEST_CHECK(!c.get(piece_index_t{3}, h));
+}
+
+TORRENT_TEST(unflushed_hashes)
+{
+	file_storage const fs = make_files();
+	std::string const save_path = setup_dir(fs);
+
+	{
+		aux::verification_cache c(save_path, ".hashes", ".parts");
+		c.enable(fs);
+		// hashes of blocks that may not be on disk yet are not saved until
+		// save_all()
+		c.set(piece_index_t{0}, piece_hash(piece_index_t{0}), true);
+		c.set(piece_index_t{1}, piece_hash(piece_index_t{1}), false);
+		c.maybe_save(fs);
+	}
+
+	aux::verification_cache c(save_path, ".hashes", ".parts");
+	c.enable(fs);
+	TEST_EQUAL(c.num_hashes(), 1);
+	sha1_hash h;
+	TEST_CHECK(c.get(piece_index_t{0}, h));
+	TEST_CHECK(!c.get(piece_index_t{1}, h));
+}
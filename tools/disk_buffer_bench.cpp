@@ -0,0 +1,217 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// micro benchmark of the disk buffer pool. It measures the cost of
+// allocating and freeing disk buffers from a number of threads, compared to
+// allocating every buffer with page_malloc() (which is what the pool used to
+// do), and the resident memory of the process as the cache fills up, churns
+// and shrinks, compared to the cache size.
+
+#include "libtorrent/disk_buffer_pool.hpp"
+#include "libtorrent/allocator.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace lt;
+
+namespace {
+
+void nop() {}
+
+// the resident set size of this process, in MiB
+double rss_mib()
+{
+#ifdef __linux__
+	FILE* f = std::fopen("/proc/self/statm", "r");
+	if (f == nullptr) return -1.;
+	long pages = 0;
+	long resident = 0;
+	int const ret = std::fscanf(f, "%ld %ld", &pages, &resident);
+	std::fclose(f);
+	if (ret != 2) return -1.;
+	return double(resident) * double(::sysconf(_SC_PAGESIZE)) / 1024. / 1024.;
+#else
+	return -1.;
+#endif
+}
+
+double block_mib(int const blocks)
+{
+	return double(blocks) * default_block_size / 1024. / 1024.;
+}
+
+// each thread allocates and frees batches of buffers, like the disk threads
+// and peer connections do
+template <typename Alloc, typename Free>
+void run_allocations(char const* name, int const num_threads, int const rounds
+	, Alloc alloc, Free free_buf)
+{
+	int const batch = 32;
+	time_point const start = clock_type::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&]
+		{
+			std::vector<char*> bufs(batch);
+			for (int r = 0; r < rounds; ++r)
+			{
+				for (auto& b : bufs)
+				{
+					b = alloc();
+					// touch the buffer, as the disk cache would
+					if (b) *b = 0;
+				}
+				for (auto& b : bufs) if (b) free_buf(b);
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+	std::int64_t const ns = total_microseconds(clock_type::now() - start) * 1000;
+	std::int64_t const ops = std::int64_t(num_threads) * rounds * batch;
+	std::printf("%-12s threads: %2d  %7.1f ns per allocate + free\n"
+		, name, num_threads, double(ns) / double(ops));
+}
+
+void print_rss(char const* phase, disk_buffer_pool& pool)
+{
+	std::printf("%-24s in use: %7.1f MiB  reserved: %7.1f MiB  RSS: %7.1f MiB\n"
+		, phase, block_mib(pool.in_use()), block_mib(pool.num_reserved()), rss_mib());
+}
+
+void run_cache(int const cache_blocks, bool const huge_pages)
+{
+	io_service ios;
+	disk_buffer_pool pool(ios, &nop);
+	aux::session_settings sett;
+	sett.set_int(settings_pack::cache_size, cache_blocks);
+	sett.set_bool(settings_pack::disk_cache_huge_pages, huge_pages);
+	pool.set_settings(sett);
+
+	std::printf("\ncache_size: %.1f MiB%s\n", block_mib(cache_blocks)
+		, huge_pages ? " (huge pages)" : "");
+	print_rss("start", pool);
+
+	std::vector<char*> bufs;
+	for (int i = 0; i < cache_blocks; ++i)
+	{
+		char* b = pool.allocate_buffer("bench");
+		if (b == nullptr) break;
+		std::memset(b, i & 0xff, default_block_size);
+		bufs.push_back(b);
+	}
+	print_rss("full", pool);
+
+	// evict and refill random blocks, like the ARC cache does over time
+	std::mt19937 rng(0x1337);
+	for (int round = 0; round < 10; ++round)
+	{
+		std::shuffle(bufs.begin(), bufs.end(), rng);
+		std::size_t const evict = bufs.size() / 4;
+		pool.free_multiple_buffers(span<char*>(bufs).last(evict));
+		bufs.resize(bufs.size() - evict);
+		while (int(bufs.size()) < cache_blocks)
+		{
+			char* b = pool.allocate_buffer("bench");
+			if (b == nullptr) break;
+			std::memset(b, 0, default_block_size);
+			bufs.push_back(b);
+		}
+	}
+	print_rss("after churn", pool);
+
+	// shrink the cache to a quarter, evicting random blocks
+	sett.set_int(settings_pack::cache_size, cache_blocks / 4);
+	pool.set_settings(sett);
+	std::shuffle(bufs.begin(), bufs.end(), rng);
+	std::size_t const evict = bufs.size() - std::size_t(cache_blocks / 4);
+	pool.free_multiple_buffers(span<char*>(bufs).last(evict));
+	bufs.resize(bufs.size() - evict);
+	print_rss("shrunk to 1/4", pool);
+
+	pool.free_multiple_buffers(bufs);
+	bufs.clear();
+	pool.set_settings(sett);
+	print_rss("empty", pool);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	if (argc > 3)
+	{
+		std::fprintf(stderr, "usage: disk_buffer_bench [cache-size-MiB] [huge-pages]\n");
+		return 1;
+	}
+
+	int const cache_mib = argc > 1 ? std::atoi(argv[1]) : 512;
+	bool const huge_pages = argc > 2 && std::atoi(argv[2]) != 0;
+
+	{
+		io_service ios;
+		disk_buffer_pool pool(ios, &nop);
+		aux::session_settings sett;
+		sett.set_int(settings_pack::cache_size, 1024 * 1024);
+		sett.set_bool(settings_pack::disk_cache_huge_pages, huge_pages);
+		pool.set_settings(sett);
+
+		int const rounds = 20000;
+		for (int threads : {1, 2, 4, 8})
+		{
+			run_allocations("page_malloc", threads, rounds
+				, [] { return page_malloc(default_block_size); }
+				, [](char* b) { page_free(b); });
+			run_allocations("pool", threads, rounds
+				, [&] { return pool.allocate_buffer("bench"); }
+				, [&](char* b) { pool.free_buffer(b); });
+		}
+	}
+
+	run_cache(cache_mib * 1024 * 1024 / default_block_size, huge_pages);
+	return 0;
+}
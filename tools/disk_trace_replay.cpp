@@ -0,0 +1,645 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+// replays a disk trace recorded with the disk_trace_file setting against the
+// block cache, with a different cache configuration. Nothing is read from or
+// written to disk, it only reports the cache hit rate, the read amplification
+// (blocks read from disk per block requested) and the write coalescing
+// (blocks per write operation) the configuration would have achieved.
+
+#include "libtorrent/aux_/disk_trace.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/block_cache_reference.hpp"
+#include "libtorrent/aux_/path.hpp" // for bufs_size
+#include "libtorrent/aux_/alloca.hpp"
+#include "libtorrent/block_cache.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/settings_pack.hpp"
+
+#include <cinttypes> // for PRId64 et.al.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/variant/get.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+using namespace lt;
+
+namespace {
+
+// the results of replaying a disk trace against the block cache
+struct cache_replay_stats
+{
+	// the number of records replayed
+	std::int64_t records = 0;
+
+	// the number of blocks requested by read jobs, and the number of those
+	// that were in the cache
+	std::int64_t blocks_requested = 0;
+	std::int64_t blocks_hit = 0;
+
+	// the number of those blocks that were served from the cache when the
+	// trace was recorded
+	std::int64_t recorded_blocks_hit = 0;
+
+	// the number of blocks read from disk, including read-ahead, and the
+	// number of read operations
+	std::int64_t blocks_read = 0;
+	std::int64_t read_ops = 0;
+
+	// the number of blocks that had to be read back from disk to hash a
+	// piece, because they had been evicted
+	std::int64_t blocks_read_back = 0;
+
+	// the number of blocks written to disk, and the number of write
+	// operations. Contiguous dirty blocks are written in one operation
+	std::int64_t blocks_written = 0;
+	std::int64_t write_ops = 0;
+};
+
+// file_storage has to be constructed before storage_interface, which
+// holds a reference to it
+struct replay_files
+{
+	replay_files(int const piece_length, int const num_pieces
+		, int const last_piece_size)
+	{
+		files.add_file("trace", std::int64_t(piece_length)
+			* (num_pieces - 1) + last_piece_size);
+		files.set_piece_length(piece_length);
+		files.set_num_pieces(num_pieces);
+	}
+	file_storage files;
+};
+
+// a storage that doesn't store anything. The replay never touches the
+// disk, it only counts the operations it would have issued
+struct replay_storage : replay_files, storage_interface
+{
+	replay_storage(int const piece_length, int const num_pieces
+		, int const last_piece_size)
+		: replay_files(piece_length, num_pieces, last_piece_size)
+		, storage_interface(replay_files::files)
+	{}
+
+	void initialize(storage_error&) override {}
+	int readv(span<iovec_t const> bufs
+		, piece_index_t, int, open_mode_t, storage_error&) override
+	{ return int(bufs_size(bufs)); }
+	int writev(span<iovec_t const> bufs
+		, piece_index_t, int, open_mode_t, storage_error&) override
+	{ return int(bufs_size(bufs)); }
+	bool has_any_file(storage_error&) override { return false; }
+	void set_file_priority(aux::vector<download_priority_t, file_index_t>&
+		, storage_error&) override {}
+	status_t move_storage(std::string const&, move_flags_t
+		, storage_error&) override { return status_t::no_error; }
+	bool verify_resume_data(add_torrent_params const&
+		, aux::vector<std::string, file_index_t> const&
+		, storage_error&) override { return true; }
+	void release_files(storage_error&) override {}
+	void rename_file(file_index_t, std::string const&
+		, storage_error&) override {}
+	void delete_files(remove_flags_t, storage_error&) override {}
+};
+
+struct cache_replay final : buffer_allocator_interface
+{
+	explicit cache_replay(aux::session_settings const& sett)
+		: m_cache(m_ios, [] {})
+		, m_settings(sett)
+	{
+		m_cache.set_settings(m_settings);
+	}
+
+	~cache_replay()
+	{
+		tailqueue<disk_io_job> jobs;
+		m_cache.clear(jobs);
+		delete_jobs(jobs.get_all());
+	}
+
+	void free_disk_buffer(char* b) override { m_cache.free_buffer(b); }
+
+	void reclaim_blocks(span<aux::block_cache_reference> refs) override
+	{
+		for (auto const& ref : refs)
+		{
+			storage_interface* st = m_storages[static_cast<std::uint32_t>(ref.storage)].get();
+			m_cache.reclaim_block(st, ref);
+			st->dec_refcount();
+		}
+	}
+
+	void replay(aux::disk_trace_record const& r)
+	{
+		++m_stats.records;
+
+		if (r.action == aux::disk_trace_record::storage_record)
+		{
+			add_storage(r);
+			return;
+		}
+
+		auto const it = m_storages.find(r.storage);
+		if (it == m_storages.end()) return;
+		std::shared_ptr<storage_interface> const& st = it->second;
+		if (r.piece < 0 || r.piece >= st->files().num_pieces()) return;
+		piece_index_t const piece(r.piece);
+
+		expire_write_blocks(r.time);
+
+		switch (static_cast<job_action_t>(r.action))
+		{
+			case job_action_t::read: read(st, piece, r); break;
+			case job_action_t::write: write(st, piece, r); break;
+			case job_action_t::hash: hash(st.get(), piece); break;
+			case job_action_t::flush_piece:
+			{
+				cached_piece_entry* pe = m_cache.find_piece(st.get(), piece);
+				if (pe != nullptr) flush(pe);
+				break;
+			}
+			case job_action_t::release_files:
+				flush_storage(st.get(), false);
+				break;
+			case job_action_t::stop_torrent:
+				flush_storage(st.get(), true);
+				break;
+			case job_action_t::delete_files:
+				delete_storage(st.get());
+				break;
+			case job_action_t::clear_piece:
+			{
+				cached_piece_entry* pe = m_cache.find_piece(st.get(), piece);
+				if (pe == nullptr) break;
+				tailqueue<disk_io_job> jobs;
+				m_cache.evict_piece(pe, jobs, block_cache::allow_ghost);
+				delete_jobs(jobs.get_all());
+				break;
+			}
+			default: break;
+		}
+	}
+
+	cache_replay_stats const& stats() const { return m_stats; }
+
+private:
+
+	void add_storage(aux::disk_trace_record const& r)
+	{
+		if (r.piece <= 0 || r.offset <= 0 || r.size == 0
+			|| r.size > std::uint32_t(r.piece)) return;
+
+		// the index may have been reused by a new torrent
+		auto const it = m_storages.find(r.storage);
+		if (it != m_storages.end()) delete_storage(it->second.get());
+
+		auto st = std::make_shared<replay_storage>(r.piece, r.offset, int(r.size));
+		st->set_storage_index(storage_index_t(r.storage));
+		st->m_settings = &m_settings;
+		m_storages[r.storage] = std::move(st);
+	}
+
+	static int blocks_spanned(aux::disk_trace_record const& r)
+	{
+		return int(((std::uint32_t(r.offset) & (default_block_size - 1))
+			+ r.size + default_block_size - 1) / default_block_size);
+	}
+
+	void init_job(disk_io_job& j, std::shared_ptr<storage_interface> const& st
+		, piece_index_t const piece, aux::disk_trace_record const& r, job_action_t const a)
+	{
+#if TORRENT_USE_ASSERTS
+		j.in_use = true;
+#endif
+		j.action = a;
+		j.storage = st;
+		j.piece = piece;
+		j.d.io.offset = r.offset;
+		j.d.io.buffer_size = std::uint16_t(std::min(r.size, std::uint32_t(default_block_size)));
+		j.flags = disk_io_job::in_progress;
+	}
+
+	// mirrors disk_io_thread::prep_read_job_impl() and do_read()
+	void read(std::shared_ptr<storage_interface> const& st
+		, piece_index_t const piece, aux::disk_trace_record const& r)
+	{
+		int const requested = blocks_spanned(r);
+		m_stats.blocks_requested += requested;
+		if (r.flags & aux::disk_trace_record::cache_hit)
+			m_stats.recorded_blocks_hit += requested;
+
+		disk_io_job j;
+		init_job(j, st, piece, r, job_action_t::read);
+		if (r.flags & aux::disk_trace_record::prefetch)
+			j.flags |= disk_interface::prefetch;
+		j.argument = disk_buffer_holder(*this, nullptr, 0);
+
+		if (m_cache.try_read(&j, *this) >= 0)
+		{
+			m_stats.blocks_hit += requested;
+			return;
+		}
+
+		if ((!m_settings.get_bool(settings_pack::use_read_cache)
+			|| m_settings.get_int(settings_pack::cache_size) == 0)
+			&& m_cache.find_piece(&j) == nullptr)
+		{
+			m_stats.blocks_read += requested;
+			++m_stats.read_ops;
+			return;
+		}
+
+		cached_piece_entry* pe = m_cache.allocate_piece(&j, cached_piece_entry::read_lru1);
+		if (pe == nullptr)
+		{
+			m_stats.blocks_read += requested;
+			++m_stats.read_ops;
+			return;
+		}
+
+		int const piece_size = st->files().piece_size(piece);
+		int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
+		int const read_ahead = (j.flags & disk_interface::prefetch)
+			? blocks_in_piece
+			: m_settings.get_int(settings_pack::read_cache_line_size);
+		int const iov_len = m_cache.pad_job(&j, blocks_in_piece, read_ahead);
+
+		// keep the piece from being evicted while we make room for it
+		pe->outstanding_read = 1;
+		int const evict = m_cache.num_to_evict(iov_len);
+		if (evict > 0) m_cache.try_evict_blocks(evict);
+
+		TORRENT_ALLOCA(iov, iovec_t, iov_len);
+		if (m_cache.allocate_iovec(iov) < 0)
+		{
+			pe->outstanding_read = 0;
+			m_stats.blocks_read += requested;
+			++m_stats.read_ops;
+			return;
+		}
+
+		int const adjusted_offset = r.offset & ~(default_block_size - 1);
+		iov[iov_len - 1] = iov[iov_len - 1].first(std::size_t(std::min(piece_size
+			- adjusted_offset - (iov_len - 1) * default_block_size
+			, default_block_size)));
+
+		m_stats.blocks_read += iov_len;
+		++m_stats.read_ops;
+
+		m_cache.insert_blocks(pe, r.offset / default_block_size, iov, &j);
+		pe->outstanding_read = 0;
+	}
+
+	// mirrors disk_io_thread::do_write(). A piece is flushed once it has
+	// write_cache_line_size contiguous dirty blocks
+	void write(std::shared_ptr<storage_interface> const& st
+		, piece_index_t const piece, aux::disk_trace_record const& r)
+	{
+		if (r.offset % default_block_size != 0) return;
+
+		char* buf = m_cache.allocate_buffer("receive buffer");
+		if (buf == nullptr)
+		{
+			++m_stats.blocks_written;
+			++m_stats.write_ops;
+			return;
+		}
+
+		disk_io_job* j = new disk_io_job;
+		init_job(*j, st, piece, r, job_action_t::write);
+		j->argument = disk_buffer_holder(*this, buf, default_block_size);
+
+		cached_piece_entry* pe = m_cache.add_dirty_block(j);
+		if (pe == nullptr)
+		{
+			delete j;
+			++m_stats.blocks_written;
+			++m_stats.write_ops;
+			return;
+		}
+
+		m_dirty_since.emplace(std::make_pair(r.storage, piece), r.time);
+
+		int const block = r.offset / default_block_size;
+		int start = block;
+		while (start > 0 && pe->blocks[start - 1].dirty) --start;
+		int end = block + 1;
+		while (end < int(pe->blocks_in_piece) && pe->blocks[end].dirty) ++end;
+		if (end - start >= m_settings.get_int(settings_pack::write_cache_line_size))
+			flush(pe);
+
+		relieve_pressure();
+	}
+
+	// blocks that aren't in the cache when a piece is hashed have to be
+	// read back from disk
+	void hash(storage_interface* st, piece_index_t const piece)
+	{
+		int const piece_size = st->files().piece_size(piece);
+		int const blocks_in_piece = (piece_size + default_block_size - 1) / default_block_size;
+
+		cached_piece_entry* pe = m_cache.find_piece(st, piece);
+		if (pe == nullptr)
+		{
+			m_stats.blocks_read_back += blocks_in_piece;
+			return;
+		}
+
+		for (int i = 0; i < blocks_in_piece; ++i)
+			if (pe->blocks[i].buf == nullptr) ++m_stats.blocks_read_back;
+
+		// once a piece has been hashed, its dirty blocks are flushed
+		flush(pe);
+	}
+
+	// write all dirty blocks of pe. Contiguous blocks are written in a
+	// single operation
+	void flush(cached_piece_entry* pe)
+	{
+		std::vector<int> flushing;
+		for (int i = 0; i < int(pe->blocks_in_piece); ++i)
+		{
+			cached_block_entry& b = pe->blocks[i];
+			if (b.buf == nullptr || !b.dirty || b.pending) continue;
+			m_cache.inc_block_refcount(pe, i, block_cache::ref_flushing);
+			b.pending = true;
+			flushing.push_back(i);
+		}
+		if (flushing.empty()) return;
+
+		m_stats.blocks_written += std::int64_t(flushing.size());
+		for (std::size_t i = 0; i < flushing.size(); ++i)
+		{
+			if (i == 0 || flushing[i] != flushing[i - 1] + 1)
+				++m_stats.write_ops;
+		}
+
+		m_dirty_since.erase(std::make_pair(
+			std::uint32_t(static_cast<int>(pe->storage->storage_index()))
+			, pe->piece));
+
+		++pe->piece_refcount;
+		m_cache.blocks_flushed(pe, flushing.data(), int(flushing.size()));
+
+		disk_io_job* j = pe->jobs.get_all();
+		while (j != nullptr)
+		{
+			disk_io_job* next = j->next;
+			j->next = nullptr;
+			if (j->completed(pe)) delete j;
+			else pe->jobs.push_back(j);
+			j = next;
+		}
+		--pe->piece_refcount;
+		m_cache.maybe_free_piece(pe);
+	}
+
+	// mirrors disk_io_thread::check_cache_level(). When evicting read
+	// blocks isn't enough, dirty pieces are flushed in LRU order
+	void relieve_pressure()
+	{
+		int evict = m_cache.num_to_evict(0);
+		if (evict == 0) return;
+		evict = m_cache.try_evict_blocks(evict);
+		if (evict == 0) return;
+
+		std::vector<std::pair<storage_interface*, piece_index_t>> pieces;
+		for (auto p = m_cache.write_lru_pieces(); p.get(); p.next())
+		{
+			if (p.get()->num_dirty == 0) continue;
+			pieces.emplace_back(p.get()->storage.get(), p.get()->piece);
+		}
+
+		for (auto const& p : pieces)
+		{
+			if (evict <= 0) break;
+			cached_piece_entry* pe = m_cache.find_piece(p.first, p.second);
+			if (pe == nullptr) continue;
+			evict -= int(pe->num_dirty);
+			flush(pe);
+		}
+		evict = m_cache.num_to_evict(0);
+		if (evict > 0) m_cache.try_evict_blocks(evict);
+	}
+
+	// mirrors disk_io_thread::flush_expired_write_blocks(), using the
+	// timestamps of the trace
+	void expire_write_blocks(std::uint64_t const now)
+	{
+		std::uint64_t const expiry = std::uint64_t(std::max(0
+			, m_settings.get_int(settings_pack::cache_expiry))) * 1000000;
+		if (expiry == 0 || now < m_next_expiry_check) return;
+		m_next_expiry_check = now + 1000000;
+
+		std::vector<std::pair<std::uint32_t, piece_index_t>> expired;
+		for (auto const& e : m_dirty_since)
+			if (e.second + expiry <= now) expired.push_back(e.first);
+
+		for (auto const& p : expired)
+		{
+			m_dirty_since.erase(p);
+			auto const it = m_storages.find(p.first);
+			if (it == m_storages.end()) continue;
+			cached_piece_entry* pe = m_cache.find_piece(it->second.get(), p.second);
+			if (pe != nullptr) flush(pe);
+		}
+	}
+
+	std::vector<piece_index_t> cached_pieces(storage_interface* st) const
+	{
+		std::vector<piece_index_t> ret;
+		for (auto const& pe : st->cached_pieces())
+			ret.push_back(pe.piece);
+		return ret;
+	}
+
+	void flush_storage(storage_interface* st, bool const evict)
+	{
+		for (piece_index_t const p : cached_pieces(st))
+		{
+			cached_piece_entry* pe = m_cache.find_piece(st, p);
+			if (pe == nullptr) continue;
+			flush(pe);
+			if (!evict) continue;
+			pe = m_cache.find_piece(st, p);
+			if (pe == nullptr || !pe->jobs.empty()) continue;
+			m_cache.mark_for_eviction(pe, block_cache::disallow_ghost);
+		}
+	}
+
+	void delete_storage(storage_interface* st)
+	{
+		std::uint32_t const idx = std::uint32_t(static_cast<int>(st->storage_index()));
+		for (piece_index_t const p : cached_pieces(st))
+		{
+			cached_piece_entry* pe = m_cache.find_piece(st, p);
+			if (pe == nullptr) continue;
+			m_dirty_since.erase(std::make_pair(idx, p));
+			m_cache.abort_dirty(pe);
+			delete_jobs(pe->jobs.get_all());
+			m_cache.mark_for_eviction(pe, block_cache::disallow_ghost);
+		}
+	}
+
+	static void delete_jobs(disk_io_job* j)
+	{
+		while (j != nullptr)
+		{
+			disk_io_job* next = j->next;
+			delete j;
+			j = next;
+		}
+	}
+
+	io_service m_ios;
+	block_cache m_cache;
+	aux::session_settings m_settings;
+	std::map<std::uint32_t, std::shared_ptr<storage_interface>> m_storages;
+
+	// the trace time when pieces in the write cache got their first
+	// dirty block
+	std::map<std::pair<std::uint32_t, piece_index_t>, std::uint64_t> m_dirty_since;
+	std::uint64_t m_next_expiry_check = 0;
+
+	cache_replay_stats m_stats;
+};
+
+// replays the jobs in ``trace`` against a block_cache configured with
+// ``sett`` (cache_size, read_cache_line_size, write_cache_line_size,
+// cache_expiry, use_read_cache and friends). No disk I/O is performed,
+// it only counts the blocks that would have been read and written
+cache_replay_stats replay_disk_trace(aux::disk_trace_reader& trace
+	, aux::session_settings const& sett)
+{
+	cache_replay r(sett);
+	aux::disk_trace_record rec;
+	while (trace.next(rec)) r.replay(rec);
+	return r.stats();
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: disk_trace_replay trace-file [--setting=value ...]\n\n"
+		"replays the disk trace against the block cache, using the default\n"
+		"settings, overridden by the specified ones. For example:\n\n"
+		"  disk_trace_replay disk.trace --cache_size=4096 --read_cache_line_size=16\n");
+}
+
+bool apply_setting(aux::session_settings& sett, char const* arg)
+{
+	if (std::strncmp(arg, "--", 2) != 0) return false;
+	char const* eq = std::strchr(arg, '=');
+	if (eq == nullptr) return false;
+
+	std::string const name(arg + 2, eq);
+	char const* value = eq + 1;
+	int const s = setting_by_name(name);
+	if (s < 0) return false;
+
+	switch (s & settings_pack::type_mask)
+	{
+		case settings_pack::string_type_base: sett.set_str(s, value); break;
+		case settings_pack::int_type_base: sett.set_int(s, std::atoi(value)); break;
+		case settings_pack::bool_type_base:
+			sett.set_bool(s, std::strcmp(value, "1") == 0
+				|| std::strcmp(value, "true") == 0);
+			break;
+		default: return false;
+	}
+	return true;
+}
+
+double ratio(std::int64_t const num, std::int64_t const den)
+{
+	return den == 0 ? 0. : double(num) / double(den);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	aux::session_settings sett;
+	for (int i = 2; i < argc; ++i)
+	{
+		if (!apply_setting(sett, argv[i]))
+		{
+			std::fprintf(stderr, "invalid setting: %s\n", argv[i]);
+			print_usage();
+			return 1;
+		}
+	}
+
+	aux::disk_trace_reader trace(argv[1]);
+	if (!trace.is_open())
+	{
+		std::fprintf(stderr, "failed to open disk trace: %s\n", argv[1]);
+		return 1;
+	}
+
+	cache_replay_stats const s = replay_disk_trace(trace, sett);
+
+	std::printf("records:             %10" PRId64 "\n", s.records);
+	std::printf("blocks requested:    %10" PRId64 "\n", s.blocks_requested);
+	std::printf("recorded hit rate:   %9.2f%%\n"
+		, ratio(s.recorded_blocks_hit, s.blocks_requested) * 100.);
+	std::printf("replayed hit rate:   %9.2f%%\n"
+		, ratio(s.blocks_hit, s.blocks_requested) * 100.);
+	std::printf("blocks read:         %10" PRId64 " (%" PRId64 " read operations)\n"
+		, s.blocks_read, s.read_ops);
+	std::printf("blocks read back:    %10" PRId64 "\n", s.blocks_read_back);
+	std::printf("read amplification:  %10.2f\n"
+		, ratio(s.blocks_read + s.blocks_read_back, s.blocks_requested));
+	std::printf("blocks written:      %10" PRId64 " (%" PRId64 " write operations)\n"
+		, s.blocks_written, s.write_ops);
+	std::printf("write coalescing:    %10.2f blocks per write\n"
+		, ratio(s.blocks_written, s.write_ops));
+	return 0;
+}
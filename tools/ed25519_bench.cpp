@@ -0,0 +1,126 @@
+/*
+
+Copyright (c) 2016, Alden Torres
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// benchmark of ed25519 signature verification, one signature at a time with
+// ed25519_verify() and in batches with ed25519_verify_batch(), the way the
+// DHT verifies mutable puts
+
+#include "libtorrent/kademlia/ed25519.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/time.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace lt;
+using namespace lt::dht;
+
+#ifdef TORRENT_DISABLE_DHT
+
+int main()
+{
+	std::fprintf(stderr, "not built with DHT support\n");
+	return 1;
+}
+
+#else
+
+int main(int argc, char* argv[])
+{
+	if (argc > 3)
+	{
+		std::fprintf(stderr, "usage: ed25519_bench [batch-size] [rounds]\n");
+		return 1;
+	}
+
+	int const num = argc > 1 ? std::atoi(argv[1]) : 64;
+	int const rounds = argc > 2 ? std::atoi(argv[2]) : 10;
+	if (num <= 0 || rounds <= 0)
+	{
+		std::fprintf(stderr, "invalid batch size or number of rounds\n");
+		return 1;
+	}
+
+	std::vector<public_key> pks;
+	std::vector<signature> sigs;
+	std::vector<std::string> msgs;
+	for (int i = 0; i < num; ++i)
+	{
+		public_key pk;
+		secret_key sk;
+		std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+		std::string msg = "message number " + std::to_string(i);
+		msg.resize(std::size_t(50 + i % 300), 'x');
+		pks.push_back(pk);
+		sigs.push_back(ed25519_sign(msg, pk, sk));
+		msgs.push_back(std::move(msg));
+	}
+	std::vector<span<char const>> const spans(msgs.begin(), msgs.end());
+
+	int failed = 0;
+	time_point start = clock_type::now();
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (int i = 0; i < num; ++i)
+		{
+			if (!ed25519_verify(sigs[std::size_t(i)], spans[std::size_t(i)]
+				, pks[std::size_t(i)]))
+				++failed;
+		}
+	}
+	double const single = double(total_microseconds(clock_type::now() - start))
+		/ (num * rounds);
+
+	std::vector<bool> valid;
+	start = clock_type::now();
+	for (int r = 0; r < rounds; ++r)
+	{
+		if (!ed25519_verify_batch(sigs, spans, pks, valid))
+			++failed;
+	}
+	double const batch = double(total_microseconds(clock_type::now() - start))
+		/ (num * rounds);
+
+	std::printf("ed25519_verify: %.1f us/signature, ed25519_verify_batch (%d): "
+		"%.1f us/signature\n", single, num, batch);
+
+	if (failed > 0)
+	{
+		std::fprintf(stderr, "%d verifications failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
+
+#endif // TORRENT_DISABLE_DHT
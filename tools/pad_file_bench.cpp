@@ -0,0 +1,156 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+// benchmark of default_storage on a torrent with many pad files, like the
+// ones created for hybrid and piece-aligned torrents. Every file is padded to
+// the next piece boundary. It measures the time spent initializing, writing,
+// reading, verifying resume data for, moving and deleting the storage. Pad
+// files are never stored on disk, so these are expected to scale with the
+// number of real files, not the pad files.
+
+#include "libtorrent/storage.hpp"
+#include "libtorrent/file_pool.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/session.hpp" // for session::delete_files
+#include "libtorrent/time.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+int const piece_size = 0x4000;
+
+// the real files are small, to keep the amount of data written down. The
+// rest of each piece is a pad file
+int const real_file_size = 0x400;
+
+void run(char const* name, int const num_pad_files, std::function<void(storage_error&)> f)
+{
+	storage_error se;
+	time_point const start = clock_type::now();
+	f(se);
+	std::int64_t const us = total_microseconds(clock_type::now() - start);
+	std::printf("%-20s %9.1f ms  %7.3f us per pad file%s%s\n", name, double(us) / 1000.
+		, double(us) / num_pad_files, se ? "  error: " : ""
+		, se ? se.ec.message().c_str() : "");
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	if (argc > 3)
+	{
+		std::fprintf(stderr, "usage: pad_file_bench [num-pad-files] [save-path]\n");
+		return 1;
+	}
+
+	int const num_files = argc > 1 ? std::atoi(argv[1]) : 100000;
+	std::string const save_path = complete(argc > 2 ? argv[2] : "pad_file_bench");
+	std::string const moved_path = save_path + "_moved";
+	if (num_files <= 0)
+	{
+		std::fprintf(stderr, "invalid number of pad files: %d\n", num_files);
+		return 1;
+	}
+
+	file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+	{
+		char name[50];
+		std::snprintf(name, sizeof(name), "%d", i);
+		fs.add_file(combine_path("bench", combine_path(name, "file")), real_file_size);
+		fs.add_file(combine_path("bench", combine_path(".pad", std::to_string(piece_size - real_file_size)))
+			, piece_size - real_file_size, file_storage::flag_pad_file);
+	}
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(num_files);
+
+	std::printf("%d files, %d pad files, %d pieces\n", fs.num_files() - num_files
+		, num_files, fs.num_pieces());
+
+	aux::session_settings sett;
+	file_pool fp;
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{
+		fs,
+		nullptr,
+		save_path,
+		storage_mode_sparse,
+		priorities,
+		info_hash
+	};
+	std::unique_ptr<storage_interface> s(new default_storage(p, fp));
+	s->m_settings = &sett;
+
+	std::vector<char> piece(piece_size, 0);
+	std::fill(piece.begin(), piece.begin() + real_file_size, 'x');
+	iovec_t const buf = {piece.data(), piece.size()};
+
+	run("initialize", num_files, [&](storage_error& se) { s->initialize(se); });
+	run("has_any_file", num_files, [&](storage_error& se) { s->has_any_file(se); });
+	run("write", num_files, [&](storage_error& se)
+	{
+		for (piece_index_t i(0); i < fs.end_piece() && !se; ++i)
+			s->writev(buf, i, 0, open_mode::read_write, se);
+	});
+	run("read", num_files, [&](storage_error& se)
+	{
+		for (piece_index_t i(0); i < fs.end_piece() && !se; ++i)
+			s->readv(buf, i, 0, open_mode::read_only, se);
+	});
+	run("release_files", num_files, [&](storage_error& se) { s->release_files(se); });
+	run("verify_resume_data", num_files, [&](storage_error& se)
+	{
+		add_torrent_params atp;
+		atp.have_pieces.resize(fs.num_pieces(), true);
+		aux::vector<std::string, file_index_t> links;
+		s->verify_resume_data(atp, links, se);
+	});
+	run("move_storage", num_files, [&](storage_error& se)
+	{ s->move_storage(moved_path, move_flags_t::always_replace_files, se); });
+	run("delete_files", num_files, [&](storage_error& se)
+	{ s->delete_files(session::delete_files, se); });
+	return 0;
+}